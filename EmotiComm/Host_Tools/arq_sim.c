@@ -0,0 +1,269 @@
+/*
+Host simulation of the sliding-window ARQ over a lossy half-duplex link (see arq.h)
+
+The sender queues a frame every PERIOD_US and runs arq_tx_burst() the way the sender's main loop does, the
+receiver answers each poll after a random turnaround (now and then a long one, as when it is busy with the
+LCD). Frames from the sender are lost at a fixed rate, acks at the rate being tested, and anything that
+overlaps on the bus because one side talked too early is lost as well. Each ack loss rate is run twice:
+with the adaptive timeout, and with the timeout pinned to the old fixed ARQ_TIMEOUT_US and no retry limit.
+
+Then the window is swept from 1 to ARQ_MAX_WINDOW frames with the same frame loss and SWEEP_ACK_LOSS of
+the acks lost. The sender queues a sample whenever the window has room, so the link runs flat out, and
+no frame is ever given up on. For each size it prints the samples per second delivered, the resends and
+the timeouts. Stop-and-wait is the 1 frame window.
+
+Every frame carries a running number, the receiver checks they come out in order with no repeats, and at
+the end every frame must have been delivered or counted as given up on. In the sweep nothing may be
+given up on at all. The program exits with 1 if any frame is lost or delivered twice without being
+counted.
+
+    cc -O2 -I../Send_Accel_Data/src -o arq_sim arq_sim.c ../Send_Accel_Data/src/arq.c ../Send_Accel_Data/src/packet.c
+    ./arq_sim [frame loss percent] [window for the ack loss table]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "host_tools.h"
+#include "packet.h"
+#include "arq.h"
+
+#define US_PER_BYTE   87                //115200 baud, 10 bits per byte
+#define WINDOW        4                 //default for the ack loss table
+#define SWEEP_ACK_LOSS 50               //per mille of acks lost in the window sweep
+#define PERIOD_US     5000              //a frame is queued this often
+#define FIXED_US      50000             //the timeout the sender used before it was adaptive
+#define RUN_US        30000000
+#define DRAIN_US      5000000           //time after the last frame is queued for the window to empty
+#define STEP_US       10
+#define WIRE_FRAMES   16
+
+typedef struct {
+    uint8_t data[PKT_MAX_WIRE];
+    int len;
+    uint32_t start, end;
+    int lost;
+} wire_frame;
+
+typedef struct {
+    wire_frame f[WIRE_FRAMES];
+    int n;
+} wire;
+
+static wire to_rx, to_tx;
+static uint32_t sender_free;            //sender's transmitter is busy until then
+static uint32_t now;
+static int frame_loss, ack_loss;        //per mille
+
+static void collide(wire *w, uint32_t start, uint32_t end, int *lost)
+{
+    //both sides talking at once garbles both frames
+    for (int i = 0; i < w->n; i++)
+    {
+        if (w->f[i].start < end && start < w->f[i].end)
+        {
+            w->f[i].lost = 1;
+            *lost = 1;
+        }
+    }
+}
+
+static void put(wire *w, wire *other, const uint8_t *data, int len, uint32_t start, int loss)
+{
+    wire_frame *f;
+    if (w->n == WIRE_FRAMES)
+    {
+        return;
+    }
+    f = &w->f[w->n++];
+    memcpy(f->data, data, len);
+    f->len = len;
+    f->start = start;
+    f->end = start + len * US_PER_BYTE;
+    f->lost = (int)(rand_next() % 1000) < loss;
+    collide(other, f->start, f->end, &f->lost);
+}
+
+static int take(wire *w, packet *pkt, uint32_t *end)
+{
+    //removes the first frame that has finished arriving, returns 0 if it decodes
+    for (int i = 0; i < w->n; i++)
+    {
+        if ((int32_t)(now - w->f[i].end) >= 0)
+        {
+            wire_frame f = w->f[i];
+            memmove(&w->f[i], &w->f[i + 1], (w->n - i - 1) * sizeof(wire_frame));
+            w->n--;
+            *end = f.end;
+            return !f.lost && packet_decode(f.data + 1, f.len - 2, pkt) == 0 ? 0 : -1;     //between the brackets
+        }
+    }
+    return -2;
+}
+
+static int emit(void *ctx, const uint8_t *frame, uint16_t len)
+{
+    (void)ctx;
+    uint32_t start = (int32_t)(sender_free - now) > 0 ? sender_free : now;
+    put(&to_rx, &to_tx, frame, len, start, frame_loss);
+    sender_free = start + len * US_PER_BYTE;
+    return 0;
+}
+
+typedef struct {
+    uint32_t queued, delivered, undelivered, errors;
+} result;
+
+static result run(arq_tx *a, int flat_out)
+{
+    //flat_out: queue a sample whenever the window has room rather than every PERIOD_US
+    arq_rx r;
+    result res = { 0, 0, 0, 0 };
+    uint32_t expect = 0, next_queue = 0;
+    uint32_t ack_at = 0;
+    int ack_due = 0;
+    packet pkt;
+    uint32_t end;
+    int got;
+
+    arq_rx_init(&r, 0);
+    to_rx.n = to_tx.n = 0;
+    sender_free = 0;
+    rand_seed(1);
+    for (now = 0; now < RUN_US + DRAIN_US; now += STEP_US)
+    {
+        //receiver
+        while ((got = take(&to_rx, &pkt, &end)) != -2)
+        {
+            if (got == 0 && arq_rx_accept(&r, &pkt))
+            {
+                uint32_t turnaround = 200 + rand_next() % 2000 + (rand_next() % 50 == 0 ? 20000 : 0);
+                ack_at = end + turnaround;
+                ack_due = 1;
+            }
+        }
+        while (arq_rx_pop(&r, &pkt) == 0)
+        {
+            uint32_t id;
+            memcpy(&id, pkt.payload, 4);
+            if (id < expect)
+            {
+                res.errors++;           //repeated or out of order
+            }
+            else
+            {
+                res.undelivered += id - expect;
+                expect = id + 1;
+            }
+            res.delivered++;
+        }
+        if (ack_due && (int32_t)(now - ack_at) >= 0)
+        {
+            uint8_t frame[PKT_MAX_WIRE];
+            int len = arq_rx_ack(&r, PKT_ADDR_FIRST, 0, frame, sizeof(frame));
+            put(&to_tx, &to_rx, frame, len, now, ack_loss);
+            ack_due = 0;
+        }
+
+        //sender
+        while ((got = take(&to_tx, &pkt, &end)) != -2)
+        {
+            if (got == 0)
+            {
+                arq_tx_ack(a, &pkt, end);
+            }
+        }
+        if (flat_out)
+        {
+            while (now < RUN_US && arq_tx_space(a) > 0)
+            {
+                uint8_t payload[4 + PKT_ACCEL_PAYLOAD];
+                memcpy(payload, &res.queued, 4);
+                packet_put_accel(payload + 4, res.queued, -res.queued, 16384);
+                arq_tx_queue(a, PKT_TYPE_ACCEL, payload, sizeof(payload));
+                res.queued++;
+            }
+        }
+        else if (now < RUN_US && (int32_t)(now - next_queue) >= 0)
+        {
+            if (arq_tx_space(a) > 0)
+            {
+                arq_tx_queue(a, PKT_TYPE_ACCEL, (const uint8_t *)&res.queued, 4);
+                res.queued++;
+            }
+            next_queue += PERIOD_US;    //a sample that finds the window full is not taken, as on the board
+        }
+        arq_tx_burst(a, now, emit, 0);
+    }
+    res.undelivered += res.queued - expect;
+    if (a->base != a->next_seq || res.undelivered > a->dropped)
+    {
+        res.errors++;
+    }
+    return res;
+}
+
+int main(int argc, char **argv)
+{
+    static const int ack_rates[] = { 0, 10, 50, 100, 200, 300 };
+    int failed = 0;
+
+    int window = argc > 2 ? atoi(argv[2]) : WINDOW;
+
+    frame_loss = argc > 1 ? atoi(argv[1]) * 10 : 10;
+    if (window < 1 || window > ARQ_MAX_WINDOW)
+    {
+        printf("window must be 1 to %d frames\n", ARQ_MAX_WINDOW);
+        return 1;
+    }
+    printf("%d frame window, %d us per byte, %d.%d%% of frames lost, receiver turnaround 0.2-2.2 ms (2%% +20 ms)\n",
+           window, US_PER_BYTE, frame_loss / 10, frame_loss % 10);
+    printf("%-9s %-9s %8s %9s %8s %8s %7s %8s %8s\n",
+           "ack loss", "timeout", "queued", "delivered", "resent", "timeouts", "dropped", "srtt us", "rto us");
+    for (unsigned i = 0; i < sizeof(ack_rates) / sizeof(ack_rates[0]); i++)
+    {
+        for (int adaptive = 1; adaptive >= 0; adaptive--)
+        {
+            arq_tx a;
+            result res;
+            ack_loss = ack_rates[i];
+            arq_tx_init(&a, PKT_ADDR_FIRST, window, FIXED_US, US_PER_BYTE);
+            if (!adaptive)
+            {
+                arq_tx_limits(&a, FIXED_US, FIXED_US, 255);
+            }
+            res = run(&a, 0);
+            printf("%5d.%d%%  %-9s %8u %9u %8u %8u %7u %8u %8u",
+                   ack_loss / 10, ack_loss % 10, adaptive ? "adaptive" : "fixed", res.queued, res.delivered,
+                   a.retransmits, a.timeouts, a.dropped, a.srtt, arq_tx_timeout(&a));
+            if (res.errors)
+            {
+                printf("   MISMATCH: %u bad, %u undelivered", res.errors, res.undelivered);
+                failed = 1;
+            }
+            printf("\n");
+        }
+    }
+
+    //window sweep, the link flat out and no frame given up on
+    ack_loss = SWEEP_ACK_LOSS;
+    printf("\nwindow sweep, %d.%d%% of acks lost, sender always has a sample waiting\n", ack_loss / 10, ack_loss % 10);
+    printf("%-7s %9s %10s %8s %8s %8s\n", "window", "delivered", "samples/s", "resent", "timeouts", "dropped");
+    for (int w = 1; w <= ARQ_MAX_WINDOW; w++)
+    {
+        arq_tx a;
+        result res;
+        arq_tx_init(&a, PKT_ADDR_FIRST, w, FIXED_US, US_PER_BYTE);
+        arq_tx_limits(&a, ARQ_RTO_MIN_US, ARQ_RTO_MAX_US, 255);
+        res = run(&a, 1);
+        printf("%4d    %9u %10.1f %8u %8u %8u", w, res.delivered, res.delivered * 1e6 / RUN_US,
+               a.retransmits, a.timeouts, a.dropped);
+        if (res.errors || res.undelivered || a.dropped || res.delivered != res.queued)
+        {
+            printf("   MISMATCH: %u bad, %u undelivered", res.errors, res.undelivered);
+            failed = 1;
+        }
+        printf("\n");
+    }
+    return failed;
+}
@@ -0,0 +1,150 @@
+/*
+Host benchmark for sample batching (see batch.h)
+
+Runs the sender's batch_tx and the receiver's batch_rx against a simulated half-duplex link and
+prints, for each batch size, how much of the wire is sample data and how long a sample takes from
+being measured to being handed to the display. At most LINK_TX_QUEUE_LEN frames can be waiting for the
+link, as on the sender. A frame that finds them all taken is refused and its samples are lost, and a
+batch size that has any frame refused is reported as link saturated instead.
+
+    cc -O2 -I../Send_Accel_Data/src -o batch_bench batch_bench.c ../Send_Accel_Data/src/batch.c ../Send_Accel_Data/src/packet.c ../Send_Accel_Data/src/delta_codec.c
+    ./batch_bench [baud] [sample period us] [max latency us]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "packet.h"
+#include "batch.h"
+#include "link_tx.h"
+
+#define SIM_SAMPLES     20000
+#define TURNAROUND_US   50              //bus handover and frame processing per frame
+#define JITTER_US       500             //sample period varies by up to this much
+#define MEASURED_LEN    128             //samples between being measured and being displayed, at most
+                                        //(LINK_TX_QUEUE_LEN + 1) * BATCH_MAX_SAMPLES + BATCH_PLAYBACK_LEN
+
+typedef struct {
+    uint64_t wire_bytes;
+    uint64_t frames;
+    uint64_t samples;
+    uint64_t latency_sum;
+    uint32_t latency_max;
+    uint32_t latency_min;
+    uint32_t gap_error_max;             //worst difference between measured and displayed sample spacing
+    uint32_t dropped;
+    uint32_t refused;                   //frames refused because LINK_TX_QUEUE_LEN were already waiting
+} bench_result;
+
+static void run(uint32_t baud, uint32_t period, uint8_t target, uint32_t max_latency, bench_result *r)
+{
+    batch_tx tx;
+    batch_rx rx;
+    batch_sample out;
+    uint8_t payload[PKT_MAX_PAYLOAD];
+    uint8_t frame[PKT_MAX_WIRE];
+    uint32_t measured[MEASURED_LEN];                //measurement time of each sample in flight, by sample number
+    uint32_t us_per_byte = (10000000 + baud - 1) / baud;
+    uint32_t bus_free = 0;              //time the link has finished the previous frame
+    uint32_t next_sample = 0;
+    uint32_t next_out = 0;              //number of the next sample expected out of playback
+    uint32_t sent = 0;
+    uint32_t prev_measured = 0, prev_shown = 0;
+    uint8_t seq = 0;
+
+    //frames queued or on the wire: arrival time and decoded contents
+    packet flight_pkt[LINK_TX_QUEUE_LEN];
+    uint32_t flight_at[LINK_TX_QUEUE_LEN];
+    int flight_head = 0, flight_count = 0;
+
+    batch_tx_init(&tx, target, max_latency);
+    batch_rx_init(&rx);
+    *r = (bench_result){ 0 };
+    r->latency_min = 0xFFFFFFFF;
+    srand(1);
+
+    for (uint32_t now = 0; sent < SIM_SAMPLES || flight_count > 0 || rx.count > 0; now += 10)
+    {
+        if (sent < SIM_SAMPLES && (int32_t)(now - next_sample) >= 0)
+        {
+            measured[sent % MEASURED_LEN] = now;
+            batch_tx_add(&tx, sent & 0x7FFF, -(int16_t)(sent & 0x7FFF), 0x5C5B, now);      //awkward values to exercise byte stuffing
+            sent++;
+            next_sample = now + period - JITTER_US / 2 + rand() % (JITTER_US + 1);
+            if (batch_tx_ready(&tx, now) || sent == SIM_SAMPLES)
+            {
+                uint8_t type;
+                int len = batch_tx_take(&tx, &type, payload);
+                int wire = packet_encode(type, PKT_ADDR_FIRST, seq++, payload, len, frame, sizeof(frame));
+                uint32_t start = (int32_t)(bus_free - now) > 0 ? bus_free : now;
+                int slot = (flight_head + flight_count) % LINK_TX_QUEUE_LEN;
+                r->frames++;
+                if (flight_count == LINK_TX_QUEUE_LEN)
+                {
+                    r->refused++;
+                }
+                else
+                {
+                    bus_free = start + wire * us_per_byte + TURNAROUND_US;
+                    packet_decode(&frame[1], wire - 2, &flight_pkt[slot]);
+                    flight_at[slot] = bus_free;
+                    flight_count++;
+                    r->wire_bytes += wire;
+                }
+            }
+        }
+        while (flight_count > 0 && (int32_t)(now - flight_at[flight_head]) >= 0)
+        {
+            batch_rx_unpack(&rx, &flight_pkt[flight_head], now);
+            flight_head = (flight_head + 1) % LINK_TX_QUEUE_LEN;
+            flight_count--;
+        }
+        while (batch_rx_next(&rx, now, &out) == 0)
+        {
+            uint32_t n = (uint16_t)out.x;       //sample number, from the x value it was sent with
+            uint32_t latency;
+            n = next_out + (uint16_t)((n - next_out) & 0x7FFF);
+            latency = now - measured[n % MEASURED_LEN];
+            r->latency_sum += latency;
+            if (latency > r->latency_max) r->latency_max = latency;
+            if (latency < r->latency_min) r->latency_min = latency;
+            if (r->samples > 0 && n == next_out)
+            {
+                int32_t err = (int32_t)((now - prev_shown) - (measured[n % MEASURED_LEN] - prev_measured));
+                if (err < 0) err = -err;
+                if ((uint32_t)err > r->gap_error_max) r->gap_error_max = err;
+            }
+            prev_shown = now;
+            prev_measured = measured[n % MEASURED_LEN];
+            r->samples++;
+            next_out = n + 1;
+        }
+    }
+    r->dropped = rx.dropped;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t baud = argc > 1 ? atoi(argv[1]) : 9600;
+    uint32_t period = argc > 2 ? atoi(argv[2]) : 20000;
+    uint32_t max_latency = argc > 3 ? atoi(argv[3]) : 0;
+    bench_result r;
+
+    printf("%lu baud, one sample every %lu us, max latency %lu us\n", (unsigned long)baud, (unsigned long)period, (unsigned long)max_latency);
+    printf("batch  frames  wire B/sample  efficiency  latency min/mean/max (us)   spacing error (us)  dropped\n");
+    for (uint8_t n = 1; n <= BATCH_MAX_SAMPLES; n++)
+    {
+        run(baud, period, n, max_latency, &r);
+        if (r.refused > 0)
+        {
+            printf("%5u  %6llu  link saturated, %lu frames refused by a full transmit queue\n", n,
+                   (unsigned long long)r.frames, (unsigned long)r.refused);
+            continue;
+        }
+        printf("%5u  %6llu  %13.2f  %9.1f%%  %8lu/%8llu/%8lu    %17lu  %7lu\n", n,
+               (unsigned long long)r.frames, (double)r.wire_bytes / r.samples,
+               100.0 * r.samples * PKT_ACCEL_PAYLOAD / r.wire_bytes,
+               (unsigned long)r.latency_min, (unsigned long long)(r.latency_sum / r.samples), (unsigned long)r.latency_max,
+               (unsigned long)r.gap_error_max, (unsigned long)r.dropped);
+    }
+    return 0;
+}
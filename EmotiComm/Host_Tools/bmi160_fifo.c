@@ -0,0 +1,401 @@
+/*
+Decoder and check for the BMI160 FIFO frame parser (see bmi160.h)
+
+Reads bytes drained from FIFO_DATA - a logic analyser export of the I2C1 read bursts, one burst per
+line as hex bytes - and writes one CSV line per reading: burst, x, y, z. Lines starting with '#' are
+skipped. The parser's totals go to stderr. --headerless reads headerless frames instead.
+
+With --test it checks itself instead:
+  - captured bursts with a known decode: headered accelerometer frames with interrupt tags, skip,
+    sensor time and configuration frames, the empty FIFO pattern, a frame cut off at the end of a
+    burst, a header that is not known, and headerless frames ending in the empty pattern
+  - a model of the sensor's FIFO, filled at the output data rate and drained the way main.c does it:
+    the fill level is read once the watermark has been reached (main.c counts data-ready pulses for
+    that), a burst of up to BMI160_FIFO_BURST bytes follows, and the readings are handed on one per
+    main loop pass. The main loop stalls now and then for long enough for the FIFO to overflow.
+    Frames cut off by a burst are sent again whole, and the readings dropped while the FIFO was full
+    are reported in a skip frame when headered.
+For each rate the model prints the bus transactions and bus time per reading next to reading each
+sample on its own, and checks that the readings come out in order with none repeated, that every gap
+is reported by a skip frame when the frames are headered, and that nothing is lost outside a stall.
+Exits with 1 if any check fails.
+
+    cc -O2 -I../Send_Accel_Data/src -o bmi160_fifo bmi160_fifo.c ../Send_Accel_Data/src/bmi160.c
+    ./bmi160_fifo [--headerless] bursts.txt > readings.csv
+    ./bmi160_fifo --test
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "bmi160.h"
+
+#define BUS_HZ          100000
+#define WATERMARK       140             //as ACCEL_WATERMARK, headered
+#define WATERMARK_PLAIN 120             //the same 20 frames headerless
+#define LOOP_US         250             //one main loop pass, a reading is handed on per pass
+#define MODEL_SECONDS   20
+
+static int decode_file(FILE *in, int headered)
+{
+    char line[4096];
+    uint8_t burst[1024];
+    bmi160_accel out[1024 / BMI160_ACC_BYTES];
+    bmi160_fifo f;
+    uint32_t bursts = 0;
+
+    bmi160_fifo_init(&f, headered);
+    printf("burst,x,y,z\n");
+    while (fgets(line, sizeof(line), in))
+    {
+        uint16_t len = 0, n;
+        char *p = line;
+        unsigned v;
+        int used;
+
+        if (line[0] == '#')
+        {
+            continue;
+        }
+        while (len < sizeof(burst) && sscanf(p, " %2x%n", &v, &used) == 1)
+        {
+            burst[len++] = (uint8_t)v;
+            p += used;
+        }
+        if (len == 0)
+        {
+            continue;
+        }
+        n = bmi160_fifo_parse(&f, burst, len, out, sizeof(out) / sizeof(out[0]));
+        for (uint16_t i = 0; i < n; i++)
+        {
+            printf("%u,%d,%d,%d\n", bursts, out[i].x, out[i].y, out[i].z);
+        }
+        bursts++;
+    }
+    fprintf(stderr, "%u bursts, %u readings, %u lost while full, %u frames split, %u bad bursts, %u config changes\n",
+            bursts, f.frames, f.skipped, f.partial, f.bad, f.config_changes);
+    if (f.have_time)
+    {
+        fprintf(stderr, "last sensor time %u (%.6f s)\n", f.sensor_time, f.sensor_time * 39.0625e-6);
+    }
+    return 0;
+}
+
+//captured bursts
+
+typedef struct {
+    const char *name;
+    int headered;
+    uint8_t data[40];
+    uint16_t len;
+    uint16_t readings;                  //expected decode
+    int16_t first[3];                   //first reading
+    int16_t last[3];                    //last reading
+    uint32_t skipped, partial, bad, config, time;
+} capture_case;
+
+static const capture_case captures[] = {
+    { "headered, two readings then empty", 1,
+      { 0x84, 0x10, 0x00, 0xF0, 0xFF, 0x00, 0x40,
+        0x85, 0x11, 0x00, 0xEF, 0xFF, 0x02, 0x40,                   //INT1 tag set
+        0x80, 0x80, 0x80, 0x80 }, 18,
+      2, { 16, -16, 16384 }, { 17, -17, 16386 }, 0, 0, 0, 0, 0 },
+    { "headered, skip, config change and sensor time", 1,
+      { 0x40, 0x05,
+        0x84, 0x00, 0x01, 0x00, 0x02, 0x00, 0x03,
+        0x48, 0x0A,
+        0x84, 0xFF, 0x7F, 0x00, 0x80, 0x01, 0x00,
+        0x44, 0x56, 0x34, 0x12,
+        0x80 }, 23,
+      2, { 256, 512, 768 }, { 32767, -32768, 1 }, 5, 0, 0, 1, 0x123456 },
+    { "headered, gyro and accelerometer frame", 1,
+      { 0x8C, 1, 0, 2, 0, 3, 0, 0x07, 0x00, 0x08, 0x00, 0x09, 0x00 }, 13,
+      1, { 7, 8, 9 }, { 7, 8, 9 }, 0, 0, 0, 0, 0 },
+    { "headered, last frame cut off", 1,
+      { 0x84, 1, 0, 2, 0, 3, 0, 0x84, 4, 0, 5 }, 11,
+      1, { 1, 2, 3 }, { 1, 2, 3 }, 0, 1, 0, 0, 0 },
+    { "headered, unknown header", 1,
+      { 0x84, 1, 0, 2, 0, 3, 0, 0x0C, 4, 0, 5, 0, 6, 0 }, 14,
+      1, { 1, 2, 3 }, { 1, 2, 3 }, 0, 0, 1, 0, 0 },
+    { "headerless, three readings then empty", 0,
+      { 0x10, 0x00, 0xF0, 0xFF, 0x00, 0x40,
+        0x00, 0x80, 0x00, 0x80, 0x01, 0x80,                         //two axes at -32768 is still a reading
+        0x11, 0x00, 0xEF, 0xFF, 0x02, 0x40,
+        0x00, 0x80, 0x00, 0x80, 0x00, 0x80 }, 24,
+      3, { 16, -16, 16384 }, { 17, -17, 16386 }, 0, 0, 0, 0, 0 },
+    { "headerless, last frame cut off", 0,
+      { 1, 0, 2, 0, 3, 0, 4, 0, 5 }, 9,
+      1, { 1, 2, 3 }, { 1, 2, 3 }, 0, 1, 0, 0, 0 },
+};
+
+static int check_captures(void)
+{
+    int fails = 0;
+
+    for (unsigned c = 0; c < sizeof(captures) / sizeof(captures[0]); c++)
+    {
+        const capture_case *k = &captures[c];
+        bmi160_accel out[8];
+        bmi160_fifo f;
+        uint16_t n;
+        int ok;
+
+        bmi160_fifo_init(&f, k->headered);
+        n = bmi160_fifo_parse(&f, k->data, k->len, out, 8);
+        ok = n == k->readings && f.frames == n && f.skipped == k->skipped && f.partial == k->partial &&
+             f.bad == k->bad && f.config_changes == k->config && (k->time == 0 || f.sensor_time == k->time);
+        if (ok && n > 0)
+        {
+            ok = out[0].x == k->first[0] && out[0].y == k->first[1] && out[0].z == k->first[2] &&
+                 out[n - 1].x == k->last[0] && out[n - 1].y == k->last[1] && out[n - 1].z == k->last[2];
+        }
+        printf("%-48s %s\n", k->name, ok ? "ok" : "WRONG");
+        fails += !ok;
+    }
+    return fails;
+}
+
+//model of the sensor's FIFO
+
+typedef struct {
+    uint8_t bytes[BMI160_FIFO_SIZE + 16];
+    uint16_t fill;
+    uint32_t pending_skip;              //readings dropped since the last skip frame was read
+    uint32_t dropped;
+} fifo_model;
+
+static uint16_t frame_len(const fifo_model *m, int headered, uint16_t at)
+{
+    if (!headered)
+    {
+        return BMI160_ACC_BYTES;
+    }
+    return m->bytes[at] == BMI160_FH_SKIP ? 2 : 1 + BMI160_ACC_BYTES;
+}
+
+static void model_sample(fifo_model *m, int headered, uint32_t index)
+{
+    //one reading, the oldest frames make room if the FIFO is full
+    uint16_t need = headered ? 1 + BMI160_ACC_BYTES : BMI160_ACC_BYTES;
+    uint16_t at;
+    //reading number k is x = k & 0x3FFF, y = -(k & 0x3FFF), z = k >> 14 so none looks like the empty pattern
+    int16_t v[3] = { (int16_t)(index & 0x3FFF), (int16_t)-(int16_t)(index & 0x3FFF), (int16_t)(index >> 14) };
+
+    while (m->fill + need > BMI160_FIFO_SIZE)
+    {
+        uint16_t drop = frame_len(m, headered, 0);
+        if (headered && m->bytes[0] == BMI160_FH_SKIP)
+        {
+            m->pending_skip += m->bytes[1];         //the report goes, what it reported is reported again
+        }
+        else
+        {
+            m->pending_skip++;
+            m->dropped++;
+        }
+        memmove(m->bytes, m->bytes + drop, m->fill - drop);
+        m->fill -= drop;
+    }
+    at = m->fill;
+    if (headered)
+    {
+        m->bytes[at++] = BMI160_FH_ACC;
+    }
+    for (int k = 0; k < 3; k++)
+    {
+        m->bytes[at++] = (uint8_t)v[k];
+        m->bytes[at++] = (uint8_t)((uint16_t)v[k] >> 8);
+    }
+    m->fill = at;
+}
+
+static uint16_t model_level(fifo_model *m, int headered)
+{
+    //a skip frame goes in front of the frames still there once readings have been dropped
+    if (headered && m->pending_skip > 0)
+    {
+        uint8_t n = m->pending_skip > 255 ? 255 : (uint8_t)m->pending_skip;
+        memmove(m->bytes + 2, m->bytes, m->fill);
+        m->bytes[0] = BMI160_FH_SKIP;
+        m->bytes[1] = n;
+        m->fill += 2;
+        m->pending_skip -= n;
+        while (m->fill > BMI160_FIFO_SIZE)
+        {
+            m->fill -= 1 + BMI160_ACC_BYTES;          //newest frames give way to the report
+            m->dropped++;
+            m->bytes[1]++;
+        }
+    }
+    else if (!headered)
+    {
+        m->pending_skip = 0;
+    }
+    return m->fill;
+}
+
+static uint16_t model_read(fifo_model *m, int headered, uint8_t *out, uint16_t len)
+{
+    //a burst of len bytes, frames cut off stay in the FIFO whole, reading past the end gives the empty pattern
+    uint16_t whole = 0;
+
+    while (whole < m->fill && whole + frame_len(m, headered, whole) <= len)
+    {
+        whole += frame_len(m, headered, whole);
+    }
+    memcpy(out, m->bytes, len < m->fill ? len : m->fill);
+    for (uint16_t i = m->fill; i < len; i++)
+    {
+        out[i] = headered ? BMI160_FH_EMPTY : (i % 2 ? 0x80 : 0x00);
+    }
+    memmove(m->bytes, m->bytes + whole, m->fill - whole);
+    m->fill -= whole;
+    return len;
+}
+
+static uint32_t bus_us(uint32_t bytes)
+{
+    //register write, restart, bytes read: start, address, register, restart, address, data, stop
+    return (uint32_t)(((uint64_t)(1 + 9 + 9 + 1 + 9 + 9 * bytes + 1) * 1000000) / BUS_HZ);
+}
+
+static int run_model(uint8_t odr, int headered)
+{
+    uint32_t period = 10000 >> (odr - BMI160_ODR_100HZ);
+    uint16_t watermark = headered ? WATERMARK : WATERMARK_PLAIN;
+    uint64_t end = (uint64_t)MODEL_SECONDS * 1000000;
+    fifo_model m;
+    bmi160_fifo f;
+    uint8_t burst[BMI160_FIFO_BURST];
+    bmi160_accel readings[BMI160_FIFO_MAX_READINGS];
+    uint16_t count = 0, next = 0;
+    uint32_t produced = 0, expect = 0, gaps = 0, out_of_order = 0, lost_outside = 0;
+    uint32_t checks = 0, drains = 0, busy = 0, reported_gap = 0;
+    uint16_t frame = BMI160_FIFO_FRAME(headered);
+    uint64_t bus_time = 0, check_due = 0, next_sample = period, stall_until = 0;
+    int fails;
+
+    memset(&m, 0, sizeof(m));
+    bmi160_fifo_init(&f, headered);
+    for (uint64_t now = 0; now < end; now += LOOP_US)
+    {
+        while (next_sample <= now)
+        {
+            model_sample(&m, headered, produced++);
+            next_sample += period;
+        }
+        //every 4 s the main loop stalls for 800 ms, longer than the FIFO can hold at 400 Hz and up
+        if (now % 4000000 == 2000000)
+        {
+            stall_until = now + 800000;
+        }
+        if (now < stall_until)
+        {
+            continue;
+        }
+        if (next < count)
+        {
+            //hand one reading on
+            bmi160_accel *a = &readings[next++];
+            uint32_t k = ((uint32_t)(uint16_t)a->z << 14) | (uint32_t)a->x;
+            if (k < expect)
+            {
+                out_of_order++;
+            }
+            else if (k > expect)
+            {
+                gaps += k - expect;
+                if (headered && !reported_gap)
+                {
+                    lost_outside++;                 //a gap no skip frame owned up to
+                }
+            }
+            reported_gap = 0;
+            expect = k + 1;
+            continue;
+        }
+        if (now < check_due)
+        {
+            continue;
+        }
+        checks++;
+        bus_time += bus_us(2);
+        uint16_t level = model_level(&m, headered);
+        if (level < watermark)
+        {
+            check_due = now + (watermark - level + frame - 1) / frame * period;     //as fifoLevelRead()
+            continue;
+        }
+        uint16_t len = level < BMI160_FIFO_BURST ? level : BMI160_FIFO_BURST;
+        uint32_t skipped = f.skipped;
+        model_read(&m, headered, burst, len);
+        bus_time += bus_us(len);
+        drains++;
+        if (len < BMI160_FIFO_BURST)
+        {
+            check_due = now + watermark / frame * period;                       //as fifoDrained()
+        }
+        count = bmi160_fifo_parse(&f, burst, len, readings, BMI160_FIFO_MAX_READINGS);
+        next = 0;
+        reported_gap = f.skipped != skipped;
+    }
+    busy = (uint32_t)(bus_time * 1000 / end);
+
+    uint32_t inside = m.fill / (headered ? 1 + BMI160_ACC_BYTES : BMI160_ACC_BYTES) + (count - next);
+    uint32_t single_us = bus_us(BMI160_ACC_BYTES);
+    printf("%5u Hz %-10s %7u readings, %5u lost in stalls (%u reported), %.3f transactions and %5.1f us of bus a reading"
+           " (one at a time: 1 and %u us), bus %u.%u%% busy\n",
+           100u << (odr - BMI160_ODR_100HZ), headered ? "headered" : "headerless", f.frames, gaps, f.skipped,
+           (double)(checks + drains) / (f.frames ? f.frames : 1), (double)bus_time / (f.frames ? f.frames : 1),
+           single_us, busy / 10, busy % 10);
+
+    fails = out_of_order != 0 || lost_outside != 0 || gaps != m.dropped ||
+            expect + inside + (m.dropped - gaps) != produced || f.bad != 0;
+    if (headered)
+    {
+        fails |= f.skipped != m.dropped;
+    }
+    if (fails)
+    {
+        printf("    %u out of order, %u gaps not reported, %u dropped by the FIFO, %u skipped, %u bad\n",
+               out_of_order, lost_outside, m.dropped, f.skipped, f.bad);
+    }
+    return fails;
+}
+
+int main(int argc, char **argv)
+{
+    FILE *in;
+    int headered = 1;
+
+    if (argc > 1 && strcmp(argv[1], "--test") == 0)
+    {
+        static const uint8_t rates[] = { BMI160_ODR_100HZ, BMI160_ODR_400HZ, BMI160_ODR_800HZ };
+        int fails = check_captures();
+        for (unsigned r = 0; r < sizeof(rates); r++)
+        {
+            fails += run_model(rates[r], 1);
+            fails += run_model(rates[r], 0);
+        }
+        if (fails)
+        {
+            printf("MISMATCH\n");
+            return 1;
+        }
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "--headerless") == 0)
+    {
+        headered = 0;
+        argc--;
+        argv++;
+    }
+    in = argc > 1 ? fopen(argv[1], "r") : stdin;
+    if (!in)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    return decode_file(in, headered);
+}
@@ -0,0 +1,239 @@
+/*
+Host check of the BMI160 burst read (see bmi160.h) against a simulated sensor on a 100 kHz I2C bus
+
+The simulated BMI160 has the register map bmi160.c uses: the command register and the six data registers
+from 0x12, which it refreshes at ODR_HZ. The register pointer increments through a read, and a new
+sample that falls due while a read is in progress is held back until the stop, as on the real part.
+Every sample n is written as x = 7n, y = -7n - 1, z = 7n + 2, so any reading shows whether its three
+axes came from the same sample. Bus time is counted at 9 clocks per byte plus one for each start,
+restart and stop. Every BAD_EVERY-th transaction is not acknowledged.
+
+The old measureAccel() is run against the same sensor for comparison: three transactions of 2 bytes
+from 0x12, 0x14 and 0x16, with the "Reading X axis..." printf at DEBUG_BAUD before each one.
+
+It checks that:
+  - bmi160_start() writes the normal mode command to the command register
+  - every burst reading decodes to the sample the sensor held, axes in order, low byte first, signed
+  - a transaction that is not acknowledged returns -1, is counted and leaves the reading alone
+It prints the bus time per reading and the readings whose axes came from different samples for both.
+Exits with 1 if any check fails.
+
+    cc -O2 -I../Send_Accel_Data/src -o bmi160_sim bmi160_sim.c ../Send_Accel_Data/src/bmi160.c
+    ./bmi160_sim [readings]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "host_tools.h"
+#include "bmi160.h"
+
+#define BUS_HZ      100000
+#define ODR_HZ      100                 //BMI160 default output data rate
+#define DEBUG_BAUD  9600                //printf on USART2 blocks for 10 bits a character
+#define BAD_EVERY   50
+#define LOOP_US_MAX 20000               //main loop time between readings, random up to this
+
+typedef struct {
+    uint8_t reg[128];
+    uint32_t sample;                    //number of the sample in the data registers
+    uint64_t next_update;               //ns
+    int reading;                        //1 while a read burst holds the data registers
+    uint32_t transactions;
+    uint32_t nacked;
+} sim_bmi160;
+
+static sim_bmi160 dev;
+static uint64_t now;                    //ns
+static uint64_t bus_ns;                 //time the bus has been busy
+
+static void put_sample(uint32_t n)
+{
+    int16_t v[3] = { (int16_t)(7 * n), (int16_t)(-7 * (int32_t)n - 1), (int16_t)(7 * n + 2) };
+    for (int i = 0; i < 3; i++)
+    {
+        dev.reg[BMI160_REG_ACC_X_L + 2 * i] = (uint16_t)v[i] & 0xFF;
+        dev.reg[BMI160_REG_ACC_X_L + 2 * i + 1] = (uint16_t)v[i] >> 8;
+    }
+}
+
+static uint32_t sample_of(int16_t x, int16_t y, int16_t z, int *coherent)
+{
+    //which sample x came from, and whether y and z are from the same one
+    uint32_t n = (uint32_t)((uint16_t)x * 28087u) & 0xFFFF;     //28087 = 1/7 mod 2^16
+    *coherent = y == (int16_t)(-7 * (int32_t)n - 1) && z == (int16_t)(7 * n + 2);
+    return n;
+}
+
+static void advance(uint64_t ns)
+{
+    //lets time pass, the sensor refreshes its data registers unless a burst is holding them
+    now += ns;
+    while (now >= dev.next_update && !dev.reading)
+    {
+        dev.sample++;
+        put_sample(dev.sample);
+        dev.next_update += 1000000000ull / ODR_HZ;
+    }
+}
+
+static void clocks(uint32_t n)
+{
+    bus_ns += (uint64_t)n * 1000000000ull / BUS_HZ;
+    advance((uint64_t)n * 1000000000ull / BUS_HZ);
+}
+
+static int nack(uint8_t addr)
+{
+    //address phase, returns 1 if nobody answers
+    dev.transactions++;
+    clocks(1 + 9);                      //start, address
+    if (addr != BMI160_ADDR || dev.transactions % BAD_EVERY == 0)
+    {
+        dev.nacked++;
+        clocks(1);                      //stop
+        return 1;
+    }
+    return 0;
+}
+
+static int sim_write(void *hw, uint8_t addr, uint8_t reg, const uint8_t *data, uint8_t len)
+{
+    (void)hw;
+    if (nack(addr))
+    {
+        return -1;
+    }
+    clocks(9);
+    for (int i = 0; i < len; i++)
+    {
+        dev.reg[(reg + i) & 0x7F] = data[i];
+        clocks(9);
+    }
+    clocks(1);
+    return 0;
+}
+
+static int sim_read(void *hw, uint8_t addr, uint8_t reg, uint8_t *data, uint8_t len)
+{
+    (void)hw;
+    if (nack(addr))
+    {
+        return -1;
+    }
+    clocks(9 + 1 + 9);                  //register, restart, address
+    dev.reading = 1;
+    for (int i = 0; i < len; i++)
+    {
+        data[i] = dev.reg[(reg + i) & 0x7F];
+        clocks(9);
+    }
+    dev.reading = 0;
+    clocks(1);                          //stop, a held back sample lands now
+    return 0;
+}
+
+static const bmi160_bus bus = { 0, sim_write, sim_read };
+
+static int legacy_read(int16_t *x, int16_t *y, int16_t *z)
+{
+    //the old measureAccel(): printf, then 2 bytes, for each axis
+    uint8_t raw[2];
+    int16_t *axis[3] = { x, y, z };
+
+    for (int i = 0; i < 3; i++)
+    {
+        advance(18ull * 10 * 1000000000ull / DEBUG_BAUD);      //"Reading X axis...\n"
+        if (sim_read(0, BMI160_ADDR, BMI160_REG_ACC_X_L + 2 * i, raw, 2) != 0)
+        {
+            return -1;
+        }
+        *axis[i] = (int16_t)(raw[0] | (raw[1] << 8));
+    }
+    return 0;
+}
+
+static void reset_sensor(void)
+{
+    memset(&dev, 0, sizeof(dev));
+    put_sample(0);
+    dev.next_update = 1000000000ull / ODR_HZ;
+    now = 0;
+    bus_ns = 0;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t readings = argc > 1 ? atoi(argv[1]) : 10000;
+    bmi160 s;
+    bmi160_accel a;
+    uint32_t wrong = 0, mixed = 0, failed_reads = 0, untouched = 0, legacy_mixed = 0, legacy_ok = 0, nacked;
+    uint64_t burst_bus_ns, legacy_ns = 0, start;
+    int coherent, failed = 0;
+
+    reset_sensor();
+    bmi160_init(&s, &bus, BMI160_ADDR);
+    while (bmi160_start(&s) != 0);
+    if (dev.reg[BMI160_REG_CMD] != BMI160_CMD_ACC_NORMAL)
+    {
+        printf("normal mode command not written\n");
+        failed = 1;
+    }
+
+    nacked = dev.nacked;
+    for (uint32_t i = 0; i < readings; i++)
+    {
+        uint32_t first, n;
+        advance((uint64_t)(rand_next() % LOOP_US_MAX) * 1000);
+        first = dev.sample;
+        a.x = a.y = a.z = 0x5555;
+        if (bmi160_read_accel(&s, &a) != 0)
+        {
+            failed_reads++;
+            untouched += a.x == 0x5555 && a.y == 0x5555 && a.z == 0x5555;
+            continue;
+        }
+        n = sample_of(a.x, a.y, a.z, &coherent);
+        if (((n - first) & 0xFFFF) > ((dev.sample - first) & 0xFFFF))
+        {
+            wrong++;                        //not a sample the registers held during the read
+        }
+        mixed += !coherent;
+    }
+    nacked = dev.nacked - nacked;
+    burst_bus_ns = bus_ns;
+
+    reset_sensor();
+    for (uint32_t i = 0; i < readings; i++)
+    {
+        int16_t x, y, z;
+        advance((uint64_t)(rand_next() % LOOP_US_MAX) * 1000);
+        start = now;
+        if (legacy_read(&x, &y, &z) != 0)
+        {
+            continue;
+        }
+        legacy_ok++;
+        legacy_ns += now - start;
+        sample_of(x, y, z, &coherent);
+        legacy_mixed += !coherent;
+    }
+
+    printf("BMI160 at %d Hz on a %d kHz bus, %u readings each\n", ODR_HZ, BUS_HZ / 1000, readings);
+    printf("burst read:  %8.0f us per reading, all of it on the bus, %u with axes from different samples, %u wrong\n",
+           burst_bus_ns / 1000.0 / (s.reads + failed_reads), mixed, wrong);
+    printf("             %u bus errors (%u not acknowledged), %u readings left alone\n", s.errors, nacked, untouched);
+    printf("three reads: %8.0f us per reading, %4.0f us of it on the bus, %u with axes from different samples\n",
+           legacy_ok ? legacy_ns / 1000.0 / legacy_ok : 0.0, bus_ns / 1000.0 / readings, legacy_mixed);
+    if (mixed || wrong || s.reads + failed_reads != readings || s.errors != nacked || failed_reads != nacked ||
+        untouched != failed_reads || legacy_mixed == 0)
+    {
+        failed = 1;
+    }
+    if (failed)
+    {
+        printf("MISMATCH\n");
+        return 1;
+    }
+    return 0;
+}
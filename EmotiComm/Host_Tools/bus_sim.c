@@ -0,0 +1,279 @@
+/*
+Host simulation of several sensor boards sharing one RS-485 pair (see poll_sched.h and arq.h)
+
+One receiver and 1 to 8 sensor boards sit on a single simulated half-duplex bus. The receiver hands the
+bus to one board at a time with the polling scheduler, the boards run the sliding window in polled mode
+and answer after a random turnaround. Frames are lost at the given rate, and any two frames that overlap
+on the bus are both lost and counted as a collision. Each board has its own poll period.
+
+The receiver keeps a latest-sample table per board, as the display modes use it. For each number of
+boards the program prints, per board, the poll rate it asked for, the polls and table updates it got
+per second and the longest gap between updates. Every frame carries the address of the board that made
+it and a running number, so the run checks that:
+  - no frame ends up in another board's entry, or out of order
+  - nothing collides, the polling keeps every board off the others' turns
+  - every board is polled at least at its own rate, however many boards share the bus
+A rate the bus has no time for must be refused. Exits with 1 if any check fails.
+
+    cc -O2 -I../Send_Accel_Data/src -o bus_sim bus_sim.c ../Send_Accel_Data/src/poll_sched.c ../Send_Accel_Data/src/arq.c ../Send_Accel_Data/src/packet.c
+    ./bus_sim [frame loss percent]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "host_tools.h"
+#include "packet.h"
+#include "arq.h"
+#include "poll_sched.h"
+
+#define US_PER_BYTE   22                //460800 baud, 10 bits per byte
+#define WINDOW        8
+#define SAMPLE_US     5000              //every board has a new frame this often
+#define TURNAROUND_US 300               //longest a board takes to answer its poll
+#define ACK_BYTES     12                //ack frame on the wire, with a little escaping
+#define ANSWER_BYTES  56                //one full batch frame
+#define TURN_US       ((ACK_BYTES + ANSWER_BYTES) * US_PER_BYTE + 2 * TURNAROUND_US)
+#define REPLY_US      ((ACK_BYTES + ANSWER_BYTES) * US_PER_BYTE + TURNAROUND_US + 100)     //poll out, turnaround, a whole frame back
+#define RUN_US        20000000
+#define STEP_US       5
+#define WIRE_FRAMES   32
+#define HUB           0xFF              //talker id of the receiver on the wire
+
+static const uint32_t period_ms[POLL_MAX_NODES] = { 10, 20, 20, 40, 20, 40, 20, 40 };
+
+typedef struct {
+    uint8_t data[PKT_MAX_WIRE];
+    int len;
+    uint8_t from;
+    uint32_t start, end;
+    int lost;
+} wire_frame;
+
+typedef struct {
+    arq_tx arq;
+    uint32_t tx_free;                   //transmitter busy until then
+    uint32_t answer_at;                 //time to start answering a poll
+    int answer_due;
+    uint32_t made;                      //running number of the next frame
+} board;
+
+typedef struct {
+    uint32_t next;                      //running number expected next
+    uint32_t updates;
+    uint32_t last_update;
+    uint32_t gap_max;                   //longest time between updates (us)
+} latest;
+
+static wire_frame bus[WIRE_FRAMES];
+static int bus_n;
+static board boards[POLL_MAX_NODES];
+static arq_rx hub_rx[POLL_MAX_NODES];
+static latest table[POLL_MAX_NODES];
+static poll_sched sched;
+static uint32_t now, collisions, misdelivered;
+static int frame_loss;                  //per mille
+
+static void put(uint8_t from, const uint8_t *data, int len, uint32_t start)
+{
+    wire_frame *f;
+    if (bus_n == WIRE_FRAMES)
+    {
+        return;
+    }
+    f = &bus[bus_n++];
+    memcpy(f->data, data, len);
+    f->len = len;
+    f->from = from;
+    f->start = start;
+    f->end = start + len * US_PER_BYTE;
+    f->lost = (int)(rand_next() % 1000) < frame_loss;
+    for (int i = 0; i < bus_n - 1; i++)
+    {
+        if (bus[i].from != from && bus[i].start < f->end && f->start < bus[i].end)
+        {
+            bus[i].lost = 1;            //two talkers at once garble each other
+            f->lost = 1;
+            collisions++;
+        }
+    }
+}
+
+static int board_emit(void *ctx, const uint8_t *frame, uint16_t len)
+{
+    board *b = ctx;
+    uint32_t start = (int32_t)(b->tx_free - now) > 0 ? b->tx_free : now;
+    put(b->arq.addr, frame, len, start);
+    b->tx_free = start + len * US_PER_BYTE;
+    return 0;
+}
+
+static void hub_frame(const packet *pkt, uint32_t end)
+{
+    int i = poll_sched_find(&sched, pkt->addr);
+    packet in;
+    if (i < 0)
+    {
+        return;
+    }
+    poll_sched_heard(&sched, pkt->addr, arq_rx_accept(&hub_rx[i], pkt), end);
+    while (arq_rx_pop(&hub_rx[i], &in) == 0)
+    {
+        uint32_t id;
+        memcpy(&id, in.payload + 1, 4);
+        if (in.payload[0] != pkt->addr || id < table[i].next)
+        {
+            misdelivered++;             //another board's frame, or out of order
+            continue;
+        }
+        table[i].next = id + 1;
+        if (table[i].updates > 0 && end - table[i].last_update > table[i].gap_max)
+        {
+            table[i].gap_max = end - table[i].last_update;
+        }
+        table[i].updates++;
+        table[i].last_update = end;
+    }
+}
+
+static void board_frame(board *b, const packet *pkt, uint32_t end)
+{
+    arq_tx_ack(&b->arq, pkt, end);      //ignores acks for the other boards
+    if (b->arq.granted)
+    {
+        b->answer_at = end + rand_next() % (TURNAROUND_US + 1);
+        b->answer_due = 1;
+    }
+}
+
+static void run(int nodes)
+{
+    packet pkt;
+
+    poll_sched_init(&sched, TURN_US, REPLY_US);
+    bus_n = 0;
+    rand_seed(1);
+    collisions = misdelivered = 0;
+    for (int i = 0; i < nodes; i++)
+    {
+        board *b = &boards[i];
+        arq_tx_init(&b->arq, PKT_ADDR_FIRST + i, WINDOW, 50000, US_PER_BYTE);
+        arq_tx_polled(&b->arq, 1);
+        b->tx_free = 0;
+        b->answer_due = 0;
+        b->made = 0;
+        arq_rx_init(&hub_rx[i], 0);
+        memset(&table[i], 0, sizeof(table[i]));
+        if (poll_sched_add(&sched, PKT_ADDR_FIRST + i, period_ms[i] * 1000, 0) != i)
+        {
+            printf("board %d refused\n", PKT_ADDR_FIRST + i);
+        }
+    }
+
+    for (now = 0; now < RUN_US; now += STEP_US)
+    {
+        //frames that have finished arriving, the receiver hears the boards and every board hears the receiver
+        for (int i = 0; i < bus_n; i++)
+        {
+            if ((int32_t)(now - bus[i].end) < 0)
+            {
+                continue;
+            }
+            wire_frame f = bus[i];
+            memmove(&bus[i], &bus[i + 1], (bus_n - i - 1) * sizeof(wire_frame));
+            bus_n--;
+            i--;
+            if (f.lost || packet_decode(f.data + 1, f.len - 2, &pkt) != 0)
+            {
+                continue;
+            }
+            if (f.from == HUB)
+            {
+                for (int n = 0; n < nodes; n++)
+                {
+                    board_frame(&boards[n], &pkt, f.end);
+                }
+            }
+            else
+            {
+                hub_frame(&pkt, f.end);
+            }
+        }
+
+        //receiver
+        poll_sched_poll(&sched, now);
+        int next = poll_sched_next(&sched, now);
+        if (next != POLL_NONE)
+        {
+            uint8_t frame[PKT_MAX_WIRE];
+            int len = arq_rx_ack(&hub_rx[next], sched.node[next].addr, PKT_FLAG_POLL, frame, sizeof(frame));
+            put(HUB, frame, len, now);
+        }
+
+        //boards
+        for (int n = 0; n < nodes; n++)
+        {
+            board *b = &boards[n];
+            if (now % SAMPLE_US == 0 && arq_tx_space(&b->arq) > 0)
+            {
+                uint8_t payload[5];
+                payload[0] = b->arq.addr;
+                memcpy(payload + 1, &b->made, 4);
+                arq_tx_queue(&b->arq, PKT_TYPE_ACCEL, payload, 5);
+                b->made++;
+            }
+            if (b->answer_due && (int32_t)(now - b->answer_at) >= 0)
+            {
+                arq_tx_burst(&b->arq, now, board_emit, b);
+                b->answer_due = 0;
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int failed = 0;
+
+    frame_loss = argc > 1 ? atoi(argv[1]) * 10 : 10;
+    printf("%d us per byte, %d.%d%% of frames lost, %u us booked per poll\n",
+           US_PER_BYTE, frame_loss / 10, frame_loss % 10, TURN_US);
+    for (int nodes = 1; nodes <= POLL_MAX_NODES; nodes++)
+    {
+        run(nodes);
+        printf("\n%d board%s, %u.%u%% of bus time booked, %u collisions, %u misdelivered\n",
+               nodes, nodes > 1 ? "s" : "", sched.load / 10, sched.load % 10, collisions, misdelivered);
+        printf("%6s %9s %8s %10s %10s %7s %8s\n", "board", "floor Hz", "polls/s", "updates/s", "max gap ms", "missed", "dropped");
+        for (int i = 0; i < nodes; i++)
+        {
+            poll_node *n = &sched.node[i];
+            uint32_t floor_polls = RUN_US / n->period;
+            printf("%6u %9u %8.1f %10.1f %10.1f %7u %8u", n->addr, 1000000 / n->period,
+                   n->polls * 1e6 / RUN_US, table[i].updates * 1e6 / RUN_US, table[i].gap_max / 1000.0,
+                   n->missed, boards[i].arq.dropped);
+            if (n->polls < floor_polls)
+            {
+                printf("   BELOW FLOOR");
+                failed = 1;
+            }
+            printf("\n");
+        }
+        if (collisions || misdelivered)
+        {
+            printf("MISMATCH\n");
+            failed = 1;
+        }
+    }
+
+    //board 1 asking for 500 Hz does not fit next to the other seven
+    if (poll_sched_set_period(&sched, 0, 2000) == 0)
+    {
+        printf("overbooked board was taken on\n");
+        failed = 1;
+    }
+    else
+    {
+        printf("\nboard 1 at 500 Hz is refused, the bus stays %u.%u%% booked\n", sched.load / 10, sched.load % 10);
+    }
+    return failed;
+}
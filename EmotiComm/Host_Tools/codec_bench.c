@@ -0,0 +1,206 @@
+/*
+Host benchmark for the accelerometer stream codec (see delta_codec.h)
+
+Encodes synthetic motion traces, or a recorded one, in batches the way the sender does. For each trace it
+prints the compression ratio against plain ACCEL_BATCH payloads and the encode/decode cost per sample.
+Every frame is decoded again and checked against the input ("errors" counts frames that differ). A second pass drops random frames to show
+how many samples are lost, including those waiting for the next keyframe after a lost one.
+Rows below 1:1 are where the firmware sends plain frames instead (see batch_tx_take()).
+
+    cc -O2 -I../Send_Accel_Data/src -o codec_bench codec_bench.c ../Send_Accel_Data/src/delta_codec.c -lm
+    ./codec_bench [samples per frame] [keyframe interval] [recorded trace]
+A recorded trace is a text file with one "x y z" line of raw counts per sample, e.g. captured from the
+sender's serial output.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include "delta_codec.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define COST_UNIT "cycles"
+static uint64_t cost_now(void) { return __rdtsc(); }
+#else
+#define COST_UNIT "ns"
+static uint64_t cost_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+#endif
+
+#define TRACE_LEN     20000
+#define SAMPLE_TICKS  20                //one sample every 20 ms, in BATCH_TICK_US units
+#define PLAIN_SAMPLE  7                 //dt + x, y, z in an ACCEL_BATCH payload
+#define MAX_PAYLOAD   255
+#define LOSS_PERCENT  10                //loss pass drops this share of frames at random
+
+static delta_sample trace[TRACE_LEN];
+static int trace_len;
+
+static int16_t clamp16(double v)
+{
+    return v > 32767 ? 32767 : v < -32768 ? -32768 : (int16_t)lrint(v);
+}
+
+static double noise(int amplitude)
+{
+    return (rand() % (2 * amplitude + 1)) - amplitude;
+}
+
+static void make_trace(int kind)
+{
+    srand(1);
+    trace_len = TRACE_LEN;
+    for (int i = 0; i < trace_len; i++)
+    {
+        double t = i * SAMPLE_TICKS / 1000.0;
+        double x = 0, y = 0, z = 16384;     //lying flat, +1g on z
+        switch (kind)
+        {
+        case 0:                         //still - sensor noise only
+            x += noise(4); y += noise(4); z += noise(4);
+            break;
+        case 1:                         //slow tilt back and forth
+            x += 8000 * sin(t * 0.6) + noise(4);
+            y += 3000 * sin(t * 0.25) + noise(4);
+            z = 16384 * cos(t * 0.3) + noise(4);
+            break;
+        case 2:                         //carried while walking
+            x += 1500 * sin(t * 12.0) + noise(40);
+            y += 600 * sin(t * 6.0 + 1) + noise(40);
+            z += 2500 * sin(t * 12.0 + 0.5) + noise(40);
+            break;
+        default:                        //shaken hard
+            x += noise(12000); y += noise(12000); z += noise(12000);
+            break;
+        }
+        trace[i].dt = SAMPLE_TICKS + (rand() % 3) - 1;
+        trace[i].x = clamp16(x);
+        trace[i].y = clamp16(y);
+        trace[i].z = clamp16(z);
+    }
+}
+
+static int load_trace(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    int x, y, z;
+    if (!f)
+    {
+        return -1;
+    }
+    trace_len = 0;
+    while (trace_len < TRACE_LEN && fscanf(f, "%d %d %d", &x, &y, &z) == 3)
+    {
+        trace[trace_len].dt = SAMPLE_TICKS;
+        trace[trace_len].x = x;
+        trace[trace_len].y = y;
+        trace[trace_len].z = z;
+        trace_len++;
+    }
+    fclose(f);
+    return trace_len > 0 ? 0 : -1;
+}
+
+static void run(const char *name, int per_frame, int key_interval)
+{
+    delta_enc enc;
+    delta_dec dec;
+    delta_sample out[DELTA_MAX_SAMPLES];
+    uint8_t payload[MAX_PAYLOAD];
+    uint64_t plain = 0, coded = 0, enc_cost = 0, dec_cost = 0;
+    int frames = 0, mismatches = 0, lost_samples = 0;
+
+    //clean pass - every frame arrives
+    delta_enc_init(&enc, key_interval);
+    delta_dec_init(&dec);
+    for (int i = 0; i < trace_len; i += per_frame)
+    {
+        int n = trace_len - i < per_frame ? trace_len - i : per_frame;
+        uint64_t t0 = cost_now();
+        int len = delta_encode(&enc, &trace[i], n, payload, sizeof(payload));
+        uint64_t t1 = cost_now();
+        int got = delta_decode(&dec, payload, len, out, DELTA_MAX_SAMPLES);
+        uint64_t t2 = cost_now();
+        enc_cost += t1 - t0;
+        dec_cost += t2 - t1;
+        plain += 1 + n * PLAIN_SAMPLE;
+        coded += len;
+        frames++;
+        if (got != n)
+        {
+            mismatches++;
+            continue;
+        }
+        for (int k = 0; k < n; k++)
+        {
+            const delta_sample *a = &out[k], *b = &trace[i + k];
+            if (a->dt != b->dt || a->x != b->x || a->y != b->y || a->z != b->z)
+            {
+                mismatches++;
+                break;
+            }
+        }
+    }
+
+    //loss pass - LOSS_PERCENT of the frames are dropped on the way
+    delta_enc_init(&enc, key_interval);
+    delta_dec_init(&dec);
+    srand(2);
+    for (int i = 0; i < trace_len; i += per_frame)
+    {
+        int n = trace_len - i < per_frame ? trace_len - i : per_frame;
+        int len = delta_encode(&enc, &trace[i], n, payload, sizeof(payload));
+        if (rand() % 100 < LOSS_PERCENT)
+        {
+            lost_samples += n;
+            continue;
+        }
+        if (delta_decode(&dec, payload, len, out, DELTA_MAX_SAMPLES) < 0)
+        {
+            lost_samples += n;
+        }
+    }
+
+    printf("%-10s %6.2f:1  %6.2f B/sample  %7.1f / %7.1f %s  %8d  %12.1f%%\n", name,
+           (double)plain / coded, (double)coded / trace_len,
+           (double)enc_cost / trace_len, (double)dec_cost / trace_len, COST_UNIT,
+           mismatches, 100.0 * lost_samples / trace_len);
+}
+
+int main(int argc, char **argv)
+{
+    static const char *names[] = { "still", "tilt", "walking", "shaking" };
+    int per_frame = argc > 1 ? atoi(argv[1]) : 4;
+    int key_interval = argc > 2 ? atoi(argv[2]) : 8;
+
+    if (per_frame < 1 || per_frame > DELTA_MAX_SAMPLES)
+    {
+        per_frame = 4;
+    }
+    printf("%d samples per frame, keyframe every %d frames, %d%% of frames dropped in the loss pass\n",
+           per_frame, key_interval, LOSS_PERCENT);
+    printf("trace      ratio     coded size      encode / decode per sample   errors  samples lost\n");
+    for (int kind = 0; kind < 4; kind++)
+    {
+        make_trace(kind);
+        run(names[kind], per_frame, key_interval);
+    }
+    if (argc > 3)
+    {
+        if (load_trace(argv[3]) == 0)
+        {
+            run("recorded", per_frame, key_interval);
+        }
+        else
+        {
+            printf("could not read %s\n", argv[3]);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,282 @@
+/*
+Host simulation of pong mode with a slow receiver, with and without credit flow control (see credit.h)
+
+The sender takes a reading every READ_US. The receiver spends DRAW_MIN_US to DRAW_MAX_US drawing the
+game on each pass of its main loop and only handles the frames that queued up in the meantime once it
+has finished, as the firmware does. Frames go over a simulated half-duplex link, land in the receiver's
+frame_pool and are unpacked into its playback queue, and the paddle moves on the newest sample the
+playback queue has handed on.
+
+Two senders are compared:
+  - free running, as pong mode was: readings are batched (BATCH_SAMPLES per frame, BATCH_LATENCY_US at
+    most, delta coded) and every frame is sent as soon as it is ready
+  - credit: the receiver grants PONG_CREDITS frames at a time once it has handled the last one it
+    allowed, and the sender sends only the newest reading, one per frame, replacing older ones meanwhile
+For each the program prints the frames sent, the frames lost to a full receive queue, the samples lost
+to a full playback queue, and the staleness of the sample the paddle moves on at each draw (how long ago
+it was measured): mean, p99 and max.
+
+It exits with 1 if the credit sender loses any frame to a full queue or does
+not give fresher samples at both the mean and the p99.
+
+    cc -O2 -I../Send_Accel_Data/src -o credit_sim credit_sim.c ../Send_Accel_Data/src/credit.c ../Send_Accel_Data/src/batch.c ../Send_Accel_Data/src/delta_codec.c ../Send_Accel_Data/src/frame_pool.c ../Send_Accel_Data/src/packet.c
+    ./credit_sim [draw ms]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "host_tools.h"
+#include "packet.h"
+#include "batch.h"
+#include "credit.h"
+#include "frame_pool.h"
+
+#define US_PER_BYTE       87            //115200 baud
+#define READ_US           5000          //one pass of the sender's pong loop
+#define BATCH_SAMPLES     4
+#define BATCH_LATENCY_US  100000
+#define DELTA_KEY_INTERVAL 8
+#define PONG_CREDITS      1
+#define CREDIT_REFRESH_US 50000
+#define RUN_US            60000000
+#define STEP_US           10
+#define WIRE_FRAMES       16
+#define MAX_DRAWS         100000
+
+typedef struct {
+    uint8_t data[PKT_MAX_WIRE];
+    int len;
+    uint32_t start, end;
+    int to_receiver;
+    int lost;
+} wire_frame;
+
+typedef struct {
+    uint32_t frames, overflows, dropped, draws;
+    uint32_t stale[MAX_DRAWS];
+} result;
+
+static wire_frame wire[WIRE_FRAMES];
+static int wire_n;
+static uint32_t now, draw_min, draw_max;
+static uint32_t sender_free;            //the transmitter each side is busy until then
+static uint32_t receiver_free;
+
+static void put(const uint8_t *data, int len, int to_receiver)
+{
+    uint32_t *tx_free = to_receiver ? &sender_free : &receiver_free;
+    uint32_t start = (int32_t)(*tx_free - now) > 0 ? *tx_free : now;
+    wire_frame *f;
+
+    if (wire_n == WIRE_FRAMES)
+    {
+        return;
+    }
+    f = &wire[wire_n++];
+    memcpy(f->data, data, len);
+    f->len = len;
+    f->start = start;
+    f->end = start + len * US_PER_BYTE;
+    f->to_receiver = to_receiver;
+    f->lost = 0;
+    *tx_free = f->end;
+    for (int i = 0; i < wire_n - 1; i++)
+    {
+        if (wire[i].to_receiver != to_receiver && wire[i].start < f->end && start < wire[i].end)
+        {
+            wire[i].lost = 1;           //both sides talking at once
+            f->lost = 1;
+        }
+    }
+}
+
+static int by_value(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void run(int use_credit, result *res)
+{
+    static frame_pool pool;
+    static batch_tx batch;
+    static delta_enc codec;
+    static batch_rx playback;
+    credit_tx ctx;
+    credit_rx crx;
+    uint8_t tx_seq = 0;
+    uint32_t next_read = 0, draw_end = 0;
+    uint32_t paddle_stamp = 0;
+    int drawing = 0, have_sample = 0;
+    int16_t value = 0;
+
+    memset(res, 0, sizeof(*res));
+    frame_pool_init(&pool);
+    batch_tx_init(&batch, use_credit ? 1 : BATCH_SAMPLES, use_credit ? 0 : BATCH_LATENCY_US);
+    if (!use_credit)
+    {
+        delta_enc_init(&codec, DELTA_KEY_INTERVAL);
+        batch_tx_use_codec(&batch, &codec);
+    }
+    batch_rx_init(&playback);
+    credit_tx_init(&ctx, PONG_CREDITS);
+    credit_rx_init(&crx, PONG_CREDITS, CREDIT_REFRESH_US, 0);
+    wire_n = 0;
+    sender_free = receiver_free = 0;
+    rand_seed(1);
+
+    for (now = 0; now < RUN_US; now += STEP_US)
+    {
+        //frames that have finished arriving
+        for (int i = 0; i < wire_n; i++)
+        {
+            wire_frame f = wire[i];
+            packet pkt;
+            if ((int32_t)(now - f.end) < 0)
+            {
+                continue;
+            }
+            memmove(&wire[i], &wire[i + 1], (wire_n - i - 1) * sizeof(wire_frame));
+            wire_n--;
+            i--;
+            if (f.lost)
+            {
+                continue;
+            }
+            if (f.to_receiver)
+            {
+                frame_slot *s = frame_pool_acquire(&pool);      //filled by the receive interrupt on the board
+                if (s != 0)
+                {
+                    memcpy(s->data, f.data + 1, f.len - 2);
+                    s->len = f.len - 2;
+                    s->time = f.end;
+                    frame_pool_publish(&pool, s);
+                }
+            }
+            else if (packet_decode(f.data + 1, f.len - 2, &pkt) == 0)
+            {
+                credit_tx_grant(&ctx, &pkt);
+            }
+        }
+
+        //sender's pong loop
+        if ((int32_t)(now - next_read) >= 0)
+        {
+            uint8_t payload[PKT_MAX_PAYLOAD], frame[PKT_MAX_WIRE];
+            uint8_t type;
+            int len, seq;
+            credit_sample s;
+
+            value++;                    //the reading says when it was taken
+            next_read += READ_US;
+            if (use_credit)
+            {
+                credit_tx_offer(&ctx, value, 0, 0, now);
+                if ((seq = credit_tx_take(&ctx, &s)) >= 0)
+                {
+                    batch_tx_add(&batch, s.x, s.y, s.z, s.time);
+                    len = batch_tx_take(&batch, &type, payload);
+                    put(frame, packet_encode(type, PKT_ADDR_FIRST, seq, payload, len, frame, sizeof(frame)), 1);
+                    res->frames++;
+                }
+            }
+            else
+            {
+                batch_tx_add(&batch, value, 0, 0, now);
+                if (batch_tx_ready(&batch, now))
+                {
+                    len = batch_tx_take(&batch, &type, payload);
+                    put(frame, packet_encode(type, PKT_ADDR_FIRST, tx_seq++, payload, len, frame, sizeof(frame)), 1);
+                    res->frames++;
+                }
+            }
+        }
+
+        //receiver's main loop: playback, draw, then the frames that queued up, then credit
+        if (!drawing)
+        {
+            batch_sample sample;
+            while (batch_rx_next(&playback, now, &sample) == 0)
+            {
+                paddle_stamp = sample.stamp;
+                have_sample = 1;
+            }
+            if (have_sample && res->draws < MAX_DRAWS)
+            {
+                res->stale[res->draws++] = (now - paddle_stamp) & 0xFFFFFF;
+            }
+            drawing = 1;
+            draw_end = now + draw_min + rand_next() % (draw_max - draw_min + 1);
+        }
+        else if ((int32_t)(now - draw_end) >= 0)
+        {
+            frame_slot *s;
+            packet pkt;
+            drawing = 0;
+            while ((s = frame_pool_borrow(&pool)) != 0)
+            {
+                if (packet_decode(s->data, s->len, &pkt) == 0)
+                {
+                    credit_rx_heard(&crx, pkt.seq, now);
+                    batch_rx_unpack(&playback, &pkt, now);
+                }
+                frame_pool_release(&pool, s);
+            }
+            if (use_credit)
+            {
+                uint8_t grant[PKT_MAX_WIRE];
+                int len = credit_rx_grant(&crx, PKT_ADDR_FIRST, now, grant, sizeof(grant));
+                if (len > 0)
+                {
+                    put(grant, len, 0);
+                }
+            }
+        }
+    }
+    res->overflows = pool.overflows;
+    res->dropped = playback.dropped;
+    qsort(res->stale, res->draws, sizeof(res->stale[0]), by_value);
+}
+
+static uint32_t mean(const result *r)
+{
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < r->draws; i++)
+    {
+        sum += r->stale[i];
+    }
+    return r->draws ? sum / r->draws : 0;
+}
+
+static void print(const char *name, const result *r)
+{
+    printf("%-12s %7u %10u %9u %7u %10.1f %9.1f %9.1f\n", name, r->frames, r->overflows, r->dropped, r->draws,
+           mean(r) / 1000.0, r->stale[r->draws * 99 / 100] / 1000.0, r->stale[r->draws - 1] / 1000.0);
+}
+
+int main(int argc, char **argv)
+{
+    static result free_running, credit;
+    uint32_t draw_ms = argc > 1 ? atoi(argv[1]) : 30;
+
+    draw_min = draw_ms * 1000 / 2;
+    draw_max = draw_ms * 1000 * 3 / 2;
+    printf("reading every %d ms, receiver draws for %u-%u ms, %d us per byte\n",
+           READ_US / 1000, draw_min / 1000, draw_max / 1000, US_PER_BYTE);
+    printf("%-12s %7s %10s %9s %7s %10s %9s %9s\n", "sender", "frames", "queue full", "playback", "draws",
+           "stale ms", "p99 ms", "max ms");
+    run(0, &free_running);
+    print("free running", &free_running);
+    run(1, &credit);
+    print("credit", &credit);
+
+    if (credit.overflows > 0 || mean(&credit) >= mean(&free_running) ||
+        credit.stale[credit.draws * 99 / 100] >= free_running.stale[free_running.draws * 99 / 100])
+    {
+        printf("MISMATCH\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,117 @@
+/*
+Host check of the data-ready timing statistics (see drdy.h)
+
+The BMI160 runs on its own oscillator, which is off from its nominal rate by up to about 1%. This puts
+data-ready pulses out at a rate that is off by a set amount and wanders slowly, and delays each one by
+a random interrupt latency on the way to drdy_edge() - most are taken at once, some wait behind another
+handler for up to 20 us - and drops a few pulses altogether. Times are in CPU cycles at 80 MHz, as on
+the board.
+
+For each output data rate and oscillator error it prints the rate drdy_mean() measures, the jitter
+drdy_jitter() reports next to the true RMS of the intervals, the missed pulses found, and how far off
+the stamps of a 20 reading drain would be if they were spaced by the nominal interval rather than the
+measured one. It checks that the measured rate is within 0.05% of the true one, that the jitter is
+within 5% of the true RMS, and that every dropped pulse is counted. Exits with 1 if any check fails.
+
+    cc -O2 -I../Send_Accel_Data/src -o drdy_sim drdy_sim.c ../Send_Accel_Data/src/drdy.c -lm
+    ./drdy_sim
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include "host_tools.h"
+#include "drdy.h"
+
+#define CPU_HZ        80000000
+#define PULSES        20000
+#define DROP_PER_MILLE 2
+#define DRAIN         20                //readings stamped back from the newest
+
+
+static uint32_t latency(void)
+{
+    //cycles from the pulse to the handler's first instruction
+    uint32_t r = rand_next() % 1000;
+    if (r < 900)
+    {
+        return 12 + rand_next() % 8;                    //taken straight away
+    }
+    return 12 + rand_next() % (20 * 80);                //behind another handler
+}
+
+static int run(uint32_t hz, double error_ppm)
+{
+    drdy_stats d;
+    double period = (double)CPU_HZ / hz * (1.0 + error_ppm * 1e-6);
+    double nominal = (double)CPU_HZ / hz;
+    double t = 1000.0, sum = 0, sum_sq = 0;
+    uint32_t prev = 0, dropped = 0, intervals = 0;
+    int have_prev = 0, fail;
+
+    drdy_init(&d, (uint32_t)(nominal + 0.5));
+    for (uint32_t i = 0; i < PULSES; i++)
+    {
+        //the oscillator wanders by +/-0.01% over a few seconds
+        t += period * (1.0 + 1e-4 * sin(i * 2.0 * M_PI / (hz * 4.0)));
+        if (rand_next() % 1000 < DROP_PER_MILLE)
+        {
+            dropped++;
+            have_prev = 0;
+            continue;
+        }
+        uint32_t seen = (uint32_t)(uint64_t)t + latency();
+        if (have_prev)
+        {
+            double iv = (double)(uint32_t)(seen - prev);
+            sum += iv;
+            sum_sq += iv * iv;
+            intervals++;
+        }
+        have_prev = 1;
+        prev = seen;
+        drdy_edge(&d, seen);
+    }
+
+    double true_mean = sum / intervals;
+    double true_rms = sqrt(sum_sq / intervals - true_mean * true_mean);
+    double mean = drdy_mean(&d);
+    double jitter = drdy_jitter(&d);
+    double stamp_err_nominal = fabs(nominal - period) * (DRAIN - 1) / 80.0;
+    double stamp_err_measured = fabs(mean - period) * (DRAIN - 1) / 80.0;
+
+    printf("%5u Hz %+6.0f ppm: measured %9.3f Hz (true %9.3f), jitter %6.2f us rms (true %6.2f), %3u of %3u missed pulses found,"
+           " oldest stamp of a drain off by %6.2f us (nominal spacing %6.2f us)\n",
+           hz, error_ppm, CPU_HZ / mean, CPU_HZ / period, jitter / 80, true_rms / 80, d.missed, dropped,
+           stamp_err_measured, stamp_err_nominal);
+
+    fail = fabs(mean - true_mean) / true_mean > 0.0005 || fabs(jitter - true_rms) > 0.05 * true_rms + 1 ||
+           d.missed != dropped || d.intervals != intervals;
+    if (fail)
+    {
+        printf("    MISMATCH: %u intervals counted, %u expected\n", d.intervals, intervals);
+    }
+    return fail;
+}
+
+int main(void)
+{
+    static const uint32_t rates[] = { 25, 100, 400, 1600 };
+    static const double errors[] = { -8000, 0, 6000 };
+    int fails = 0;
+
+    rand_seed(11);
+    for (unsigned r = 0; r < sizeof(rates) / sizeof(rates[0]); r++)
+    {
+        for (unsigned e = 0; e < sizeof(errors) / sizeof(errors[0]); e++)
+        {
+            fails += run(rates[r], errors[e]);
+        }
+    }
+    if (fails)
+    {
+        printf("MISMATCH\n");
+        return 1;
+    }
+    return 0;
+}
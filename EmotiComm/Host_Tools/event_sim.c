@@ -0,0 +1,201 @@
+/*
+Host stress run for the interrupt to main loop event queue (see event_queue.h)
+
+Several producer threads stand in for interrupt handlers of different priorities and post events as fast
+as they can, each with its own event type and a counter in the time field. The main thread stands in
+for the main loop and calls event_dispatch() with a random amount of other work between calls, so the
+queue runs both nearly empty and full. The lock is a mutex here, on the board it masks interrupts.
+
+It checks that:
+  - every event that was accepted is handled exactly once, by the handler of its type, in the order its
+    producer posted it
+  - every event that was refused shows up in the dropped counter
+  - an event posted by a handler is left for the next event_dispatch() call rather than run straight away
+It prints the events posted, handled and dropped, the deepest the queue got, and the longest a single
+event_post() took in ns. Exits with 1 if any check fails.
+
+    cc -O2 -pthread -I../Send_Accel_Data/src -o event_sim event_sim.c ../Send_Accel_Data/src/event_queue.c
+    ./event_sim [seconds]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include "host_tools.h"
+#include "event_queue.h"
+
+#define PRODUCERS   3               //types 0 to PRODUCERS - 1
+#define EVENT_CHAIN (EVENT_TYPES - 2)   //handler of this type posts EVENT_CHAINED
+#define EVENT_CHAINED (EVENT_TYPES - 1)
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static event_queue q;
+static volatile int running = 1;
+static uint32_t accepted[PRODUCERS], refused[PRODUCERS], expect[PRODUCERS];
+static uint64_t post_ns_max[PRODUCERS];
+static uint32_t wrong_order, wrong_type, chain_posted, chained_handled, chained_early;
+static int in_chain_dispatch;
+
+static uint32_t mock_lock(void *hw)
+{
+    (void)hw;
+    pthread_mutex_lock(&mutex);
+    return 0;
+}
+
+static void mock_unlock(void *hw, uint32_t state)
+{
+    (void)hw;
+    (void)state;
+    pthread_mutex_unlock(&mutex);
+}
+
+static const event_lock lock = { 0, mock_lock, mock_unlock };
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static void on_producer(void *ctx, const event *e)
+{
+    int p = (int)(intptr_t)ctx;
+    if (e->type != p || e->arg != (uint8_t)(p * 40 + e->time))
+    {
+        wrong_type++;
+    }
+    if (e->time != expect[p])
+    {
+        wrong_order++;
+    }
+    expect[p] = e->time + 1;
+}
+
+static void on_chain(void *ctx, const event *e)
+{
+    (void)ctx;
+    (void)e;
+    in_chain_dispatch = 1;
+    if (event_post(&q, EVENT_CHAINED, 0, 0) == 0)
+    {
+        chain_posted++;
+    }
+}
+
+static void on_chained(void *ctx, const event *e)
+{
+    (void)ctx;
+    (void)e;
+    chained_handled++;
+    chained_early += in_chain_dispatch;    //ran in the same event_dispatch() call that posted it
+}
+
+static void *producer(void *arg)
+{
+    int p = (int)(intptr_t)arg;
+    uint32_t seq = 0, state = p + 1;
+
+    while (running)
+    {
+        uint64_t start = now_ns(), spent;
+        int rc = event_post(&q, p, (uint8_t)(p * 40 + seq), seq);
+        spent = now_ns() - start;
+        if (spent > post_ns_max[p])
+        {
+            post_ns_max[p] = spent;
+        }
+        if (rc == 0)
+        {
+            accepted[p]++;
+            seq++;                          //the next accepted one carries the next number
+        }
+        else
+        {
+            refused[p]++;
+        }
+        uint32_t r = rand_from(&state);
+        for (volatile uint32_t spin = (r >> 12) & 0xFFF; spin > 0; spin--)
+        {
+        }
+        if (r % 64 == 0)
+        {
+            sched_yield();
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    pthread_t t[PRODUCERS];
+    double seconds = argc > 1 ? atof(argv[1]) : 2.0;
+    uint64_t end;
+    uint32_t handled = 0, state = 99, posted = 0, dropped = 0, chain_sent = 0;
+    int failed;
+
+    event_init(&q, &lock);
+    for (int p = 0; p < PRODUCERS; p++)
+    {
+        event_on(&q, p, on_producer, (void *)(intptr_t)p);
+    }
+    event_on(&q, EVENT_CHAIN, on_chain, 0);
+    event_on(&q, EVENT_CHAINED, on_chained, 0);
+    for (int p = 0; p < PRODUCERS; p++)
+    {
+        pthread_create(&t[p], 0, producer, (void *)(intptr_t)p);
+    }
+
+    end = now_ns() + (uint64_t)(seconds * 1e9);
+    while (now_ns() < end)
+    {
+        if (rand_from(&state) % 16 == 0 && event_post(&q, EVENT_CHAIN, 0, 0) == 0)
+        {
+            chain_sent++;
+        }
+        in_chain_dispatch = 0;
+        handled += event_dispatch(&q);
+        for (volatile uint32_t spin = (state >> 16) & 0x3FFF; spin > 0; spin--)
+        {
+        }
+    }
+    running = 0;
+    for (int p = 0; p < PRODUCERS; p++)
+    {
+        pthread_join(t[p], 0);
+    }
+    for (int n = 1; n > 0; handled += n)
+    {
+        in_chain_dispatch = 0;
+        n = event_dispatch(&q);
+    }
+
+    for (int p = 0; p < PRODUCERS; p++)
+    {
+        posted += accepted[p];
+        dropped += refused[p];
+        printf("producer %d: %u posted, %u refused, longest post %llu ns\n",
+               p, accepted[p], refused[p], (unsigned long long)post_ns_max[p]);
+    }
+    printf("queue: %u posted, %u handled, %u dropped, deepest %u of %d\n",
+           q.posted, q.dispatched, q.dropped, q.high_water, EVENT_QUEUE_LEN);
+    printf("handlers: %u out of order, %u wrong type, %u chained posted, %u handled, %u run early\n",
+           wrong_order, wrong_type, chain_posted, chained_handled, chained_early);
+
+    failed = 0;
+    for (int p = 0; p < PRODUCERS; p++)
+    {
+        failed |= expect[p] != accepted[p];
+    }
+    if (failed || wrong_order || wrong_type || chained_early || chained_handled != chain_posted ||
+        q.posted != posted + chain_sent + chain_posted || q.dispatched != q.posted || handled != q.dispatched || q.dropped < dropped ||
+        dropped == 0 || q.high_water != EVENT_QUEUE_LEN)
+    {
+        printf("MISMATCH\n");
+        return 1;
+    }
+    return 0;
+}
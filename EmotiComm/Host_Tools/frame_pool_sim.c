@@ -0,0 +1,371 @@
+/*
+Host check of the receive slot pool and its two SPSC rings (see frame_pool.h and spsc_ring.h)
+
+The receive interrupt acquires a slot, writes a frame into it and publishes it. The main loop borrows
+the oldest published frame, reads it where it is and releases the slot. Here both sides are run
+step by step in one thread, so every interleaving is scripted and repeatable. A model keeps what each
+slot should be doing - free, being filled, queued or held by the main loop - and every call is checked
+against it:
+  - acquire only hands out a free slot, and fails (counted in overflows) only when there is none
+  - borrow hands out the oldest queued frame, whole, and nothing when the queue is empty
+  - no frame is handed out twice or lost without being counted, no slot is in two places at once
+Scripted cases: an empty queue, a full queue, the pool used up while the main loop holds frames,
+the interrupt taking a slot between the main loop's borrow and release, and both rings' indexes
+running over 2^32. A long random interleaving then follows, with the ring indexes started just short
+of the wrap. Exits with 1 if any check fails.
+
+    cc -O2 -I../Send_Accel_Data/src -o frame_pool_sim frame_pool_sim.c ../Send_Accel_Data/src/frame_pool.c
+    ./frame_pool_sim [random steps]
+
+Another queue depth can be tried by adding -DFRAME_POOL_SLOTS=8 to the cc line.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "host_tools.h"
+#include "frame_pool.h"
+
+#define SLOT_FREE     0
+#define SLOT_FILLING  1
+#define SLOT_QUEUED   2
+#define SLOT_HELD     3
+
+static frame_pool pool;
+static uint8_t slot_state[FRAME_POOL_SLOTS];
+static frame_slot *filling;             //interrupt side: slot being filled, 0 if none
+static frame_slot *held[FRAME_POOL_SLOTS];     //main loop side: borrowed and not yet released
+static uint32_t held_id[FRAME_POOL_SLOTS];     //the frame each one held when it was borrowed
+static int held_n;
+static uint32_t next_id, expect_id, lost, delivered, errors;
+
+static void fail(const char *what)
+{
+    if (errors++ < 10)
+    {
+        printf("    %s (frame %u)\n", what, next_id);
+    }
+}
+
+static void reset(uint32_t start)
+{
+    //a fresh pool with both rings' free running indexes starting at `start`
+    frame_pool_init(&pool);
+    pool.ready.head = pool.ready.tail = start;
+    pool.free.head = pool.free.tail = start;
+    for (int i = 0; i < FRAME_POOL_SLOTS; i++)
+    {
+        frame_index_ring_push(&pool.free, i);
+        slot_state[i] = SLOT_FREE;
+    }
+    filling = 0;
+    held_n = 0;
+    next_id = expect_id = lost = delivered = 0;
+}
+
+//interrupt side
+static int isr_start(void)
+{
+    //'[' arrives - returns 1 if a slot was taken
+    int free_slots = 0;
+    for (int i = 0; i < FRAME_POOL_SLOTS; i++)
+    {
+        free_slots += slot_state[i] == SLOT_FREE;
+    }
+    uint32_t overflows = pool.overflows;
+    filling = frame_pool_acquire(&pool);
+    if (!filling)
+    {
+        if (free_slots)
+        {
+            fail("acquire failed with a slot free");
+        }
+        if (pool.overflows != overflows + 1)
+        {
+            fail("failed acquire not counted");
+        }
+        lost++;
+        next_id++;                      //this frame is gone, the next one follows it
+        return 0;
+    }
+    int i = filling - pool.slot;
+    if (slot_state[i] != SLOT_FREE)
+    {
+        fail("acquire handed out a slot that is not free");
+    }
+    slot_state[i] = SLOT_FILLING;
+    return 1;
+}
+
+static void isr_end(void)
+{
+    //bytes and ']' arrive - the frame is written and published
+    int len = 4 + next_id % (FRAME_SLOT_SIZE - 4);
+    memcpy(filling->data, &next_id, 4);
+    for (int i = 4; i < len; i++)
+    {
+        filling->data[i] = next_id + i;
+    }
+    filling->len = len;
+    filling->time = next_id;
+    slot_state[filling - pool.slot] = SLOT_QUEUED;
+    frame_pool_publish(&pool, filling);
+    filling = 0;
+    next_id++;
+}
+
+static void isr_frame(void)
+{
+    if (isr_start())
+    {
+        isr_end();
+    }
+}
+
+//main loop side
+static int main_borrow(void)
+{
+    //returns 1 if a frame was taken
+    int queued = 0;
+    for (int i = 0; i < FRAME_POOL_SLOTS; i++)
+    {
+        queued += slot_state[i] == SLOT_QUEUED;
+    }
+    if ((int)frame_pool_waiting(&pool) != queued)
+    {
+        fail("waiting count does not match the frames queued");
+    }
+    frame_slot *s = frame_pool_borrow(&pool);
+    if (!s)
+    {
+        if (queued)
+        {
+            fail("borrow found nothing with frames queued");
+        }
+        return 0;
+    }
+    int i = s - pool.slot;
+    uint32_t id;
+    memcpy(&id, s->data, 4);
+    if (slot_state[i] != SLOT_QUEUED)
+    {
+        fail("borrow handed out a slot that was not queued");
+    }
+    //frames lost to overflow are skipped, anything else out of order is an error
+    if (id < expect_id || s->time != id || s->len != 4 + id % (FRAME_SLOT_SIZE - 4))
+    {
+        fail("frame handed out twice, out of order or damaged");
+    }
+    for (int b = 4; b < s->len; b++)
+    {
+        if (s->data[b] != (uint8_t)(id + b))
+        {
+            fail("frame bytes overwritten while queued");
+            break;
+        }
+    }
+    expect_id = id + 1;
+    slot_state[i] = SLOT_HELD;
+    held_id[held_n] = id;
+    held[held_n++] = s;
+    delivered++;
+    return 1;
+}
+
+static void main_release(int which)
+{
+    frame_slot *s = held[which];
+    int i = s - pool.slot;
+    uint32_t id;
+
+    //the slot must still hold the frame borrowed, the interrupt may not have written into it
+    memcpy(&id, s->data, 4);
+    if (id != held_id[which] || s->len != 4 + id % (FRAME_SLOT_SIZE - 4))
+    {
+        fail("held frame overwritten");
+    }
+    slot_state[i] = SLOT_FREE;
+    frame_pool_release(&pool, s);
+    held_n--;
+    held[which] = held[held_n];
+    held_id[which] = held_id[held_n];
+}
+
+static void main_drain(void)
+{
+    while (main_borrow())
+    {
+        main_release(held_n - 1);
+    }
+}
+
+static int accounted(void)
+{
+    //every frame sent has been delivered, is still queued or held, or was counted lost
+    return delivered + lost + frame_pool_waiting(&pool) == next_id - (filling != 0) && lost == pool.overflows;
+}
+
+static int scripted(uint32_t start)
+{
+    uint32_t e = errors;
+
+    //empty queue: nothing to borrow before, between and after frames
+    reset(start);
+    for (int i = 0; i < 3; i++)
+    {
+        if (main_borrow())
+        {
+            fail("borrowed from an empty queue");
+        }
+    }
+    isr_frame();
+    main_drain();
+    if (main_borrow())
+    {
+        fail("borrowed from a drained queue");
+    }
+
+    //full queue: every slot queued, the next frame is lost and counted, the rest come out in order
+    reset(start);
+    for (int i = 0; i < FRAME_POOL_SLOTS; i++)
+    {
+        isr_frame();
+    }
+    isr_frame();
+    if (lost != 1 || frame_pool_waiting(&pool) != FRAME_POOL_SLOTS)
+    {
+        fail("full queue did not drop exactly one frame");
+    }
+    main_drain();
+    isr_frame();                        //slots are back
+    main_drain();
+
+    //pool used up while the main loop holds frames: held slots are never handed to the interrupt
+    reset(start);
+    isr_frame();
+    isr_frame();
+    main_borrow();
+    main_borrow();
+    for (int i = 0; i < FRAME_POOL_SLOTS; i++)
+    {
+        isr_frame();                    //the last two find no slot
+    }
+    if (lost != 2)
+    {
+        fail("held slots were handed out again");
+    }
+    main_release(0);
+    isr_frame();                        //one slot back, one frame gets through
+    main_release(0);
+    main_drain();
+
+    //the interrupt between borrow and release, and a frame half written while the main loop releases
+    reset(start);
+    for (int round = 0; round < 3 * FRAME_POOL_SLOTS; round++)
+    {
+        isr_frame();
+        main_borrow();
+        isr_start();
+        main_release(0);
+        isr_end();
+        main_drain();
+    }
+
+    //wraparound of the slot indexes: many more frames than slots, queue kept partly full
+    reset(start);
+    for (int i = 0; i < 10 * FRAME_POOL_SLOTS; i++)
+    {
+        isr_frame();
+        isr_frame();
+        main_borrow();
+        main_release(0);
+    }
+    main_drain();
+
+    if (!accounted())
+    {
+        fail("frames unaccounted for");
+    }
+    return errors != e;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t steps = argc > 1 ? strtoul(argv[1], 0, 10) : 10000000;
+    static const uint32_t starts[] = { 0, 0xFFFFFFFFu - 2, 0xFFFFFFFFu - FRAME_POOL_SLOTS };
+    uint32_t max_held = 0;
+
+    rand_seed(13);
+    for (unsigned i = 0; i < sizeof(starts) / sizeof(starts[0]); i++)
+    {
+        int bad = scripted(starts[i]);
+        printf("scripted cases, ring indexes from 0x%08X: %s\n", starts[i], bad ? "FAILED" : "ok");
+    }
+
+    //random interleaving - the interrupt stops the main loop at any point, and the main loop sometimes
+    //holds more than one frame (a frame being parsed while the next is looked at)
+    reset(0xFFFFFFFFu - 1000);
+    for (uint32_t n = 0; n < steps; n++)
+    {
+        uint32_t r = rand_next() % 100;
+        if (r < 20)
+        {
+            if (filling)
+            {
+                isr_end();
+            }
+            else
+            {
+                isr_start();
+            }
+        }
+        else if (r < 55)
+        {
+            if (held_n < 1 || (held_n < FRAME_POOL_SLOTS && rand_next() % 8 == 0))
+            {
+                main_borrow();
+            }
+        }
+        else if (r < 90)
+        {
+            if (held_n > 0)
+            {
+                main_release(rand_next() % held_n);
+            }
+        }
+        else if (r < 92)
+        {
+            while (filling || rand_next() % 4)
+            {
+                filling ? isr_end() : isr_frame();      //a burst while the main loop is busy
+            }
+        }
+        if ((uint32_t)held_n > max_held)
+        {
+            max_held = held_n;
+        }
+    }
+    if (filling)
+    {
+        isr_end();
+    }
+    while (held_n)
+    {
+        main_release(0);
+    }
+    main_drain();
+    printf("random interleaving: %u frames, %u delivered, %u lost with no slot free, up to %u held at once, "
+           "ring indexes wrapped: %s\n", next_id, delivered, lost, max_held,
+           pool.free.head < 0x80000000u && pool.ready.head < 0x80000000u ? "yes" : "no");
+    if (!accounted() || pool.free.head >= 0x80000000u || pool.ready.head >= 0x80000000u)
+    {
+        fail("frames unaccounted for after the random run");
+    }
+
+    if (errors)
+    {
+        printf("MISMATCH: %u errors\n", errors);
+        return 1;
+    }
+    return 0;
+}
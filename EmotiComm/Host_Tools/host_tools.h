@@ -0,0 +1,38 @@
+/*
+Shared by the host tools in this directory
+
+Every tool is a single C file that runs on the PC against the board sources in ../Send_Accel_Data/src,
+with nothing but a C compiler. Its header comment gives the sources it needs. Build and run it from
+this directory, e.g.
+    cc -O2 -I../Send_Accel_Data/src -o packet_test packet_test.c ../Send_Accel_Data/src/packet.c
+    ./packet_test
+
+Random traffic, loss and timing come from rand_next(), a fixed LCG each tool seeds with its own number,
+so a tool gives the same result on every run and a failure can be repeated. Only timings measured on
+the PC (ns/byte, cycles per sample) change from run to run.
+*/
+#ifndef HOST_TOOLS_H
+#define HOST_TOOLS_H
+
+#include <stdint.h>
+
+static uint32_t rand_state = 1;
+
+static inline uint32_t rand_from(uint32_t *state)
+{
+    //a generator of its own, for a thread or a stream that must not disturb the others
+    *state = *state * 1664525u + 1013904223u;
+    return *state >> 8;
+}
+
+static inline void rand_seed(uint32_t seed)
+{
+    rand_state = seed;
+}
+
+static inline uint32_t rand_next(void)
+{
+    return rand_from(&rand_state);
+}
+
+#endif
@@ -0,0 +1,382 @@
+/*
+Host check of the interrupt driven I2C engine (see i2c_async.h) against a model of the I2C1 peripheral
+
+The model does what the firmware's driver functions ask of I2C1 - start or restart with a byte count
+and AUTOEND, write TXDR, read RXDR, software reset - and raises the TXIS, TC, RXNE, NACKF and STOPF
+flags at the times a 100 kHz bus would: 9 clocks a byte, one for each start, restart and stop. A flag
+goes to i2c_async_event() the way I2C1_EV_IRQHandler() passes it on. The slave behind it is a 256
+register device with an auto-incrementing register pointer. Faults are injected at random: a slave
+that does not acknowledge its address, and a slave that holds SCL low until the peripheral is reset.
+
+The main loop queues register writes and reads of random length at random moments, from a few
+sources so the queue runs both empty and full, and polls for timeouts. A copy of what the registers
+should hold is kept from the writes that completed.
+
+It checks that:
+  - every transaction queued ends exactly once, with its callback, in the order it was queued
+  - a transaction ends DONE unless a fault was injected into it, and reads return what was written
+  - every slave that held the bus was given up on by i2c_async_poll() and the next transaction ran
+  - the queue refuses transactions only when it is full, and counts them
+It prints the transactions run, the faults, the interrupts per transaction and how much of the time
+the bus was busy while the main loop was free. Exits with 1 if any check fails.
+
+    cc -O2 -I../Send_Accel_Data/src -o i2c_async_sim i2c_async_sim.c ../Send_Accel_Data/src/i2c_async.c
+    ./i2c_async_sim [seconds]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "host_tools.h"
+#include "i2c_async.h"
+
+#define BUS_HZ      100000
+#define CLOCK_NS    (1000000000 / BUS_HZ)
+#define NACK_PPM    20000               //transactions whose address is not acknowledged, per million
+#define HANG_PPM    2000                //transactions where the slave holds the bus
+#define SOURCES     6                   //callers, each with one transaction at a time
+#define MAX_LEN     8
+
+typedef struct {
+    //peripheral
+    uint8_t addr, read, nbytes, autoend;
+    uint8_t done_bytes;
+    uint8_t txdr_full, txdr, rxdr_full, rxdr;
+    uint8_t flag;                       //event waiting to be raised at due
+    uint64_t due;
+    int active, hung;
+    //slave
+    uint8_t reg[256];
+    uint8_t ptr;
+    int first_write;                    //next written byte is the register pointer
+    uint32_t events;
+} mock_i2c;
+
+typedef struct {
+    i2c_txn t;
+    uint8_t wdata[MAX_LEN];
+    uint8_t rdata[MAX_LEN];
+    uint32_t order;                     //queued as number
+    int faulted;                        //a fault was injected into it
+    int ends;                           //callbacks seen
+} source_txn;
+
+static mock_i2c bus;
+static i2c_async e;
+static uint64_t now;
+static uint8_t shadow[256];             //what the registers should hold
+static source_txn txns[SOURCES];
+static uint32_t queued, next_end, out_of_order, bad_data, extra_ends, wrong_status;
+static uint32_t nacks_injected, hangs_injected;
+static int fault_next;                  //0, 1 = NACK, 2 = hang, for the transaction about to start
+static uint64_t busy_ns;
+
+static void raise_at(uint8_t flag, uint32_t clocks)
+{
+    bus.flag = flag;
+    bus.due = now + (uint64_t)clocks * CLOCK_NS;
+}
+
+//driver functions, standing in for i2cStart() and friends in main.c
+static void drv_start(void *hw, uint8_t addr, int read, uint8_t nbytes, int autoend)
+{
+    (void)hw;
+    if (!bus.active)
+    {
+        bus.first_write = 1;            //new transaction, restarts keep the pointer
+        uint32_t r = rand_next() % 1000000;
+        fault_next = r < NACK_PPM ? 1 : r < NACK_PPM + HANG_PPM ? 2 : 0;
+    }
+    bus.active = 1;
+    bus.addr = addr;
+    bus.read = read;
+    bus.nbytes = nbytes;
+    bus.autoend = autoend;
+    bus.done_bytes = 0;
+    bus.txdr_full = 0;
+    if (fault_next == 2)
+    {
+        bus.hung = 1;                   //SCL held low, nothing more happens
+        bus.flag = I2C_EV_NONE;
+        return;
+    }
+    if (fault_next == 1)
+    {
+        raise_at(I2C_EV_NACK, 1 + 9);
+        return;
+    }
+    if (read)
+    {
+        raise_at(0xFF, 1 + 9 + 9);      //first byte arrives after the address and 9 clocks
+    }
+    else
+    {
+        raise_at(I2C_EV_TXIS, 1 + 9);
+    }
+}
+static void drv_put(void *hw, uint8_t data)
+{
+    (void)hw;
+    bus.txdr = data;
+    bus.txdr_full = 1;
+    bus.flag = 0xFE;                    //byte on the wire
+    bus.due = now + 9ull * CLOCK_NS;
+}
+static uint8_t drv_get(void *hw)
+{
+    (void)hw;
+    bus.rxdr_full = 0;
+    return bus.rxdr;
+}
+static void drv_reset(void *hw)
+{
+    (void)hw;
+    bus.active = 0;
+    bus.hung = 0;
+    bus.flag = I2C_EV_NONE;
+    bus.rxdr_full = 0;
+    bus.txdr_full = 0;
+}
+static uint32_t drv_lock(void *hw)
+{
+    (void)hw;
+    return 0;
+}
+static void drv_unlock(void *hw, uint32_t state)
+{
+    (void)hw;
+    (void)state;
+}
+
+static const i2c_async_driver driver = { 0, drv_start, drv_put, drv_get, drv_reset, drv_lock, drv_unlock };
+
+static void irq(uint8_t ev)
+{
+    bus.events++;
+    i2c_async_event(&e, ev);
+}
+
+static void step_bus(void)
+{
+    //raises whatever the peripheral has due, as its interrupt would
+    uint8_t flag;
+
+    if (!bus.active || bus.hung || bus.flag == I2C_EV_NONE || now < bus.due)
+    {
+        return;
+    }
+    flag = bus.flag;
+    bus.flag = I2C_EV_NONE;
+    switch (flag)
+    {
+    case 0xFE:                          //a written byte has been clocked out and acknowledged
+        if (bus.first_write)
+        {
+            bus.ptr = bus.txdr;
+            bus.first_write = 0;
+        }
+        else
+        {
+            bus.reg[bus.ptr++] = bus.txdr;
+        }
+        bus.txdr_full = 0;
+        if (++bus.done_bytes < bus.nbytes)
+        {
+            irq(I2C_EV_TXIS);
+        }
+        else if (bus.autoend)
+        {
+            raise_at(I2C_EV_STOP, 1);
+        }
+        else
+        {
+            irq(I2C_EV_TC);
+        }
+        break;
+    case 0xFF:                          //a byte has been received
+        if (bus.rxdr_full)
+        {
+            bus.due = now + CLOCK_NS;   //clock stretched until RXDR is read
+            bus.flag = 0xFF;
+            break;
+        }
+        bus.rxdr = bus.reg[bus.ptr++];
+        bus.rxdr_full = 1;
+        bus.done_bytes++;
+        irq(I2C_EV_RXNE);
+        if (bus.done_bytes < bus.nbytes)
+        {
+            raise_at(0xFF, 9);
+        }
+        else
+        {
+            raise_at(I2C_EV_STOP, 1);
+        }
+        break;
+    case I2C_EV_NACK:
+        irq(I2C_EV_NACK);
+        raise_at(I2C_EV_STOP, 1);       //stop goes out by itself after a NACK
+        break;
+    case I2C_EV_STOP:
+        bus.active = 0;
+        irq(I2C_EV_STOP);
+        break;
+    default:
+        irq(flag);
+        break;
+    }
+}
+
+static void on_end(void *ctx, i2c_txn *t)
+{
+    source_txn *s = ctx;
+
+    if (s->ends++ > 0)
+    {
+        extra_ends++;
+    }
+    if (s->order != next_end)
+    {
+        out_of_order++;
+    }
+    next_end = s->order + 1;
+    if (t->status == I2C_TXN_DONE)
+    {
+        if (s->faulted)
+        {
+            wrong_status++;
+        }
+        for (int i = 0; i < t->wlen; i++)
+        {
+            shadow[(uint8_t)(t->reg + i)] = t->wdata[i];
+        }
+        for (int i = 0; i < t->rlen; i++)
+        {
+            if (t->rdata[i] != shadow[(uint8_t)(t->reg + i)])
+            {
+                bad_data++;
+            }
+        }
+    }
+    else if (!s->faulted)
+    {
+        wrong_status++;
+    }
+}
+
+static int start_source(source_txn *s)
+{
+    i2c_txn *t = &s->t;
+    int read = rand_next() % 2;
+    uint8_t len = 1 + rand_next() % MAX_LEN;
+
+    t->addr = 0x69;
+    t->reg = rand_next() & 0xFF;
+    t->wdata = s->wdata;
+    t->wlen = read ? 0 : len;
+    t->rdata = s->rdata;
+    t->rlen = read ? len : 0;
+    t->done = on_end;
+    t->ctx = s;
+    for (int i = 0; i < t->wlen; i++)
+    {
+        s->wdata[i] = rand_next() & 0xFF;
+    }
+    s->order = queued;
+    s->faulted = 0;
+    s->ends = 0;
+    if (i2c_async_queue(&e, t) != 0)
+    {
+        return -1;
+    }
+    queued++;
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 20.0;
+    uint64_t end = (uint64_t)(seconds * 1e9);
+    uint32_t refused = 0, refused_not_full = 0, faulted_ends = 0;
+    source_txn *current = 0;
+    uint32_t current_started = 0;
+    int failed = 0;
+
+    rand_seed(7);
+    i2c_async_init(&e, &driver);
+    memset(&bus, 0, sizeof(bus));
+    for (int i = 0; i < 256; i++)
+    {
+        bus.reg[i] = shadow[i] = i * 13;
+    }
+
+    for (now = 0; now < end || i2c_async_busy(&e); now += CLOCK_NS / 10)
+    {
+        step_bus();
+        if (bus.active || i2c_async_busy(&e))
+        {
+            busy_ns += CLOCK_NS / 10;
+        }
+
+        //note which transaction the fault was drawn for as soon as it starts
+        if (i2c_async_busy(&e) && e.started != current_started)
+        {
+            current_started = e.started;
+            current = (source_txn *)e.queue[e.tail]->ctx;
+            if (fault_next)
+            {
+                current->faulted = 1;
+                nacks_injected += fault_next == 1;
+                hangs_injected += fault_next == 2;
+            }
+        }
+
+        //main loop, every 50 us: queue something now and then, watch for timeouts
+        if (now % 50000 == 0)
+        {
+            i2c_async_poll(&e, (uint32_t)(now / 1000));
+            if (now < end && rand_next() % 8 == 0)
+            {
+                source_txn *s = &txns[rand_next() % SOURCES];
+                if (s->t.status != I2C_TXN_BUSY)
+                {
+                    int was_full = e.count == I2C_QUEUE_LEN;
+                    if (start_source(s) != 0)
+                    {
+                        refused++;
+                        refused_not_full += !was_full;
+                    }
+                }
+            }
+        }
+    }
+    for (int i = 0; i < SOURCES; i++)
+    {
+        if (txns[i].t.status == I2C_TXN_BUSY)
+        {
+            wrong_status++;                 //never ended
+        }
+    }
+    faulted_ends = nacks_injected + hangs_injected;
+
+    printf("%.0f s at %d kHz: %u transactions queued, %u done, %u failed, %u refused with the queue full\n",
+           seconds, BUS_HZ / 1000, queued, e.done, e.failed, e.full);
+    printf("faults: %u not acknowledged, %u held the bus (%u timeouts)\n", nacks_injected, hangs_injected, e.timeouts);
+    printf("%.1f interrupts per transaction, bus busy %.1f%% of the time with the main loop free throughout\n",
+           queued ? (double)bus.events / queued : 0.0, busy_ns * 100.0 / now);
+    printf("%u out of order, %u ended twice, %u wrong status, %u bad bytes read\n",
+           out_of_order, extra_ends, wrong_status, bad_data);
+
+    if (out_of_order || extra_ends || wrong_status || bad_data || e.done + e.failed != queued ||
+        e.failed != faulted_ends || e.timeouts != hangs_injected || e.full != refused || refused_not_full ||
+        nacks_injected == 0 || hangs_injected == 0 || refused == 0)
+    {
+        failed = 1;
+    }
+    if (failed)
+    {
+        printf("MISMATCH\n");
+        return 1;
+    }
+    return 0;
+}
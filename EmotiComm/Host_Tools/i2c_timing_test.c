@@ -0,0 +1,161 @@
+/*
+Host check of the I2C TIMINGR calculator (see i2c_timing.h)
+
+For kernel clocks from 4 to 80 MHz, the three bus rates and a range of rise and fall times, it takes
+the TIMINGR value i2c_timing_calc() returns apart again and works out the bus timing it gives: the
+SCL rate at its fastest (shortest analog filter delay) and slowest (longest), tLOW and tHIGH, the data
+setup time, and the earliest and latest the data can change after SCL falls. Each is checked against
+this file's own copy of the I2C specification limits (UM10204 table 10) for the mode:
+  - the SCL rate never goes above the asked one, and is not more than 10% below it
+  - tLOW, tHIGH and tSU;DAT are at least their minimums, the hold time is not negative and the data is
+    valid within tVD;DAT
+  - every field is within its register width, and the result fields match the TIMINGR value
+It also checks that the settings the firmware can be built for are found - 100 kHz, 400 kHz and 1 MHz
+at 80 MHz with I2C_RISE_NS and I2C_FALL_NS - that rates above 1 MHz and edges too slow for the mode are
+refused, and it prints the old hand-worked 100 kHz value's timing next to the calculated one.
+Exits with 1 if any check fails.
+
+    cc -O2 -I../Send_Accel_Data/src -o i2c_timing_test i2c_timing_test.c ../Send_Accel_Data/src/i2c_timing.c
+    ./i2c_timing_test
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include "i2c_timing.h"
+
+typedef struct {
+    const char *name;
+    uint32_t max_hz;
+    double low, high, su_dat, vd_dat, rise, fall;       //ns
+} spec;
+
+static const spec specs[] = {
+    { "standard",  100000, 4700, 4000, 250, 3450, 1000, 300 },
+    { "fast",      400000, 1300,  600, 100,  900,  300, 300 },
+    { "fast plus", 1000000, 500,  260,  50,  450,  120, 120 },
+};
+
+typedef struct {
+    double hz_fast, hz_slow, low, high, setup, hold_min, valid_max;
+} bus_timing;
+
+static const spec *mode_for(uint32_t hz)
+{
+    for (unsigned i = 0; i < 3; i++)
+    {
+        if (hz <= specs[i].max_hz)
+        {
+            return &specs[i];
+        }
+    }
+    return 0;
+}
+
+static bus_timing timing_of(uint32_t timingr, uint32_t clock, double tr, double tf)
+{
+    //RM0394 I2C timing: each edge is seen after the rise or fall time, the analog filter and 2 to 3
+    //kernel clocks, then the peripheral counts SCLL + 1 or SCLH + 1 prescaled clocks
+    double tclk = 1e9 / clock;
+    double tp = ((timingr >> 28) + 1) * tclk;
+    double scll = (timingr & 0xFF) + 1, sclh = ((timingr >> 8) & 0xFF) + 1;
+    double sdadel = (timingr >> 16) & 0xF, scldel = ((timingr >> 20) & 0xF) + 1;
+    double sync_fast = I2C_AF_MIN_NS + 2 * tclk, sync_slow = I2C_AF_MAX_NS + 3 * tclk;
+    bus_timing b;
+
+    b.hz_fast = 1e9 / ((scll + sclh) * tp + tr + tf + 2 * sync_fast);
+    b.hz_slow = 1e9 / ((scll + sclh) * tp + tr + tf + 2 * sync_slow);
+    b.low = scll * tp + sync_fast;
+    b.high = sclh * tp + sync_fast;
+    b.setup = scldel * tp - tr;
+    b.hold_min = sdadel * tp + I2C_AF_MIN_NS + 3 * tclk - tf;
+    b.valid_max = sdadel * tp + I2C_AF_MAX_NS + 4 * tclk + tr;
+    return b;
+}
+
+static int check(uint32_t clock, uint32_t hz, uint32_t tr, uint32_t tf, int must_find, int verbose)
+{
+    const spec *s = mode_for(hz);
+    i2c_timing t;
+    bus_timing b;
+    int bad = 0;
+
+    if (i2c_timing_calc(clock, hz, tr, tf, &t) != 0)
+    {
+        if (must_find)
+        {
+            printf("%2u MHz %4u kHz tr %4u tf %3u: not found\n", clock / 1000000, hz / 1000, tr, tf);
+        }
+        return must_find;
+    }
+    b = timing_of(t.timingr, clock, tr, tf);
+    bad |= b.hz_fast > hz + 0.5 || b.hz_fast < hz * 0.9;
+    bad |= b.low < s->low || b.high < s->high || b.setup < s->su_dat;
+    bad |= b.hold_min < 0 || b.valid_max > s->vd_dat;
+    bad |= t.timingr != (((uint32_t)t.presc << 28) | ((uint32_t)t.scldel << 20) | ((uint32_t)t.sdadel << 16) |
+                         ((uint32_t)t.sclh << 8) | t.scll);
+    bad |= t.presc > 15 || t.scldel > 15 || t.sdadel > 15;
+    bad |= (uint32_t)(b.hz_fast + 0.5) + 1 < t.actual || (uint32_t)(b.hz_fast + 0.5) > t.actual + 1;
+    if (bad || verbose)
+    {
+        printf("%2u MHz %4u kHz tr %4u tf %3u: TIMINGR 0x%08X (PRESC %2u SCLDEL %2u SDADEL %u SCLH %3u SCLL %3u)"
+               " %6.1f-%6.1f kHz, tLOW %6.0f tHIGH %6.0f tSU;DAT %5.0f tHD;DAT >= %4.0f tVD;DAT <= %5.0f ns%s\n",
+               clock / 1000000, hz / 1000, tr, tf, t.timingr, t.presc, t.scldel, t.sdadel, t.sclh, t.scll,
+               b.hz_slow / 1000, b.hz_fast / 1000, b.low, b.high, b.setup, b.hold_min, b.valid_max,
+               bad ? "  OUT OF SPEC" : "");
+    }
+    return bad;
+}
+
+int main(void)
+{
+    static const uint32_t clocks[] = { 4000000, 8000000, 16000000, 24000000, 32000000, 48000000, 64000000, 80000000 };
+    static const uint32_t rates[] = { 100000, 400000, 1000000, 50000, 250000, 800000 };
+    int fails = 0;
+    uint32_t tried = 0, found = 0;
+    i2c_timing t;
+
+    printf("the settings the firmware can be built with:\n");
+    fails += check(80000000, 100000, 1000, 300, 1, 1);
+    fails += check(80000000, 400000, 300, 300, 1, 1);
+    fails += check(80000000, 1000000, 120, 120, 1, 1);
+    fails += check(16000000, 100000, 1000, 300, 1, 1);
+    fails += check(16000000, 400000, 300, 300, 1, 1);
+
+    for (unsigned c = 0; c < sizeof(clocks) / sizeof(clocks[0]); c++)
+    {
+        for (unsigned r = 0; r < sizeof(rates) / sizeof(rates[0]); r++)
+        {
+            const spec *s = mode_for(rates[r]);
+            for (uint32_t tr = 20; tr <= s->rise; tr += s->rise / 8)
+            {
+                for (uint32_t tf = 10; tf <= s->fall; tf += s->fall / 4)
+                {
+                    tried++;
+                    found += i2c_timing_calc(clocks[c], rates[r], tr, tf, &t) == 0;
+                    fails += check(clocks[c], rates[r], tr, tf, 0, 0);
+                }
+            }
+        }
+    }
+    printf("%u settings tried, %u found, all found within the specification unless listed above\n", tried, found);
+
+    //refused
+    if (i2c_timing_calc(80000000, 1000001, 100, 100, &t) == 0 || i2c_timing_calc(80000000, 400000, 301, 100, &t) == 0 ||
+        i2c_timing_calc(80000000, 1000000, 120, 121, &t) == 0 || i2c_timing_calc(4000000, 1000000, 120, 120, &t) == 0)
+    {
+        printf("a setting that cannot work was accepted\n");
+        fails++;
+    }
+
+    //the value initI2C() used to set, worked out by hand for 100 kHz at 80 MHz, against a 1000 ns rise time
+    bus_timing old = timing_of((7u << 28) + (4u << 20) + (2u << 16) + (49u << 8) + 49, 80000000, 1000, 300);
+    printf("old hand-worked TIMINGR 0x%08X: %.1f-%.1f kHz, tLOW %.0f tHIGH %.0f tSU;DAT %.0f ns%s\n",
+           (7u << 28) + (4u << 20) + (2u << 16) + (49u << 8) + 49, old.hz_slow / 1000, old.hz_fast / 1000,
+           old.low, old.high, old.setup, old.setup < specs[0].su_dat ? " - setup too short for a 1000 ns rise" : "");
+
+    if (fails)
+    {
+        printf("MISMATCH\n");
+        return 1;
+    }
+    return 0;
+}
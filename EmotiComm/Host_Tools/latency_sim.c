@@ -0,0 +1,123 @@
+/*
+Host check of the receiver's latency statistics (see latency_stats.h)
+
+Simulates the accelerometer stream with the two boards' clocks running at a fixed offset and a
+small rate difference. Samples are taken every period, sent in frames of 4, held up on the way by a
+random queueing delay (and occasionally a retransmission), then shown after a playback delay. The
+latencies the receiver works out with its offset estimate are compared with the true ones, which the
+simulation knows, and both are printed side by side. Dropped and reordered samples are injected and
+must show up as missing and late.
+
+    cc -O2 -I../Send_Accel_Data/src -o latency_sim latency_sim.c ../Send_Accel_Data/src/latency_stats.c -lm
+    ./latency_sim [clock difference ppm]
+Exits with 1 if the estimate is off by more than the allowance printed at the top.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include "host_tools.h"
+#include "latency_stats.h"
+
+#define SAMPLES       20000
+#define PERIOD_US     20000
+#define PER_FRAME     4
+#define WIRE_US       2000             //frame time on the wire
+#define PLAYBACK_US   (PER_FRAME * PERIOD_US)
+#define RETRY_US      50000            //extra delay of a retransmitted frame
+#define DROP_EVERY    997              //every n-th sample never arrives
+#define SWAP_EVERY    1499             //every n-th sample is shown after the one following it
+
+static uint32_t sorted[SAMPLES];
+
+static int compare(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+int main(int argc, char **argv)
+{
+    double ppm = argc > 1 ? atof(argv[1]) : 500;
+    uint32_t clock_offset = 0x9E3779B9;         //receiver clock - sender clock at t = 0, anything will do
+    //the offset is taken from the least held-up frame, so it reads a little high, plus drift over two windows
+    uint32_t allowance = 300 + (uint32_t)(fabs(ppm) * LAT_OFFSET_WINDOW_US * 2 / 1e6);
+    lat_stats l;
+    uint32_t state = 1, n = 0;
+    uint32_t missing = 0, late = 0;
+
+    printf("clock difference %.0f ppm, estimate allowed to be off by %u us\n", ppm, allowance);
+    lat_stats_init(&l);
+
+    for (uint32_t first = 0; first + PER_FRAME <= SAMPLES; first += PER_FRAME)
+    {
+        //true times in microseconds since start, sender clock runs (1 + ppm) times as fast
+        double capture[PER_FRAME], display[PER_FRAME];
+        double sent = (first + PER_FRAME - 1) * (double)PERIOD_US;
+        uint32_t r = rand_from(&state);
+        double held = r % 3000 + ((r >> 20) == 0 ? RETRY_US : 0);
+        double arrival = sent + WIRE_US + held;
+
+        for (int i = 0; i < PER_FRAME; i++)
+        {
+            capture[i] = (first + i) * (double)PERIOD_US;
+            display[i] = arrival + PLAYBACK_US - (PER_FRAME - 1 - i) * (double)PERIOD_US;
+        }
+        uint32_t newest = (uint32_t)(uint64_t)(capture[PER_FRAME - 1] * (1 + ppm / 1e6)) & LAT_STAMP_MASK;     //24 bits as sent
+        lat_stats_arrival(&l, newest, clock_offset + (uint32_t)arrival, WIRE_US);
+
+        int order[PER_FRAME] = { 0, 1, 2, 3 };
+        for (int i = 0; i + 1 < PER_FRAME; i++)
+        {
+            if ((first + i) % SWAP_EVERY == SWAP_EVERY - 1)
+            {
+                order[i] = i + 1;
+                order[i + 1] = i;
+                late++;
+            }
+        }
+        for (int k = 0; k < PER_FRAME; k++)
+        {
+            int i = order[k];
+            uint32_t seq = first + i;
+            if (seq % DROP_EVERY == DROP_EVERY - 1)
+            {
+                missing++;
+                continue;
+            }
+            uint32_t stamp = (uint32_t)(uint64_t)(capture[i] * (1 + ppm / 1e6)) & LAT_STAMP_MASK;
+            if (lat_stats_display(&l, (uint8_t)seq, stamp, clock_offset + (uint32_t)display[i]) >= 0)
+            {
+                sorted[n++] = (uint32_t)(display[i] - capture[i]);
+            }
+        }
+    }
+
+    qsort(sorted, n, sizeof(sorted[0]), compare);
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        sum += sorted[i];
+    }
+    uint32_t true_min = sorted[0], true_mean = sum / n, true_p99 = sorted[(n * 99 + 99) / 100 - 1], true_max = sorted[n - 1];
+    uint32_t p99 = lat_stats_percentile(&l, 990);
+
+    printf("%-10s %10s %10s\n", "", "true", "estimated");
+    printf("%-10s %10u %10u\n", "samples", n, l.count);
+    printf("%-10s %10u %10u\n", "min us", true_min, l.min);
+    printf("%-10s %10u %10u\n", "mean us", true_mean, lat_stats_mean(&l));
+    printf("%-10s %10u %10u   (histogram bucket top)\n", "p99 us", true_p99, p99);
+    printf("%-10s %10u %10u\n", "max us", true_max, l.max);
+    printf("%-10s %10u %10u\n", "missing", missing + late, l.missing);     //a reordered sample is missing until it turns up late
+    printf("%-10s %10u %10u\n", "late", late, l.late);
+
+    int bad = l.count != n || l.missing != missing + late || l.late != late ||
+              abs((int)(lat_stats_mean(&l) - true_mean)) > (int)allowance ||
+              abs((int)(l.max - true_max)) > (int)allowance ||
+              p99 + allowance < true_p99 || p99 > true_p99 + true_p99 / 8 + allowance;
+    if (bad)
+    {
+        printf("MISMATCH\n");
+    }
+    return bad;
+}
@@ -0,0 +1,219 @@
+/*
+Host check of the receive frame extractor (see link_rx.h)
+
+On the board DMA1 channel 5 writes every received byte into a circular ring. The frame extractor is
+fed from it at the idle line interrupt, at the half and full transfer interrupts, and whenever the
+turnaround check looks. So a frame can be split at any byte and across the end of the ring. Here a
+model of the ring is written the way DMA writes it, and link_rx_feed() is called with the writer's
+position, as receive_Poll() does.
+
+Two runs:
+  - every split: a stream of three frames, with garbage in front of, between and after them, is fed
+    in two calls cut at every offset, with the ring starting at every position so the cut and the
+    wrap fall everywhere
+  - a long run: frames of random length and content with random garbage between them, fed at every
+    frame end and half ring as the interrupts would and at random moments in between, while the main
+    loop takes the frames out as it does on the board
+The garbage has stray '[' bytes and ']' bytes that end nothing, but never a ']' after a stray '[',
+which would make a frame of its own. Every frame must come out of the pool exactly once, decode, and
+be the next one sent. Exits with 1 if any check fails.
+
+    cc -O2 -I../Send_Accel_Data/src -o link_rx_test link_rx_test.c ../Send_Accel_Data/src/link_rx.c ../Send_Accel_Data/src/frame_pool.c ../Send_Accel_Data/src/packet.c
+    ./link_rx_test
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "host_tools.h"
+#include "packet.h"
+#include "frame_pool.h"
+#include "link_rx.h"
+
+#define RING_SIZE    128                //LINK_RX_RING_SIZE in biDirectional_Trans.h
+#define LONG_FRAMES  200000
+#define MAX_GARBAGE  12
+
+static frame_pool pool;
+static link_rx rx;
+static uint8_t ring[RING_SIZE];
+static uint16_t head;                   //DMA's next write position
+static uint32_t expect, extracted, bad, wrong;
+
+static int garbage(uint8_t *out)
+{
+    //bytes between frames - a ']' only before any '['
+    int n = rand_next() % (MAX_GARBAGE + 1), opened = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        uint8_t b = rand_next() & 0xFF;
+        if (rand_next() % 6 == 0)
+        {
+            b = rand_next() % 2 ? PKT_START : PKT_END;
+        }
+        if (b == PKT_END && opened)
+        {
+            b = 0x55;
+        }
+        opened |= b == PKT_START;
+        out[i] = b;
+    }
+    return n;
+}
+
+static int make_frame(uint32_t id, uint8_t *out)
+{
+    uint8_t payload[PKT_MAX_PAYLOAD];
+    int len = 4 + rand_next() % (PKT_MAX_PAYLOAD - 4);
+
+    memcpy(payload, &id, 4);
+    for (int i = 4; i < len; i++)
+    {
+        //plenty of bytes that have to be stuffed
+        payload[i] = rand_next() % 4 == 0 ? PKT_START + rand_next() % 3 : rand_next() & 0xFF;
+    }
+    return packet_encode(PKT_TYPE_ACCEL_BATCH, PKT_ADDR_FIRST, id, payload, len, out, PKT_MAX_WIRE);
+}
+
+static void write_ring(const uint8_t *data, int len)
+{
+    //DMA1 channel 5 in circular mode
+    for (int i = 0; i < len; i++)
+    {
+        ring[head] = data[i];
+        head = (head + 1) % RING_SIZE;
+    }
+}
+
+static void feed(void)
+{
+    //receive_Poll(): the writer's position is RING_SIZE - CNDTR, which is RING_SIZE itself just before the reload
+    uint16_t at = head == 0 && rand_next() % 2 ? RING_SIZE : head;
+    link_rx_feed(&rx, ring, RING_SIZE, at, 0);
+}
+
+static void take_frames(void)
+{
+    //main loop: every waiting frame is decoded and has to be the next one sent
+    frame_slot *s;
+    packet pkt;
+    uint32_t id;
+
+    while ((s = frame_pool_borrow(&pool)) != 0)
+    {
+        extracted++;
+        if (packet_decode(s->data, s->len, &pkt) != 0 || pkt.len < 4)
+        {
+            bad++;
+        }
+        else
+        {
+            memcpy(&id, pkt.payload, 4);
+            wrong += id != expect;
+            expect = id + 1;
+        }
+        frame_pool_release(&pool, s);
+    }
+}
+
+static void restart(uint16_t at)
+{
+    //a fresh extractor with the ring starting at `at`, as if that much had already been received
+    frame_pool_init(&pool);
+    link_rx_init(&rx, &pool);
+    head = at;
+    rx.tail = at;
+}
+
+int main(void)
+{
+    uint8_t stream[3 * (PKT_MAX_WIRE + MAX_GARBAGE) + MAX_GARBAGE];
+    uint32_t splits = 0, split_fails = 0;
+    int fails = 0;
+
+    rand_seed(9);
+    //every split of a short stream, with the ring starting everywhere
+    for (int round = 0; round < 20; round++)
+    {
+        int len = 0;
+        uint32_t first = round * 3;
+
+        for (int f = 0; f < 3; f++)
+        {
+            len += garbage(&stream[len]);
+            len += make_frame(first + f, &stream[len]);
+        }
+        len += garbage(&stream[len]);
+        if (len >= RING_SIZE)
+        {
+            len = 0;                        //a full ring in one go looks empty, DMA would have run over it
+            round--;
+            continue;
+        }
+        for (int cut = 0; cut <= len; cut++)
+        {
+            for (uint16_t at = 0; at < RING_SIZE; at++)
+            {
+                uint32_t before = extracted, bad_before = bad, wrong_before = wrong;
+
+                restart(at);
+                expect = first;
+                write_ring(stream, cut);
+                feed();
+                write_ring(&stream[cut], len - cut);
+                feed();
+                take_frames();
+                splits++;
+                if (extracted - before != 3 || bad != bad_before || wrong != wrong_before || expect != first + 3)
+                {
+                    split_fails++;
+                }
+            }
+        }
+    }
+    printf("every split: %u cut and ring positions tried, %u lost or extracted twice\n", splits, split_fails);
+    fails += split_fails != 0;
+
+    //a long run fed as the interrupts would feed it
+    uint32_t feeds = 0;
+    restart(0);
+    extracted = bad = wrong = expect = 0;
+    for (uint32_t id = 0; id < LONG_FRAMES; id++)
+    {
+        uint8_t chunk[PKT_MAX_WIRE + MAX_GARBAGE];
+        int len = garbage(chunk);
+        len += make_frame(id, &chunk[len]);
+
+        for (int i = 0; i < len; i++)
+        {
+            write_ring(&chunk[i], 1);
+            //half and full transfer interrupts, and a turnaround check now and then
+            if (head % (RING_SIZE / 2) == 0 || rand_next() % 64 == 0)
+            {
+                feed();
+                feeds++;
+            }
+        }
+        feed();                             //idle line after the frame
+        feeds++;
+        if (rand_next() % 3 == 0)
+        {
+            take_frames();                  //the main loop is not always there straight away
+        }
+        if (frame_pool_waiting(&pool) >= FRAME_POOL_SLOTS - 1)
+        {
+            take_frames();
+        }
+    }
+    take_frames();
+    printf("long run: %u frames sent, %u extracted in %u feeds, %u bad, %u out of order, %u truncated by a stray '['\n",
+           LONG_FRAMES, extracted, feeds, bad, wrong, rx.truncated);
+    fails += extracted != LONG_FRAMES || bad || wrong || expect != LONG_FRAMES || pool.overflows || rx.too_long;
+
+    if (fails)
+    {
+        printf("MISMATCH\n");
+        return 1;
+    }
+    return 0;
+}
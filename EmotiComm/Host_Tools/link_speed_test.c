@@ -0,0 +1,253 @@
+/*
+Host check of the baud rate calculation and the link speed negotiation (see baud.h and link_speed.h)
+
+Baud rates: for every rate in LINK_RATES, for the debug port rates and for a few that need 8x
+oversampling, it runs baud_calc() at the 80 MHz kernel clock. It decodes the BRR value back into the
+rate the USART really runs at, and checks that:
+  - the rate and error the function reports are what BRR gives
+  - the error is within BAUD_MAX_ERROR_PPM and no other divider comes closer
+  - 16x oversampling is used unless only 8x can get there, and 8x only when it is allowed
+  - rates the USART cannot reach are refused
+It prints BRR, the oversampling and the error for each.
+
+Negotiation: the sender's and the receiver's state machines run against each other on a model of the
+link with a fake clock. A frame takes its length in byte times at the rate it was sent at, a rate
+change waits for the frame on the wire to finish, and a frame only arrives if both ends are at the
+same rate and the cable can carry it. Frames are dropped as each scenario says, including the
+acknowledgement of a step and every answer to DONE for long enough that the sender has to start again.
+For each scenario it checks that both ends finish, at the same rate, and at the rate expected. Then a
+frame sent at that rate must get through. Exits with 1 if any check fails.
+
+    cc -O2 -I../Send_Accel_Data/src -o link_speed_test link_speed_test.c ../Send_Accel_Data/src/baud.c ../Send_Accel_Data/src/link_speed.c
+    ./link_speed_test
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "packet.h"
+#include "baud.h"
+#include "link_speed.h"
+
+#define CLOCK        80000000           //LINK_CLOCK in biDirectional_Trans.h
+#define NUM_RATES    8
+#define STEP_US      100
+#define GIVE_UP_US   60000000
+#define MAX_WIRE     8
+
+static const uint32_t rates[NUM_RATES] = { 9600, 19200, 57600, 115200, 230400, 460800, 921600, 1000000 };    //LINK_RATES
+
+static int check_baud(uint32_t clock, uint32_t baud, int allow_over8, int expect_ok, int expect_over8)
+{
+    //returns 1 if baud_calc() gets it wrong
+    baud_setting s;
+    int ok = baud_calc(clock, baud, allow_over8, &s) == 0;
+    uint32_t usartdiv, best = 0;
+    double actual, best_err = 1e9;
+    int bad = ok != expect_ok;
+
+    if (!ok)
+    {
+        printf("%10u baud  %s: refused%s\n", baud, allow_over8 ? "16x/8x" : "16x   ", bad ? "  WRONG" : "");
+        return bad;
+    }
+    usartdiv = s.over8 ? (s.brr & 0xFFF0) | ((s.brr & 0x7) << 1) : s.brr;
+    actual = (s.over8 ? 2.0 * clock : (double)clock) / usartdiv;
+    bad |= s.over8 != expect_over8 || (s.over8 && !allow_over8) || usartdiv < 16;
+    bad |= (uint32_t)(actual + 0.5) != s.actual;
+    bad |= (actual - baud) * 1e6 / baud - s.error_ppm > 1 || (actual - baud) * 1e6 / baud - s.error_ppm < -1;
+    bad |= s.error_ppm > BAUD_MAX_ERROR_PPM || s.error_ppm < -BAUD_MAX_ERROR_PPM;
+    //no divider in the same mode is closer
+    for (uint32_t d = 16; d <= 0xFFFF; d++)
+    {
+        double e = (s.over8 ? 2.0 * clock : (double)clock) / d - baud;
+        e = e < 0 ? -e : e;
+        if (e < best_err)
+        {
+            best_err = e;
+            best = d;
+        }
+    }
+    bad |= best != usartdiv;
+    printf("%10u baud  %s: BRR 0x%04X OVER8 %u, %10.1f baud, %+6d ppm%s\n", baud, allow_over8 ? "16x/8x" : "16x   ",
+           s.brr, s.over8, actual, s.error_ppm, bad ? "  WRONG" : "");
+    return bad;
+}
+
+//the link: two ends and the frames on the wire between them
+typedef struct {
+    uint32_t rate, next_rate, switch_at;    //a rate change waits for the frame being sent
+    uint32_t busy_until;
+    uint8_t master;
+} link_end;
+
+typedef struct {
+    packet pkt;
+    uint32_t rate, arrive;
+    uint8_t to_master;
+} wire_frame;
+
+typedef struct {
+    const char *name;
+    uint32_t cable_max;                 //fastest rate the cable and transceivers carry
+    uint8_t from_master;                //1 = drop the master's frames, 0 = the slave's (ACCEPT, TEST_OK, DONE_ACK)
+    uint8_t op, index;                  //what is dropped, index 0xFF = any
+    uint16_t drops;                     //how many of them
+    uint32_t expect;                    //rate both ends should settle on
+} scenario;
+
+static link_end ends[2];
+static wire_frame wire[MAX_WIRE];
+static int wire_n;
+static uint32_t now;
+static scenario *sc;
+static uint32_t dropped, sent;
+
+static uint32_t rate_at(const link_end *e, uint32_t t)
+{
+    return (int32_t)(t - e->switch_at) >= 0 ? e->next_rate : e->rate;
+}
+
+static void send_frame(void *ctx, const uint8_t *payload, uint8_t len)
+{
+    link_end *e = ctx;
+    uint32_t start = (int32_t)(e->busy_until - now) > 0 ? e->busy_until : now;
+    uint32_t rate = rate_at(e, start);
+    wire_frame *f;
+
+    sent++;
+    e->busy_until = start + (uint32_t)((uint64_t)(len + PKT_HEADER_SIZE + PKT_CRC_SIZE + 2) * 10000000 / rate);
+    if (sc->drops && sc->from_master == e->master && payload[0] == sc->op &&
+        (sc->index == 0xFF || payload[1] == sc->index))
+    {
+        dropped++;
+        sc->drops--;
+        return;
+    }
+    if (wire_n == MAX_WIRE)
+    {
+        return;
+    }
+    f = &wire[wire_n++];
+    f->pkt.type = PKT_TYPE_SPEED;
+    f->pkt.flags = 0;
+    f->pkt.seq = 0;
+    f->pkt.addr = PKT_ADDR_FIRST;
+    f->pkt.len = len;
+    memcpy(f->pkt.payload, payload, len);
+    f->rate = rate;
+    f->arrive = e->busy_until;
+    f->to_master = !e->master;
+}
+
+static void set_rate(void *ctx, uint32_t baud)
+{
+    link_end *e = ctx;
+    e->rate = rate_at(e, now);
+    e->next_rate = baud;
+    e->switch_at = (int32_t)(e->busy_until - now) > 0 ? e->busy_until : now;
+}
+
+static int negotiate(scenario *s)
+{
+    //returns 1 if the scenario does not end as expected
+    static const link_speed_ops master_ops = { &ends[0], send_frame, set_rate };
+    static const link_speed_ops slave_ops = { &ends[1], send_frame, set_rate };
+    link_speed m, sl;
+    uint32_t done_at = 0;
+    int bad;
+
+    sc = s;
+    dropped = sent = 0;
+    wire_n = 0;
+    for (int i = 0; i < 2; i++)
+    {
+        ends[i].rate = ends[i].next_rate = rates[0];
+        ends[i].switch_at = ends[i].busy_until = 0;
+        ends[i].master = i == 0;
+    }
+    now = 0;
+    link_speed_slave_init(&sl, rates, NUM_RATES, CLOCK, &slave_ops, now);
+    link_speed_master_init(&m, rates, NUM_RATES, CLOCK, &master_ops, now);
+    for (now = 0; now < GIVE_UP_US; now += STEP_US)
+    {
+        for (int i = 0; i < wire_n; i++)
+        {
+            if ((int32_t)(now - wire[i].arrive) >= 0)
+            {
+                wire_frame f = wire[i];
+                link_end *to = &ends[f.to_master ? 0 : 1];
+                memmove(&wire[i], &wire[i + 1], (wire_n - i - 1) * sizeof(wire_frame));
+                wire_n--;
+                i--;
+                if (f.rate == rate_at(to, f.arrive) && f.rate <= s->cable_max)
+                {
+                    link_speed_input(f.to_master ? &m : &sl, &f.pkt, now);
+                }
+            }
+        }
+        link_speed_poll(&m, now);
+        link_speed_poll(&sl, now);
+        if (link_speed_done(&m) && link_speed_done(&sl) && wire_n == 0)
+        {
+            done_at = now;
+            break;
+        }
+    }
+
+    //a frame at the agreed rate gets through, and it counts as the master talking to the slave
+    uint32_t m_rate = rate_at(&ends[0], now), s_rate = rate_at(&ends[1], now);
+    packet data = { PKT_TYPE_ACCEL, 0, 0, PKT_ADDR_FIRST, 0, { 0 } };
+    if (m_rate == s_rate && m_rate <= s->cable_max)
+    {
+        link_speed_input(&sl, &data, now);
+    }
+    link_speed_poll(&sl, now + 1000000);
+
+    bad = !done_at || link_speed_rate(&m) != s->expect || link_speed_rate(&sl) != s->expect ||
+          m_rate != s->expect || s_rate != s->expect || rate_at(&ends[1], now + 1000000) != s->expect || s->drops;
+    printf("%-32s %7u baud after %5.2f s, %3u frames sent, %u dropped%s\n", s->name, link_speed_rate(&m),
+           done_at / 1e6, sent, dropped, bad ? "  WRONG" : "");
+    return bad;
+}
+
+int main(void)
+{
+    static scenario scenarios[] = {
+        { "clean, cable takes everything",  1000000, 0, 0,                 0,    0, 1000000 },
+        { "cable tops out at 230400",        230400, 0, 0,                 0,    0,  230400 },
+        { "TEST_OK for 115200 lost",        1000000, 0, SPEED_OP_TEST_OK,  3,    1,   57600 },
+        { "ACCEPT for 19200 lost",          1000000, 0, SPEED_OP_ACCEPT,   1,    1,    9600 },
+        { "ACCEPT for 57600 lost",          1000000, 0, SPEED_OP_ACCEPT,   2,    1,   19200 },
+        { "TEST for 230400 lost",           1000000, 1, SPEED_OP_TEST,     4,    1,  115200 },
+        { "two DONE_ACKs lost",             1000000, 0, SPEED_OP_DONE_ACK, 0xFF, 2, 1000000 },
+        { "every DONE_ACK lost, restart",    460800, 0, SPEED_OP_DONE_ACK, 0xFF, 5,  460800 },
+        { "first PROPOSE lost",             1000000, 1, SPEED_OP_PROPOSE,  1,    1,    9600 },
+    };
+    int fails = 0;
+
+    printf("baud rates at %u MHz:\n", CLOCK / 1000000);
+    for (int i = 0; i < NUM_RATES; i++)
+    {
+        fails += check_baud(CLOCK, rates[i], 1, 1, 0);
+    }
+    fails += check_baud(CLOCK, 2000000, 1, 1, 0);           //debug port
+    fails += check_baud(CLOCK, 8000000, 1, 1, 1);           //16x cannot go above 5 Mbaud
+    fails += check_baud(CLOCK, 8000000, 0, 0, 0);           //and 8x is not allowed
+    fails += check_baud(CLOCK, 6000000, 1, 0, 0);           //8x gets within 1.2%, not close enough
+    fails += check_baud(CLOCK, 12000000, 1, 0, 0);          //too fast for either
+    fails += check_baud(CLOCK, 1200, 1, 0, 0);              //divider too big for BRR
+    fails += check_baud(16000000, 2000000, 1, 1, 1);        //at 16 MHz 8x is needed sooner
+
+    printf("\nnegotiation:\n");
+    for (unsigned i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+    {
+        fails += negotiate(&scenarios[i]);
+    }
+
+    if (fails)
+    {
+        printf("MISMATCH\n");
+        return 1;
+    }
+    return 0;
+}
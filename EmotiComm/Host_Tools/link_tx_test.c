@@ -0,0 +1,273 @@
+/*
+Host check of the DMA transmit path and driver enable handling (see link_tx.h and biDirectional_Trans.c)
+
+A model of USART1 and DMA1 channel 4 stands in for the hardware, one step per bit time. USART1 has
+TDR and a shift register that takes 10 bit times a byte. TC is set once the last stop bit has gone
+and TDR is empty. DMA moves the next byte into TDR as soon as it empties. The driver functions and the
+two interrupt handlers do what hw_start(), hw_set_driver(), DMA1_Channel4_IRQHandler() and
+transceiver_USART1_IRQ() do on the board. That means reloading the channel, clearing TC, turning
+TCIE on at the DMA transfer-complete interrupt and calling link_tx_done() from TC. Each interrupt is
+taken after a random latency of up to INT_LATENCY bit times.
+
+The main loop queues frames at random moments, often several back to back while one is still going out,
+and sometimes more than the queue holds. It checks that:
+  - the bytes on the wire are the queued frames, whole, in the order they were queued, each exactly once
+  - DE is on for every bit of every byte, including across frames sent back to back
+  - DE is only released once the last stop bit of the last frame has left, and the bus is released once
+    the queue is empty
+  - frames are refused only when the queue is full
+It prints the frames sent, how long DE stayed on after the last stop bit, and the gap between frames
+sent back to back. Exits with 1 if any check fails.
+
+    cc -O2 -I../Send_Accel_Data/src -o link_tx_test link_tx_test.c ../Send_Accel_Data/src/link_tx.c ../Send_Accel_Data/src/packet.c
+    ./link_tx_test
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "host_tools.h"
+#include "packet.h"
+#include "link_tx.h"
+
+#define RUN_BITS     20000000           //length of the run in bit times
+#define INT_LATENCY  30                 //most bit times an interrupt waits to be taken
+#define WIRE_SIZE    (RUN_BITS / 10 + PKT_MAX_WIRE)
+#define MAX_FRAMES   400000
+
+typedef struct {
+    //USART1
+    uint8_t tdr, tdr_full;
+    uint8_t shift;
+    int shift_bits;                     //bit times left of the byte in the shift register, 0 = idle
+    int tc, tcie;
+    //DMA1 channel 4
+    const uint8_t *cmar;
+    uint16_t cndtr;
+    int enabled, tcif;
+    //interrupts waiting to be taken, 0 = none
+    uint32_t dma_irq_at, usart_irq_at;
+    int de;                             //driver enable pin
+} mock_hw;
+
+static mock_hw hw;
+static link_tx tx;
+static uint32_t now;
+static uint8_t wire[WIRE_SIZE];
+static uint32_t wire_len, last_stop;    //bit time the last stop bit ended
+static uint32_t unsent_bits, early_release, hold_max, released;
+static uint16_t queued_len[MAX_FRAMES];
+static uint32_t queued_n;
+
+//driver functions, as hw_set_driver() and hw_start() in biDirectional_Trans.c
+static void drv_set_driver(void *p, int transmit)
+{
+    (void)p;
+    if (!transmit)
+    {
+        //DE goes low here - nothing may be left in TDR, the shift register or the DMA channel
+        if (hw.shift_bits || hw.tdr_full || hw.cndtr || now < last_stop)
+        {
+            early_release++;
+        }
+        if (now - last_stop > hold_max)
+        {
+            hold_max = now - last_stop;
+        }
+        released++;
+    }
+    hw.de = transmit;
+}
+static void drv_start(void *p, const uint8_t *data, uint16_t len)
+{
+    (void)p;
+    hw.enabled = 0;
+    hw.cmar = data;
+    hw.cndtr = len;
+    hw.tc = 0;                          //ICR TCCF
+    hw.enabled = 1;
+}
+static uint32_t drv_lock(void *p)
+{
+    (void)p;
+    return 0;
+}
+static void drv_unlock(void *p, uint32_t s)
+{
+    (void)p;
+    (void)s;
+}
+
+static const link_tx_driver driver = { 0, drv_set_driver, drv_start, drv_lock, drv_unlock, 0 };
+
+static void step(void)
+{
+    //one bit time of USART1 and DMA1 channel 4, then whatever interrupt is due
+    if (hw.shift_bits)
+    {
+        unsent_bits += !hw.de;
+        if (--hw.shift_bits == 0)
+        {
+            wire[wire_len++] = hw.shift;
+            last_stop = now + 1;
+            if (!hw.tdr_full)
+            {
+                hw.tc = 1;
+            }
+        }
+    }
+    if (!hw.shift_bits && hw.tdr_full)
+    {
+        hw.shift = hw.tdr;
+        hw.shift_bits = 10;
+        hw.tdr_full = 0;
+    }
+    if (hw.enabled && hw.cndtr && !hw.tdr_full)
+    {
+        hw.tdr = *hw.cmar++;
+        hw.tdr_full = 1;
+        if (--hw.cndtr == 0)
+        {
+            hw.tcif = 1;
+            hw.dma_irq_at = now + 1 + rand_next() % INT_LATENCY;
+        }
+    }
+
+    //DMA1_Channel4_IRQHandler()
+    if (hw.dma_irq_at && now >= hw.dma_irq_at)
+    {
+        hw.dma_irq_at = 0;
+        if (hw.tcif)
+        {
+            hw.tcif = 0;
+            hw.enabled = 0;
+            hw.tcie = 1;
+        }
+    }
+    //transceiver_USART1_IRQ()
+    if (hw.tcie && hw.tc && !hw.usart_irq_at)
+    {
+        hw.usart_irq_at = now + 1 + rand_next() % INT_LATENCY;
+    }
+    if (hw.usart_irq_at && now >= hw.usart_irq_at)
+    {
+        hw.usart_irq_at = 0;
+        if (hw.tcie && hw.tc)
+        {
+            hw.tcie = 0;
+            hw.tc = 0;
+            link_tx_done(&tx);
+        }
+    }
+}
+
+static int make_frame(uint32_t id, uint8_t *out)
+{
+    uint8_t payload[PKT_MAX_PAYLOAD];
+    int len = 4 + rand_next() % (PKT_MAX_PAYLOAD - 4);
+
+    memcpy(payload, &id, 4);
+    for (int i = 4; i < len; i++)
+    {
+        payload[i] = id * 7 + i;
+    }
+    return packet_encode(PKT_TYPE_ACCEL, PKT_ADDR_FIRST, id, payload, len, out, PKT_MAX_WIRE);
+}
+
+int main(void)
+{
+    uint32_t next = 0, refused = 0, refused_not_full = 0, bad = 0, order = 0, sent = 0;
+    uint32_t gap_max = 0, gap_start = 0, in_gap = 0;
+    int burst = 0;
+
+    rand_seed(3);
+    link_tx_init(&tx, &driver);
+    for (now = 0; now < RUN_BITS || link_tx_busy(&tx) || hw.usart_irq_at; now++)
+    {
+        step();
+
+        //main loop: now and then a burst of frames queued one after the other
+        if (now < RUN_BITS && queued_n < MAX_FRAMES && now >= next)
+        {
+            uint8_t frame[PKT_MAX_WIRE];
+            int len = make_frame(queued_n, frame);
+            int was_full = tx.queue[LINK_TX_DATA].count == LINK_TX_QUEUE_LEN;
+
+            if (link_tx_queue(&tx, frame, len) == 0)
+            {
+                queued_len[queued_n++] = len;
+            }
+            else
+            {
+                refused++;
+                refused_not_full += !was_full;
+            }
+            if (burst == 0)
+            {
+                burst = 1 + rand_next() % (LINK_TX_QUEUE_LEN + 4);
+                next = now + rand_next() % 8000;
+            }
+            else
+            {
+                burst--;
+                next = now + rand_next() % 3;
+            }
+        }
+
+        //gaps on the wire while DE is held between frames
+        if (hw.de && !hw.shift_bits)
+        {
+            if (!in_gap)
+            {
+                in_gap = 1;
+                gap_start = now;
+            }
+        }
+        else if (in_gap)
+        {
+            in_gap = 0;
+            if (hw.de && now - gap_start > gap_max)
+            {
+                gap_max = now - gap_start;
+            }
+        }
+    }
+
+    //read the wire back frame by frame
+    for (uint32_t pos = 0; pos < wire_len;)
+    {
+        packet pkt;
+        uint32_t id;
+        uint32_t end = pos + 1;
+
+        while (end < wire_len && wire[end] != PKT_END)
+        {
+            end++;
+        }
+        if (wire[pos] != PKT_START || end >= wire_len || packet_decode(&wire[pos + 1], end - pos - 1, &pkt) != 0)
+        {
+            bad++;
+            break;
+        }
+        memcpy(&id, pkt.payload, 4);
+        if (id != sent || end + 1 - pos != queued_len[id])
+        {
+            order++;
+        }
+        sent++;
+        pos = end + 1;
+    }
+
+    printf("%u frames queued, %u sent, %u bytes, %u refused with the queue full\n", queued_n, sent, wire_len, refused);
+    printf("DE released %u times, at most %u bit times after the last stop bit, longest gap between frames %u bit times\n",
+           released, hold_max, gap_max);
+    printf("%u bits sent without DE, %u early releases, %u out of order, %u bad frames\n",
+           unsent_bits, early_release, order, bad);
+
+    if (bad || order || unsent_bits || early_release || sent != queued_n || tx.frames_sent != queued_n ||
+        refused != tx.full || refused_not_full || hw.de || refused == 0)
+    {
+        printf("MISMATCH\n");
+        return 1;
+    }
+    return 0;
+}
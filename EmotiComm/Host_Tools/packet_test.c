@@ -0,0 +1,186 @@
+/*
+Host check of the binary link frame (see packet.h)
+
+For every payload length from 0 to PKT_MAX_PAYLOAD it encodes payloads of random bytes, of nothing but
+'[', ']' and PKT_ESC (every byte stuffed) and of a mix, with random type, poll flag, sequence number and
+address, and decodes the body back. It checks that:
+  - the frame starts with '[' and ends with ']' and neither appears anywhere in between
+  - the decoded type, flags, seq, addr, len and payload are what went in
+  - the longest frame fits PKT_MAX_WIRE, an output buffer one byte too small is refused, and so is a
+    payload longer than PKT_MAX_PAYLOAD
+  - any single bit flipped in the frame body is rejected, and so is every body cut short
+Then it sends readings one per frame the way the sensor board does, through batch_tx_take() with its
+capture stamp, and prints the bytes a sample takes on the wire next to the old "[X=%d,Y=%d,Z=%d]" text
+message, for a board lying still and for readings over the whole +/-2 g range. Each of those frames
+must unpack back to the reading that went in. Exits with 1 if any check fails.
+
+    cc -O2 -I../Send_Accel_Data/src -o packet_test packet_test.c ../Send_Accel_Data/src/packet.c ../Send_Accel_Data/src/batch.c ../Send_Accel_Data/src/delta_codec.c
+    ./packet_test
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "host_tools.h"
+#include "packet.h"
+#include "batch.h"
+
+#define ROUNDS 200                      //payloads of each kind per length
+#define READING_US 2500                 //400 Hz, the sensor board's output data rate
+
+
+static int is_special(uint8_t b)
+{
+    return b == PKT_START || b == PKT_END || b == PKT_ESC;
+}
+
+static int round_trip(const uint8_t *payload, uint8_t len)
+{
+    //returns the number of failed checks
+    static const uint8_t stuffed[] = { PKT_START, PKT_END, PKT_ESC };
+    uint8_t wire[PKT_MAX_WIRE];
+    uint8_t type = (1 + rand_next() % PKT_TYPE_MASK) | (rand_next() % 2 ? PKT_FLAG_POLL : 0);
+    uint8_t seq = rand_next() & 0xFF, addr = rand_next() % 3 ? PKT_ADDR_FIRST + rand_next() % 8 : stuffed[rand_next() % 3];
+    int fails = 0;
+    packet pkt;
+
+    int n = packet_encode(type, addr, seq, payload, len, wire, sizeof(wire));
+    if (n < 2 + PKT_HEADER_SIZE + len + PKT_CRC_SIZE || wire[0] != PKT_START || wire[n - 1] != PKT_END)
+    {
+        return 1;
+    }
+    for (int i = 1; i < n - 1; i++)
+    {
+        fails += wire[i] == PKT_START || wire[i] == PKT_END;
+    }
+    if (packet_decode(wire + 1, n - 2, &pkt) != 0 || pkt.type != (type & PKT_TYPE_MASK) ||
+        pkt.flags != (type & PKT_FLAG_POLL) || pkt.seq != seq || pkt.addr != addr || pkt.len != len ||
+        memcmp(pkt.payload, payload, len) != 0)
+    {
+        fails++;
+    }
+
+    //an output buffer one byte short of the frame is refused
+    uint8_t small[PKT_MAX_WIRE];
+    fails += packet_encode(type, addr, seq, payload, len, small, n - 1) != -1;
+
+    //every bit flipped in the body, as long as it leaves the stuffing alone so one bit of the
+    //unstuffed body changes
+    for (int i = 1; i < n - 1; i++)
+    {
+        if (wire[i] == PKT_ESC || wire[i - 1] == PKT_ESC)
+        {
+            continue;
+        }
+        for (int bit = 0; bit < 8; bit++)
+        {
+            uint8_t keep = wire[i];
+            wire[i] ^= 1 << bit;
+            if (!is_special(wire[i]) && packet_decode(wire + 1, n - 2, &pkt) == 0)
+            {
+                fails++;
+            }
+            wire[i] = keep;
+        }
+    }
+
+    //every body cut short
+    for (int cut = 0; cut < n - 2; cut++)
+    {
+        fails += packet_decode(wire + 1, cut, &pkt) == 0;
+    }
+    return fails;
+}
+
+static int compare(const char *name, int16_t x0, int16_t y0, int16_t z0, int spread)
+{
+    //bytes on the wire per sample for readings spread around (x0, y0, z0), sent one per frame as the
+    //sensor board does and as the old text, returns the number of frames that did not unpack to their reading
+    uint8_t payload[PKT_MAX_PAYLOAD];
+    uint8_t wire[PKT_MAX_WIRE];
+    char text[64];
+    uint32_t binary = 0, binary_max = 0, old = 0, old_max = 0;
+    uint32_t now = rand_next();
+    batch_tx tx;
+    batch_rx rx;
+    batch_sample out;
+    packet pkt;
+    int fails = 0;
+
+    batch_tx_init(&tx, 1, 0);
+    batch_rx_init(&rx);
+    for (int i = 0; i < 10000; i++)
+    {
+        int16_t x = x0 + (int)(rand_next() % (2 * spread + 1)) - spread;
+        int16_t y = y0 + (int)(rand_next() % (2 * spread + 1)) - spread;
+        int16_t z = z0 + (int)(rand_next() % (2 * spread + 1)) - spread;
+        uint8_t type;
+        int len;
+        uint32_t b;
+        now += READING_US;
+        batch_tx_add(&tx, x, y, z, now);
+        len = batch_tx_take(&tx, &type, payload);
+        b = packet_encode(type, PKT_ADDR_FIRST, i & 0xFF, payload, len, wire, sizeof(wire));
+        if (packet_decode(wire + 1, b - 2, &pkt) != 0 || batch_rx_unpack(&rx, &pkt, now) != 1 ||
+            batch_rx_next(&rx, now, &out) != 0 || out.x != x || out.y != y || out.z != z)
+        {
+            fails++;
+        }
+        //the old message sent cm/s^2, X_g = x * 981 / 16384
+        uint32_t t = snprintf(text, sizeof(text), "[X=%d,Y=%d,Z=%d]", x * 981 / 16384, y * 981 / 16384, z * 981 / 16384);
+        binary += b;
+        old += t;
+        binary_max = b > binary_max ? b : binary_max;
+        old_max = t > old_max ? t : old_max;
+    }
+    printf("%-22s binary %5.2f bytes/sample (worst %2u), text %5.2f (worst %2u)\n",
+           name, binary / 10000.0, binary_max, old / 10000.0, old_max);
+    return fails;
+}
+
+int main(void)
+{
+    static const uint8_t stuffed[] = { PKT_START, PKT_END, PKT_ESC };
+    uint8_t payload[PKT_MAX_PAYLOAD + 1];
+    uint8_t wire[PKT_MAX_WIRE];
+    int fails = 0;
+
+    rand_seed(5);
+    for (int len = 0; len <= PKT_MAX_PAYLOAD; len++)
+    {
+        for (int r = 0; r < ROUNDS; r++)
+        {
+            for (int kind = 0; kind < 3; kind++)
+            {
+                for (int i = 0; i < len; i++)
+                {
+                    payload[i] = kind == 0 ? rand_next() & 0xFF : kind == 1 ? stuffed[rand_next() % 3] :
+                                 rand_next() % 2 ? stuffed[rand_next() % 3] : rand_next() & 0xFF;
+                }
+                fails += round_trip(payload, len);
+            }
+        }
+    }
+    printf("%d payload lengths, %d frames round-tripped with every bit error and cut checked\n",
+           PKT_MAX_PAYLOAD + 1, (PKT_MAX_PAYLOAD + 1) * ROUNDS * 3);
+
+    //the longest frame there can be fits PKT_MAX_WIRE - only the type, len and CRC bytes may go unstuffed -
+    //and a payload too long is refused
+    memset(payload, PKT_ESC, sizeof(payload));
+    int longest = packet_encode(PKT_TYPE_ACCEL_BATCH, PKT_ESC, PKT_ESC, payload, PKT_MAX_PAYLOAD, wire, sizeof(wire));
+    if (longest < PKT_MAX_WIRE - 4 || longest > PKT_MAX_WIRE ||
+        packet_encode(PKT_TYPE_ACCEL_BATCH, 1, 0, payload, PKT_MAX_PAYLOAD + 1, wire, sizeof(wire)) != -1)
+    {
+        printf("worst case frame size or over-long payload not handled\n");
+        fails++;
+    }
+
+    fails += compare("lying still", 0, 0, 16384, 40);
+    fails += compare("whole +/-2 g range", 0, 0, 0, 32767);
+
+    if (fails)
+    {
+        printf("MISMATCH: %d checks failed\n", fails);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,311 @@
+/*
+Host benchmark and stress run for the SPSC ring (see spsc_ring.h)
+
+The first part times pushing and popping bytes through the ring against the circular_buffer it replaced,
+copied below as it was (modulo index, shared count and the '-' written into every slot read). Each run
+fills the buffer half way and drains it again, which is what the receive path did per frame.
+
+The second part runs a producer and a consumer thread on one ring for a few seconds. The producer writes
+an incrementing counter using single pushes and bulk spans of random length, the consumer reads it back the
+same way and checks that no value is lost, repeated or out of order.
+
+    cc -O2 -pthread -I../Send_Accel_Data/src -o ring_bench ring_bench.c
+    ./ring_bench [stress seconds]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include "host_tools.h"
+#include "spsc_ring.h"
+
+#define BENCH_BYTES   (64u * 1000000u)
+#define BLOCK         64                //bytes pushed before draining, half of the old CIRC_BUF_SIZE
+
+//---- the old circular_buffer, kept out of line as it was in its own file ----
+#define CIRC_BUF_SIZE 128
+typedef struct {
+    char data[CIRC_BUF_SIZE];
+    uint32_t head;
+    uint32_t tail;
+    uint32_t count;
+} circular_buffer;
+
+__attribute__((noinline)) static void init_circ_buf(circular_buffer *buf)
+{
+    buf->head = 0;
+    buf->tail = 0;
+    buf->count = 0;
+}
+
+__attribute__((noinline)) static int put_circ_buf(circular_buffer *buf, char c)
+{
+    uint32_t new_head;
+    if (buf->count < CIRC_BUF_SIZE)
+    {
+        new_head = ((buf->head) + 1) % CIRC_BUF_SIZE;
+        buf->data[buf->head] = c;
+        buf->head = new_head;
+        buf->count++;
+        return 0;
+    }
+    return -1;
+}
+
+__attribute__((noinline)) static int get_circ_buf(circular_buffer *buf, char *c)
+{
+    uint32_t new_tail;
+    if (buf->count > 0)
+    {
+        new_tail = ((buf->tail) + 1) % CIRC_BUF_SIZE;
+        *c = buf->data[buf->tail];
+        buf->data[buf->tail] = '-';
+        buf->tail = new_tail;
+        buf->count--;
+        return 0;
+    }
+    return -1;
+}
+
+SPSC_RING(byte_ring, char, 128)
+SPSC_RING(word_ring, uint32_t, 256)
+
+static volatile uint32_t sink;          //keeps the compiler from dropping the reads
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void report(const char *name, double seconds, double base)
+{
+    double ns = seconds * 1e9 / BENCH_BYTES;
+    printf("%-28s %6.2f ns/byte", name, ns);
+    if (base > 0)
+    {
+        printf("   %5.2fx", base / seconds);
+    }
+    printf("\n");
+}
+
+static double bench_circ(void)
+{
+    static circular_buffer buf;
+    uint32_t sum = 0;
+    char c;
+    init_circ_buf(&buf);
+    double t = now_s();
+    for (uint32_t n = 0; n < BENCH_BYTES; n += BLOCK)
+    {
+        for (int i = 0; i < BLOCK; i++)
+        {
+            put_circ_buf(&buf, (char)(n + i));
+        }
+        while (get_circ_buf(&buf, &c) == 0)
+        {
+            sum += (uint8_t)c;
+        }
+    }
+    t = now_s() - t;
+    sink = sum;
+    return t;
+}
+
+static double bench_ring(void)
+{
+    static byte_ring ring;
+    uint32_t sum = 0;
+    char c;
+    byte_ring_init(&ring);
+    double t = now_s();
+    for (uint32_t n = 0; n < BENCH_BYTES; n += BLOCK)
+    {
+        for (int i = 0; i < BLOCK; i++)
+        {
+            byte_ring_push(&ring, (char)(n + i));
+        }
+        while (byte_ring_pop(&ring, &c) == 0)
+        {
+            sum += (uint8_t)c;
+        }
+    }
+    t = now_s() - t;
+    sink = sum;
+    return t;
+}
+
+static double bench_ring_bulk(void)
+{
+    static byte_ring ring;
+    char in[BLOCK], out[BLOCK];
+    uint32_t sum = 0;
+    for (int i = 0; i < BLOCK; i++)
+    {
+        in[i] = (char)i;
+    }
+    byte_ring_init(&ring);
+    double t = now_s();
+    for (uint32_t n = 0; n < BENCH_BYTES; n += BLOCK)
+    {
+        in[0] = (char)n;
+        byte_ring_push_bulk(&ring, in, BLOCK);
+        uint32_t got = byte_ring_pop_bulk(&ring, out, BLOCK);
+        sum += (uint8_t)out[0] + got;
+    }
+    t = now_s() - t;
+    sink = sum;
+    return t;
+}
+
+static double bench_ring_span(void)
+{
+    //consumer works on the bytes where they lie, as the frame extractor does on the DMA ring
+    static byte_ring ring;
+    uint32_t sum = 0;
+    byte_ring_init(&ring);
+    double t = now_s();
+    for (uint32_t n = 0; n < BENCH_BYTES; n += BLOCK)
+    {
+        char *span;
+        uint32_t len = byte_ring_push_span(&ring, &span);
+        if (len > BLOCK)
+        {
+            len = BLOCK;
+        }
+        for (uint32_t i = 0; i < len; i++)
+        {
+            span[i] = (char)(n + i);
+        }
+        byte_ring_push_commit(&ring, len);
+        while ((len = byte_ring_pop_span(&ring, &span)) > 0)
+        {
+            for (uint32_t i = 0; i < len; i++)
+            {
+                sum += (uint8_t)span[i];
+            }
+            byte_ring_pop_commit(&ring, len);
+        }
+    }
+    t = now_s() - t;
+    sink = sum;
+    return t;
+}
+
+//---- two thread stress run ----
+static word_ring shared;
+static int stop;                        //set by main, read with __atomic by both threads
+static uint64_t produced, consumed, errors;
+
+static void *producer(void *arg)
+{
+    uint32_t state = 1, next = 0;
+    uint32_t block[64];
+    (void)arg;
+    while (!__atomic_load_n(&stop, __ATOMIC_ACQUIRE))
+    {
+        if (rand_from(&state) & 1)
+        {
+            if (word_ring_push(&shared, next) == 0)
+            {
+                next++;
+            }
+            else
+            {
+                sched_yield();          //full - let the consumer run if both share a core
+            }
+            continue;
+        }
+        uint32_t n = 1 + rand_from(&state) % 64;
+        for (uint32_t i = 0; i < n; i++)
+        {
+            block[i] = next + i;
+        }
+        next += word_ring_push_bulk(&shared, block, n);
+    }
+    produced = next;
+    return 0;
+}
+
+static void *consumer(void *arg)
+{
+    uint32_t state = 2, expect = 0;
+    uint32_t block[64];
+    (void)arg;
+    for (;;)
+    {
+        uint32_t n = 0, v, *span;
+        switch (rand_from(&state) % 3)
+        {
+        case 0:
+            if (word_ring_pop(&shared, &v) == 0)
+            {
+                block[n++] = v;
+            }
+            break;
+        case 1:
+            n = word_ring_pop_bulk(&shared, block, 1 + rand_from(&state) % 64);
+            break;
+        default:
+            n = word_ring_pop_span(&shared, &span);
+            if (n > 64)
+            {
+                n = 64;
+            }
+            for (uint32_t i = 0; i < n; i++)
+            {
+                block[i] = span[i];
+            }
+            word_ring_pop_commit(&shared, n);
+            break;
+        }
+        for (uint32_t i = 0; i < n; i++)
+        {
+            if (block[i] != expect)
+            {
+                errors++;
+                expect = block[i];
+            }
+            expect++;
+        }
+        if (n == 0)
+        {
+            if (__atomic_load_n(&stop, __ATOMIC_ACQUIRE) && word_ring_count(&shared) == 0)
+            {
+                break;
+            }
+            sched_yield();
+        }
+    }
+    consumed = expect;
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int seconds = argc > 1 ? atoi(argv[1]) : 3;
+
+    printf("push %u bytes in blocks of %u, then drain\n", BENCH_BYTES, BLOCK);
+    double base = bench_circ();
+    report("circular_buffer put/get", base, 0);
+    report("spsc_ring push/pop", bench_ring(), base);
+    report("spsc_ring push/pop bulk", bench_ring_bulk(), base);
+    report("spsc_ring spans in place", bench_ring_span(), base);
+
+    printf("\nstress: producer and consumer threads for %d s\n", seconds);
+    pthread_t p, c;
+    word_ring_init(&shared);
+    pthread_create(&c, 0, consumer, 0);
+    pthread_create(&p, 0, producer, 0);
+    struct timespec ts = { seconds, 0 };
+    nanosleep(&ts, 0);
+    __atomic_store_n(&stop, 1, __ATOMIC_RELEASE);
+    pthread_join(p, 0);
+    pthread_join(c, 0);
+    printf("%llu values produced, %llu consumed, %llu out of sequence\n",
+           (unsigned long long)produced, (unsigned long long)consumed, (unsigned long long)errors);
+    return (errors == 0 && produced == consumed) ? 0 : 1;
+}
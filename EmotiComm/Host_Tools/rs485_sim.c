@@ -0,0 +1,536 @@
+/*
+Host simulation of the whole RS-485 link, byte by byte, for a sweep of baud rates and bit error rates
+
+Both boards run their own link code against a model of the half-duplex pair: the transmit queue (link_tx)
+with a mock driver standing in for USART1 and its DMA, the receive ring and frame extractor (link_rx and
+frame_pool) fed the way the DMA and idle line interrupts feed them, packet_decode() and the sliding window
+(arq_tx on the sensor board, arq_rx and its acks on the receiver).
+
+The pair is modelled as:
+  - every byte takes 10 bit times, a frame goes out as one burst and back to back frames keep the bus
+  - a board that takes the bus drives it for DE_BITS bit times (LINK_DE_ASSERT_TIME) plus the extra
+    turnaround before its first start bit, and for as long again after its last stop bit
+  - a board hears nothing while it drives the bus (RE is tied to DE)
+  - each bit is flipped at the bit error rate: a flipped start or stop bit is a framing error and the
+    byte is garbled, a flipped data bit changes the byte
+  - bytes are dropped at the given rate, as an overrun would
+  - a byte heard while the other board was driving the bus is garbled and counted as a collision
+Each board holds a frame until the pair has been quiet for its turnaround gap (turnaround.h), the way the
+firmware does from the receive ring and the USART BUSY flag, and starts it once the gap has passed. Before
+every run the two boards calibrate the gap over the simulated pair, the result is the "gap" column.
+The sensor board always has a sample frame ready, so the window is kept full and the run measures the
+most the protocol can carry. The receiver's main loop stops for LCD_US every LCD_EVERY_US, as when the
+display is redrawn, so its receive queue has to ride out the gap.
+
+For every rate the program prints the goodput (payload bytes delivered per second, and as a share of the
+raw line rate), the capture-to-delivery latency percentiles, the retransmit rate and the error counts: bytes garbled by a collision, framing errors,
+frames that failed to decode and frames lost to a full receive queue.
+Every frame carries a running number, its capture time and a pattern made from the number, so the run
+checks that frames come out in order with no repeats and unaltered, and that every frame queued was
+delivered or counted as given up on, and that no board took the bus while the other one's bytes were
+already on the wire. Two boards can still collide if both take an idle bus within the DE lead time, that
+shows up in the collision count. Exits with 1 if any check fails.
+
+    cc -O2 -I../Send_Accel_Data/src -o rs485_sim rs485_sim.c ../Send_Accel_Data/src/link_tx.c ../Send_Accel_Data/src/link_rx.c ../Send_Accel_Data/src/frame_pool.c ../Send_Accel_Data/src/arq.c ../Send_Accel_Data/src/packet.c ../Send_Accel_Data/src/turnaround.c
+    ./rs485_sim [bytes dropped per million] [extra turnaround us]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "host_tools.h"
+#include "packet.h"
+#include "arq.h"
+#include "link_tx.h"
+#include "link_rx.h"
+#include "frame_pool.h"
+#include "turnaround.h"
+
+#define RING_SIZE     128               //LINK_RX_RING_SIZE
+#define DE_BITS       1                 //LINK_DE_ASSERT_TIME / 16
+#define WINDOW        8                 //ARQ_WINDOW
+#define TIMEOUT_US    50000             //ARQ_TIMEOUT_US
+#define PAYLOAD       36                //running number, capture time and pattern - about a batch frame
+#define LOOP_US       100               //one pass of either main loop when there is nothing to draw
+#define LCD_EVERY_US  100000
+#define LCD_US        10000
+#define RUN_US        10000000
+#define DRAIN_US      3000000           //time after the last frame is queued for the window to empty
+#define STEP_NS       1000
+#define MAX_LATENCY   (1 << 20)
+#define CAL_US        5000000           //longest the gap calibration may take before the run
+
+typedef struct {
+    link_tx tx;
+    link_tx_driver drv;
+    link_rx rx;
+    frame_pool pool;
+    uint8_t ring[RING_SIZE];
+    uint16_t head;                      //next ring index DMA writes
+    int idle_due;                       //bytes have arrived since the last idle line
+
+    //bus driver
+    int de;                             //1 while driving the bus
+    uint64_t de_on, de_off;             //when the driver was taken, when it lets go (ns)
+    const uint8_t *out;
+    uint16_t out_len, out_i;
+    uint64_t byte_start, byte_end;
+    int sending;
+
+    //turnaround gap
+    turn_guard guard;
+    turn_ops ops;
+    turn_cal cal;
+    uint32_t last_heard;                //micros() at the end of the last byte heard
+    uint64_t wake_at;                   //when a held frame may go, 0 if none is held (ns)
+
+    uint64_t busy_until;                //main loop is busy until then
+    uint32_t framing, collisions, lost_bytes, bad_frames;
+    uint32_t barged;                    //took the bus in the middle of a byte from the other board
+} board;
+
+typedef struct {
+    uint32_t queued, delivered, in_run, undelivered, errors;
+    uint32_t n_latency;
+} result;
+
+static board sensor, hub;
+static uint32_t link_baud;
+static arq_tx arq;
+static arq_rx arq_in;
+static uint64_t now, bit_ns, byte_ns, turn_ns;
+static uint32_t byte_hit;               //per 2^24, chance a byte has at least one bit flipped
+static uint32_t byte_drop;              //per million
+static uint32_t expect;
+static uint32_t latency[MAX_LATENCY];
+static result res;
+
+static uint32_t micros_now(void)
+{
+    return (uint32_t)(now / 1000);
+}
+
+//mock USART1/DMA driver for link_tx
+static void drv_set_driver(void *hw, int transmit)
+{
+    board *b = hw;
+    const board *other = b == &sensor ? &hub : &sensor;
+    if (transmit)
+    {
+        if (other->sending && now >= other->byte_start)
+        {
+            b->barged++;                //drv_clear() should have held the frame
+        }
+        b->de = 1;
+        b->de_on = now;
+    }
+    else
+    {
+        b->de = 0;
+        b->de_off = now + turn_ns;      //DE is held for the deassertion time after the last stop bit
+    }
+}
+static void drv_start(void *hw, const uint8_t *data, uint16_t len)
+{
+    board *b = hw;
+    b->out = data;
+    b->out_len = len;
+    b->out_i = 0;
+    b->byte_start = now > b->de_on + turn_ns ? now : b->de_on + turn_ns;
+    b->byte_end = b->byte_start + byte_ns;
+    b->sending = 1;
+}
+static int drv_clear(void *hw)
+{
+    //1 once the other board has been quiet for the gap, BUSY stands for a byte coming in right now
+    board *b = hw;
+    const board *other = b == &sensor ? &hub : &sensor;
+    uint32_t wait;
+
+    if (other->sending && now >= other->byte_start && !b->de && b->de_off <= now)
+    {
+        b->last_heard = micros_now();
+    }
+    wait = turn_guard_wait(&b->guard, b->last_heard, micros_now());
+    if (wait > 0)
+    {
+        b->wake_at = now + wait * 1000ull;      //TIM2 alarm
+        return 0;
+    }
+    return 1;
+}
+static uint32_t drv_lock(void *hw)
+{
+    (void)hw;
+    return 0;
+}
+static void drv_unlock(void *hw, uint32_t state)
+{
+    (void)hw;
+    (void)state;
+}
+
+static int drove(const board *b, uint64_t from, uint64_t to)
+{
+    //1 if b had the bus at any time between from and to
+    return (b->de && b->de_on < to) || b->de_off > from;
+}
+
+static void feed(board *b)
+{
+    link_rx_feed(&b->rx, b->ring, RING_SIZE, b->head, micros_now());
+}
+
+static void hear(board *to, const board *from, uint8_t c)
+{
+    //one byte has finished on the wire, `to` receives it unless it is driving the bus itself
+    if (to->de || to->de_off > now)
+    {
+        return;
+    }
+    if (drove(to, from->byte_start, from->byte_end))
+    {
+        to->collisions++;
+        c = rand_next();
+    }
+    else if (rand_next() % 1000000 < byte_drop)
+    {
+        to->lost_bytes++;
+        return;
+    }
+    else if (rand_next() < byte_hit)
+    {
+        int bit = rand_next() % 10;
+        if (bit == 0 || bit == 9)
+        {
+            to->framing++;              //start or stop bit, the USART resyncs on whatever comes next
+            c = rand_next();
+        }
+        else
+        {
+            c ^= 1 << (bit - 1);
+        }
+    }
+    to->last_heard = micros_now();
+    to->ring[to->head] = c;
+    to->head = (to->head + 1) % RING_SIZE;
+    to->idle_due = 1;
+    if (to->head == RING_SIZE / 2 || to->head == 0)
+    {
+        feed(to);                       //half transfer / transfer complete
+    }
+}
+
+static void wire(board *b, board *other)
+{
+    if (b->sending && now >= b->byte_end)
+    {
+        hear(other, b, b->out[b->out_i]);
+        if (++b->out_i < b->out_len)
+        {
+            b->byte_start = b->byte_end;
+            b->byte_end += byte_ns;
+        }
+        else
+        {
+            b->sending = 0;
+            link_tx_done(&b->tx);       //TC interrupt
+        }
+    }
+    if (b->idle_due && !other->sending && now >= other->byte_end + byte_ns)
+    {
+        b->idle_due = 0;
+        feed(b);                        //idle line
+    }
+}
+
+static int emit(void *ctx, const uint8_t *frame, uint16_t len)
+{
+    board *b = ctx;
+    return link_tx_queue(&b->tx, frame, len);
+}
+
+static void make_sample(uint8_t *payload, uint32_t id)
+{
+    uint32_t stamp = micros_now();
+    memcpy(payload, &id, 4);
+    memcpy(payload + 4, &stamp, 4);
+    for (int i = 8; i < PAYLOAD; i++)
+    {
+        payload[i] = (uint8_t)(id * 31 + i);
+    }
+}
+
+static void sensor_loop(void)
+{
+    frame_slot *f;
+    packet pkt;
+    uint8_t payload[PAYLOAD];
+
+    while ((f = frame_pool_borrow(&sensor.pool)) != 0)
+    {
+        if (packet_decode(f->data, f->len, &pkt) == 0)
+        {
+            arq_tx_ack(&arq, &pkt, f->time);
+        }
+        else
+        {
+            sensor.bad_frames++;
+        }
+        frame_pool_release(&sensor.pool, f);
+    }
+    while (now < (uint64_t)RUN_US * 1000 && arq_tx_space(&arq) > 0)
+    {
+        make_sample(payload, res.queued);
+        arq_tx_queue(&arq, PKT_TYPE_ACCEL_BATCH, payload, PAYLOAD);
+        res.queued++;
+    }
+    arq_tx_burst(&arq, micros_now(), emit, &sensor);
+}
+
+static void hub_loop(void)
+{
+    frame_slot *f;
+    packet pkt;
+
+    while ((f = frame_pool_borrow(&hub.pool)) != 0)
+    {
+        if (packet_decode(f->data, f->len, &pkt) != 0)
+        {
+            hub.bad_frames++;
+        }
+        else if (arq_rx_accept(&arq_in, &pkt))
+        {
+            uint8_t ack[PKT_MAX_WIRE];
+            int len = arq_rx_ack(&arq_in, PKT_ADDR_FIRST, 0, ack, sizeof(ack));
+            link_tx_queue_class(&hub.tx, LINK_TX_CONTROL, ack, len);
+        }
+        frame_pool_release(&hub.pool, f);
+    }
+    while (arq_rx_pop(&arq_in, &pkt) == 0)
+    {
+        uint32_t id, stamp;
+        memcpy(&id, pkt.payload, 4);
+        memcpy(&stamp, pkt.payload + 4, 4);
+        for (int i = 8; i < PAYLOAD; i++)
+        {
+            if (pkt.len != PAYLOAD || pkt.payload[i] != (uint8_t)(id * 31 + i))
+            {
+                res.errors++;           //got through the checksum altered
+                break;
+            }
+        }
+        if (id < expect)
+        {
+            res.errors++;               //repeated or out of order
+            continue;
+        }
+        res.undelivered += id - expect;
+        expect = id + 1;
+        res.delivered++;
+        if (now <= (uint64_t)RUN_US * 1000)
+        {
+            res.in_run++;
+        }
+        if (res.n_latency < MAX_LATENCY)
+        {
+            latency[res.n_latency++] = micros_now() - stamp;
+        }
+    }
+}
+
+static void cal_send(void *ctx, const uint8_t *payload, uint8_t len)
+{
+    board *b = ctx;
+    uint8_t frame[PKT_MAX_WIRE];
+    int frame_len = packet_encode(PKT_TYPE_TURN, b == &sensor ? PKT_ADDR_FIRST : PKT_ADDR_ALL, 0, payload, len, frame, sizeof(frame));
+    link_tx_queue_class(&b->tx, LINK_TX_CONTROL, frame, frame_len);
+}
+
+static void cal_set_gap(void *ctx, uint8_t gap_bits)
+{
+    board *b = ctx;
+    turn_guard_set_gap(&b->guard, gap_bits, link_baud);
+}
+
+static void cal_loop(board *b)
+{
+    frame_slot *f;
+    packet pkt;
+
+    while ((f = frame_pool_borrow(&b->pool)) != 0)
+    {
+        if (packet_decode(f->data, f->len, &pkt) == 0)
+        {
+            turn_cal_input(&b->cal, &pkt, micros_now());
+        }
+        frame_pool_release(&b->pool, f);
+    }
+    turn_cal_poll(&b->cal, micros_now());
+}
+
+static void board_init(board *b, uint8_t gap_bits)
+{
+    memset(b, 0, sizeof(*b));
+    b->drv.hw = b;
+    b->drv.set_driver = drv_set_driver;
+    b->drv.start = drv_start;
+    b->drv.lock = drv_lock;
+    b->drv.unlock = drv_unlock;
+    b->drv.clear = drv_clear;
+    link_tx_init(&b->tx, &b->drv);
+    frame_pool_init(&b->pool);
+    link_rx_init(&b->rx, &b->pool);
+    turn_guard_init(&b->guard, gap_bits, DE_BITS * 16, DE_BITS * 16, link_baud);
+    b->ops.ctx = b;
+    b->ops.send = cal_send;
+    b->ops.set_gap = cal_set_gap;
+}
+
+static void step(board *b, board *other)
+{
+    wire(b, other);
+    if (b->wake_at && now >= b->wake_at)
+    {
+        b->wake_at = 0;
+        link_tx_poll(&b->tx);
+    }
+}
+
+static uint8_t calibrate(void)
+{
+    //start-up calibration over the same pair, returns the gap the boards settled on
+    now = 0;
+    board_init(&sensor, TURN_MAX_BITS);
+    board_init(&hub, TURN_MAX_BITS);
+    turn_cal_master_init(&sensor.cal, &sensor.ops, 0);
+    turn_cal_slave_init(&hub.cal, &hub.ops);
+    for (; now < (uint64_t)CAL_US * 1000 && !turn_cal_done(&sensor.cal); now += STEP_NS)
+    {
+        step(&sensor, &hub);
+        step(&hub, &sensor);
+        if (now >= sensor.busy_until)
+        {
+            cal_loop(&sensor);
+            sensor.busy_until = now + LOOP_US * 1000;
+        }
+        if (now >= hub.busy_until)
+        {
+            cal_loop(&hub);
+            hub.busy_until = now + LOOP_US * 1000;
+        }
+    }
+    if (!turn_cal_done(&sensor.cal) || sensor.cal.configured != hub.cal.configured)
+    {
+        return TURN_MAX_BITS;                       //as the firmware does when it gives up
+    }
+    return sensor.cal.configured;
+}
+
+static uint8_t run(uint32_t baud, double ber, uint32_t extra_us)
+{
+    double clean = 1.0;
+    uint8_t gap;
+    uint64_t next_lcd = (uint64_t)LCD_EVERY_US * 1000;
+
+    for (int i = 0; i < 10; i++)
+    {
+        clean *= 1.0 - ber;
+    }
+    byte_hit = (uint32_t)((1.0 - clean) * (1 << 24));
+    bit_ns = 1000000000ull / baud;
+    byte_ns = 10 * bit_ns;
+    turn_ns = DE_BITS * bit_ns + extra_us * 1000ull;
+    link_baud = baud;
+    rand_seed(1);
+    gap = calibrate();
+    board_init(&sensor, gap);
+    board_init(&hub, gap);
+    arq_tx_init(&arq, PKT_ADDR_FIRST, WINDOW, TIMEOUT_US, (10000000 + baud - 1) / baud);
+    arq_rx_init(&arq_in, 0);
+    memset(&res, 0, sizeof(res));
+    expect = 0;
+
+    for (now = 0; now < (uint64_t)(RUN_US + DRAIN_US) * 1000; now += STEP_NS)
+    {
+        step(&sensor, &hub);
+        step(&hub, &sensor);
+        if (now >= sensor.busy_until)
+        {
+            sensor_loop();
+            sensor.busy_until = now + LOOP_US * 1000;
+        }
+        if (now >= hub.busy_until)
+        {
+            hub_loop();
+            if (now >= next_lcd)
+            {
+                hub.busy_until = now + LCD_US * 1000;
+                next_lcd += LCD_EVERY_US * 1000;
+            }
+            else
+            {
+                hub.busy_until = now + LOOP_US * 1000;
+            }
+        }
+    }
+    res.undelivered += res.queued - expect;
+    if (arq.base != arq.next_seq || res.undelivered > arq.dropped)
+    {
+        res.errors++;
+    }
+    return gap;
+}
+
+static int by_value(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile_ms(uint32_t per_mille)
+{
+    if (res.n_latency == 0)
+    {
+        return 0;
+    }
+    return latency[(uint64_t)(res.n_latency - 1) * per_mille / 1000] / 1000.0;
+}
+
+int main(int argc, char **argv)
+{
+    static const uint32_t bauds[] = { 9600, 19200, 57600, 115200, 230400, 460800, 921600, 1000000 };     //LINK_RATES
+    static const double bers[] = { 0, 1e-6, 1e-5, 1e-4, 1e-3 };
+    uint32_t extra_us;
+    int failed = 0;
+
+    byte_drop = argc > 1 ? atoi(argv[1]) : 0;
+    extra_us = argc > 2 ? atoi(argv[2]) : 0;
+    printf("%d frame window, %d byte payload, %u bytes per million dropped, %u us extra turnaround, receiver busy %d ms every %d ms\n",
+           WINDOW, PAYLOAD, byte_drop, extra_us, LCD_US / 1000, LCD_EVERY_US / 1000);
+    printf("%8s %7s %4s %9s %6s %8s %8s %8s %8s %8s %8s %8s %8s %6s %6s\n", "baud", "BER", "gap", "goodput", "line",
+           "p50 ms", "p99 ms", "max ms", "resent", "timeouts", "dropped", "collide", "framing", "bad", "full");
+    for (unsigned i = 0; i < sizeof(bauds) / sizeof(bauds[0]); i++)
+    {
+        for (unsigned j = 0; j < sizeof(bers) / sizeof(bers[0]); j++)
+        {
+            double goodput;
+            uint8_t gap = run(bauds[i], bers[j], extra_us);
+            qsort(latency, res.n_latency, sizeof(latency[0]), by_value);
+            goodput = (double)res.in_run * PAYLOAD / (RUN_US / 1e6);
+            res.errors += sensor.barged + hub.barged;
+            printf("%8u %7.0e %4u %7.0f/s %5.1f%% %8.1f %8.1f %8.1f %7.1f%% %8u %8u %8u %8u %6u %6u",
+                   bauds[i], bers[j], gap, goodput, goodput * 1000 / bauds[i], percentile_ms(500), percentile_ms(990),
+                   percentile_ms(1000), arq.frames_sent ? arq.retransmits * 100.0 / arq.frames_sent : 0.0,
+                   arq.timeouts, arq.dropped, sensor.collisions + hub.collisions, sensor.framing + hub.framing, sensor.bad_frames + hub.bad_frames,
+                   sensor.pool.overflows + hub.pool.overflows);
+            if (res.errors)
+            {
+                printf("   MISMATCH: %u bad, %u undelivered", res.errors, res.undelivered);
+                failed = 1;
+            }
+            printf("\n");
+        }
+    }
+    return failed;
+}
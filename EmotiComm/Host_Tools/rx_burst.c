@@ -0,0 +1,94 @@
+/*
+Host simulation of the receive queue under bursts (see frame_pool.h and link_rx.h)
+
+Frames are fed byte by byte through the same extractor and slot pool the boards use, while the main loop
+is "busy" (e.g. redrawing the LCD) for a given number of frame times before it drains the queue. For each
+busy time it prints how many frames were delivered, how many were lost because the queue was full, and
+the deepest the queue got. Every delivered frame is decoded and checked to be in order, and delivered plus
+lost must equal sent, so the program exits with 1 if any frame goes missing without being counted.
+
+    cc -O2 -I../Send_Accel_Data/src -o rx_burst rx_burst.c ../Send_Accel_Data/src/link_rx.c ../Send_Accel_Data/src/frame_pool.c ../Send_Accel_Data/src/packet.c
+    ./rx_burst [frames per burst]
+
+Another queue depth can be tried by adding -DFRAME_POOL_SLOTS=8 to the cc line.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "packet.h"
+#include "frame_pool.h"
+#include "link_rx.h"
+
+#define BURSTS 100
+
+static frame_pool pool;
+static link_rx rx;
+
+static int run(int burst, int busy, uint32_t *delivered, uint32_t *lost, int *deepest)
+{
+    //sends BURSTS bursts of `burst` frames, the main loop only gets to the queue every `busy` frame times
+    //returns the number of frames that were delivered out of order or failed to decode
+    uint8_t payload[PKT_ACCEL_PAYLOAD];
+    uint8_t wire[PKT_MAX_WIRE];
+    uint8_t seq = 0, expect = 0;
+    int errors = 0;
+    packet pkt;
+
+    frame_pool_init(&pool);
+    link_rx_init(&rx, &pool);
+    *delivered = 0;
+    for (int b = 0; b < BURSTS; b++)
+    {
+        for (int f = 0; f < burst; f++)
+        {
+            int len;
+            packet_put_accel(payload, f, -f, 1000);
+            len = packet_encode(PKT_TYPE_ACCEL, PKT_ADDR_FIRST, seq++, payload, PKT_ACCEL_PAYLOAD, wire, sizeof(wire));
+            for (int i = 0; i < len; i++)
+            {
+                link_rx_byte(&rx, wire[i]);
+            }
+            if ((f + 1) % busy == 0 || f == burst - 1)
+            {
+                frame_slot *s;
+                while ((s = frame_pool_borrow(&pool)) != 0)
+                {
+                    if (packet_decode(s->data, s->len, &pkt) != 0 || (int8_t)(pkt.seq - expect) < 0)
+                    {
+                        errors++;
+                    }
+                    expect = pkt.seq + 1;
+                    (*delivered)++;
+                    frame_pool_release(&pool, s);
+                }
+            }
+        }
+    }
+    *lost = pool.overflows + rx.too_long;
+    *deepest = pool.high_water;
+    return errors;
+}
+
+int main(int argc, char **argv)
+{
+    int burst = argc > 1 ? atoi(argv[1]) : 8;
+    int failed = 0;
+
+    printf("queue depth %d, %d bursts of %d frames\n", FRAME_POOL_SLOTS, BURSTS, burst);
+    printf("%-22s %10s %10s %8s\n", "main loop busy for", "delivered", "lost", "deepest");
+    for (int busy = 1; busy <= burst; busy++)
+    {
+        uint32_t delivered, lost;
+        int deepest;
+        int errors = run(burst, busy, &delivered, &lost, &deepest);
+        uint32_t sent = (uint32_t)BURSTS * burst;
+        printf("%3d frame times         %10u %10u %8d", busy, delivered, lost, deepest);
+        if (errors || delivered + lost != sent)
+        {
+            printf("   MISMATCH: %d bad, %u unaccounted", errors, sent - delivered - lost);
+            failed = 1;
+        }
+        printf("\n");
+    }
+    return failed;
+}
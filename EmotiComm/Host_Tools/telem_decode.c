@@ -0,0 +1,198 @@
+/*
+Decoder for the sender's binary capture on USART2 (see telemetry.h)
+
+Reads a capture - the raw bytes logged from the serial port after "capture on" - and writes one CSV line
+per record: seq, time in us, x, y, z. The start of a record is found by its two sync bytes and a record
+is only used if its CRC matches, so the decoder picks the stream up again after anything that is not a
+record (text sent before the switch, a garbled byte). Missing sequence numbers are counted as lost
+samples. The totals go to stderr.
+
+With --test it checks itself against the firmware's own encoder instead. Samples are pushed through
+telem_push() with a mock DMA driver that takes as long as USART2 would, at a rate the port can carry and
+at one it cannot, and the stream is garbled in a few places on the way. The run checks that every record
+that arrives intact is decoded with the values that were pushed, that every garbled one is rejected,
+and that the missing sequence numbers add up to the samples dropped plus the records garbled. Exits with
+1 if any check fails.
+
+    cc -O2 -I../Send_Accel_Data/src -o telem_decode telem_decode.c ../Send_Accel_Data/src/telemetry.c ../Send_Accel_Data/src/packet.c
+    ./telem_decode capture.bin > capture.csv
+    ./telem_decode --test
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "telemetry.h"
+
+typedef struct {
+    uint8_t buf[TELEM_RECORD_SIZE];
+    int n;
+    int started;                        //a record has been seen, so seq can be checked
+    uint16_t expect;                    //seq of the next record
+    uint32_t records, lost, rejected;
+} telem_reader;
+
+static void reader_init(telem_reader *rd)
+{
+    memset(rd, 0, sizeof(*rd));
+}
+
+static int reader_byte(telem_reader *rd, uint8_t c, telem_record *r)
+{
+    //adds one byte, returns 1 when it completes a good record
+    rd->buf[rd->n++] = c;
+    if ((rd->n == 1 && c != TELEM_SYNC0) || (rd->n == 2 && c != TELEM_SYNC1))
+    {
+        rd->n = c == TELEM_SYNC0 ? (rd->buf[0] = c, 1) : 0;
+        return 0;
+    }
+    if (rd->n < TELEM_RECORD_SIZE)
+    {
+        return 0;
+    }
+    if (telem_decode(rd->buf, r) != 0)
+    {
+        //not a record after all, look for the next start inside the bytes already taken
+        uint8_t rest[TELEM_RECORD_SIZE - 1];
+        int found = 0;
+        rd->rejected++;
+        memcpy(rest, rd->buf + 1, sizeof(rest));
+        rd->n = 0;
+        for (unsigned i = 0; i < sizeof(rest); i++)
+        {
+            found |= reader_byte(rd, rest[i], r);
+        }
+        return found;
+    }
+    rd->n = 0;
+    if (rd->started)
+    {
+        rd->lost += (uint16_t)(r->seq - rd->expect);
+    }
+    rd->started = 1;
+    rd->expect = r->seq + 1;
+    rd->records++;
+    return 1;
+}
+
+static int decode_file(FILE *in)
+{
+    telem_reader rd;
+    telem_record r;
+    int c;
+
+    reader_init(&rd);
+    printf("seq,time_us,x,y,z\n");
+    while ((c = fgetc(in)) != EOF)
+    {
+        if (reader_byte(&rd, c, &r))
+        {
+            printf("%u,%u,%d,%d,%d\n", r.seq, r.time, r.x, r.y, r.z);
+        }
+    }
+    fprintf(stderr, "%u records, %u samples missing, %u bad records skipped\n", rd.records, rd.lost, rd.rejected);
+    return 0;
+}
+
+//--test: the firmware encoder behind a mock DMA driver that sends at the USART2 rate
+#define TEST_SAMPLES 20000
+#define WIRE_SIZE    (TEST_SAMPLES * TELEM_RECORD_SIZE + 4096)
+
+static uint8_t wire[WIRE_SIZE];
+static uint32_t wire_len;
+static uint64_t now_ns, done_at, byte_ns;
+static telem t;
+
+static void mock_start(void *hw, const uint8_t *data, uint16_t len)
+{
+    (void)hw;
+    memcpy(&wire[wire_len], data, len);
+    wire_len += len;
+    done_at = now_ns + len * byte_ns;
+}
+
+static const telem_driver mock = { 0, mock_start };
+
+static int16_t axis(uint32_t seq, int k)
+{
+    return (int16_t)(seq * (7 + k) - 16000 * k);
+}
+
+static int run_test(uint32_t baud, uint32_t rate_hz)
+{
+    uint32_t sample_ns = 1000000000u / rate_hz;
+    uint32_t garbled = 0, bad = 0;
+    telem_reader rd;
+    telem_record r;
+
+    byte_ns = 10000000000ull / baud;
+    telem_init(&t, &mock);
+    wire_len = 0;
+    done_at = 0;
+    memcpy(wire, "Reading X axis...\n", 18);         //text sent before the switch
+    wire_len = 18;
+    for (uint32_t i = 0; i < TEST_SAMPLES; i++)
+    {
+        now_ns = (uint64_t)i * sample_ns;
+        if (t.busy && now_ns >= done_at)
+        {
+            telem_done(&t);                         //DMA transfer complete interrupt
+        }
+        telem_push(&t, i * (sample_ns / 1000), axis(i, 0), axis(i, 1), axis(i, 2));
+        telem_flush(&t);
+    }
+    telem_done(&t);
+    telem_flush(&t);
+
+    //garble one byte of every 997th record that made it out, from the second one on
+    for (uint32_t pos = 18 + TELEM_RECORD_SIZE + 5; pos < wire_len; pos += 997 * TELEM_RECORD_SIZE)
+    {
+        wire[pos] ^= 0x10;
+        garbled++;
+    }
+
+    reader_init(&rd);
+    for (uint32_t i = 0; i < wire_len; i++)
+    {
+        if (reader_byte(&rd, wire[i], &r))
+        {
+            uint32_t seq = r.seq;
+            if (r.x != axis(seq, 0) || r.y != axis(seq, 1) || r.z != axis(seq, 2) || r.time != seq * (sample_ns / 1000))
+            {
+                bad++;
+            }
+        }
+    }
+    printf("%7u baud, %5u Hz: %5u pushed, %5u sent, %5u dropped, %3u garbled -> %5u decoded, %5u missing, %3u rejected",
+           baud, rate_hz, TEST_SAMPLES, t.records, t.dropped, garbled, rd.records, rd.lost, rd.rejected);
+    //samples dropped after the last record that arrived leave no gap behind them
+    if (bad || rd.records != t.records - garbled || rd.lost + (uint16_t)(TEST_SAMPLES - rd.expect) != t.dropped + garbled ||
+        rd.rejected < garbled)
+    {
+        printf("   MISMATCH\n");
+        return 1;
+    }
+    printf("\n");
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    FILE *in;
+    int failed = 0;
+
+    if (argc > 1 && strcmp(argv[1], "--test") == 0)
+    {
+        failed |= run_test(921600, 1600);          //CAPTURE_BAUD has room for the fastest data rate
+        failed |= run_test(115200, 1600);          //too slow, whole records are dropped and show up as gaps
+        failed |= run_test(9600, 100);
+        return failed;
+    }
+    in = argc > 1 ? fopen(argv[1], "rb") : stdin;
+    if (in == 0)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    return decode_file(in);
+}
@@ -0,0 +1,222 @@
+/*
+Host check of the transmit queue's two classes (see link_tx.h)
+
+The main loop queues sensor data frames (as sendMessage() and the sliding window do) while an interrupt
+queues control frames at random moments, often while a data frame is half way out, as EXTI1_IRQHandler
+does with [PONG]/[EXIT]. A mock driver plays the part of the DMA and the TC interrupt: it takes as many
+byte times as the frame is long and writes the bytes to a simulated wire.
+
+The wire is then read back frame by frame and checked:
+  - every frame is whole and unaltered, no frame starts before the last one has finished
+  - control frames go out in the order they were queued, and so do data frames
+  - a control frame goes out at the first frame boundary after it was queued, ahead of every data frame
+    still waiting then
+The program prints the frames of each class, how often a control frame overtook waiting data, and the
+longest wait of a control frame in byte times. It exits with 1 if any check fails.
+
+    cc -O2 -I../Send_Accel_Data/src -o tx_sched_sim tx_sched_sim.c ../Send_Accel_Data/src/link_tx.c ../Send_Accel_Data/src/packet.c
+    ./tx_sched_sim
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "host_tools.h"
+#include "packet.h"
+#include "link_tx.h"
+
+#define RUN_BYTES    2000000        //length of the run in byte times
+#define DATA_EVERY   40             //main loop queues a data frame every 1 to 2x this many byte times
+#define CONTROL_EVERY 700           //interrupt fires every 1 to 2x this many byte times
+#define WIRE_SIZE    (RUN_BYTES + PKT_MAX_WIRE)
+#define MAX_FRAMES   200000
+
+typedef struct {
+    uint8_t cls;
+    uint32_t id;                    //counts the frames of each class
+    uint32_t time;                  //byte time it was queued, or started on the wire
+} frame_log;
+
+static uint8_t wire[WIRE_SIZE];
+static uint32_t wire_len;
+static uint32_t now, done_at;
+static int sending, driving, overlapped;
+static frame_log sent[MAX_FRAMES], queued[MAX_FRAMES];
+static uint32_t started[MAX_FRAMES];
+static uint32_t sent_n, queued_n, started_n;
+
+static void mock_set_driver(void *hw, int transmit)
+{
+    (void)hw;
+    driving = transmit;
+}
+
+static void mock_start(void *hw, const uint8_t *data, uint16_t len)
+{
+    (void)hw;
+    if (sending || !driving)
+    {
+        overlapped++;               //a frame started on top of another or without the bus
+    }
+    sending = 1;
+    if (started_n < MAX_FRAMES)
+    {
+        started[started_n++] = now;
+    }
+    memcpy(&wire[wire_len], data, len);
+    wire_len += len;
+    done_at = now + len;
+}
+
+static uint32_t mock_lock(void *hw)
+{
+    (void)hw;
+    return 0;
+}
+
+static void mock_unlock(void *hw, uint32_t s)
+{
+    (void)hw;
+    (void)s;
+}
+
+static const link_tx_driver mock = { 0, mock_set_driver, mock_start, mock_lock, mock_unlock, 0 };
+
+static int make_frame(uint8_t cls, uint32_t id, uint8_t *out)
+{
+    //a data frame carries a batch sized payload, a control frame a short one, both say what they are
+    uint8_t payload[PKT_MAX_PAYLOAD];
+    int len = cls == LINK_TX_CONTROL ? 4 : 8 + rand_next() % (PKT_MAX_PAYLOAD - 8);
+
+    memset(payload, 0, len);
+    memcpy(payload, &id, 4);
+    for (int i = 4; i < len; i++)
+    {
+        payload[i] = id * 31 + i;
+    }
+    return packet_encode(cls == LINK_TX_CONTROL ? PKT_TYPE_SYNC : PKT_TYPE_ACCEL, PKT_ADDR_FIRST, id,
+                         payload, len, out, PKT_MAX_WIRE);
+}
+
+int main(void)
+{
+    static link_tx tx;
+    uint32_t next_data = 0, next_control = 0, ids[LINK_TX_CLASSES] = { 0, 0 };
+    uint32_t expect[LINK_TX_CLASSES] = { 0, 0 }, count[LINK_TX_CLASSES] = { 0, 0 };
+    uint32_t refused = 0, bad = 0, order = 0, late = 0, wait_max = 0, boundary = 0;
+    uint32_t pos, i;
+
+    link_tx_init(&tx, &mock);
+    for (now = 0; now < RUN_BYTES && queued_n < MAX_FRAMES - 1; now++)
+    {
+        if (sending && now >= done_at)
+        {
+            sending = 0;
+            link_tx_done(&tx);      //TC interrupt
+        }
+        for (int cls = LINK_TX_CONTROL; cls < LINK_TX_CLASSES; cls++)
+        {
+            uint32_t *next = cls == LINK_TX_CONTROL ? &next_control : &next_data;
+            uint32_t every = cls == LINK_TX_CONTROL ? CONTROL_EVERY : DATA_EVERY;
+            uint8_t frame[PKT_MAX_WIRE];
+            int len;
+
+            if (now < *next)
+            {
+                continue;
+            }
+            *next = now + every + rand_next() % every;
+            len = make_frame(cls, ids[cls], frame);
+            if (link_tx_queue_class(&tx, cls, frame, len) != 0)
+            {
+                refused++;          //the id is not used up, the next frame takes it
+                continue;
+            }
+            queued[queued_n].cls = cls;
+            queued[queued_n].id = ids[cls]++;
+            queued[queued_n].time = now;
+            queued_n++;
+        }
+    }
+
+    //read the wire back
+    for (pos = 0; pos < wire_len; )
+    {
+        packet pkt;
+        uint32_t id;
+        uint8_t cls;
+        const uint8_t *end = memchr(&wire[pos], ']', wire_len - pos);
+        uint32_t len = end ? (uint32_t)(end - &wire[pos]) + 1 : wire_len - pos;
+
+        if (wire[pos] != '[' || packet_decode(&wire[pos + 1], len - 2, &pkt) != 0 || pkt.len < 4)
+        {
+            bad++;
+            pos += len;
+            continue;
+        }
+        cls = pkt.type == PKT_TYPE_SYNC ? LINK_TX_CONTROL : LINK_TX_DATA;
+        memcpy(&id, pkt.payload, 4);
+        for (int k = 4; k < pkt.len; k++)
+        {
+            bad += pkt.payload[k] != (uint8_t)(id * 31 + k);
+        }
+        order += id != expect[cls];
+        expect[cls] = id + 1;
+        count[cls]++;
+        sent[sent_n].cls = cls;
+        sent[sent_n].id = id;
+        sent[sent_n].time = started[sent_n];
+        sent_n++;
+        pos += len;
+    }
+
+    //every control frame starts at the first boundary after it was queued, no data frame may start in between
+    for (i = 0; i < sent_n; i++)
+    {
+        uint32_t q = 0, k;
+        if (sent[i].cls != LINK_TX_CONTROL)
+        {
+            continue;
+        }
+        while (queued[q].cls != LINK_TX_CONTROL || queued[q].id != sent[i].id)
+        {
+            q++;
+        }
+        for (k = i; k > 0 && sent[k - 1].time > queued[q].time; k--)
+        {
+            if (sent[k - 1].cls == LINK_TX_DATA)
+            {
+                late++;             //a data frame went out between queueing and sending it
+                break;
+            }
+        }
+        if (sent[i].time - queued[q].time > wait_max)
+        {
+            wait_max = sent[i].time - queued[q].time;
+        }
+        //data frames queued before it went but sent after it - it overtook them
+        for (k = i + 1; k < sent_n && sent[k].cls == LINK_TX_CONTROL; k++)
+        {
+        }
+        if (k < sent_n)
+        {
+            uint32_t d = 0;
+            while (queued[d].cls != LINK_TX_DATA || queued[d].id != sent[k].id)
+            {
+                d++;
+            }
+            boundary += queued[d].time < sent[i].time;
+        }
+    }
+
+    printf("%u control and %u data frames sent, %u refused, %u control frames overtook waiting data (queue says %u)\n",
+           count[LINK_TX_CONTROL], count[LINK_TX_DATA], refused, boundary, tx.preempted);
+    printf("longest control wait %u byte times, %u bad frames, %u out of order, %u late, %d overlapped\n",
+           wait_max, bad, order, late, overlapped);
+    if (bad || order || late || overlapped || boundary == 0 || boundary != tx.preempted ||
+        count[LINK_TX_CONTROL] + count[LINK_TX_DATA] != tx.frames_sent + sending)
+    {
+        printf("MISMATCH\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,407 @@
+#include <stdint.h>
+#include "arq.h"
+
+//sender
+
+void arq_tx_init(arq_tx *a, uint8_t addr, uint8_t window, uint32_t timeout, uint32_t us_per_byte)
+{
+    //timeout is the retransmission timeout used until the first round trip has been measured
+    //the sender is not polled until arq_tx_polled() says so
+    if (window < 1)
+    {
+        window = 1;
+    }
+    if (window > ARQ_MAX_WINDOW)
+    {
+        window = ARQ_MAX_WINDOW;
+    }
+    for (int i = 0; i < ARQ_MAX_WINDOW; i++)
+    {
+        a->slot[i].state = ARQ_SLOT_FREE;
+    }
+    a->addr = addr;
+    a->window = window;
+    a->base = 0;
+    a->next_seq = 0;
+    a->synced = 0;
+    a->polling = 0;
+    a->polled = 0;
+    a->granted = 0;
+    a->poll_end = 0;
+    a->poll_deadline = 0;
+    a->us_per_byte = us_per_byte;
+    a->rto = timeout;
+    a->srtt = 0;
+    a->rttvar = 0;
+    a->backoff = 0;
+    a->frames_sent = 0;
+    a->retransmits = 0;
+    a->timeouts = 0;
+    a->dropped = 0;
+    arq_tx_limits(a, ARQ_RTO_MIN_US, ARQ_RTO_MAX_US, ARQ_MAX_TRIES);
+}
+
+void arq_tx_limits(arq_tx *a, uint32_t rto_min, uint32_t rto_max, uint8_t max_tries)
+{
+    a->rto_min = rto_min;
+    a->rto_max = rto_max > rto_min ? rto_max : rto_min;
+    a->max_tries = max_tries > 0 ? max_tries : 1;
+}
+
+void arq_tx_polled(arq_tx *a, uint8_t polled)
+{
+    a->polled = polled;
+    a->granted = 0;
+}
+
+uint32_t arq_tx_timeout(const arq_tx *a)
+{
+    //wait after the end of a burst before it is resent, including backoff
+    uint32_t t = a->rto;
+    for (int i = 0; i < a->backoff && t < a->rto_max; i++)
+    {
+        t <<= 1;
+    }
+    return t < a->rto_max ? t : a->rto_max;
+}
+
+static void rtt_sample(arq_tx *a, uint32_t rtt)
+{
+    //RFC 6298 smoothing in integer microseconds
+    if (a->srtt == 0)
+    {
+        a->srtt = rtt > 0 ? rtt : 1;
+        a->rttvar = rtt / 2;
+    }
+    else
+    {
+        uint32_t err = rtt > a->srtt ? rtt - a->srtt : a->srtt - rtt;
+        a->rttvar = a->rttvar - a->rttvar / 4 + err / 4;
+        a->srtt = a->srtt - a->srtt / 8 + rtt / 8;
+    }
+    a->rto = a->srtt + 4 * a->rttvar;
+    if (a->rto < a->rto_min)
+    {
+        a->rto = a->rto_min;
+    }
+    if (a->rto > a->rto_max)
+    {
+        a->rto = a->rto_max;
+    }
+}
+
+int arq_tx_space(const arq_tx *a)
+{
+    //number of new frames that can be queued before the window is full
+    return a->window - (uint8_t)(a->next_seq - a->base);
+}
+
+int arq_tx_queue(arq_tx *a, uint8_t type, const uint8_t *payload, uint8_t len)
+{
+    //adds a frame to the window, it is sent by the next arq_tx_burst()
+    //returns the seq given to the frame, or -1 if the window is full
+    arq_slot *s;
+
+    if (arq_tx_space(a) <= 0 || len > PKT_MAX_PAYLOAD)
+    {
+        return -1;
+    }
+    s = &a->slot[a->next_seq % ARQ_MAX_WINDOW];
+    s->state = ARQ_SLOT_PENDING;
+    s->type = type & PKT_TYPE_MASK;
+    s->len = len;
+    s->tries = 0;
+    for (int i = 0; i < len; i++)
+    {
+        s->payload[i] = payload[i];
+    }
+    return a->next_seq++;
+}
+
+//gives up on everything in the window, the next burst starts with a SYNC so the receiver skips the gap
+static void drop_window(arq_tx *a)
+{
+    while (a->base != a->next_seq)
+    {
+        a->slot[a->base % ARQ_MAX_WINDOW].state = ARQ_SLOT_FREE;
+        a->base++;
+        a->dropped++;
+    }
+    a->synced = 0;
+}
+
+//true if a frame still waiting for an ack has been sent max_tries times
+static int out_of_tries(const arq_tx *a)
+{
+    for (uint8_t seq = a->base; seq != a->next_seq; seq++)
+    {
+        const arq_slot *s = &a->slot[seq % ARQ_MAX_WINDOW];
+        if (s->state != ARQ_SLOT_ACKED && s->tries >= a->max_tries)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+//puts every frame that went out but was not acked back in line to be sent again
+static void resend_unacked(arq_tx *a)
+{
+    for (uint8_t seq = a->base; seq != a->next_seq; seq++)
+    {
+        arq_slot *s = &a->slot[seq % ARQ_MAX_WINDOW];
+        if (s->state == ARQ_SLOT_SENT)
+        {
+            s->state = ARQ_SLOT_PENDING;
+        }
+    }
+}
+
+int arq_tx_burst(arq_tx *a, uint32_t now, arq_emit emit, void *ctx)
+{
+    //sends everything the window allows, the last frame carries the poll
+    //does nothing while a poll is outstanding (or, polled, until the receiver hands over the bus),
+    //the caller should have room for a full window of frames
+    //returns the number of frames handed to emit()
+    uint8_t frame[PKT_MAX_WIRE];
+    uint32_t bytes = 0;
+    int sent = 0;
+    int len;
+    int last = -1;
+
+    if (a->polled)
+    {
+        if (!a->granted)
+        {
+            return 0;
+        }
+        a->granted = 0;
+        if (out_of_tries(a))
+        {
+            drop_window(a);
+        }
+    }
+    else if (a->polling)
+    {
+        if ((int32_t)(now - a->poll_deadline) < 0)
+        {
+            return 0;
+        }
+        a->polling = 0;                 //poll or its answer was lost
+        a->timeouts++;
+        if (a->backoff < 16)
+        {
+            a->backoff++;
+        }
+        if (out_of_tries(a))
+        {
+            drop_window(a);
+        }
+        else
+        {
+            resend_unacked(a);
+        }
+    }
+
+    if (!a->synced)
+    {
+        len = packet_encode(PKT_TYPE_SYNC | PKT_FLAG_POLL, a->addr, a->base, 0, 0, frame, sizeof(frame));
+        if (emit(ctx, frame, len) != 0)
+        {
+            return 0;
+        }
+        a->polling = 1;
+        a->poll_end = now + len * a->us_per_byte;
+        a->poll_deadline = a->poll_end + arq_tx_timeout(a);
+        return 1;
+    }
+
+    for (uint8_t seq = a->base; seq != a->next_seq; seq++)
+    {
+        if (a->slot[seq % ARQ_MAX_WINDOW].state == ARQ_SLOT_PENDING)
+        {
+            last = seq;
+        }
+    }
+    if (last < 0)
+    {
+        if (!a->polled)
+        {
+            return 0;
+        }
+        //nothing to send this turn, the bus goes straight back
+        len = packet_encode(PKT_TYPE_IDLE | PKT_FLAG_POLL, a->addr, a->base, 0, 0, frame, sizeof(frame));
+        return emit(ctx, frame, len) == 0 ? 1 : 0;
+    }
+
+    for (uint8_t seq = a->base; seq != a->next_seq; seq++)
+    {
+        arq_slot *s = &a->slot[seq % ARQ_MAX_WINDOW];
+        if (s->state != ARQ_SLOT_PENDING)
+        {
+            continue;
+        }
+        len = packet_encode(s->type | (seq == last ? PKT_FLAG_POLL : 0), a->addr, seq, s->payload, s->len, frame, sizeof(frame));
+        if (emit(ctx, frame, len) != 0)
+        {
+            break;                      //no poll went out, the timeout recovers
+        }
+        if (s->tries++ > 0)
+        {
+            a->retransmits++;
+        }
+        s->state = ARQ_SLOT_SENT;
+        a->frames_sent++;
+        bytes += len;
+        sent++;
+        if (seq == last)
+        {
+            break;
+        }
+    }
+    if (sent > 0)
+    {
+        a->polling = 1;
+        a->poll_end = now + bytes * a->us_per_byte;
+        a->poll_deadline = a->poll_end + arq_tx_timeout(a);
+    }
+    return sent;
+}
+
+void arq_tx_ack(arq_tx *a, const packet *ack, uint32_t now)
+{
+    //applies a PKT_TYPE_ACK frame from the receiver, now is when it arrived
+    //acks for other senders on the bus are ignored
+    uint8_t cum, sack, in_flight;
+
+    if (ack->type != PKT_TYPE_ACK || ack->len < 2 || ack->addr != a->addr)
+    {
+        return;
+    }
+    if (a->polled && (ack->flags & PKT_FLAG_POLL))
+    {
+        a->granted = 1;                 //our turn, the next arq_tx_burst() answers
+    }
+    cum = ack->payload[0];
+    sack = ack->payload[1];
+    in_flight = a->next_seq - a->base;
+    if (a->backoff > 0)
+    {
+        //after a timeout this may answer the earlier poll, so it is not a sample (Karn). The link works
+        //again, so the backoff is dropped, but the timeout is raised to at least how long this ack took
+        //in case the round trip has grown past it and every poll would time out
+        int32_t waited = now - a->poll_end;
+        if (a->polling && waited > (int32_t)a->rto)
+        {
+            a->rto = (uint32_t)waited < a->rto_max ? (uint32_t)waited : a->rto_max;
+        }
+        a->backoff = 0;
+    }
+    else if (a->polling && !a->polled)
+    {
+        //not when polled - the time to the ack then includes other senders' turns
+        int32_t rtt = now - a->poll_end;
+        rtt_sample(a, rtt > 0 ? rtt : 0);
+    }
+    a->polling = 0;
+
+    if ((uint8_t)(cum - a->base) > in_flight)
+    {
+        a->synced = 0;                  //receiver is expecting something outside our window
+        resend_unacked(a);
+        return;
+    }
+    a->synced = 1;
+
+    //cumulative part - everything before cum has arrived
+    while (a->base != cum)
+    {
+        a->slot[a->base % ARQ_MAX_WINDOW].state = ARQ_SLOT_FREE;
+        a->base++;
+    }
+    //selective part - bit i acknowledges cum + 1 + i
+    for (int i = 0; i < 8; i++)
+    {
+        uint8_t seq = cum + 1 + i;
+        if ((sack & (1 << i)) && (uint8_t)(seq - a->base) < (uint8_t)(a->next_seq - a->base))
+        {
+            a->slot[seq % ARQ_MAX_WINDOW].state = ARQ_SLOT_ACKED;
+        }
+    }
+    //the ack answers the poll on the last frame of the burst, so anything still unacked was lost
+    resend_unacked(a);
+}
+
+//receiver
+
+void arq_rx_init(arq_rx *r, uint8_t first_seq)
+{
+    for (int i = 0; i < ARQ_MAX_WINDOW; i++)
+    {
+        r->valid[i] = 0;
+    }
+    r->expected = first_seq;
+}
+
+int arq_rx_accept(arq_rx *r, const packet *pkt)
+{
+    //takes a decoded frame from the sender, returns 1 if it carried a poll and an ack must be sent now
+    if (pkt->type == PKT_TYPE_SYNC)
+    {
+        arq_rx_init(r, pkt->seq);
+    }
+    else if (pkt->type == PKT_TYPE_IDLE)
+    {
+        //polled sender with nothing to send, only hands back the bus
+    }
+    else if ((uint8_t)(pkt->seq - r->expected) < ARQ_MAX_WINDOW)
+    {
+        uint8_t i = pkt->seq % ARQ_MAX_WINDOW;
+        if (!r->valid[i])
+        {
+            r->held[i] = *pkt;
+            r->valid[i] = 1;
+        }
+    }
+    //anything else is a duplicate of a frame already delivered - it is still acked below
+    return (pkt->flags & PKT_FLAG_POLL) != 0;
+}
+
+int arq_rx_pop(arq_rx *r, packet *out)
+{
+    //returns 0 and the next in-order frame, or -1 if the next frame has not arrived yet
+    uint8_t i = r->expected % ARQ_MAX_WINDOW;
+    if (!r->valid[i])
+    {
+        return -1;
+    }
+    *out = r->held[i];
+    r->valid[i] = 0;
+    r->expected++;
+    return 0;
+}
+
+int arq_rx_ack(const arq_rx *r, uint8_t addr, uint8_t flags, uint8_t *out, int out_size)
+{
+    //encodes the ack frame for the sender at addr, returns its length
+    //flags is PKT_FLAG_POLL to hand that sender the bus (polled mode), 0 to answer its poll
+    uint8_t payload[2];
+    uint8_t cum = r->expected;
+    uint8_t sack = 0;
+
+    while ((uint8_t)(cum - r->expected) < ARQ_MAX_WINDOW && r->valid[cum % ARQ_MAX_WINDOW])
+    {
+        cum++;                          //received in order but not popped yet
+    }
+    for (int i = 0; i < 8; i++)
+    {
+        uint8_t seq = cum + 1 + i;
+        if ((uint8_t)(seq - r->expected) < ARQ_MAX_WINDOW && r->valid[seq % ARQ_MAX_WINDOW])
+        {
+            sack |= (1 << i);
+        }
+    }
+    payload[0] = cum;
+    payload[1] = sack;
+    return packet_encode(PKT_TYPE_ACK | flags, addr, cum, payload, 2, out, out_size);
+}
@@ -0,0 +1,104 @@
+#ifndef ARQ_H
+#define ARQ_H
+#include <stdint.h>
+#include "packet.h"
+
+// Sliding-window ARQ for the half-duplex RS-485 link (replaces stop-and-wait [Ack])
+//
+// Sender: up to `window` frames may be unacknowledged. arq_tx_burst() sends every frame that is
+// new or needs resending back to back and sets PKT_FLAG_POLL on the last one, which hands the bus
+// to the receiver. The receiver answers a poll with one PKT_TYPE_ACK frame carrying a cumulative
+// ack (next expected seq) and a selective-ack bitmap for the 8 frames after it. Anything from the
+// burst that is not acked was lost and goes out again in the next burst. If the ack itself never
+// arrives the poll times out and every unacknowledged frame is resent.
+//
+// Retransmission timeout: the time from the end of a burst to its ack is measured and smoothed the way
+// TCP does it (RFC 6298) - SRTT and RTTVAR with gains 1/8 and 1/4, RTO = SRTT + 4 * RTTVAR, kept within
+// rto_min..rto_max. Every timeout in a row doubles the wait (exponential backoff). An ack for a poll
+// sent after a timeout may answer an earlier poll, so it is not used as a sample (Karn), it only ends
+// the backoff and raises the timeout if it took longer than that. A frame that has been sent max_tries times
+// without an ack is given up on: the whole window is dropped, counted in `dropped`, and the receiver
+// is resynchronised past it.
+//
+// A PKT_TYPE_SYNC frame tells the receiver which seq comes next, it is sent first after
+// arq_tx_init() and whenever an ack does not fit the sender's window.
+//
+// Polled mode (arq_tx_polled()), for several sensor boards on one pair: a sender only talks when the
+// receiver hands it the bus with an ack that has PKT_FLAG_POLL set (see poll_sched.h). The ack covers
+// the sender's previous turn, so anything it does not cover is resent in this one, and a sender with
+// nothing to send answers with PKT_TYPE_IDLE. The receiver times out a silent turn, the sender never
+// does, so the retransmission timeout is not used; max_tries still applies, counted in turns.
+//
+// Time is passed in by the caller (microseconds from micros()) so none of this touches hardware.
+
+#define ARQ_MAX_WINDOW 8
+#define ARQ_RTO_MIN_US   5000               //default lower limit on the retransmission timeout
+#define ARQ_RTO_MAX_US   2000000            //default upper limit, also caps the backoff
+#define ARQ_MAX_TRIES    8                  //default number of sends before a frame is given up on
+
+#define ARQ_SLOT_FREE    0
+#define ARQ_SLOT_PENDING 1      //waiting to be sent or resent
+#define ARQ_SLOT_SENT    2      //sent, waiting for an ack
+#define ARQ_SLOT_ACKED   3      //selectively acked, waiting for the frames before it
+
+//sends one encoded frame, returns 0 on success
+typedef int (*arq_emit)(void *ctx, const uint8_t *frame, uint16_t len);
+
+typedef struct {
+    uint8_t state;
+    uint8_t type;
+    uint8_t len;
+    uint8_t tries;                          //number of times the frame has been sent
+    uint8_t payload[PKT_MAX_PAYLOAD];
+} arq_slot;
+
+typedef struct {
+    arq_slot slot[ARQ_MAX_WINDOW];          //indexed by seq % ARQ_MAX_WINDOW
+    uint8_t addr;                           //this sender's address on the bus, in every frame
+    uint8_t window;                         //frames allowed in flight, 1..ARQ_MAX_WINDOW
+    uint8_t base;                           //oldest unacknowledged seq
+    uint8_t next_seq;                       //seq given to the next queued frame
+    uint8_t synced;                         //receiver has confirmed base
+    uint8_t polling;                        //poll outstanding - the receiver owns the bus
+    uint8_t polled;                         //only send when handed the bus by the receiver
+    uint8_t granted;                        //polled mode: the receiver has handed over the bus
+    uint32_t poll_end;                      //time the last byte of the outstanding poll should be on the wire
+    uint32_t poll_deadline;                 //time the outstanding poll times out
+    uint32_t us_per_byte;                   //time to send one byte on the link (us)
+
+    //retransmission timeout, all in us
+    uint32_t rto;                           //current timeout before backoff
+    uint32_t srtt;                          //smoothed round trip (end of burst to ack), 0 until measured
+    uint32_t rttvar;                        //smoothed mean deviation of the round trip
+    uint32_t rto_min;
+    uint32_t rto_max;
+    uint8_t backoff;                        //timeouts in a row, the wait is rto << backoff
+    uint8_t max_tries;
+
+    uint32_t frames_sent;
+    uint32_t retransmits;
+    uint32_t timeouts;
+    uint32_t dropped;                       //frames given up on after max_tries sends
+} arq_tx;
+
+typedef struct {
+    packet held[ARQ_MAX_WINDOW];            //frames received ahead of a gap, indexed by seq % ARQ_MAX_WINDOW
+    uint8_t valid[ARQ_MAX_WINDOW];
+    uint8_t expected;                       //next seq to deliver
+} arq_rx;
+
+void arq_tx_init(arq_tx *a, uint8_t addr, uint8_t window, uint32_t timeout, uint32_t us_per_byte);
+void arq_tx_limits(arq_tx *a, uint32_t rto_min, uint32_t rto_max, uint8_t max_tries);
+void arq_tx_polled(arq_tx *a, uint8_t polled);
+int arq_tx_space(const arq_tx *a);
+int arq_tx_queue(arq_tx *a, uint8_t type, const uint8_t *payload, uint8_t len);
+int arq_tx_burst(arq_tx *a, uint32_t now, arq_emit emit, void *ctx);
+void arq_tx_ack(arq_tx *a, const packet *ack, uint32_t now);
+uint32_t arq_tx_timeout(const arq_tx *a);
+
+void arq_rx_init(arq_rx *r, uint8_t first_seq);
+int arq_rx_accept(arq_rx *r, const packet *pkt);
+int arq_rx_pop(arq_rx *r, packet *out);
+int arq_rx_ack(const arq_rx *r, uint8_t addr, uint8_t flags, uint8_t *out, int out_size);
+
+#endif
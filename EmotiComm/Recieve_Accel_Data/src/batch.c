@@ -0,0 +1,266 @@
+#include <stdint.h>
+#include "batch.h"
+
+void batch_tx_init(batch_tx *b, uint8_t target, uint32_t max_latency)
+{
+    b->count = 0;
+    b->have_last = 0;
+    b->last_time = 0;
+    b->next_seq = 0;
+    b->codec = 0;
+    batch_tx_config(b, target, max_latency);
+}
+
+void batch_tx_config(batch_tx *b, uint8_t target, uint32_t max_latency)
+{
+    //can be changed at any time, samples already held are kept
+    if (target < 1)
+    {
+        target = 1;
+    }
+    if (target > BATCH_MAX_SAMPLES)
+    {
+        target = BATCH_MAX_SAMPLES;
+    }
+    b->target = target;
+    b->max_latency = max_latency;
+}
+
+void batch_tx_use_codec(batch_tx *b, delta_enc *codec)
+{
+    //codec = 0 goes back to plain frames, otherwise the encoder starts with a keyframe
+    b->codec = codec;
+    if (codec)
+    {
+        delta_enc_reset(codec);
+    }
+}
+
+int batch_wire_bytes(uint8_t samples)
+{
+    //bytes a plain frame of this many samples takes on the wire, delimiters included but nothing escaped
+    int payload = BATCH_STAMP_SIZE + (samples == 1 ? PKT_ACCEL_PAYLOAD : 1 + samples * BATCH_SAMPLE_SIZE);
+    return 2 + PKT_HEADER_SIZE + payload + PKT_CRC_SIZE;
+}
+
+int batch_tx_add(batch_tx *b, int16_t x, int16_t y, int16_t z, uint32_t now)
+{
+    //returns -1 if the batch is already full - take it first
+    batch_sample *s;
+
+    if (b->count >= BATCH_MAX_SAMPLES)
+    {
+        return -1;
+    }
+    s = &b->sample[b->count++];
+    s->x = x;
+    s->y = y;
+    s->z = z;
+    s->seq = b->next_seq++;
+    s->time = now;
+    s->stamp = now;
+    return 0;
+}
+
+int batch_tx_ready(const batch_tx *b, uint32_t now)
+{
+    if (b->count == 0)
+    {
+        return 0;
+    }
+    if (b->count >= b->target)
+    {
+        return 1;
+    }
+    return b->max_latency != 0 && (uint32_t)(now - b->sample[0].time) >= b->max_latency;
+}
+
+static uint8_t ticks(uint32_t dt)
+{
+    dt = (dt + BATCH_TICK_US / 2) / BATCH_TICK_US;
+    return dt > 255 ? 255 : dt;
+}
+
+//encodes the held samples with the delta codec, returns the payload length
+//or -1 if they would not be any smaller than the plain frame (e.g. while the board is being shaken)
+static int take_delta(batch_tx *b, uint32_t prev, uint8_t *payload)
+{
+    int plain = b->count == 1 ? PKT_ACCEL_PAYLOAD : 1 + b->count * BATCH_SAMPLE_SIZE;
+    delta_sample s[BATCH_MAX_SAMPLES];
+    for (int i = 0; i < b->count; i++)
+    {
+        s[i].dt = ticks(b->sample[i].time - prev);
+        s[i].x = b->sample[i].x;
+        s[i].y = b->sample[i].y;
+        s[i].z = b->sample[i].z;
+        prev = b->sample[i].time;
+    }
+    //on failure the encoder is left as it was, the plain frame sent instead does not affect the reference
+    return delta_encode(b->codec, s, b->count, payload, plain);
+}
+
+int batch_tx_take(batch_tx *b, uint8_t *type, uint8_t *payload)
+{
+    //writes the held samples to payload[] and empties the batch, returns the payload length
+    uint32_t prev;
+    uint8_t *stamp = payload;
+    int len = 0;
+
+    if (b->count == 0)
+    {
+        return 0;
+    }
+    stamp[0] = b->sample[0].seq;
+    stamp[1] = b->sample[0].time & 0xFF;
+    stamp[2] = (b->sample[0].time >> 8) & 0xFF;
+    stamp[3] = (b->sample[0].time >> 16) & 0xFF;
+    payload += BATCH_STAMP_SIZE;
+
+    prev = b->have_last ? b->last_time : b->sample[0].time;
+    if (b->codec && (len = take_delta(b, prev, payload)) > 0)
+    {
+        *type = PKT_TYPE_ACCEL_DELTA;
+    }
+    else if (b->count == 1)
+    {
+        *type = PKT_TYPE_ACCEL;
+        packet_put_accel(payload, b->sample[0].x, b->sample[0].y, b->sample[0].z);
+        len = PKT_ACCEL_PAYLOAD;
+    }
+    else
+    {
+        *type = PKT_TYPE_ACCEL_BATCH;
+        len = 0;
+        payload[len++] = b->count;
+        for (int i = 0; i < b->count; i++)
+        {
+            payload[len++] = ticks(b->sample[i].time - prev);
+            packet_put_accel(&payload[len], b->sample[i].x, b->sample[i].y, b->sample[i].z);
+            len += PKT_ACCEL_PAYLOAD;
+            prev = b->sample[i].time;
+        }
+    }
+    b->last_time = b->sample[b->count - 1].time;
+    b->have_last = 1;
+    b->count = 0;
+    return BATCH_STAMP_SIZE + len;
+}
+
+void batch_rx_init(batch_rx *b)
+{
+    b->head = 0;
+    b->count = 0;
+    b->last_due = 0;
+    b->last_stamp = 0;
+    b->dropped = 0;
+    delta_dec_init(&b->codec);
+}
+
+static void play(batch_rx *b, const delta_sample *sample, uint8_t seq, uint32_t stamp, uint32_t due)
+{
+    batch_sample *s;
+
+    if (b->count == BATCH_PLAYBACK_LEN)
+    {
+        b->head = (b->head + 1) % BATCH_PLAYBACK_LEN;        //drop the oldest, the display has fallen behind
+        b->count--;
+        b->dropped++;
+    }
+    s = &b->sample[(b->head + b->count++) % BATCH_PLAYBACK_LEN];
+    s->x = sample->x;
+    s->y = sample->y;
+    s->z = sample->z;
+    s->seq = seq;
+    s->time = due;
+    s->stamp = stamp;
+    b->last_due = due;
+    b->last_stamp = stamp;
+}
+
+static void get_raw(delta_sample *s, const uint8_t *raw)
+{
+    s->x = (int16_t)(raw[0] | (raw[1] << 8));
+    s->y = (int16_t)(raw[2] | (raw[3] << 8));
+    s->z = (int16_t)(raw[4] | (raw[5] << 8));
+}
+
+int batch_rx_unpack(batch_rx *b, const packet *pkt, uint32_t now)
+{
+    //queues the samples from an ACCEL, ACCEL_BATCH or ACCEL_DELTA frame, returns how many or -1 for any other frame
+    delta_sample s[BATCH_PLAYBACK_LEN];
+    const uint8_t *payload = pkt->payload + BATCH_STAMP_SIZE;
+    int len = pkt->len - BATCH_STAMP_SIZE;
+    uint8_t seq;
+    uint32_t stamp, due;
+    int n;
+
+    if (len < 0 || (pkt->type != PKT_TYPE_ACCEL && pkt->type != PKT_TYPE_ACCEL_BATCH && pkt->type != PKT_TYPE_ACCEL_DELTA))
+    {
+        return -1;
+    }
+    seq = pkt->payload[0];
+    stamp = pkt->payload[1] | (pkt->payload[2] << 8) | ((uint32_t)pkt->payload[3] << 16);
+
+    if (pkt->type == PKT_TYPE_ACCEL)
+    {
+        if (len != PKT_ACCEL_PAYLOAD)
+        {
+            return -1;
+        }
+        get_raw(&s[0], payload);
+        play(b, &s[0], seq, stamp, now);
+        return 1;
+    }
+    if (pkt->type == PKT_TYPE_ACCEL_DELTA)
+    {
+        n = delta_decode(&b->codec, payload, len, s, BATCH_PLAYBACK_LEN);
+        if (n < 0)
+        {
+            return -1;                  //lost frame or bad payload, samples resume at the next keyframe
+        }
+    }
+    else
+    {
+        n = len >= 1 ? payload[0] : 0;
+        if (n == 0 || n > BATCH_MAX_SAMPLES || len != 1 + n * BATCH_SAMPLE_SIZE)
+        {
+            return -1;
+        }
+        for (int i = 0; i < n; i++)
+        {
+            const uint8_t *raw = &payload[1 + i * BATCH_SAMPLE_SIZE];
+            s[i].dt = raw[0];
+            get_raw(&s[i], &raw[1]);
+        }
+    }
+
+    //carry on from the previous batch if it is still playing, otherwise start now
+    due = now;
+    if (b->count > 0 && (int32_t)(b->last_due - now) > 0)
+    {
+        due = b->last_due + s[0].dt * BATCH_TICK_US;
+    }
+    for (int i = 0; i < n; i++)
+    {
+        if (i > 0)
+        {
+            due += s[i].dt * BATCH_TICK_US;
+            stamp = (stamp + s[i].dt * BATCH_TICK_US) & 0xFFFFFF;      //to within BATCH_TICK_US / 2 per sample
+        }
+        play(b, &s[i], seq + i, stamp, due);
+    }
+    return n;
+}
+
+int batch_rx_next(batch_rx *b, uint32_t now, batch_sample *out)
+{
+    //returns 0 and the oldest sample once it is due, -1 if nothing is due yet
+    if (b->count == 0 || (int32_t)(now - b->sample[b->head].time) < 0)
+    {
+        return -1;
+    }
+    *out = b->sample[b->head];
+    b->head = (b->head + 1) % BATCH_PLAYBACK_LEN;
+    b->count--;
+    return 0;
+}
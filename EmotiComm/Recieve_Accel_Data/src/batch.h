@@ -0,0 +1,77 @@
+#ifndef BATCH_H
+#define BATCH_H
+#include <stdint.h>
+#include "packet.h"
+#include "delta_codec.h"
+
+// Several accelerometer samples per link frame
+//
+// Sender: samples are collected with the time they were taken and sent as one PKT_TYPE_ACCEL_BATCH
+// frame once `target` samples are held, or once the oldest has waited `max_latency` microseconds.
+// A batch of one goes out as a plain PKT_TYPE_ACCEL frame.
+//
+// Every sample frame starts with a 4 byte stamp for latency measurement (see latency_stats.h):
+//   seq | uint24 time
+// - seq : number of the first sample in the frame (wraps at 255), the others follow on from it
+// - time: when the first sample was measured, low 24 bits of the sender's micros() (little endian)
+//
+// Payload after the stamp: count | count x (dt | int16 x | int16 y | int16 z)
+// - dt: time since the sample before it (the last sample of the previous frame for the first one),
+//       in units of BATCH_TICK_US, saturating at 255
+//
+// With a delta_enc attached (batch_tx_use_codec()) the samples are sent as one PKT_TYPE_ACCEL_DELTA
+// frame instead, see delta_codec.h. If the encoded samples would not be smaller, the plain frame is sent and
+// the codec carries on from its current keyframe.
+//
+// Receiver: samples go into a playback queue spaced by their dt, so they are handed on at the same
+// intervals they were measured at, one batch span after the first one was taken.
+
+#define BATCH_MAX_SAMPLES 6             //4 + 1 + 6 * 7 = 47 bytes, fits PKT_MAX_PAYLOAD
+#define BATCH_STAMP_SIZE  4
+#define BATCH_SAMPLE_SIZE 7
+#define BATCH_TICK_US     1000
+#define BATCH_PLAYBACK_LEN 16
+
+typedef struct {
+    int16_t x;
+    int16_t y;
+    int16_t z;
+    uint8_t seq;                        //sample number, counted by the sender
+    uint32_t time;                      //sender: when it was measured, receiver: when it is due
+    uint32_t stamp;                     //when it was measured, on the sender's clock (receiver: low 24 bits only)
+} batch_sample;
+
+typedef struct {
+    batch_sample sample[BATCH_MAX_SAMPLES];
+    uint8_t count;
+    uint8_t target;                     //samples per frame, 1..BATCH_MAX_SAMPLES
+    uint32_t max_latency;               //send early once the oldest sample is this old, 0 = no limit
+    uint32_t last_time;                 //time of the last sample taken out by batch_tx_take()
+    uint8_t have_last;
+    uint8_t next_seq;                   //number given to the next sample added
+    delta_enc *codec;                   //0 = send plain ACCEL/ACCEL_BATCH frames
+} batch_tx;
+
+typedef struct {
+    batch_sample sample[BATCH_PLAYBACK_LEN];
+    uint8_t head;                       //oldest sample
+    uint8_t count;
+    uint32_t last_due;                  //due time of the newest sample in the queue
+    uint32_t last_stamp;                //capture time of the newest sample unpacked, on the sender's clock
+    uint32_t dropped;                   //samples lost because the queue was full
+    delta_dec codec;                    //state for PKT_TYPE_ACCEL_DELTA frames
+} batch_rx;
+
+void batch_tx_init(batch_tx *b, uint8_t target, uint32_t max_latency);
+void batch_tx_config(batch_tx *b, uint8_t target, uint32_t max_latency);
+void batch_tx_use_codec(batch_tx *b, delta_enc *codec);
+int batch_wire_bytes(uint8_t samples);
+int batch_tx_add(batch_tx *b, int16_t x, int16_t y, int16_t z, uint32_t now);
+int batch_tx_ready(const batch_tx *b, uint32_t now);
+int batch_tx_take(batch_tx *b, uint8_t *type, uint8_t *payload);
+
+void batch_rx_init(batch_rx *b);
+int batch_rx_unpack(batch_rx *b, const packet *pkt, uint32_t now);
+int batch_rx_next(batch_rx *b, uint32_t now, batch_sample *out);
+
+#endif
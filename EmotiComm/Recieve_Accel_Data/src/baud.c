@@ -0,0 +1,51 @@
+#include <stdint.h>
+#include "baud.h"
+
+//fills out for one oversampling mode, returns -1 if the divider is out of range
+static int calc_mode(uint32_t clock, uint32_t baud, int over8, baud_setting *out)
+{
+    uint32_t scaled = over8 ? 2 * clock : clock;
+    uint32_t usartdiv = (scaled + baud / 2) / baud;         //rounded to the nearest divider
+
+    if (usartdiv < 16 || usartdiv > 0xFFFF)
+    {
+        return -1;
+    }
+    out->over8 = over8;
+    out->brr = over8 ? ((usartdiv & 0xFFF0) | ((usartdiv & 0x000F) >> 1)) : usartdiv;
+    out->actual = (scaled + usartdiv / 2) / usartdiv;
+    out->error_ppm = (int32_t)(((int64_t)scaled - (int64_t)baud * usartdiv) * 1000000 / ((int64_t)baud * usartdiv));
+    return 0;
+}
+
+static int32_t abs_ppm(int32_t ppm)
+{
+    return ppm < 0 ? -ppm : ppm;
+}
+
+int baud_calc(uint32_t clock, uint32_t baud, int allow_over8, baud_setting *out)
+{
+    //uses 16x oversampling whenever it is within BAUD_MAX_ERROR_PPM, 8x only when allowed and 16x cannot get there
+    //returns 0 on success, -1 if the rate cannot be reached within BAUD_MAX_ERROR_PPM
+    baud_setting s16, s8;
+    int ok16, ok8;
+
+    if (baud == 0)
+    {
+        return -1;
+    }
+    ok16 = calc_mode(clock, baud, 0, &s16) == 0 && abs_ppm(s16.error_ppm) <= BAUD_MAX_ERROR_PPM;
+    ok8 = allow_over8 && calc_mode(clock, baud, 1, &s8) == 0 && abs_ppm(s8.error_ppm) <= BAUD_MAX_ERROR_PPM;
+
+    if (ok16)
+    {
+        *out = s16;                     //16x has the better tolerance to noise and clock mismatch
+        return 0;
+    }
+    if (ok8)
+    {
+        *out = s8;
+        return 0;
+    }
+    return -1;
+}
@@ -1,5 +1,23 @@
 #include "biDirectional_Trans.h"
 #include "stm32l4xx.h" 
+#include "eeng1030_lib.h"
+#include "timebase.h"
+
+link_tx rs485_tx;                  //frames waiting to go out on USART1
+isr_time isr_link_tx_dma = { "DMA1 ch4 (link tx)" };
+isr_time isr_link_rx_dma = { "DMA1 ch5 (link rx)" };
+static link_rx rs485_rx;           //frame extractor for the receive ring
+static frame_pool rx_frames;       //completed frames, filled by the interrupts and borrowed by the main loop
+static uint8_t rx_ring[LINK_RX_RING_SIZE];     //written by DMA1 channel 5
+static uint32_t framing_errors;    //USART1 receive errors, counted by transceiver_USART1_IRQ()
+static uint32_t noise_errors;
+static uint32_t overruns;
+static uint32_t crc_errors;        //frames that failed to decode, counted by decode_Frame() in the main loop
+static uint32_t bad_frames;
+static turn_guard turn;            //turnaround gap and DE times
+static uint32_t link_baud;         //rate USART1 runs at
+static uint32_t last_heard;        //micros() when the last byte from the other board ended, near enough
+static uint16_t heard_head;        //receive ring position at last_heard
 
 void enable_Transmit(int RE,int DE)
 {
@@ -12,4 +30,286 @@ void enable_Recieve(int RE,int DE)
     GPIOB->ODR &= ~(1 << DE);   // DE = 0 disable transmission
 }
 
+//driver functions used by the link_tx queue
+static void hw_set_driver(void *hw, int transmit)
+{
+#if LINK_HW_DE
+    (void)transmit;                             //USART1 switches DE/RE itself
+#else
+    if (transmit)
+    {
+        enable_Transmit(4,5);
+    }
+    else
+    {
+        enable_Recieve(4,5);
+    }
+#endif
+}
+static void hw_start(void *hw, const uint8_t *data, uint16_t len)
+{
+    DMA1_Channel4->CCR &= ~(1 << 0);            //channel has to be disabled to reload it
+    DMA1_Channel4->CMAR = (uint32_t)data;
+    DMA1_Channel4->CNDTR = len;
+    USART1->ICR = (1 << 6);                     //clear TC so it is only set again by the end of this frame
+    DMA1_Channel4->CCR |= (1 << 0);             //enable channel - USART1 requests each byte as TDR empties
+}
+static uint32_t hw_lock(void *hw)
+{
+    uint32_t state = __get_PRIMASK();
+    __disable_irq();
+    return state;
+}
+static void hw_unlock(void *hw, uint32_t state)
+{
+    __set_PRIMASK(state);
+}
+static void hw_wake(void)
+{
+    link_tx_poll(&rs485_tx);                    //from the TIM2 alarm, the gap has passed
+}
+static int hw_clear(void *hw)
+{
+    //called with interrupts masked before taking an idle bus - 1 if the turnaround gap has passed,
+    //otherwise the TIM2 alarm tries again when it will have
+    uint32_t now = micros();
+    uint16_t head = LINK_RX_RING_SIZE - DMA1_Channel5->CNDTR;
+    uint32_t wait;
+
+    if (head != heard_head || (USART1->ISR & (1 << 16)))     // bytes not seen by receive_Poll() yet, or BUSY - one is coming in now
+    {
+        heard_head = head;
+        last_heard = now;
+    }
+    wait = turn_guard_wait(&turn, last_heard, now);
+    if (wait > 0)
+    {
+        alarm_At(now + wait, hw_wake);
+        return 0;
+    }
+    return 1;
+}
+static const link_tx_driver rs485_driver = { 0, hw_set_driver, hw_start, hw_lock, hw_unlock, hw_clear };
+
+#if LINK_HW_DE
+static void set_DE_Times(int over8)
+{
+    //DEAT/DEDT in sample times for the oversampling in use - UE must be 0
+    uint8_t deat, dedt;
+    turn_guard_de_times(&turn, over8, &deat, &dedt);
+    USART1->CR1 &= ~((0x1F << 21) | (0x1F << 16));
+    USART1->CR1 |= (deat << 21) | (dedt << 16);     //DE assertion/deassertion times
+}
+#endif
+
+void init_Transceiver(uint32_t baud)
+{
+    //called from initSerial() while USART1 is still disabled - DEM, DEAT and DEDT can only be written when UE = 0
+    link_baud = baud;
+    turn_guard_init(&turn, LINK_GAP_BITS, LINK_DE_ASSERT_TIME, LINK_DE_DEASSERT_TIME, baud);
+#if LINK_HW_DE
+    pinMode(GPIOA,12,2);                                    // alternate function mode for PA12
+    selectAlternateFunction(GPIOA,12,7);                   // AF7 = USART1_DE
+    set_DE_Times((USART1->CR1 >> 15) & 1);                // OVER8 has already been set by initSerial()
+    USART1->CR3 |= (1 << 14);                            // DEM = 1 driver enable mode, DEP = 0 so DE is active high
+#else
+    enable_Recieve(4,5);                                // listen until there is something to send
+#endif
+    USART1->CR3 |= (1 << 7);                          // DMAT = 1 transmit data register is fed by DMA
+    RCC->AHB1ENR |= (1 << 0);                        // turn on DMA1
+    DMA1_CSELR->CSELR &= ~(0xF << 12);
+    DMA1_CSELR->CSELR |= (2 << 12);                // channel 4 request 2 = USART1_TX
+    DMA1_Channel4->CCR = (1 << 7) | (1 << 4) | (1 << 1);  // memory increment, memory to peripheral, transfer complete interrupt
+    DMA1_Channel4->CPAR = (uint32_t)&USART1->TDR;
+    NVIC->ISER[0] |= (1 << 14);                  // Enable DMA1_Channel4 IRQ (interrupt 14)
+    link_tx_init(&rs485_tx, &rs485_driver);
+
+    //receive - USART1 writes every byte into rx_ring without interrupting the CPU
+    frame_pool_init(&rx_frames);
+    link_rx_init(&rs485_rx, &rx_frames);
+    USART1->CR3 |= (1 << 6);                                 // DMAR = 1 received bytes are collected by DMA
+    USART1->CR1 |= (1 << 4);                                // IDLEIE - interrupt when the line goes quiet after a frame
+    USART1->CR3 |= (1 << 0);                               // EIE - interrupt on framing, noise and overrun errors while DMA receives
+    DMA1_CSELR->CSELR &= ~(0xF << 16);
+    DMA1_CSELR->CSELR |= (2 << 16);                       // channel 5 request 2 = USART1_RX
+    DMA1_Channel5->CPAR = (uint32_t)&USART1->RDR;
+    DMA1_Channel5->CMAR = (uint32_t)rx_ring;
+    DMA1_Channel5->CNDTR = LINK_RX_RING_SIZE;
+    DMA1_Channel5->CCR = (1 << 7) | (1 << 5) | (1 << 2) | (1 << 1);  // memory increment, circular, half and full transfer interrupts
+    DMA1_Channel5->CCR |= (1 << 0);                  // enable channel
+    NVIC->ISER[0] |= (1 << 15);                     // Enable DMA1_Channel5 IRQ (interrupt 15)
+}
+
+static void receive_Poll(uint32_t quiet_us)
+{
+    //hands every byte DMA has written since the last call to the frame extractor
+    //quiet_us is how long the line has already been idle, for the turnaround gap
+    uint16_t head = LINK_RX_RING_SIZE - DMA1_Channel5->CNDTR;
+    uint32_t now = micros();
+    if (head != heard_head)
+    {
+        heard_head = head;
+        last_heard = now - quiet_us;
+    }
+    link_rx_feed(&rs485_rx, rx_ring, LINK_RX_RING_SIZE, head, now);
+}
+
+int send_Frame(const uint8_t *frame, uint16_t len)
+{
+    //queues a complete frame (delimiters included) for transmission, returns -1 if the queue is full
+    return link_tx_queue(&rs485_tx, frame, len);
+}
+
+int send_Control(const uint8_t *frame, uint16_t len)
+{
+    //queues a control frame, it goes out at the next frame boundary ahead of any waiting sensor data
+    return link_tx_queue_class(&rs485_tx, LINK_TX_CONTROL, frame, len);
+}
 
+int transmit_Busy(void)
+{
+    return link_tx_busy(&rs485_tx);
+}
+
+frame_slot *receive_Frame(void)
+{
+    //returns the oldest complete frame (bytes between '[' and ']', still stuffed) or 0 if none is waiting
+    //the frame stays valid until it is handed back with release_Frame(), which should be soon - the
+    //slot cannot take another frame in the meantime
+    return frame_pool_borrow(&rx_frames);
+}
+
+void release_Frame(frame_slot *frame)
+{
+    frame_pool_release(&rx_frames, frame);
+}
+
+int decode_Frame(const frame_slot *frame, packet *pkt)
+{
+    //packet_decode() on a received frame, counting the ones that fail - main loop only
+    int result = packet_decode(frame->data, frame->len, pkt);
+    if (result == PKT_ERR_CRC)
+    {
+        crc_errors++;
+    }
+    else if (result != 0)
+    {
+        bad_frames++;
+    }
+    return result;
+}
+
+void link_Stats(link_stats *s)
+{
+    //snapshot of the link counters - each one has a single writer and is at most 32 bits, so plain reads are safe
+    s->bytes_in = rs485_rx.bytes;
+    s->frames_in = rx_frames.published;
+    s->framing_errors = framing_errors;
+    s->noise_errors = noise_errors;
+    s->overruns = overruns;
+    s->truncated = rs485_rx.truncated;
+    s->too_long = rs485_rx.too_long;
+    s->overflows = rx_frames.overflows;
+    s->crc_errors = crc_errors;
+    s->bad_frames = bad_frames;
+    s->waiting = frame_pool_waiting(&rx_frames);
+    s->high_water = rx_frames.high_water;
+    s->bytes_out = rs485_tx.bytes_sent;
+    s->frames_out = rs485_tx.frames_sent;
+    s->tx_full = rs485_tx.full;
+    s->tx_high_water = rs485_tx.high_water;
+    s->tx_preempted = rs485_tx.preempted;
+    s->tx_held = rs485_tx.held;
+    s->gap_bits = turn.gap_bits;
+    s->retransmits = 0;
+    s->timeouts = 0;
+    s->dropped = 0;
+}
+
+int set_Link_Baud(uint32_t baud, int32_t *error_ppm)
+{
+    //changes the USART1 rate once everything queued has left at the old rate, returns -1 if baud cannot be reached
+    baud_setting setting;
+    if (baud_calc(LINK_CLOCK, baud, 1, &setting) != 0)
+    {
+        return -1;
+    }
+    while (transmit_Busy());                    // e.g. the ACCEPT of a speed change still has to go out at the old rate
+    USART1->CR1 &= ~(1 << 0);                   // UE = 0 - BRR and OVER8 can only be written while the USART is disabled
+    USART1->BRR = setting.brr;
+    if (setting.over8)
+    {
+        USART1->CR1 |= (1 << 15);               // OVER8 = 1, 8x oversampling for the highest rates
+    }
+    else
+    {
+        USART1->CR1 &= ~(1 << 15);
+    }
+#if LINK_HW_DE
+    set_DE_Times(setting.over8);
+#endif
+    link_baud = baud;
+    turn_guard_set_gap(&turn, turn.gap_bits, baud);
+    USART1->CR1 |= (1 << 0);                    // UE = 1, receive DMA carries on where it was
+    if (error_ppm)
+    {
+        *error_ppm = setting.error_ppm;
+    }
+    return 0;
+}
+
+void set_Link_Gap(uint8_t gap_bits)
+{
+    //turnaround gap in bit periods for every frame sent from now on
+    uint32_t state = hw_lock(0);
+    turn_guard_set_gap(&turn, gap_bits, link_baud);
+    hw_unlock(0, state);
+}
+
+void DMA1_Channel4_IRQHandler(void)
+{
+    uint32_t start = cycles();
+    if (DMA1->ISR & (1 << 13))                  // TCIF4 - last byte of the frame has been written to TDR
+    {
+        DMA1->IFCR = (1 << 12);                 // clear all channel 4 flags
+        DMA1_Channel4->CCR &= ~(1 << 0);
+        USART1->CR1 |= (1 << 6);                // TCIE - wait for the last stop bit before giving up the bus
+    }
+    isr_Time(&isr_link_tx_dma, start);
+}
+
+void DMA1_Channel5_IRQHandler(void)
+{
+    uint32_t start = cycles();
+    if (DMA1->ISR & ((1 << 17) | (1 << 18)))    // TCIF5 or HTIF5 - half of the receive ring has filled
+    {
+        DMA1->IFCR = (1 << 16);                 // clear all channel 5 flags
+        receive_Poll(0);
+    }
+    isr_Time(&isr_link_rx_dma, start);
+}
+
+void transceiver_USART1_IRQ(void)
+{
+    //called from USART1_IRQHandler - handles receive errors, idle line after received bytes and transmission complete at the end of each frame
+    uint32_t isr = USART1->ISR;
+    if (isr & ((1 << 1) | (1 << 2) | (1 << 3)))
+    {
+        //the byte is still stored and DMA carries on, the frame it lands in fails its checksum or is cut short
+        framing_errors += (isr >> 1) & 1;       // FE
+        noise_errors += (isr >> 2) & 1;         // NF
+        overruns += (isr >> 3) & 1;             // ORE - the byte that came in on top of the last one is lost
+        USART1->ICR = isr & ((1 << 1) | (1 << 2) | (1 << 3));      // FECF, NCF, ORECF
+    }
+    if (isr & (1 << 4))                 // IDLE - a burst of received bytes has ended
+    {
+        USART1->ICR = (1 << 4);
+        receive_Poll(10000000 / link_baud);     // IDLE is set one character time after the last stop bit
+    }
+    if ((USART1->CR1 & (1 << 6)) && (USART1->ISR & (1 << 6)))
+    {
+        USART1->CR1 &= ~(1 << 6);               // TCIE off until the next frame
+        USART1->ICR = (1 << 6);                 // clear TC
+        link_tx_done(&rs485_tx);
+    }
+}
@@ -1,7 +1,94 @@
 #include <stdint.h>
 #include <stm32l432xx.h>
+#include "link_tx.h"
+#include "link_rx.h"
+#include "timebase.h"
+#include "baud.h"
+#include "turnaround.h"
 
-void enable_Transmit(int RE,int DE);
-void enable_Recieve(int RE,int De);
+// LINK_HW_DE = 1 : DE and RE of the SN75176 are tied together and driven by USART1_DE on PA12.
+//                  USART1 raises DE LINK_DE_ASSERT_TIME before the first start bit and drops it
+//                  LINK_DE_DEASSERT_TIME after the last stop bit, both in 1/16 bit periods (max 31).
+//                  They are converted to USART1 sample times for OVER8 whenever the rate changes.
+// LINK_HW_DE = 0 : RE/DE stay on PB4/PB5 and are switched by software from the TC interrupt.
+#ifndef LINK_HW_DE
+#define LINK_HW_DE 1
+#endif
+#define LINK_DE_ASSERT_TIME   16
+#define LINK_DE_DEASSERT_TIME 16
+
+// Nothing is sent until the pair has been quiet for the turnaround gap (see turnaround.h), a frame queued
+// sooner is held and TIM2 starts it once the gap has passed. Both boards use LINK_GAP_BITS until the
+// sender has calibrated the gap with set_Link_Gap(), a shared pair always uses it.
+#define LINK_GAP_BITS TURN_MAX_BITS
+
+// USART1 receives continuously into this ring by circular DMA. The frame extractor runs on
+// idle line, half transfer and transfer complete, so the ring only has to hold half a ring's
+// worth of bytes between interrupts.
+#define LINK_RX_RING_SIZE 128
+
+// Both boards start at LINK_BAUD_SAFE and the sender then steps up through LINK_RATES (see link_speed.h)
+// as far as the cable and transceivers allow. Every rate has to be reachable from LINK_CLOCK within
+// BAUD_MAX_ERROR_PPM, the table is cut off at the first one that is not.
+#define LINK_CLOCK     80000000
+#define LINK_BAUD_SAFE 9600
+#define LINK_RATES     { 9600, 19200, 57600, 115200, 230400, 460800, 921600, 1000000 }
+#define LINK_NUM_RATES 8
 
+// Several sensor boards can share the pair, the receiver then polls them in turn (see poll_sched.h).
+// The negotiation only works between two boards, so a shared pair runs at LINK_BAUD_BUS.
+// LINK_NODES must be the same on every board, the sensor boards are addressed PKT_ADDR_FIRST onwards.
+#ifndef LINK_NODES
+#define LINK_NODES     1
+#endif
+#define LINK_BAUD_BUS  460800
 
+// Link health counters, read with link_Stats(). Every counter has one writer - the USART1 and DMA
+// interrupts, the transmit queue with interrupts masked, or the main loop through decode_Frame() - so
+// they are counted without locks and never cleared, take the difference of two snapshots for a rate.
+// Set FRAME_POOL_SLOTS and LINK_TX_QUEUE_LEN in the build flags to change the queue depths.
+typedef struct {
+    //receive
+    uint32_t bytes_in;          //bytes DMA has written into the receive ring
+    uint32_t frames_in;         //complete frames queued for the main loop
+    uint32_t framing_errors;    //FE - no stop bit where one was due: wrong rate, a collision or a break
+    uint32_t noise_errors;      //NE - the samples of a bit disagreed
+    uint32_t overruns;          //ORE - a byte arrived before DMA had taken the one before
+    uint32_t truncated;         //frames cut short by the next '[', their ']' was lost
+    uint32_t too_long;          //frames lost because they were longer than FRAME_SLOT_SIZE
+    uint32_t overflows;         //frames lost because the receive queue was full
+    uint32_t crc_errors;        //frames that failed the checksum
+    uint32_t bad_frames;        //frames that failed to decode otherwise - length, sync or escape
+    uint8_t waiting;            //frames queued right now
+    uint8_t high_water;         //deepest the receive queue has been, FRAME_POOL_SLOTS means it has been full
+    //transmit
+    uint32_t bytes_out;
+    uint32_t frames_out;        //frames whose last stop bit has left
+    uint32_t tx_full;           //frames refused because the transmit queue was full
+    uint8_t tx_high_water;      //deepest the transmit queue has been, LINK_TX_QUEUE_LEN means it has been full
+    uint32_t tx_preempted;      //control frames sent ahead of waiting sensor data
+    uint32_t tx_held;           //times a frame had to wait for the turnaround gap
+    uint8_t gap_bits;           //turnaround gap in use
+    //sliding window - left at 0 here, the sensor board fills them in from its arq_tx
+    uint32_t retransmits;
+    uint32_t timeouts;
+    uint32_t dropped;           //frames given up on after ARQ_MAX_TRIES
+} link_stats;
+
+extern link_tx rs485_tx;
+extern isr_time isr_link_tx_dma;      //run times of the DMA interrupts below
+extern isr_time isr_link_rx_dma;
+
+void enable_Transmit(int RE,int DE);
+void enable_Recieve(int RE,int De);
+void init_Transceiver(uint32_t baud);
+int send_Frame(const uint8_t *frame, uint16_t len);
+int send_Control(const uint8_t *frame, uint16_t len);
+int transmit_Busy(void);
+frame_slot *receive_Frame(void);
+void release_Frame(frame_slot *frame);
+int decode_Frame(const frame_slot *frame, packet *pkt);
+void link_Stats(link_stats *s);
+int set_Link_Baud(uint32_t baud, int32_t *error_ppm);
+void set_Link_Gap(uint8_t gap_bits);
+void transceiver_USART1_IRQ(void);
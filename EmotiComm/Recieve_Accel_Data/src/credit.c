@@ -0,0 +1,94 @@
+#include <stdint.h>
+#include "credit.h"
+
+void credit_tx_init(credit_tx *c, uint8_t window)
+{
+    //both sides start from sequence number 0 with a full window of credit
+    c->seq = 0;
+    c->limit = window;
+    c->window = window;
+    c->waiting = 0;
+    c->sent = 0;
+    c->overwritten = 0;
+}
+
+void credit_tx_offer(credit_tx *c, int16_t x, int16_t y, int16_t z, uint32_t time)
+{
+    //makes a new reading the one to send next, dropping an older one that is still waiting
+    if (c->waiting)
+    {
+        c->overwritten++;
+    }
+    c->latest.x = x;
+    c->latest.y = y;
+    c->latest.z = z;
+    c->latest.time = time;
+    c->waiting = 1;
+}
+
+int credit_tx_take(credit_tx *c, credit_sample *s)
+{
+    //returns the sequence number for a frame carrying *s, or -1 if there is no credit or nothing new
+    if (!c->waiting || c->seq == c->limit)
+    {
+        return -1;
+    }
+    *s = c->latest;
+    c->waiting = 0;
+    c->sent++;
+    return c->seq++;
+}
+
+void credit_tx_grant(credit_tx *c, const packet *pkt)
+{
+    //takes the limit from a grant frame, unless it is further ahead than a window (a stale or garbled grant)
+    if (pkt->type != PKT_TYPE_CREDIT || pkt->len != 1 || (uint8_t)(pkt->payload[0] - c->seq) > c->window)
+    {
+        return;
+    }
+    c->limit = pkt->payload[0];
+}
+
+void credit_rx_init(credit_rx *c, uint8_t window, uint32_t refresh_us, uint32_t now)
+{
+    c->next = 0;
+    c->limit = window;
+    c->window = window;
+    c->due = 0;
+    c->last = now;
+    c->refresh_us = refresh_us;
+    c->grants = 0;
+    c->refreshes = 0;
+}
+
+void credit_rx_heard(credit_rx *c, uint8_t seq, uint32_t now)
+{
+    //a sample frame arrived, frames lost before it still used up credit
+    c->next = seq + 1;
+    c->last = now;
+    if (c->next == c->limit)
+    {
+        c->due = 1;
+    }
+}
+
+int credit_rx_grant(credit_rx *c, uint8_t addr, uint32_t now, uint8_t *out, int out_size)
+{
+    //call once the frames heard have been handled, returns the length of a grant frame to send or 0
+    uint8_t limit;
+
+    if (!c->due && (uint32_t)(now - c->last) < c->refresh_us)
+    {
+        return 0;
+    }
+    if (!c->due)
+    {
+        c->refreshes++;
+    }
+    limit = c->next + c->window;
+    c->limit = limit;
+    c->due = 0;
+    c->last = now;
+    c->grants++;
+    return packet_encode(PKT_TYPE_CREDIT, addr, 0, &limit, 1, out, out_size);
+}
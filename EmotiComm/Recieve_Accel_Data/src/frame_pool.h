@@ -0,0 +1,46 @@
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+#include <stdint.h>
+#include "packet.h"
+#include "spsc_ring.h"
+
+// Preallocated slots for received frames
+// The receive interrupt assembles each frame straight into a free slot and queues it when the ']'
+// arrives. The main loop takes the oldest queued slot, parses it where it is and releases it, so
+// frame bytes are never copied and a frame still being parsed cannot be overwritten by the next one.
+//
+// Slot numbers travel between the two sides in two SPSC rings: `ready` (interrupt -> main loop) holds
+// complete frames in arrival order and `free` (main loop -> interrupt) holds slots that can be filled.
+// Each ring has one writer, so neither side has to lock. A burst of up to FRAME_POOL_SLOTS frames is
+// absorbed while the main loop is busy, anything beyond that is dropped and counted in `overflows`.
+
+#ifndef FRAME_POOL_SLOTS
+#define FRAME_POOL_SLOTS 4                      //queue depth, a power of two - override with -DFRAME_POOL_SLOTS=n
+#endif
+#define FRAME_SLOT_SIZE  (PKT_MAX_WIRE - 2)     //longest body kept, longer frames are dropped
+
+typedef struct {
+    uint8_t data[FRAME_SLOT_SIZE];      //(still stuffed) bytes between '[' and ']'
+    uint16_t len;
+    uint32_t time;                      //when the ']' was received, see link_rx_feed()
+} frame_slot;
+
+SPSC_RING(frame_index_ring, uint8_t, FRAME_POOL_SLOTS)
+
+typedef struct {
+    frame_slot slot[FRAME_POOL_SLOTS];
+    frame_index_ring ready;             //complete frames, oldest first
+    frame_index_ring free;              //slots the interrupt may fill
+    uint32_t published;                 //frames queued, interrupt side only
+    uint32_t overflows;                 //frames dropped because every slot was taken, interrupt side only
+    uint8_t high_water;                 //most slots ever taken at once (including the one being filled)
+} frame_pool;
+
+void frame_pool_init(frame_pool *p);
+frame_slot *frame_pool_acquire(frame_pool *p);
+void frame_pool_publish(frame_pool *p, frame_slot *s);
+frame_slot *frame_pool_borrow(frame_pool *p);
+void frame_pool_release(frame_pool *p, frame_slot *s);
+uint32_t frame_pool_waiting(const frame_pool *p);
+
+#endif
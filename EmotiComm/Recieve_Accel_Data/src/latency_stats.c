@@ -0,0 +1,155 @@
+#include <stdint.h>
+#include "latency_stats.h"
+
+void lat_stats_init(lat_stats *l)
+{
+    l->offset = 0;
+    l->window_start = 0;
+    l->window_min = 0;
+    l->prev_min = 0;
+    l->have_offset = 0;
+    l->have_prev = 0;
+    lat_stats_reset(l);
+}
+
+void lat_stats_reset(lat_stats *l)
+{
+    //starts the statistics again, the clock offset estimate is kept
+    l->have_seq = 0;
+    l->next_seq = 0;
+    l->missing = 0;
+    l->late = 0;
+    l->count = 0;
+    l->min = 0;
+    l->max = 0;
+    l->sum = 0;
+    for (int i = 0; i < LAT_BUCKETS; i++)
+    {
+        l->bucket[i] = 0;
+    }
+}
+
+static int32_t diff24(uint32_t a, uint32_t b)
+{
+    //a - b for 24 bit times, sign extended
+    return (int32_t)((a - b) << 8) >> 8;
+}
+
+void lat_stats_arrival(lat_stats *l, uint32_t stamp, uint32_t arrival, uint32_t wire_us)
+{
+    //stamp: capture time of the newest sample in a frame (sender clock)
+    //arrival: when the end of the frame was received (receiver clock), wire_us: how long the frame took to send
+    uint32_t delay = (arrival - wire_us - stamp) & LAT_STAMP_MASK;
+
+    if (!l->have_offset)
+    {
+        l->have_offset = 1;
+        l->window_start = arrival;
+        l->window_min = delay;
+    }
+    else if (arrival - l->window_start >= LAT_OFFSET_WINDOW_US)
+    {
+        l->prev_min = l->window_min;    //start a new window, the old minimum still counts for one more
+        l->have_prev = 1;
+        l->window_start = arrival;
+        l->window_min = delay;
+    }
+    else if (diff24(delay, l->window_min) < 0)
+    {
+        l->window_min = delay;
+    }
+    l->offset = l->have_prev && diff24(l->prev_min, l->window_min) < 0 ? l->prev_min : l->window_min;
+}
+
+static int bucket_index(uint32_t v)
+{
+    int msb;
+    if (v < 8)
+    {
+        return v;
+    }
+    msb = 31 - __builtin_clz(v);
+    return (msb - 2) * 8 + ((v >> (msb - 3)) & 7);
+}
+
+static uint32_t bucket_top(int index)
+{
+    //largest latency counted in a bucket
+    int msb;
+    if (index < 8)
+    {
+        return index;
+    }
+    msb = index / 8 + 2;
+    return ((uint32_t)(8 + index % 8 + 1) << (msb - 3)) - 1;
+}
+
+int32_t lat_stats_display(lat_stats *l, uint8_t seq, uint32_t stamp, uint32_t now)
+{
+    //records a sample being handed to the display, returns its latency or -1 before the first frame has arrived
+    int8_t ahead = seq - l->next_seq;
+    int32_t latency;
+
+    if (!l->have_seq || ahead >= 0)
+    {
+        if (l->have_seq)
+        {
+            l->missing += ahead;
+        }
+        l->next_seq = seq + 1;
+        l->have_seq = 1;
+    }
+    else
+    {
+        l->late++;
+    }
+
+    if (!l->have_offset)
+    {
+        return -1;
+    }
+    latency = diff24(now, stamp + l->offset);
+    if (latency < 0)
+    {
+        latency = 0;                    //the offset estimate is ahead by a few microseconds of drift
+    }
+    if (l->count == 0 || (uint32_t)latency < l->min)
+    {
+        l->min = latency;
+    }
+    if ((uint32_t)latency > l->max)
+    {
+        l->max = latency;
+    }
+    l->count++;
+    l->sum += latency;
+    l->bucket[bucket_index(latency)]++;
+    return latency;
+}
+
+uint32_t lat_stats_mean(const lat_stats *l)
+{
+    return l->count ? l->sum / l->count : 0;
+}
+
+uint32_t lat_stats_percentile(const lat_stats *l, uint32_t per_mille)
+{
+    //latency that per_mille/1000 of the samples were at or below, rounded up to the end of its bucket
+    uint64_t need = ((uint64_t)l->count * per_mille + 999) / 1000;
+    uint64_t seen = 0;
+
+    if (l->count == 0)
+    {
+        return 0;
+    }
+    for (int i = 0; i < LAT_BUCKETS; i++)
+    {
+        seen += l->bucket[i];
+        if (seen >= need && seen > 0)
+        {
+            uint32_t top = bucket_top(i);
+            return top < l->max ? top : l->max;
+        }
+    }
+    return l->max;
+}
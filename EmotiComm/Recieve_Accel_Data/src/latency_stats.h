@@ -0,0 +1,58 @@
+#ifndef LATENCY_STATS_H
+#define LATENCY_STATS_H
+#include <stdint.h>
+
+// Capture-to-display latency, gap and reordering statistics for the accelerometer stream
+//
+// The sender stamps every sample with a sequence number and its capture time on its own TIM2 (see
+// batch.h). The two boards' clocks are not synchronised, so the offset between them is estimated from
+// frame arrivals: arrival - capture - wire time is the offset plus however long the frame was held up
+// on the way. The smallest value seen over the last one to two LAT_OFFSET_WINDOW_US is taken as the
+// offset, the window is kept short so the estimate follows the drift between the two oscillators.
+// A latency is then display time - (capture time + offset), so it includes the time on the wire.
+//
+// The sender only sends the low 24 bits of its capture times and 8 bit sample numbers, so all time
+// arithmetic in here is done modulo 2^24 (latencies up to about 8.4 s can be told from negative ones)
+// and a gap of more than 127 samples cannot be told from reordering.
+//
+// Latencies are counted in a log-linear histogram with 8 buckets per power of two, so percentiles
+// are read to within 1/8 without keeping every sample. min, max and mean are exact.
+//
+// Nothing in here touches hardware, all times are passed in (microseconds).
+
+#define LAT_OFFSET_WINDOW_US 1000000
+#define LAT_STAMP_MASK 0xFFFFFF                 //capture times are 24 bit
+#define LAT_MAX_US   ((1u << 23) - 1)           //longest latency that can be told from a negative one
+#define LAT_BUCKETS  168                        //8 exact buckets + 8 per power of two up to LAT_MAX_US
+
+typedef struct {
+    //clock offset estimate, receiver clock - sender clock, modulo 2^24
+    uint32_t offset;
+    uint32_t window_start;
+    uint32_t window_min;                //smallest arrival delay in the current window
+    uint32_t prev_min;                  //and in the one before it
+    uint8_t have_offset;                //0 until the first frame has arrived
+    uint8_t have_prev;
+
+    //sequence numbers
+    uint8_t next_seq;                   //sample expected next
+    uint8_t have_seq;
+    uint32_t missing;                   //samples skipped over by the sequence numbers
+    uint32_t late;                      //samples older than one already shown - a reordered sample counts as missing, then late
+
+    //latency
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+    uint32_t bucket[LAT_BUCKETS];
+} lat_stats;
+
+void lat_stats_init(lat_stats *l);
+void lat_stats_reset(lat_stats *l);
+void lat_stats_arrival(lat_stats *l, uint32_t stamp, uint32_t arrival, uint32_t wire_us);
+int32_t lat_stats_display(lat_stats *l, uint8_t seq, uint32_t stamp, uint32_t now);
+uint32_t lat_stats_mean(const lat_stats *l);
+uint32_t lat_stats_percentile(const lat_stats *l, uint32_t per_mille);
+
+#endif
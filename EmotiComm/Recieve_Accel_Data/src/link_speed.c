@@ -0,0 +1,293 @@
+#include <stdint.h>
+#include "link_speed.h"
+#include "baud.h"
+
+#define SPEED_M_PROPOSE  0
+#define SPEED_M_TEST     1
+#define SPEED_M_SETTLE   2
+#define SPEED_M_DONE     3
+#define SPEED_M_RESTART  4
+#define SPEED_S_IDLE     5
+#define SPEED_S_TEST     6
+#define SPEED_S_CONFIRM  7
+
+#define SPEED_DONE_RETRIES 5
+
+//sent in every TEST frame - covers all-zero/all-one bytes, alternating bits and the bytes that need stuffing
+static const uint8_t speed_pattern[SPEED_PATTERN_LEN] = {
+    0x00, 0xFF, 0x55, 0xAA, '[', ']', 0x5C, 0x0F, 0xF0, 0x33, 0xCC, 0x01, 0x80, 0x7E, 0x81, 0x5A
+};
+
+static void send_op(link_speed *s, uint8_t op, uint8_t index)
+{
+    uint8_t payload[2 + SPEED_PATTERN_LEN];
+    uint8_t len = 2;
+
+    payload[0] = op;
+    payload[1] = index;
+    if (op == SPEED_OP_TEST)
+    {
+        for (int i = 0; i < SPEED_PATTERN_LEN; i++)
+        {
+            payload[len++] = speed_pattern[i];
+        }
+    }
+    s->ops->send(s->ops->ctx, payload, len);
+}
+
+static int pattern_ok(const packet *pkt)
+{
+    if (pkt->len != 2 + SPEED_PATTERN_LEN)
+    {
+        return 0;
+    }
+    for (int i = 0; i < SPEED_PATTERN_LEN; i++)
+    {
+        if (pkt->payload[2 + i] != speed_pattern[i])
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+//common set up - only the leading rates this clock can generate are used
+static void speed_init(link_speed *s, const uint32_t *rates, uint8_t num_rates, uint32_t clock, const link_speed_ops *ops, uint32_t now)
+{
+    baud_setting bs;
+    uint8_t usable = 0;
+
+    if (num_rates > SPEED_MAX_RATES)
+    {
+        num_rates = SPEED_MAX_RATES;
+    }
+    while (usable < num_rates && baud_calc(clock, rates[usable], 1, &bs) == 0)
+    {
+        usable++;
+    }
+    s->ops = ops;
+    s->rates = rates;
+    s->num_rates = usable;
+    s->good = 0;
+    s->trying = 0;
+    s->retries = 0;
+    s->finished = 0;
+    s->deadline = now;
+    s->last_rx = now;
+}
+
+static void master_start(link_speed *s, uint32_t now)
+{
+    s->good = 0;
+    s->trying = 1;
+    s->retries = 0;
+    s->finished = 0;
+    if (s->num_rates < 2)
+    {
+        s->finished = 1;                //nothing faster to try
+        return;
+    }
+    send_op(s, SPEED_OP_PROPOSE, s->trying);
+    s->state = SPEED_M_PROPOSE;
+    s->deadline = now + SPEED_REPLY_US;
+}
+
+static void master_done(link_speed *s, uint32_t now)
+{
+    send_op(s, SPEED_OP_DONE, s->good);
+    s->state = SPEED_M_DONE;
+    s->deadline = now + SPEED_REPLY_US;
+}
+
+void link_speed_master_init(link_speed *s, const uint32_t *rates, uint8_t num_rates, uint32_t clock, const link_speed_ops *ops, uint32_t now)
+{
+    //sender board - starts stepping up straight away
+    speed_init(s, rates, num_rates, clock, ops, now);
+    master_start(s, now);
+}
+
+void link_speed_slave_init(link_speed *s, const uint32_t *rates, uint8_t num_rates, uint32_t clock, const link_speed_ops *ops, uint32_t now)
+{
+    //receiver board - only ever answers the master
+    speed_init(s, rates, num_rates, clock, ops, now);
+    s->state = SPEED_S_IDLE;
+}
+
+static void master_input(link_speed *s, uint8_t op, uint8_t index, uint32_t now)
+{
+    if (s->state == SPEED_M_PROPOSE && index == s->trying)
+    {
+        if (op == SPEED_OP_ACCEPT)
+        {
+            s->ops->set_rate(s->ops->ctx, s->rates[s->trying]);       //slave has switched after its reply
+            send_op(s, SPEED_OP_TEST, s->trying);
+            s->state = SPEED_M_TEST;
+            s->deadline = now + SPEED_REPLY_US;
+        }
+        else if (op == SPEED_OP_REJECT)
+        {
+            master_done(s, now);
+        }
+    }
+    else if (s->state == SPEED_M_TEST && index == s->trying && op == SPEED_OP_TEST_OK)
+    {
+        s->good = s->trying++;
+        if (s->trying < s->num_rates)
+        {
+            send_op(s, SPEED_OP_PROPOSE, s->trying);       //this frame also confirms the new rate to the slave
+            s->state = SPEED_M_PROPOSE;
+            s->deadline = now + SPEED_REPLY_US;
+        }
+        else
+        {
+            master_done(s, now);
+        }
+    }
+    else if (s->state == SPEED_M_DONE && index == s->good && op == SPEED_OP_DONE_ACK)
+    {
+        s->finished = 1;
+    }
+}
+
+static void slave_input(link_speed *s, uint8_t op, uint8_t index, const packet *pkt, uint32_t now)
+{
+    if (s->state == SPEED_S_TEST)
+    {
+        if (op == SPEED_OP_TEST && index == s->trying && pattern_ok(pkt))
+        {
+            send_op(s, SPEED_OP_TEST_OK, index);
+            s->state = SPEED_S_CONFIRM;
+            s->deadline = now + SPEED_STEP_US;
+        }
+        return;
+    }
+    if (op == SPEED_OP_PROPOSE)
+    {
+        if (index < s->num_rates)
+        {
+            send_op(s, SPEED_OP_ACCEPT, index);
+            s->ops->set_rate(s->ops->ctx, s->rates[index]);          //waits for ACCEPT to leave at the old rate
+            s->trying = index;
+            s->finished = 0;
+            s->state = SPEED_S_TEST;
+            s->deadline = now + SPEED_STEP_US;
+        }
+        else
+        {
+            send_op(s, SPEED_OP_REJECT, index);
+        }
+    }
+    else if (op == SPEED_OP_DONE && index == s->good)
+    {
+        send_op(s, SPEED_OP_DONE_ACK, index);                          //answered every time in case the ack is lost
+        s->finished = 1;
+    }
+}
+
+void link_speed_input(link_speed *s, const packet *pkt, uint32_t now)
+{
+    //takes every decoded frame from the other board, not just PKT_TYPE_SPEED ones
+    uint8_t op, index;
+
+    if (s->state >= SPEED_S_IDLE)
+    {
+        s->last_rx = now;
+        if (s->state == SPEED_S_CONFIRM)
+        {
+            s->good = s->trying;        //the master is talking at the new rate - it works both ways
+            s->state = SPEED_S_IDLE;
+        }
+    }
+    if (pkt->type != PKT_TYPE_SPEED || pkt->len < 2)
+    {
+        return;
+    }
+    op = pkt->payload[0];
+    index = pkt->payload[1];
+    if (index >= SPEED_MAX_RATES)
+    {
+        return;
+    }
+    if (s->state >= SPEED_S_IDLE)
+    {
+        slave_input(s, op, index, pkt, now);
+    }
+    else
+    {
+        master_input(s, op, index, now);
+    }
+}
+
+void link_speed_poll(link_speed *s, uint32_t now)
+{
+    //runs the timeouts, call it regularly from the main loop
+    int expired = (int32_t)(now - s->deadline) >= 0;
+
+    switch (s->state)
+    {
+    case SPEED_M_PROPOSE:
+    case SPEED_M_TEST:
+        if (expired && !s->finished)
+        {
+            s->ops->set_rate(s->ops->ctx, s->rates[s->good]);        //step failed, go back to what worked
+            s->state = SPEED_M_SETTLE;
+            s->deadline = now + SPEED_SETTLE_US;
+        }
+        break;
+    case SPEED_M_SETTLE:
+        if (expired)
+        {
+            master_done(s, now);
+        }
+        break;
+    case SPEED_M_DONE:
+        if (expired && !s->finished)
+        {
+            if (++s->retries < SPEED_DONE_RETRIES)
+            {
+                send_op(s, SPEED_OP_DONE, s->good);
+                s->deadline = now + SPEED_REPLY_US;
+            }
+            else
+            {
+                //lost the slave entirely - wait until its idle timer has put it back to rates[0] and start again
+                s->ops->set_rate(s->ops->ctx, s->rates[0]);
+                s->state = SPEED_M_RESTART;
+                s->deadline = now + SPEED_IDLE_US + SPEED_REPLY_US;
+            }
+        }
+        break;
+    case SPEED_M_RESTART:
+        if (expired)
+        {
+            master_start(s, now);
+        }
+        break;
+    case SPEED_S_TEST:
+    case SPEED_S_CONFIRM:
+        if (expired)
+        {
+            s->ops->set_rate(s->ops->ctx, s->rates[s->good]);
+            s->state = SPEED_S_IDLE;
+        }
+        break;
+    case SPEED_S_IDLE:
+        if (s->good != 0 && (uint32_t)(now - s->last_rx) > SPEED_IDLE_US)
+        {
+            s->good = 0;                //master has gone quiet, it may have restarted at rates[0]
+            s->finished = 0;
+            s->ops->set_rate(s->ops->ctx, s->rates[0]);
+        }
+        break;
+    }
+}
+
+int link_speed_done(const link_speed *s)
+{
+    return s->finished;
+}
+
+uint32_t link_speed_rate(const link_speed *s)
+{
+    return s->rates[s->good];
+}
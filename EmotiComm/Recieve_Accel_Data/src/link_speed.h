@@ -0,0 +1,64 @@
+#ifndef LINK_SPEED_H
+#define LINK_SPEED_H
+#include <stdint.h>
+#include "packet.h"
+
+// Start-up link speed negotiation
+// Both boards start at rates[0]. The sender (master) steps through the table:
+//   master  PROPOSE(i)  -> slave           at the current rate
+//   slave   ACCEPT(i)   -> master          then the slave switches to rates[i]
+//   master  TEST(i)     -> slave           at rates[i], payload carries a fixed test pattern
+//   slave   TEST_OK(i)  -> master          the slave now waits for the next frame at rates[i]
+// A frame from the master at rates[i] confirms the step, so the next PROPOSE (or DONE) also tells
+// the slave that rates[i] is good. Any missing reply makes both ends fall back to the last good
+// rate on their own timers, then the master sends DONE(good) until the slave answers DONE_ACK.
+//
+// All frames are PKT_TYPE_SPEED with payload: op | rate index | test pattern (TEST only).
+// Time is passed in (microseconds) and the link is driven through link_speed_ops, so the state
+// machines run the same on the board and on a host.
+
+#define PKT_TYPE_SPEED 0x04
+
+#define SPEED_OP_PROPOSE  1
+#define SPEED_OP_ACCEPT   2
+#define SPEED_OP_REJECT   3
+#define SPEED_OP_TEST     4
+#define SPEED_OP_TEST_OK  5
+#define SPEED_OP_DONE     6
+#define SPEED_OP_DONE_ACK 7
+
+#define SPEED_MAX_RATES   8
+#define SPEED_PATTERN_LEN 16
+
+#define SPEED_REPLY_US    200000        //master: time allowed for any reply
+#define SPEED_STEP_US     400000        //slave: time allowed for TEST, and for the confirming frame after TEST_OK
+#define SPEED_SETTLE_US   (SPEED_STEP_US + SPEED_REPLY_US)  //master: wait after a failure so the slave has fallen back too
+#define SPEED_IDLE_US     5000000       //slave: silence before giving up on a negotiated rate and going back to rates[0]
+
+typedef struct {
+    void *ctx;
+    void (*send)(void *ctx, const uint8_t *payload, uint8_t len);      //send one PKT_TYPE_SPEED frame at the current rate
+    void (*set_rate)(void *ctx, uint32_t baud);                         //switch the link once the frame on the wire is finished
+} link_speed_ops;
+
+typedef struct {
+    const link_speed_ops *ops;
+    const uint32_t *rates;              //ascending, rates[0] is the safe start-up rate
+    uint8_t num_rates;
+    uint8_t good;                       //index of the highest rate proven to work
+    uint8_t trying;                     //index being tried
+    uint8_t state;
+    uint8_t retries;                    //master: DONE frames sent without an answer
+    uint8_t finished;                   //1 once DONE/DONE_ACK has been exchanged
+    uint32_t deadline;
+    uint32_t last_rx;                   //slave: time of the last frame from the master
+} link_speed;
+
+void link_speed_master_init(link_speed *s, const uint32_t *rates, uint8_t num_rates, uint32_t clock, const link_speed_ops *ops, uint32_t now);
+void link_speed_slave_init(link_speed *s, const uint32_t *rates, uint8_t num_rates, uint32_t clock, const link_speed_ops *ops, uint32_t now);
+void link_speed_input(link_speed *s, const packet *pkt, uint32_t now);
+void link_speed_poll(link_speed *s, uint32_t now);
+int link_speed_done(const link_speed *s);
+uint32_t link_speed_rate(const link_speed *s);
+
+#endif
@@ -0,0 +1,139 @@
+#include <stdint.h>
+#include "link_tx.h"
+
+void link_tx_init(link_tx *tx, const link_tx_driver *drv)
+{
+    tx->drv = drv;
+    tx->queue[LINK_TX_CONTROL].frame = tx->control_frame;
+    tx->queue[LINK_TX_CONTROL].len = tx->control_len;
+    tx->queue[LINK_TX_CONTROL].size = LINK_TX_CONTROL_LEN;
+    tx->queue[LINK_TX_DATA].frame = tx->data_frame;
+    tx->queue[LINK_TX_DATA].len = tx->data_len;
+    tx->queue[LINK_TX_DATA].size = LINK_TX_QUEUE_LEN;
+    for (int c = 0; c < LINK_TX_CLASSES; c++)
+    {
+        tx->queue[c].head = 0;
+        tx->queue[c].tail = 0;
+        tx->queue[c].count = 0;
+    }
+    tx->sending = 0;
+    tx->busy = 0;
+    tx->frames_sent = 0;
+    tx->bytes_sent = 0;
+    tx->preempted = 0;
+    tx->held = 0;
+    tx->full = 0;
+    tx->high_water = 0;
+}
+
+//hands the oldest frame of the first class that has one to the driver - called with interrupts masked or from the TC interrupt
+static void start_next(link_tx *tx)
+{
+    link_tx_class *q;
+    int c = 0;
+
+    while (tx->queue[c].count == 0)
+    {
+        c++;
+    }
+    q = &tx->queue[c];
+    if (!tx->busy)
+    {
+        if (tx->drv->clear && !tx->drv->clear(tx->drv->hw))
+        {
+            tx->held++;                             //the other board may still be driving, wait for link_tx_poll()
+            return;
+        }
+        tx->busy = 1;
+        tx->drv->set_driver(tx->drv->hw, 1);        //bus was idle, take it before the first byte
+    }
+    if (c == LINK_TX_CONTROL && tx->queue[LINK_TX_DATA].count > 0)
+    {
+        tx->preempted++;
+    }
+    tx->sending = c;
+    tx->drv->start(tx->drv->hw, q->frame[q->tail], q->len[q->tail]);
+}
+
+int link_tx_queue_class(link_tx *tx, uint8_t cls, const uint8_t *frame, uint16_t len)
+{
+    //copies a complete frame into the queue of its class and starts sending if the link is idle
+    //returns 0 on success, -1 if the frame is too long or its class is full
+    //safe to call from the main loop and from interrupt handlers
+    link_tx_class *q;
+    uint32_t state;
+
+    if (len == 0 || len > PKT_MAX_WIRE || cls >= LINK_TX_CLASSES)
+    {
+        return -1;
+    }
+    q = &tx->queue[cls];
+    state = tx->drv->lock(tx->drv->hw);
+    if (q->count == q->size)
+    {
+        tx->full++;
+        tx->drv->unlock(tx->drv->hw, state);
+        return -1;
+    }
+    for (int i = 0; i < len; i++)
+    {
+        q->frame[q->head][i] = frame[i];
+    }
+    q->len[q->head] = len;
+    q->head = (q->head + 1) % q->size;
+    q->count++;
+    if (cls == LINK_TX_DATA && q->count > tx->high_water)
+    {
+        tx->high_water = q->count;
+    }
+    if (!tx->busy)
+    {
+        start_next(tx);
+    }
+    tx->drv->unlock(tx->drv->hw, state);
+    return 0;
+}
+
+int link_tx_queue(link_tx *tx, const uint8_t *frame, uint16_t len)
+{
+    //queues a sensor data frame
+    return link_tx_queue_class(tx, LINK_TX_DATA, frame, len);
+}
+
+void link_tx_done(link_tx *tx)
+{
+    //called by the driver once the last stop bit of the current frame has left the USART
+    //frames queued back to back keep the bus, the bus is only released when both classes are empty
+    link_tx_class *q = &tx->queue[tx->sending];
+
+    tx->frames_sent++;
+    tx->bytes_sent += q->len[q->tail];
+    q->tail = (q->tail + 1) % q->size;
+    q->count--;
+    if (tx->queue[LINK_TX_CONTROL].count > 0 || tx->queue[LINK_TX_DATA].count > 0)
+    {
+        start_next(tx);
+    }
+    else
+    {
+        tx->busy = 0;
+        tx->drv->set_driver(tx->drv->hw, 0);
+    }
+}
+
+void link_tx_poll(link_tx *tx)
+{
+    //starts frames that were held for the turnaround gap - called by the driver once it has passed
+    uint32_t state = tx->drv->lock(tx->drv->hw);
+    if (!tx->busy && (tx->queue[LINK_TX_CONTROL].count > 0 || tx->queue[LINK_TX_DATA].count > 0))
+    {
+        start_next(tx);
+    }
+    tx->drv->unlock(tx->drv->hw, state);
+}
+
+int link_tx_busy(const link_tx *tx)
+{
+    //1 while a frame is on the wire or waiting to go out
+    return tx->busy || tx->queue[LINK_TX_CONTROL].count > 0 || tx->queue[LINK_TX_DATA].count > 0;
+}
@@ -7,20 +7,37 @@ Last Updated : 30/04/2025
  communication setup. 
 - X,Y,Z accelerometer data is recieved from the sender board
 - Two-way communication is achieved by sending and receiving data over UART.
-- Received data is parsed and stores in a circular buffer via interrupt-driven UART (USART1).
-- An [Ack] message is sent back to the sender board after each valid transmission to demonstrate direction control of the transceiver.
+- Received frames are assembled in place in a small slot pool by the USART1/DMA interrupts and parsed
+  straight from there by the main loop (see frame_pool.h).
+- Samples arrive through a sliding window (see arq.h). When the last frame of a burst polls this board, an ack frame
+  carrying the next expected sequence number and a bitmap of frames received after a gap is sent back straight away
+  (on a shared pair it goes out with that board's next turn).
+- The link starts at LINK_BAUD_SAFE. The sender then steps it up as far as the cable allows, this board answers
+  the speed frames and falls back to LINK_BAUD_SAFE on its own if the sender goes quiet (see link_speed.h).
+- Neither board drives the pair until it has been quiet for the turnaround gap. This board answers the sender's
+  probes after the gap they ask for and takes the gap the sender settles on (see turnaround.h).
+- Up to 8 sensor boards can share the RS-485 pair (LINK_NODES > 1). The link then runs at LINK_BAUD_BUS and
+  this board hands the bus to one sensor board at a time, each at least as often as its poll period (see
+  poll_sched.h). Every board has its own sliding window, playback queue and an entry in a latest-sample table,
+  the display modes show the board picked with "show <board>". "poll <board> <ms>" changes a poll period
+  and "nodes" prints the table and the poll counters.
+- Samples can arrive several to a frame (see batch.h), plain or delta compressed (see delta_codec.h). They are queued with the time gaps they were measured
+  with and handed to the display modes at those same intervals.
 - USART2 is used to output debugging and validation messages to a serial monitor.
+- Interrupt handlers only move received bytes and frames along, the main loop does the rest. Every handler
+  times itself with the cycle counter, "isr" on the serial monitor prints the longest runs.
 - The accelerometer information is displayed on an LCD via SPI in three switchable modes using a button:
     1. Raw sensor values (X, Y, Z) in mg
     2. A smiley face that changes orientation based on motion direction
     3. A Pong-style game where paddle movement is controlled by sender board accelerometer data
 - Messages are transmitted with square bracket delimiters ('[' and ']') to indicate start and end.
+  Accelerometer samples arrive as binary frames (see packet.h), control messages are still plain text.
 
 Core components include:
 - USART1 (primary data communication)
 - USART2 (serial terminal for debugging)
-- Bidirectional transceiver control via GPIO (RE/DE lines)
-- Circular buffer for reliable, asynchronous message reception
+- Bidirectional transceiver control by the USART1 driver enable output, frames sent by DMA
+- Frame slot pool for reliable, asynchronous message reception without copying
 - LCD output with multiple dynamic display modes
 - Button input handling for display mode switching
 - Message parsing, formatting, and feedback loop via [Ack]
@@ -32,57 +49,116 @@ Core components include:
 #include <stdio.h>
 #include  <errno.h>
 #include  <sys/unistd.h> // STDOUT_FILENO, STDERR_FILENO
-#include "circular_buffer.h"
 #include "display.h"
 #include "biDirectional_Trans.h"
 #include <string.h>
+#include "packet.h"
+#include "arq.h"
+#include "timebase.h"
+#include "link_speed.h"
+#include "batch.h"
+#include "latency_stats.h"  // Capture-to-display latency of the samples
+#include "spsc_ring.h"      // Console receive ring
+#include "poll_sched.h"     // Polling of several sensor boards on one pair
+#include "credit.h"         // Pong mode flow control
+#include "turnaround.h"     // RS-485 turnaround gap calibration
 
 
                                                   //assembly instruction functions embedded with c to enable/disable interrupts
 #define enable_interrupts() asm(" cpsie i ")     //Change Processor State Interrupt Enable
 #define disable_interrupt() asm (" cpsid i")    //Change Processor State Interrupt Disable
-#define INPUT_BUFFER_SIZE CIRC_BUF_SIZE        //Input buffer size equal to circular buffer for consitency  
+#define INPUT_BUFFER_SIZE 64                   //longest console command line
 #define LINE_HEIGHT 10                        //LCD dimension definitions 
 #define SCREEN_HEIGHT 80
 #define SCREEN_WIDTH 160
 #define NUM_LINES 8
+#define DEBUG_BAUD 9600                  //USART2 serial monitor
+#define POLL_PERIOD_US 50000            //default poll period of each sensor board, a floor on its update rate
+#define POLL_TURNAROUND_US 2000        //longest a sensor board takes to start answering its poll
+#define POLL_ACK_BYTES 12             //ack frame on the wire, allowing for some escaping
+#define POLL_ANSWER_BYTES 60         //a full batch frame on the wire, allowing for some escaping
+#define PONG_CREDITS 1              //pong mode frames granted at a time, the same on both boards
+#define CREDIT_REFRESH_US 50000    //grant again if nothing is heard for this long in pong mode
 
 //function prototypes 
 void setup(void);
 void delay(volatile uint32_t dly);
-void initSerial(uint32_t baudrate);
+void initSerial(uint32_t link_baud, uint32_t debug_baud);
 void eputc(char c);
 void shiftdisp(int i,const char *message);
-void sendMessage();
-void clearMessage(char *buffer, int size);
 void printMessage(int i,const char *message);
 void shiftdisp(int type,const char *message);
-void send_Ack();
+typedef struct {
+    arq_rx arq;                 //receive side of its sliding window
+    batch_rx playback;          //its samples waiting for their turn on the display
+    int x, y, z;                //latest sample handed on, in mg
+    uint32_t updated;           //micros() when that was
+    uint32_t samples;           //samples handed on so far
+} sensor_node;
+
+void send_Ack(sensor_node *node, uint8_t flags);
+void takeSample(sensor_node *node, const batch_sample *s);
+void pollNodes();
+void startBus();
+void printNodes();
 void drawSmiley(int next_position);
 int buttonpressed(void);
+void sendSpeedFrame(void *ctx, const uint8_t *payload, uint8_t len);
+void setSpeed(void *ctx, uint32_t baud);
+void sendTurnFrame(void *ctx, const uint8_t *payload, uint8_t len);
+void setGap(void *ctx, uint8_t gap_bits);
+void pollConsole();
+void printStats();
+void printLinkStats();
+void printIsrTimes();
+void noteArrival(const sensor_node *node, const frame_slot *frame);
 
 //global variables declarations 
 int count;
 int currentLine = 0;
-circular_buffer rx_buf;                             //Circular buffer structure defined in circular buffer.h
-volatile uint32_t data_ready=0;                    //flag to indicate when meesage is finished being added to the buffer
 volatile char input_buffer[INPUT_BUFFER_SIZE];    //stores user-typed message from serial port
 volatile uint8_t input_index = 0;                //index variable to irerate through characters in input message
 volatile uint8_t input_ready = 0;               //flag to indicate when input message is ready to be sent 
-static volatile uint8_t message_started = 0;   //Flag to indicate when message has started being recieved 
 char messagesdisp[8][24];                     //stores ch line of messages to be printed to LCD
 int messagetype[8];                          //stores whether message is recieved message or sent message to detemine how it is displayed on LCD
 int current_position = 0;                   //determines current position of smiley face display on lcd
 int next_position = 0;                     //determines next position of smiley face display on lcd
+sensor_node nodes[LINK_NODES];            //one per sensor board, the latest-sample table for the display modes
+int shown = 0;                           //index of the sensor board the display modes use
+poll_sched sched;                       //whose turn it is on a shared pair
+uint32_t link_baud = LINK_BAUD_SAFE;   //current USART1 rate
+static const uint32_t link_rates[LINK_NUM_RATES] = LINK_RATES;
+static const link_speed_ops speed_ops = { 0, sendSpeedFrame, setSpeed };
+link_speed speed;                        //answers the sender's rate negotiation
+static const turn_ops turn_cal_ops = { 0, sendTurnFrame, setGap };
+turn_cal turn;                          //answers the sender's turnaround gap calibration
+credit_rx credit;                       //pong mode credit granted to the sender
+lat_stats latency;                     //capture-to-display latency, missing and late samples
+SPSC_RING(console_ring, char, 64)     //USART2_IRQHandler produces, pollConsole() consumes
+console_ring console_rx;
+volatile uint32_t console_overruns = 0;     //characters lost because the ring was full
+isr_time isr_usart1 = { "USART1 (link)" };  //run times of the interrupt handlers in this file
+isr_time isr_usart2 = { "USART2 (console)" };
 
 int main()
 {
 
-    char message_received[CIRC_BUF_SIZE];      //stores recieved message from circular buffer
+    frame_slot *frame;                         //frame borrowed from the receive slot pool
     setup();                                  //call functions to setup and initialise the system
     init_display();
-    init_circ_buf(&rx_buf);
+    init_Timebase();
+    for (int i = 0; i < LINK_NODES; i++)
+    {
+        arq_rx_init(&nodes[i].arq, 0);
+        batch_rx_init(&nodes[i].playback);
+        nodes[i].samples = 0;
+    }
+    lat_stats_init(&latency);
+    link_speed_slave_init(&speed, link_rates, LINK_NUM_RATES, LINK_CLOCK, &speed_ops, micros());
+    turn_cal_slave_init(&turn, &turn_cal_ops);
+    startBus();
     NVIC->ISER[1] |= (1 << (37-32));        //ensures that the USART1_IRQHandler() gets triggered when data is received via UART2
+    NVIC->ISER[1] |= (1 << (38-32));        //USART2_IRQHandler() collects console characters
     enable_interrupts();
     fillRectangle(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, RGBToWord(0, 0, 0));    //clear LCD screen
     fillCircle(80, 40, 20, RGBToWord(255, 255, 0));                        
@@ -94,10 +170,44 @@ int main()
     int y_val = 0;
     int z_val = 0;
     int pongMode = 0;             //pongmode used to determine if the sender baord has been set to pong mode
+    packet rx_pkt;                //decoded binary frame
+    packet sample_pkt;            //next in-order frame from the sliding window
+    sensor_node *node;            //sensor board the frame came from
+    int hands_back;               //frame hands the bus back to this board
+    batch_sample sample;          //next sample due from the playback queue
+    int new_sample;               //set when a new sample has been handed on this time round the loop
+    link_stats link;              //link counters, reported when frames are lost
+    uint32_t rx_lost = 0;
     printf("Receiver setup complete. Waiting for messages...\r\n");
 
     while(1)
     {
+        if (LINK_NODES == 1)
+        {
+            link_speed_poll(&speed, micros());          //falls back to a slower rate if a speed change is not confirmed
+            turn_cal_poll(&turn, micros());             //back to the settled gap if the probes stop
+        }
+        pollNodes();
+        pollConsole();
+
+        //samples are handed on at the intervals they were measured at, not all at once when their frame arrives
+        new_sample = 0;
+        for (int i = 0; i < LINK_NODES; i++)
+        {
+            while (batch_rx_next(&nodes[i].playback, micros(), &sample) == 0)
+            {
+                takeSample(&nodes[i], &sample);
+                if (i == shown)
+                {
+                    lat_stats_display(&latency, sample.seq, sample.stamp, micros());      //the display modes below use it on this pass
+                    new_sample = 1;
+                }
+            }
+        }
+        x_val = nodes[shown].x;
+        y_val = nodes[shown].y;
+        z_val = nodes[shown].z;
+
         //This section switches the lcd display mode in response to a button press
         currentButton = buttonpressed();                   //call buttonpressed function to check if button has been pressed
         if (previousButton == 0 && currentButton == 1)     
@@ -155,46 +265,97 @@ int main()
            
 
 
-        if (data_ready)                                     //data ready flag controller by usart1 interupt handler
+        //every frame that queued up while the LCD was being drawn is handled now, oldest first
+        while ((frame = receive_Frame()) != 0)             //parsed where the interrupt put it
         {
-
-            printf("Data ready flag set. Processing received message...\r\n");
-
-            int i = 0;                                  
-            char c;                                       
-            while(get_circ_buf(&rx_buf, &c) == 0)         //get circ buffer fuction returns 0 when circular buffer is not empty    
-            {
-                message_received[i++] = c;              //next character of buffer is retrieved and stored in message array each time get_circ_buf function is called
-                //printf("Char extracted from buffer: %c\r\n", c);
-            }
-           message_received[i+1] = '\0';            
-           
-           printf("Message received from USART1: %s\r\n", message_received);      //print to serial monitor (usart2) 
-           
            //THREE POSSIBLE MESSAGE RECIEVED FROM SENDER BOARD VIA USART : 
-           // - X,Y,Z accelerometer packet
+           // - X,Y,Z accelerometer packet (binary frame)
            // - "PONG" - to put the board in pong mode
            // - "EXIT" - to put exit pong mode
 
-           if (strcmp(message_received, "PONG") == 0)      //when the reciever board recieves the message "PONG" - pong mode flag is set to 1
+           if (frame->len == 4 && memcmp(frame->data, "PONG", 4) == 0)      //when the reciever board recieves the message "PONG" - pong mode flag is set to 1
            {
             pongMode = 1;
+            credit_rx_init(&credit, PONG_CREDITS, CREDIT_REFRESH_US, micros());     //the sender starts with the same credit
            }
-           else if(strcmp(message_received, "EXIT") == 0)    //when the sender baord sends an "EXIT" message - pong mode flag is set to 0
+           else if(frame->len == 4 && memcmp(frame->data, "EXIT", 4) == 0)    //when the sender baord sends an "EXIT" message - pong mode flag is set to 0
            {
             pongMode = 0;
            }
-    
-        else if (sscanf(message_received, "X=%d,Y=%d,Z=%d", &x_val, &y_val, &z_val) == 3) {
-            
-          //  printf("Parsed values - X: %d, Y: %d, Z: %d\r\n", x_val, y_val, z_val);
-        } else {
+           else if (decode_Frame(frame, &rx_pkt) == 0 &&
+                    rx_pkt.addr >= PKT_ADDR_FIRST && rx_pkt.addr < PKT_ADDR_FIRST + LINK_NODES)     //the text messages are checked first so they do not count as bad frames
+           {
+            node = &nodes[rx_pkt.addr - PKT_ADDR_FIRST];
+            if (LINK_NODES == 1)
+            {
+                link_speed_input(&speed, &rx_pkt, micros());        //every frame from the sender keeps the negotiated rate alive
+                turn_cal_input(&turn, &rx_pkt, micros());
+            }
+            if (rx_pkt.type == PKT_TYPE_SPEED || rx_pkt.type == PKT_TYPE_TURN)
+            {
+                //handled by the rate negotiation and the turnaround calibration
+            }
+            else if (pongMode == 1)
+            {
+                credit_rx_heard(&credit, rx_pkt.seq, micros());
+                if (batch_rx_unpack(&node->playback, &rx_pkt, micros()) > 0 && node == &nodes[shown])     //pong mode samples are not acknowledged, use them as they come
+                {
+                    noteArrival(node, frame);
+                }
+            }
+            else
+            {
+                hands_back = arq_rx_accept(&node->arq, &rx_pkt);
+                if (LINK_NODES > 1)
+                {
+                    poll_sched_heard(&sched, rx_pkt.addr, hands_back, frame->time);      //the ack goes with the board's next turn
+                }
+                else if (hands_back)
+                {
+                    send_Ack(node, 0);                              //answer the poll straight away, before any slow LCD drawing
+                }
+                while (arq_rx_pop(&node->arq, &sample_pkt) == 0)     //samples are used in sequence order, a gap holds later ones back
+                {
+                    if (batch_rx_unpack(&node->playback, &sample_pkt, micros()) > 0 && sample_pkt.seq == rx_pkt.seq && node == &nodes[shown])
+                    {
+                        noteArrival(node, frame);                   //only the frame that has just come in, not ones held back by a gap
+                    }
+                }
+            }
+           }
+        else {
             // If parsing fails, show raw message
+            char message_received[FRAME_SLOT_SIZE + 1];
+            memcpy(message_received, frame->data, frame->len);
+            message_received[frame->len] = '\0';
+            printf("Message received from USART1: %s\r\n", message_received);      //print to serial monitor (usart2) 
             printf("Parsing failed. Displaying raw message.\r\n");
             printMessage(1, message_received);
         }   //call printMessage funtion to print to LCD
             
-        if(mode == 0)
+            release_Frame(frame);                                  //After message has been handled the slot can take the next frame
+        }
+
+        if (pongMode == 1)
+        {
+            //more credit once the frame using the last of it has been handled - the sender is quiet until then
+            uint8_t grant[PKT_MAX_WIRE];
+            int grant_len = credit_rx_grant(&credit, PKT_ADDR_FIRST, micros(), grant, sizeof(grant));
+            if (grant_len > 0)
+            {
+                send_Control(grant, grant_len);
+            }
+        }
+
+        link_Stats(&link);
+        if (link.overflows + link.too_long != rx_lost)
+        {
+            rx_lost = link.overflows + link.too_long;
+            printf("receive queue: %lu frames, %lu lost while full, %lu too long, deepest %u of %u\r\n",
+                   link.frames_in, link.overflows, link.too_long, link.high_water, FRAME_POOL_SLOTS);
+        }
+
+        if(mode == 0 && new_sample)
         {
             //mode 0 displays the x,y and z accelerometer values
             char xyz_buffer[32];
@@ -219,12 +380,6 @@ printMessage(1,xyz_buffer);
 
 
        }
-            clearMessage(message_received, CIRC_BUF_SIZE);          //After message has been recieved, call function to clear message recieved function
-            data_ready = 0;                                        //reset data flag to zero
-            delay(10000);
-            if(pongMode == 0)                                    //only send Ack message back to sender board if pong mode flag is not set to 1
-            {send_Ack(); }                                              
-        }
 
        
 
@@ -239,15 +394,16 @@ void setup()
     initClocks();    
     RCC->AHB2ENR |= (1 << 0) + (1 << 1);     // enable GPIOA and GPIOB
     //Changing led functionality pins to pins to control chip comms settings
+#if !LINK_HW_DE                             //with USART1 driver enable, DE/RE are on PA12 and set up by initSerial()
     pinMode(GPIOB,4,1);                     //Set pin B4 to 1 -ouput pin for RE
     pinMode(GPIOB,5,1);                    //Set pin pB5 to 1 - output pin for DE
+#endif
     pinMode(GPIOB,0,0);
     enablePullUp(GPIOB,0);
-    initSerial(9600);
-    enable_Recieve(4,5);
+    initSerial(LINK_BAUD_SAFE, DEBUG_BAUD);                   //transceiver starts in receive mode
     
 }
-void initSerial(uint32_t baudrate)
+void initSerial(uint32_t link_baud, uint32_t debug_baud)
 {
     RCC->AHB2ENR |= (1 << 0);                                // make sure GPIOA is turned on
     pinMode(GPIOA,2,2);                                     // alternate function mode for PA2
@@ -265,27 +421,38 @@ void initSerial(uint32_t baudrate)
 
 
 
-    const uint32_t CLOCK_SPEED=80000000;    
-    uint32_t BaudRateDivisor;
-    
-    BaudRateDivisor = CLOCK_SPEED/baudrate;      
+    baud_setting link_setting;
+    baud_setting debug_setting;
+
+    if (baud_calc(LINK_CLOCK, link_baud, 1, &link_setting) != 0)      //rounded divider, 8x oversampling only if 16x cannot reach the rate
+    {
+        baud_calc(LINK_CLOCK, LINK_BAUD_SAFE, 0, &link_setting);
+    }
+    if (baud_calc(LINK_CLOCK, debug_baud, 1, &debug_setting) != 0)
+    {
+        baud_calc(LINK_CLOCK, 9600, 0, &debug_setting);
+    }
     USART1->CR1 = 0;                                       //clear control reg 1
     USART1->CR2 = 0;                                      //clear control reg 2
-    USART1->CR3 = (1 << 12);                             //disable over-run errors
-    USART1->BRR = BaudRateDivisor;                      //set baud rate
-    USART1->CR1 =  (1 << 3);                           //enable the transmitter 
+    USART1->CR3 = 0;                                     //over-run detection stays on, errors are counted in link_Stats()
+    USART1->BRR = link_setting.brr;                     //set baud rate
+    USART1->CR1 =  (1 << 3) | (link_setting.over8 << 15);  //enable the transmitter, OVER8 if needed
     USART1->CR1 |=  (1 << 2);                         //enable the receiver
+    init_Transceiver(link_baud);                              //driver enable, transmit and receive DMA - must be set up before UE
     USART1->CR1 |= (1 << 0);                         //enable usart1 peripheral 
-    USART1->CR1 |= (1 << 5);                        //enable RXNE interrupt for USART1
     USART1->ICR = (1 << 1);                        //Clear any pending USART1 errors 
                                              
     USART2->CR1 = 0;                              //repeat for usart2
     USART2->CR2 = 0;
     USART2->CR3 = (1 << 12);             
-    USART2->BRR = BaudRateDivisor;
-    USART2->CR1 =  (1 << 3);   
+    USART2->BRR = debug_setting.brr;
+    USART2->CR1 =  (1 << 3) | (debug_setting.over8 << 15);
     USART2->CR1 |=  (1 << 2);  
+    console_ring_init(&console_rx);
+    USART2->CR1 |= (1 << 5);                       //RXNEIE - console characters are collected by USART2_IRQHandler()
     USART2->CR1 |= (1 << 0);
+
+    printf("USART1 %lu baud (%ld ppm), USART2 %lu baud (%ld ppm)\r\n", link_setting.actual, link_setting.error_ppm, debug_setting.actual, debug_setting.error_ppm);
 }
 int _write(int file, char *data, int len)
 {
@@ -321,64 +488,243 @@ int buttonpressed(void)
         return 0;  
     }
 }
-void sendMessage()
+void send_Ack(sensor_node *node, uint8_t flags)
+{
+    //function is used to send the ack frame back to a sender board through USART1 when it polls,
+    //or with flags = PKT_FLAG_POLL to hand it the bus on a shared pair.
+    //The frame is queued and sent by DMA, the USART drives the transceiver DE line itself so no leading guard spaces are needed.
+       uint8_t frame[PKT_MAX_WIRE];
+       int len = arq_rx_ack(&node->arq, PKT_ADDR_FIRST + (node - nodes), flags, frame, sizeof(frame));
+
+       send_Control(frame, len);
+}
+
+void startBus()
 {
-    //function is used to call function to send message to LCD. It is also adds sqaure brackets to the start and end of the message in the input
-    //buffer and transmitts it through USART1.    
-       const char *msg = "  [Ack]";
-
-        for (int i = 0; msg[i] != '\0'; i++) {
-            while (!(USART1->ISR & (1 << 6)));  // Wait until TXE = 1
-            USART1->TDR = msg[i];
-      //     printf("Sent: %c\n", msg[i]);       // Debug: print each character
-            delay(100000);
+    //on a shared pair every sensor board is taken on at the default poll period and the link goes to LINK_BAUD_BUS
+    uint32_t us_per_byte = (10000000 + LINK_BAUD_BUS - 1) / LINK_BAUD_BUS;
+
+    if (LINK_NODES == 1)
+    {
+        return;
+    }
+    setSpeed(0, LINK_BAUD_BUS);
+    poll_sched_init(&sched, (POLL_ACK_BYTES + POLL_ANSWER_BYTES) * us_per_byte + 2 * POLL_TURNAROUND_US,
+                    (POLL_ACK_BYTES + POLL_ANSWER_BYTES) * us_per_byte + POLL_TURNAROUND_US);
+    for (int i = 0; i < LINK_NODES; i++)
+    {
+        if (poll_sched_add(&sched, PKT_ADDR_FIRST + i, POLL_PERIOD_US, micros()) < 0)
+        {
+            printf("sensor board %d does not fit on the bus at a %lu ms poll period\r\n", PKT_ADDR_FIRST + i, (unsigned long)(POLL_PERIOD_US / 1000));
         }
-        while (!(USART1->ISR & (1 << 7)));      // Wait until TC = 1 (all sent)
-    
-    
+    }
 }
 
-void clearMessage(char *buffer, int size)
+void pollNodes()
 {
-   //function used to clear recieved message after it has been recieved and displayed.
-    for (int i = 0; i < size; i++)
+    //shared pair: ends a turn that has run out and hands the bus to the next sensor board that is due
+    int next;
+
+    if (LINK_NODES == 1)
     {
-        buffer[i] = '\0';
+        return;
+    }
+    poll_sched_poll(&sched, micros());
+    if (transmit_Busy())
+    {
+        return;
+    }
+    next = poll_sched_next(&sched, micros());
+    if (next != POLL_NONE)
+    {
+        send_Ack(&nodes[sched.node[next].addr - PKT_ADDR_FIRST], PKT_FLAG_POLL);     //acks its last turn as well
     }
 }
 
-void USART1_IRQHandler(void)
+void printNodes()
 {
-    
-    //Interupt function handler - called when USART1 RX buffer is not empty
+    //latest-sample table and poll counters, one line per sensor board
+    uint32_t now = micros();
+    for (int i = 0; i < LINK_NODES; i++)
+    {
+        printf("%c board %d: X=%d Y=%d Z=%d mg, %lu samples, last %lu ms ago\r\n", i == shown ? '*' : ' ',
+               PKT_ADDR_FIRST + i, nodes[i].x, nodes[i].y, nodes[i].z, nodes[i].samples, (now - nodes[i].updated) / 1000);
+    }
+    for (int i = 0; i < sched.count; i++)
+    {
+        poll_node *n = &sched.node[i];
+        printf("  board %d: every %lu ms, %lu polls, %lu answered, %lu missed, up to %lu us late\r\n",
+               n->addr, n->period / 1000, n->polls, n->answered, n->missed, n->late_max);
+    }
+    if (LINK_NODES > 1)
+    {
+        printf("bus %lu.%lu%% booked\r\n", sched.load / 10, sched.load % 10);
+    }
+}
 
-    if (USART1->ISR & (1 << 5))               // Check if RXNE (Receive Not Empty) flag is set
+void sendSpeedFrame(void *ctx, const uint8_t *payload, uint8_t len)
+{
+    //replies to the sender's rate negotiation
+    uint8_t frame[PKT_MAX_WIRE];
+    int frame_len = packet_encode(PKT_TYPE_SPEED, PKT_ADDR_ALL, 0, payload, len, frame, sizeof(frame));
+    send_Control(frame, frame_len);
+}
+
+void sendTurnFrame(void *ctx, const uint8_t *payload, uint8_t len)
+{
+    //echoes and acknowledgements for the sender's turnaround calibration
+    uint8_t frame[PKT_MAX_WIRE];
+    int frame_len = packet_encode(PKT_TYPE_TURN, PKT_ADDR_ALL, 0, payload, len, frame, sizeof(frame));
+    send_Control(frame, frame_len);
+}
+
+void setGap(void *ctx, uint8_t gap_bits)
+{
+    set_Link_Gap(gap_bits);
+}
+
+void setSpeed(void *ctx, uint32_t baud)
+{
+    int32_t error_ppm;
+    if (set_Link_Baud(baud, &error_ppm) == 0)
     {
-       
-        char c = USART1->RDR;               // Read the received character
-        if (c == '[')                      // Message recieved from board 2 will be enclosed in sqaure brackets
+        link_baud = baud;
+        printf("USART1 now %lu baud (%ld ppm)\r\n", baud, error_ppm);
+    }
+}
+
+void takeSample(sensor_node *node, const batch_sample *s)
+{
+    //converts a raw accelerometer sample to the same units the sender used to transmit as text and makes it the board's latest
+    node->x = ((int32_t)s->x * 981) / 16384;      // assuming +1g ->16384 (+/-2g range)
+    node->y = ((int32_t)s->y * 981) / 16384;
+    node->z = ((int32_t)s->z * 981) / 16384;
+    node->updated = micros();
+    node->samples++;
+}
+
+void noteArrival(const sensor_node *node, const frame_slot *frame)
+{
+    //feeds the clock offset estimate with the newest sample just unpacked from frame
+    uint32_t wire_us = (frame->len + 2) * 10000000 / link_baud;     //10 bits per byte including delimiters
+    lat_stats_arrival(&latency, node->playback.last_stamp, frame->time, wire_us);
+}
+
+void printStats()
+{
+    printf("latency: %lu samples, min %lu us, mean %lu us, p99 %lu us, max %lu us\r\n",
+           latency.count, latency.min, lat_stats_mean(&latency), lat_stats_percentile(&latency, 990), latency.max);
+    printf("samples: %lu missing, %lu late, %lu dropped by playback\r\n", latency.missing, latency.late, nodes[shown].playback.dropped);
+}
+
+void printLinkStats()
+{
+    link_stats s;
+    link_Stats(&s);
+    printf("link in: %lu bytes, %lu frames, %lu framing, %lu noise, %lu overrun, %lu cut short, %lu too long, %lu queue full\r\n",
+           s.bytes_in, s.frames_in, s.framing_errors, s.noise_errors, s.overruns, s.truncated, s.too_long, s.overflows);
+    printf("link in: %lu bad checksum, %lu undecodable, %u waiting, deepest %u of %u\r\n",
+           s.crc_errors, s.bad_frames, s.waiting, s.high_water, FRAME_POOL_SLOTS);
+    printf("link out: %lu bytes, %lu frames, %lu queue full, deepest %u of %u, %lu control frames sent first\r\n",
+           s.bytes_out, s.frames_out, s.tx_full, s.tx_high_water, LINK_TX_QUEUE_LEN, s.tx_preempted);
+    printf("link out: turnaround gap %u bits, %lu frames held for it\r\n", s.gap_bits, s.tx_held);
+}
+
+void pollConsole()
+{
+    //collects a line typed on the serial monitor (USART2) and handles "stats", "stats reset", "link", "isr", "nodes",
+    //"show <board>" and "poll <board> <ms>"
+    unsigned int board, period_ms;
+    int index;
+    char c;
+    while (console_ring_pop(&console_rx, &c) == 0)
+    {
+        if (c != '\r' && c != '\n' && input_index < INPUT_BUFFER_SIZE - 1)
         {
-            
-            init_circ_buf(&rx_buf);         // Reset/clear the circular buffer
-            message_started = 1;           // Set flag because message is being receiving
+            input_buffer[input_index++] = c;
+            continue;
         }
-        else if (c == ']')                //when final character of message is recieved
+        input_buffer[input_index] = '\0';
+        if (strcmp((const char *)input_buffer, "stats") == 0)
         {
-           
-            if (message_started)                                 
-            {
-                data_ready = 1;                            //data ready if flag set if message was being recieved - indicated by flag above
-                message_started = 0;                      // Reset message recieving flag     
-            }
-  
+            printStats();
+        }
+        else if (strcmp((const char *)input_buffer, "stats reset") == 0)
+        {
+            lat_stats_reset(&latency);
+            printf("statistics cleared\r\n");
+        }
+        else if (strcmp((const char *)input_buffer, "link") == 0)
+        {
+            printLinkStats();
+        }
+        else if (strcmp((const char *)input_buffer, "isr") == 0)
+        {
+            printIsrTimes();
         }
-        else
+        else if (strcmp((const char *)input_buffer, "nodes") == 0)
         {
-            if (message_started)
+            printNodes();
+        }
+        else if (sscanf((const char *)input_buffer, "show %u", &board) == 1 &&
+                 board >= PKT_ADDR_FIRST && board < PKT_ADDR_FIRST + LINK_NODES)
+        {
+            shown = board - PKT_ADDR_FIRST;
+            lat_stats_reset(&latency);                  //latency is measured for the board on show
+            printf("showing sensor board %u\r\n", board);
+        }
+        else if (sscanf((const char *)input_buffer, "poll %u %u", &board, &period_ms) == 2 &&
+                 (index = poll_sched_find(&sched, board)) >= 0)
+        {
+            if (poll_sched_set_period(&sched, index, period_ms * 1000) == 0)
             {
-                put_circ_buf(&rx_buf, c);             // Store characters in circular buffer if recieving message flag is set and if end of message has not been reached
+                printf("polling sensor board %u every %u ms, bus %lu.%lu%% booked\r\n", board, period_ms, sched.load / 10, sched.load % 10);
             }
+            else
+            {
+                printf("no bus time for sensor board %u every %u ms\r\n", board, period_ms);
+            }
+        }
+        else if (input_index > 0)
+        {
+            printf("unknown command - stats / stats reset / link / isr / nodes / show <board> / poll <board> <ms>\r\n");
         }
+        input_index = 0;
+    }
+}
+
+void USART2_IRQHandler(void)
+{
+    //moves each console character into console_rx, the main loop picks them up in pollConsole()
+    uint32_t start = cycles();
+    while (USART2->ISR & (1 << 5))              // RXNE - reading RDR clears it
+    {
+        if (console_ring_push(&console_rx, USART2->RDR) != 0)
+        {
+            console_overruns++;
+        }
+    }
+    isr_Time(&isr_usart2, start);
+}
+
+void USART1_IRQHandler(void)
+{
+    //Interupt function handler - called on idle line after received bytes or when a transmitted frame has completed
+    uint32_t start = cycles();
+    transceiver_USART1_IRQ();                 // runs the frame extractor over the receive ring / releases the bus at transmission complete
+    isr_Time(&isr_usart1, start);
+}
+
+void printIsrTimes()
+{
+    //longest and mean run of every interrupt handler since reset
+    const isr_time *isr[] = { &isr_usart1, &isr_link_tx_dma, &isr_link_rx_dma, &isr_alarm, &isr_usart2 };
+    for (unsigned i = 0; i < sizeof(isr) / sizeof(isr[0]); i++)
+    {
+        const isr_time *t = isr[i];
+        uint32_t mean = t->calls ? t->total_cycles / t->calls : 0;
+        printf("isr %s: %lu calls, longest %lu cycles (%lu us), mean %lu cycles\r\n",
+               t->name, t->calls, t->max_cycles, t->max_cycles / 80, mean);
     }
 }
 
@@ -0,0 +1,145 @@
+#include <stdint.h>
+#include "poll_sched.h"
+
+void poll_sched_init(poll_sched *s, uint32_t turn_us, uint32_t reply_us)
+{
+    s->count = 0;
+    s->current = POLL_NONE;
+    s->deadline = 0;
+    s->turn_us = turn_us;
+    s->reply_us = reply_us;
+    s->load = 0;
+}
+
+//per mille of bus time a board polled every `period` takes, rounded up
+static uint32_t load_of(const poll_sched *s, uint32_t period)
+{
+    if (period == 0)
+    {
+        return UINT32_MAX;
+    }
+    return (uint32_t)(((uint64_t)s->turn_us * 1000 + period - 1) / period);
+}
+
+int poll_sched_add(poll_sched *s, uint8_t addr, uint32_t period, uint32_t now)
+{
+    //takes on a sensor board to be polled every `period` us, the first poll is due straight away
+    //returns its index, or -1 if the table is full, it is already there or the bus has no time for it
+    uint32_t load = load_of(s, period);
+    poll_node *n;
+
+    if (s->count >= POLL_MAX_NODES || poll_sched_find(s, addr) >= 0 || load > POLL_MAX_LOAD - s->load)
+    {
+        return -1;
+    }
+    n = &s->node[s->count];
+    n->addr = addr;
+    n->period = period;
+    n->load = load;
+    n->due = now;
+    n->polls = 0;
+    n->answered = 0;
+    n->missed = 0;
+    n->late_max = 0;
+    s->load += load;
+    return s->count++;
+}
+
+int poll_sched_set_period(poll_sched *s, int index, uint32_t period)
+{
+    //changes how often a board is polled, returns -1 (and keeps the old period) if the bus has no time for it
+    poll_node *n = &s->node[index];
+    uint32_t load = load_of(s, period);
+
+    if (load > POLL_MAX_LOAD - (s->load - n->load))
+    {
+        return -1;
+    }
+    s->load = s->load - n->load + load;
+    n->load = load;
+    n->period = period;
+    return 0;
+}
+
+int poll_sched_find(const poll_sched *s, uint8_t addr)
+{
+    for (int i = 0; i < s->count; i++)
+    {
+        if (s->node[i].addr == addr)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int poll_sched_next(poll_sched *s, uint32_t now)
+{
+    //picks the board to hand the bus to now, the caller sends it an ack with PKT_FLAG_POLL straight away
+    //returns its index, or POLL_NONE if a turn is still running or no board is due yet
+    int best = POLL_NONE;
+    poll_node *n;
+
+    if (s->current != POLL_NONE)
+    {
+        return POLL_NONE;
+    }
+    for (int i = 0; i < s->count; i++)
+    {
+        int32_t overdue = now - s->node[i].due;
+        if (overdue >= 0 && (best == POLL_NONE || (int32_t)(s->node[i].due - s->node[best].due) < 0))
+        {
+            best = i;
+        }
+    }
+    if (best == POLL_NONE)
+    {
+        return POLL_NONE;
+    }
+
+    n = &s->node[best];
+    if (now - n->due > n->late_max)
+    {
+        n->late_max = now - n->due;
+    }
+    n->due += n->period;
+    if ((int32_t)(now - n->due) > 0)
+    {
+        n->due = now;                   //fell a whole period behind, do not try to catch up with a burst of polls
+    }
+    n->polls++;
+    s->current = best;
+    s->deadline = now + s->reply_us;
+    return best;
+}
+
+void poll_sched_heard(poll_sched *s, uint8_t addr, int hands_back, uint32_t now)
+{
+    //a frame arrived from addr, hands_back is set if it carried PKT_FLAG_POLL
+    //the board holding the bus gets reply_us more after every frame, so a long answer is not cut off
+    if (s->current == POLL_NONE || s->node[s->current].addr != addr)
+    {
+        return;
+    }
+    if (hands_back)
+    {
+        s->node[s->current].answered++;
+        s->current = POLL_NONE;
+    }
+    else
+    {
+        s->deadline = now + s->reply_us;
+    }
+}
+
+int poll_sched_poll(poll_sched *s, uint32_t now)
+{
+    //ends a turn the board has let run out, returns 1 if it did
+    if (s->current == POLL_NONE || (int32_t)(now - s->deadline) < 0)
+    {
+        return 0;
+    }
+    s->node[s->current].missed++;
+    s->current = POLL_NONE;
+    return 1;
+}
@@ -0,0 +1,135 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+#include <stdint.h>
+#include <string.h>
+
+// Lock-free single producer / single consumer ring (replaces circular_buffer)
+//
+// SPSC_RING(name, type, capacity) declares a ring type `name` holding up to `capacity` elements of
+// `type` and its functions name_init(), name_push(), name_pop() etc. The capacity has to be a power
+// of two so indexes are masked rather than divided.
+//
+// head and tail run freely and wrap at 2^32, head - tail is the number of elements held. Only the
+// producer writes head and only the consumer writes tail, so one side can be an interrupt (or feed
+// a DMA channel) while the other is the main loop without any critical section. The __atomic loads
+// and stores order the element data against the index that hands it over.
+//
+// The span functions give the largest contiguous block that can be written or read in place -
+// fill or drain it (e.g. by DMA) and then commit how much was used.
+
+#define SPSC_RING(name, type, capacity)                                                          \
+typedef struct {                                                                                 \
+    type data[capacity];                                                                         \
+    uint32_t head;                      /* next element to write, producer only */               \
+    uint32_t tail;                      /* next element to read, consumer only */                \
+} name;                                                                                          \
+                                                                                                 \
+_Static_assert((capacity) > 0 && ((capacity) & ((capacity) - 1)) == 0,                           \
+               #name " capacity must be a power of two");                                        \
+                                                                                                 \
+static inline void name##_init(name *r)                                                          \
+{                                                                                                \
+    r->head = 0;                                                                                 \
+    r->tail = 0;                                                                                 \
+}                                                                                                \
+                                                                                                 \
+static inline uint32_t name##_count(const name *r)                                               \
+{                                                                                                \
+    return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE); \
+}                                                                                                \
+                                                                                                 \
+/* producer side */                                                                              \
+static inline uint32_t name##_push_span(name *r, type **span)                                    \
+{                                                                                                \
+    uint32_t head = r->head;                                                                     \
+    uint32_t free = (capacity) - (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE));           \
+    uint32_t to_end = (capacity) - (head & ((capacity) - 1));                                    \
+    *span = &r->data[head & ((capacity) - 1)];                                                   \
+    return free < to_end ? free : to_end;                                                        \
+}                                                                                                \
+                                                                                                 \
+static inline void name##_push_commit(name *r, uint32_t n)                                       \
+{                                                                                                \
+    __atomic_store_n(&r->head, r->head + n, __ATOMIC_RELEASE);                                   \
+}                                                                                                \
+                                                                                                 \
+static inline int name##_push(name *r, type value)                                               \
+{                                                                                                \
+    /* returns -1 if the ring is full */                                                         \
+    uint32_t head = r->head;                                                                     \
+    if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= (capacity))                        \
+    {                                                                                            \
+        return -1;                                                                               \
+    }                                                                                            \
+    r->data[head & ((capacity) - 1)] = value;                                                    \
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);                                      \
+    return 0;                                                                                    \
+}                                                                                                \
+                                                                                                 \
+static inline uint32_t name##_push_bulk(name *r, const type *src, uint32_t n)                    \
+{                                                                                                \
+    /* copies as much of src[] as fits, in at most two blocks, returns the number pushed */      \
+    uint32_t done = 0;                                                                           \
+    for (int pass = 0; pass < 2 && done < n; pass++)                                             \
+    {                                                                                            \
+        type *span;                                                                              \
+        uint32_t len = name##_push_span(r, &span);                                               \
+        if (len > n - done)                                                                      \
+        {                                                                                        \
+            len = n - done;                                                                      \
+        }                                                                                        \
+        memcpy(span, &src[done], len * sizeof(type));                                            \
+        name##_push_commit(r, len);                                                              \
+        done += len;                                                                             \
+    }                                                                                            \
+    return done;                                                                                 \
+}                                                                                                \
+                                                                                                 \
+/* consumer side */                                                                              \
+static inline uint32_t name##_pop_span(name *r, type **span)                                     \
+{                                                                                                \
+    uint32_t tail = r->tail;                                                                     \
+    uint32_t used = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - tail;                          \
+    uint32_t to_end = (capacity) - (tail & ((capacity) - 1));                                    \
+    *span = &r->data[tail & ((capacity) - 1)];                                                   \
+    return used < to_end ? used : to_end;                                                        \
+}                                                                                                \
+                                                                                                 \
+static inline void name##_pop_commit(name *r, uint32_t n)                                        \
+{                                                                                                \
+    __atomic_store_n(&r->tail, r->tail + n, __ATOMIC_RELEASE);                                   \
+}                                                                                                \
+                                                                                                 \
+static inline int name##_pop(name *r, type *value)                                               \
+{                                                                                                \
+    /* returns -1 if the ring is empty */                                                        \
+    uint32_t tail = r->tail;                                                                     \
+    if (__atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == tail)                                     \
+    {                                                                                            \
+        return -1;                                                                               \
+    }                                                                                            \
+    *value = r->data[tail & ((capacity) - 1)];                                                   \
+    __atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);                                      \
+    return 0;                                                                                    \
+}                                                                                                \
+                                                                                                 \
+static inline uint32_t name##_pop_bulk(name *r, type *dst, uint32_t n)                           \
+{                                                                                                \
+    /* copies up to n elements out, in at most two blocks, returns the number popped */          \
+    uint32_t done = 0;                                                                           \
+    for (int pass = 0; pass < 2 && done < n; pass++)                                             \
+    {                                                                                            \
+        type *span;                                                                              \
+        uint32_t len = name##_pop_span(r, &span);                                                \
+        if (len > n - done)                                                                      \
+        {                                                                                        \
+            len = n - done;                                                                      \
+        }                                                                                        \
+        memcpy(&dst[done], span, len * sizeof(type));                                            \
+        name##_pop_commit(r, len);                                                               \
+        done += len;                                                                             \
+    }                                                                                            \
+    return done;                                                                                 \
+}
+
+#endif
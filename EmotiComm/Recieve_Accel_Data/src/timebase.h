@@ -0,0 +1,28 @@
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+#include <stdint.h>
+
+// Free-running microsecond counter on TIM2 (32 bit, wraps after about 71 minutes)
+// Differences between two readings are correct across the wrap as long as they are done in uint32_t.
+void init_Timebase(void);
+uint32_t micros(void);
+
+// One-shot alarm on TIM2 compare channel 1: fn runs from the TIM2 interrupt once micros() reaches time.
+// Setting a new alarm replaces the one waiting. Keep fn short, it runs in the interrupt.
+void alarm_At(uint32_t time, void (*fn)(void));
+
+// CPU cycle counter (DWT CYCCNT, 80 per microsecond, wraps after about 53 seconds), started by init_Timebase()
+// Interrupt handlers time themselves with it: take cycles() on entry and pass it to isr_Time() on the way out.
+typedef struct {
+    const char *name;
+    uint32_t calls;
+    uint32_t max_cycles;            //longest single run, entry to exit
+    uint64_t total_cycles;
+} isr_time;
+
+uint32_t cycles(void);
+void isr_Time(isr_time *t, uint32_t start);
+
+extern isr_time isr_alarm;          //run times of TIM2_IRQHandler
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef BAUD_H
+#define BAUD_H
+#include <stdint.h>
+
+// USART baud rate register calculation
+// With 16x oversampling BRR = USARTDIV = clock/baud (rounded), with 8x oversampling
+// USARTDIV = 2*clock/baud and BRR holds USARTDIV with bits 3:0 shifted right by one.
+// USARTDIV must be at least 16 in both modes.
+
+#define BAUD_MAX_ERROR_PPM 10000        //reject settings more than 1% away from the requested rate
+
+typedef struct {
+    uint32_t brr;                       //value for USARTx->BRR
+    uint8_t over8;                      //1 = set OVER8 in CR1
+    uint32_t actual;                    //baud rate the setting really gives
+    int32_t error_ppm;                  //(actual - requested) in parts per million
+} baud_setting;
+
+int baud_calc(uint32_t clock, uint32_t baud, int allow_over8, baud_setting *out);
+
+#endif
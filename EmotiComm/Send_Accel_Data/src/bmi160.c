@@ -0,0 +1,208 @@
+#include <stdint.h>
+#include "bmi160.h"
+
+void bmi160_init(bmi160 *s, const bmi160_bus *bus, uint8_t addr)
+{
+    s->bus = bus;
+    s->addr = addr;
+    s->reads = 0;
+    s->errors = 0;
+}
+
+int bmi160_start(bmi160 *s)
+{
+    //takes the accelerometer out of power-down, it needs a few ms before the first reading
+    uint8_t cmd = BMI160_CMD_ACC_NORMAL;
+    if (s->bus->write(s->bus->hw, s->addr, BMI160_REG_CMD, &cmd, 1) != 0)
+    {
+        s->errors++;
+        return -1;
+    }
+    return 0;
+}
+
+int bmi160_read_accel(bmi160 *s, bmi160_accel *a)
+{
+    //all three axes in one burst, returns -1 and leaves a alone if the bus failed
+    uint8_t raw[BMI160_ACC_BYTES];
+
+    if (s->bus->read(s->bus->hw, s->addr, BMI160_REG_ACC_X_L, raw, BMI160_ACC_BYTES) != 0)
+    {
+        s->errors++;
+        return -1;
+    }
+    bmi160_decode_accel(s, raw, a);
+    return 0;
+}
+
+void bmi160_decode_accel(bmi160 *s, const uint8_t *raw, bmi160_accel *a)
+{
+    //BMI160_ACC_BYTES data registers as read, each axis low byte first
+    a->x = (int16_t)(raw[0] | (raw[1] << 8));
+    a->y = (int16_t)(raw[2] | (raw[3] << 8));
+    a->z = (int16_t)(raw[4] | (raw[5] << 8));
+    s->reads++;
+}
+
+int bmi160_fifo_start(bmi160 *s, uint8_t odr, int headered, uint16_t watermark)
+{
+    //sets the output data rate, +/-2 g and accelerometer readings into the FIFO, then empties it
+    //watermark is in bytes, rounded down to the 4 byte steps of FIFO_CONFIG_0
+    uint8_t conf[2] = { (uint8_t)(0x20 | odr), 0x03 };     //normal filter, ACC_RANGE +/-2 g
+    uint8_t fifo[2] = { (uint8_t)(watermark / 4), (uint8_t)(0x40 | (headered ? 0x10 : 0)) };
+    uint8_t cmd = BMI160_CMD_FIFO_FLUSH;
+
+    if (s->bus->write(s->bus->hw, s->addr, BMI160_REG_ACC_CONF, conf, 2) != 0 ||
+        s->bus->write(s->bus->hw, s->addr, BMI160_REG_FIFO_CONFIG_0, fifo, 2) != 0 ||
+        s->bus->write(s->bus->hw, s->addr, BMI160_REG_CMD, &cmd, 1) != 0)
+    {
+        s->errors++;
+        return -1;
+    }
+    return 0;
+}
+
+uint16_t bmi160_fifo_length(const uint8_t *raw)
+{
+    //the two FIFO_LENGTH registers as read
+    return (uint16_t)((raw[0] | (raw[1] << 8)) & 0x07FF);
+}
+
+uint8_t bmi160_odr_code(uint16_t hz)
+{
+    //ACC_CONF code for 25 to 1600 Hz, 0 for a rate the accelerometer does not have in normal mode
+    for (uint8_t code = BMI160_ODR_25HZ; code <= BMI160_ODR_1600HZ; code++)
+    {
+        if (hz == (code >= BMI160_ODR_100HZ ? 100u << (code - BMI160_ODR_100HZ) : 100u >> (BMI160_ODR_100HZ - code)))
+        {
+            return code;
+        }
+    }
+    return 0;
+}
+
+uint32_t bmi160_odr_period_us(uint8_t odr)
+{
+    //time between readings at an ACC_CONF rate
+    return odr >= BMI160_ODR_100HZ ? 10000u >> (odr - BMI160_ODR_100HZ) : 10000u << (BMI160_ODR_100HZ - odr);
+}
+
+int bmi160_drdy_int1(bmi160 *s)
+{
+    //INT1 push-pull, active high, a 312.5 us pulse for every new reading
+    uint8_t out = 0x0A;                                     //INT_OUT_CTRL: int1_output_en, int1_lvl high
+    uint8_t latch = 0x01;                                   //INT_LATCH: temporary, 312.5 us
+    uint8_t map = 0x80;                                     //INT_MAP_1: data ready on INT1
+    uint8_t en = 0x10;                                      //INT_EN_1: data ready
+
+    if (s->bus->write(s->bus->hw, s->addr, BMI160_REG_INT_OUT_CTRL, &out, 1) != 0 ||
+        s->bus->write(s->bus->hw, s->addr, BMI160_REG_INT_LATCH, &latch, 1) != 0 ||
+        s->bus->write(s->bus->hw, s->addr, BMI160_REG_INT_MAP_1, &map, 1) != 0 ||
+        s->bus->write(s->bus->hw, s->addr, BMI160_REG_INT_EN_1, &en, 1) != 0)
+    {
+        s->errors++;
+        return -1;
+    }
+    return 0;
+}
+
+void bmi160_fifo_init(bmi160_fifo *f, int headered)
+{
+    f->headered = headered ? 1 : 0;
+    f->frames = 0;
+    f->skipped = 0;
+    f->partial = 0;
+    f->bad = 0;
+    f->config_changes = 0;
+    f->sensor_time = 0;
+    f->have_time = 0;
+}
+
+static void decode_frame(const uint8_t *raw, bmi160_accel *a)
+{
+    a->x = (int16_t)(raw[0] | (raw[1] << 8));
+    a->y = (int16_t)(raw[2] | (raw[3] << 8));
+    a->z = (int16_t)(raw[4] | (raw[5] << 8));
+}
+
+uint16_t bmi160_fifo_parse(bmi160_fifo *f, const uint8_t *data, uint16_t len, bmi160_accel *out, uint16_t max)
+{
+    //decodes one burst read from FIFO_DATA into out, oldest first, returns the readings written
+    //stops at the end of the data in the FIFO, and at max - BMI160_FIFO_MAX_READINGS holds any burst
+    uint16_t i = 0;
+    uint16_t n = 0;
+
+    while (i < len && n < max)
+    {
+        if (!f->headered)
+        {
+            if (len - i < BMI160_ACC_BYTES)
+            {
+                f->partial++;
+                break;
+            }
+            decode_frame(&data[i], &out[n]);
+            if (out[n].x == INT16_MIN && out[n].y == INT16_MIN && out[n].z == INT16_MIN)
+            {
+                break;                          //read past the last frame
+            }
+            i += BMI160_ACC_BYTES;
+            n++;
+            f->frames++;
+            continue;
+        }
+
+        uint8_t h = data[i];
+        uint8_t need;                           //bytes after the header
+        if ((h & 0xC0) == 0x80)
+        {
+            //regular frame, bits 4..2 say which of magnetometer (8 bytes), gyro (6) and accelerometer (6) follow
+            uint8_t parts = (h >> 2) & 0x07;
+            if (parts == 0)
+            {
+                break;                          //BMI160_FH_EMPTY
+            }
+            need = ((parts & 0x04) ? 8 : 0) + ((parts & 0x02) ? 6 : 0) + ((parts & 0x01) ? BMI160_ACC_BYTES : 0);
+        }
+        else if (h == BMI160_FH_SKIP || h == BMI160_FH_CONFIG)
+        {
+            need = 1;
+        }
+        else if (h == BMI160_FH_TIME)
+        {
+            need = 3;
+        }
+        else
+        {
+            f->bad++;                           //lost track of the frames, the rest of the burst cannot be trusted
+            break;
+        }
+        if (len - i < 1 + need)
+        {
+            f->partial++;
+            break;
+        }
+
+        const uint8_t *p = &data[i + 1];
+        if (h == BMI160_FH_SKIP)
+        {
+            f->skipped += p[0];
+        }
+        else if (h == BMI160_FH_CONFIG)
+        {
+            f->config_changes++;
+        }
+        else if (h == BMI160_FH_TIME)
+        {
+            f->sensor_time = p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16);
+            f->have_time = 1;
+        }
+        else if (h & 0x04)
+        {
+            decode_frame(p + need - BMI160_ACC_BYTES, &out[n++]);     //accelerometer data comes last
+            f->frames++;
+        }
+        i += 1 + need;
+    }
+    return n;
+}
@@ -0,0 +1,108 @@
+#ifndef BMI160_H
+#define BMI160_H
+#include <stdint.h>
+
+// BMI160 accelerometer
+// X, Y and Z are six consecutive registers from BMI160_REG_ACC_X_L, each axis low byte first. They are
+// read in one burst - the register pointer increments by itself - so a reading is one bus transaction,
+// and the BMI160 holds back the next sample until the burst has finished so the three axes always
+// come from the same instant.
+//
+// Nothing in here touches hardware, register reads and writes go through bmi160_bus. On the board that
+// is I2C1 (i2c.c), Host_Tools/bmi160_sim.c backs it with a simulated register map. Readings can also be
+// fetched in the background with i2c_async.h, BMI160_ACC_BYTES from BMI160_REG_ACC_X_L, and turned into
+// a bmi160_accel with bmi160_decode_accel().
+//
+// FIFO mode (bmi160_fifo_start()): the sensor samples by itself at a set output data rate and keeps the
+// readings in its 1024 byte FIFO. Once enough are waiting - BMI160_REG_FIFO_LENGTH says how many, or
+// the firmware counts the data-ready pulses bmi160_drdy_int1() puts on INT1 - the FIFO is drained from
+// BMI160_REG_FIFO_DATA in one burst of up to BMI160_FIFO_BURST bytes. bmi160_fifo_parse() turns the
+// bytes read into readings, oldest first.
+// - Headered frames: a header byte says what follows. An accelerometer frame is 0x84 and 6 data bytes,
+//   control frames report readings lost while the FIFO was full (skip), the sensor time and
+//   configuration changes, and 0x80 is what the FIFO returns once it is empty.
+// - Headerless frames: just the 6 data bytes each, no room for anything else, so lost readings cannot
+//   be seen. A frame of 0x8000 on every axis is what an empty FIFO returns.
+// A frame cut off at the end of a burst is not lost, the sensor sends it again at the start of the next.
+// At 100 kHz the bus carries about 1400 headered frames a second, so rates above 800 Hz need I2C1 at
+// 400 kHz or more (I2C_BUS_HZ in i2c.h).
+
+#define BMI160_ADDR            0x69        //SDO pulled high
+#define BMI160_REG_ACC_X_L     0x12        //ACC_X_L, ACC_X_H, ACC_Y_L, ACC_Y_H, ACC_Z_L, ACC_Z_H
+#define BMI160_REG_CMD         0x7E
+#define BMI160_CMD_ACC_NORMAL  0x11        //accelerometer out of suspend into normal mode
+#define BMI160_ACC_BYTES       6
+#define BMI160_REG_FIFO_LENGTH 0x22        //FIFO fill level in bytes, 11 bits, low byte first
+#define BMI160_REG_FIFO_DATA   0x24
+#define BMI160_REG_ACC_CONF    0x40        //output data rate and filter
+#define BMI160_REG_ACC_RANGE   0x41
+#define BMI160_REG_FIFO_CONFIG_0 0x46      //watermark, in units of 4 bytes
+#define BMI160_REG_FIFO_CONFIG_1 0x47      //what goes into the FIFO
+#define BMI160_REG_INT_EN_1    0x51        //bit 4: data ready
+#define BMI160_REG_INT_OUT_CTRL 0x53
+#define BMI160_REG_INT_LATCH   0x54
+#define BMI160_REG_INT_MAP_1   0x56        //bit 7: data ready to INT1
+#define BMI160_CMD_FIFO_FLUSH  0xB0
+
+//output data rates for ACC_CONF, the rate in Hz is 100 << (code - 8), see bmi160_odr_code()
+#define BMI160_ODR_25HZ        0x06
+#define BMI160_ODR_50HZ        0x07
+#define BMI160_ODR_100HZ       0x08
+#define BMI160_ODR_200HZ       0x09
+#define BMI160_ODR_400HZ       0x0A
+#define BMI160_ODR_800HZ       0x0B
+#define BMI160_ODR_1600HZ      0x0C
+
+#define BMI160_FIFO_SIZE       1024
+#define BMI160_FIFO_BURST      252         //longest drain, whole 6 and 7 byte frames and within one I2C1 transfer
+#define BMI160_FIFO_MAX_READINGS (BMI160_FIFO_BURST / BMI160_ACC_BYTES)
+#define BMI160_FIFO_FRAME(headered) ((headered) ? 1 + BMI160_ACC_BYTES : BMI160_ACC_BYTES)    //bytes a reading takes
+
+//headered FIFO frames
+#define BMI160_FH_ACC          0x84        //accelerometer only, the low two bits are interrupt tags
+#define BMI160_FH_EMPTY        0x80        //regular frame with nothing in it, the FIFO has run dry
+#define BMI160_FH_SKIP         0x40        //1 byte: readings dropped while the FIFO was full
+#define BMI160_FH_TIME         0x44        //3 bytes: sensor time, 39.0625 us a tick
+#define BMI160_FH_CONFIG       0x48        //1 byte: a configuration change took effect
+
+typedef struct {
+    void *hw;                                                                       //passed back to every call
+    int (*write)(void *hw, uint8_t addr, uint8_t reg, const uint8_t *data, uint8_t len);   //0, or -1 on NACK/timeout
+    int (*read)(void *hw, uint8_t addr, uint8_t reg, uint8_t *data, uint8_t len);          //len registers from reg on
+} bmi160_bus;
+
+typedef struct {
+    int16_t x, y, z;                    //raw counts, 16384 per g in the +/-2 g range
+} bmi160_accel;
+
+typedef struct {
+    const bmi160_bus *bus;
+    uint8_t addr;
+    uint32_t reads;                     //readings taken
+    uint32_t errors;                    //bus transactions that failed
+} bmi160;
+
+typedef struct {
+    uint8_t headered;                   //1 = headered frames, 0 = headerless
+    uint32_t frames;                    //readings decoded
+    uint32_t skipped;                   //readings the sensor dropped because the FIFO was full (headered only)
+    uint32_t partial;                   //frames cut off at the end of a burst, sent again in the next one
+    uint32_t bad;                       //bursts abandoned at a header that is not known
+    uint32_t config_changes;
+    uint32_t sensor_time;               //last sensor time frame, 24 bits
+    uint8_t have_time;
+} bmi160_fifo;
+
+void bmi160_init(bmi160 *s, const bmi160_bus *bus, uint8_t addr);
+int bmi160_start(bmi160 *s);
+int bmi160_read_accel(bmi160 *s, bmi160_accel *a);
+void bmi160_decode_accel(bmi160 *s, const uint8_t *raw, bmi160_accel *a);
+int bmi160_fifo_start(bmi160 *s, uint8_t odr, int headered, uint16_t watermark);
+uint16_t bmi160_fifo_length(const uint8_t *raw);
+uint8_t bmi160_odr_code(uint16_t hz);
+uint32_t bmi160_odr_period_us(uint8_t odr);
+int bmi160_drdy_int1(bmi160 *s);
+void bmi160_fifo_init(bmi160_fifo *f, int headered);
+uint16_t bmi160_fifo_parse(bmi160_fifo *f, const uint8_t *data, uint16_t len, bmi160_accel *out, uint16_t max);
+
+#endif
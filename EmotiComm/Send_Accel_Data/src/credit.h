@@ -0,0 +1,60 @@
+#ifndef CREDIT_H
+#define CREDIT_H
+#include <stdint.h>
+#include "packet.h"
+
+// Credit flow control with latest-wins sending, for pong mode
+//
+// Pong mode has no sliding window, the game only wants the newest reading. The receiver grants the
+// sender credit for a number of frames and the sender only sends while it has some left. In between,
+// every new reading replaces the one waiting to go, so whatever is sent next is the freshest there is,
+// and a receiver busy drawing is never sent more than it can take.
+//
+// Credit is counted in frame sequence numbers: the sender may send the frame numbered seq while
+// seq != limit, and a grant moves limit on. A grant says where the limit is rather than how much to
+// add, so a lost grant is made good by the next one.
+//
+// The link is half duplex, so the receiver only grants once the frame using the last credit has been
+// handled - the sender is quiet then. If nothing is heard for refresh_us (a frame or a grant was lost)
+// the receiver grants again.
+//
+// Grant frame: PKT_TYPE_CREDIT, payload: limit
+
+#define PKT_TYPE_CREDIT 0x08
+
+typedef struct {
+    int16_t x, y, z;
+    uint32_t time;                      //micros() when it was measured
+} credit_sample;
+
+typedef struct {
+    uint8_t seq;                        //sequence number of the next frame
+    uint8_t limit;                      //frames can be sent until seq reaches it
+    uint8_t window;                     //most credit ever held
+    credit_sample latest;               //newest reading
+    uint8_t waiting;                    //1 if latest has not been sent
+    uint32_t sent;
+    uint32_t overwritten;               //readings replaced by a newer one before they could go
+} credit_tx;
+
+typedef struct {
+    uint8_t next;                       //sequence number expected next
+    uint8_t limit;                      //limit last granted
+    uint8_t window;
+    uint8_t due;                        //the sender has used its credit, grant once its frame is handled
+    uint32_t last;                      //micros() of the last frame heard or grant sent
+    uint32_t refresh_us;
+    uint32_t grants;
+    uint32_t refreshes;                 //grants sent because nothing was heard for refresh_us
+} credit_rx;
+
+void credit_tx_init(credit_tx *c, uint8_t window);
+void credit_tx_offer(credit_tx *c, int16_t x, int16_t y, int16_t z, uint32_t time);
+int credit_tx_take(credit_tx *c, credit_sample *s);
+void credit_tx_grant(credit_tx *c, const packet *pkt);
+
+void credit_rx_init(credit_rx *c, uint8_t window, uint32_t refresh_us, uint32_t now);
+void credit_rx_heard(credit_rx *c, uint8_t seq, uint32_t now);
+int credit_rx_grant(credit_rx *c, uint8_t addr, uint32_t now, uint8_t *out, int out_size);
+
+#endif
@@ -0,0 +1,182 @@
+#include <stdint.h>
+#include "delta_codec.h"
+
+static uint32_t zigzag(int32_t v)
+{
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int32_t unzigzag(uint32_t u)
+{
+    return (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+}
+
+//writes v as a varint at out[index], returns the new index or -1 if out[] is full
+static int put_varint(uint8_t *out, int index, int out_size, uint32_t v)
+{
+    do
+    {
+        if (index >= out_size)
+        {
+            return -1;
+        }
+        out[index++] = (v & 0x7F) | (v > 0x7F ? 0x80 : 0);
+        v >>= 7;
+    } while (v);
+    return index;
+}
+
+//reads a varint from in[*index], returns -1 if it runs past the end or is longer than 3 bytes
+static int get_varint(const uint8_t *in, int *index, int len, uint32_t *v)
+{
+    uint32_t value = 0;
+    for (int shift = 0; shift < 21; shift += 7)
+    {
+        if (*index >= len)
+        {
+            return -1;
+        }
+        uint8_t b = in[(*index)++];
+        value |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80))
+        {
+            *v = value;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void delta_enc_init(delta_enc *e, uint8_t key_interval)
+{
+    e->key_id = 0;
+    e->key_interval = key_interval ? key_interval : 1;
+    delta_enc_reset(e);
+}
+
+void delta_enc_reset(delta_enc *e)
+{
+    //the next frame is a keyframe, e.g. after the receiver may have missed frames
+    e->need_key = 1;
+    e->since_key = 0;
+    e->ref[0] = e->ref[1] = e->ref[2] = 0;
+}
+
+int delta_encode(delta_enc *e, const delta_sample *s, uint8_t n, uint8_t *out, int out_size)
+{
+    //returns the payload length, or -1 if n is out of range or the samples do not fit in out[]
+    //nothing changes on failure, so the caller can send the samples some other way
+    int key = e->need_key || e->since_key + 1 >= e->key_interval;
+    int16_t prev[3] = { e->ref[0], e->ref[1], e->ref[2] };
+    int index = DELTA_HEADER_SIZE;
+
+    if (n == 0 || n > DELTA_MAX_SAMPLES || out_size < DELTA_HEADER_SIZE)
+    {
+        return -1;
+    }
+    out[0] = (key ? DELTA_FLAG_KEY : 0) | n;
+    out[1] = key ? (uint8_t)(e->key_id + 1) : e->key_id;
+    for (int i = 0; i < n && index >= 0; i++)
+    {
+        int16_t v[3] = { s[i].x, s[i].y, s[i].z };
+        index = put_varint(out, index, out_size, s[i].dt);
+        for (int axis = 0; axis < 3 && index >= 0; axis++)
+        {
+            int32_t d = (key && i == 0) ? v[axis] : (int32_t)v[axis] - prev[axis];
+            index = put_varint(out, index, out_size, zigzag(d));
+            prev[axis] = v[axis];
+        }
+    }
+    if (index < 0)
+    {
+        return -1;
+    }
+
+    if (key)
+    {
+        e->ref[0] = prev[0];
+        e->ref[1] = prev[1];
+        e->ref[2] = prev[2];
+        e->key_id++;
+        e->since_key = 0;
+    }
+    else
+    {
+        e->since_key++;
+    }
+    e->need_key = 0;
+    return index;
+}
+
+void delta_dec_init(delta_dec *d)
+{
+    d->synced = 0;
+    d->key_id = 0;
+    d->keyframes = 0;
+    d->lost = 0;
+    d->ref[0] = d->ref[1] = d->ref[2] = 0;
+}
+
+int delta_decode(delta_dec *d, const uint8_t *in, int len, delta_sample *s, uint8_t max)
+{
+    //returns the number of samples written to s[], or a DELTA_ERR_xxx code
+    int16_t prev[3];
+    int key, n, index = DELTA_HEADER_SIZE;
+
+    if (len < DELTA_HEADER_SIZE)
+    {
+        return DELTA_ERR_FORMAT;
+    }
+    key = (in[0] & DELTA_FLAG_KEY) != 0;
+    n = in[0] & DELTA_COUNT_MASK;
+    if (n == 0 || n > max)
+    {
+        return DELTA_ERR_FORMAT;
+    }
+    if (!key && (!d->synced || in[1] != d->key_id))
+    {
+        d->lost++;                      //its keyframe never arrived, wait for the next one
+        return DELTA_ERR_SYNC;
+    }
+
+    prev[0] = d->ref[0];
+    prev[1] = d->ref[1];
+    prev[2] = d->ref[2];
+    for (int i = 0; i < n; i++)
+    {
+        uint32_t u;
+        int16_t v[3];
+        if (get_varint(in, &index, len, &u) != 0)
+        {
+            return DELTA_ERR_FORMAT;
+        }
+        s[i].dt = u > 255 ? 255 : u;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (get_varint(in, &index, len, &u) != 0)
+            {
+                return DELTA_ERR_FORMAT;
+            }
+            v[axis] = (key && i == 0) ? (int16_t)unzigzag(u) : (int16_t)(prev[axis] + unzigzag(u));
+            prev[axis] = v[axis];
+        }
+        s[i].x = v[0];
+        s[i].y = v[1];
+        s[i].z = v[2];
+    }
+    if (index != len)
+    {
+        return DELTA_ERR_FORMAT;
+    }
+
+    if (key)
+    {
+        d->ref[0] = prev[0];
+        d->ref[1] = prev[1];
+        d->ref[2] = prev[2];
+        d->key_id = in[1];
+        d->synced = 1;
+        d->keyframes++;
+    }
+    return n;
+}
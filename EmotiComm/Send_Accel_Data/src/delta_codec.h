@@ -0,0 +1,62 @@
+#ifndef DELTA_CODEC_H
+#define DELTA_CODEC_H
+#include <stdint.h>
+
+// Delta + zig-zag/varint codec for the accelerometer stream
+//
+// Payload: flags | key id | count x (dt, x, y, z as varints)
+// - flags : bit 7 set for a keyframe, bits 6:0 number of samples
+// - key id: goes up by one with every keyframe, a delta frame carries the id of the keyframe it follows
+// - dt    : ticks since the sample before (unsigned varint)
+// - x/y/z : zig-zag varints - absolute for the first sample of a keyframe. Otherwise the change from
+//           the sample before it in the frame, or for the first sample from the last sample of the
+//           keyframe (the reference).
+//
+// A varint holds 7 bits per byte, least significant group first, bit 7 set on all but the last byte.
+// Zig-zag maps 0, -1, 1, -2 ... to 0, 1, 2, 3 ... so small changes of either sign take one byte.
+// A board lying still costs 4 bytes per sample instead of 7.
+//
+// Every delta frame only depends on its keyframe, so a lost delta frame costs just its own samples.
+// If a keyframe is lost the decoder sees the new key id and drops frames until the next keyframe,
+// which the encoder sends every key_interval frames or straight after delta_enc_reset().
+
+#define DELTA_MAX_SAMPLES 127
+#define DELTA_FLAG_KEY    0x80
+#define DELTA_COUNT_MASK  0x7F
+#define DELTA_HEADER_SIZE 2
+#define DELTA_MAX_SAMPLE_SIZE 11        //worst case bytes per sample: 2 for dt, 3 for each axis
+
+//error codes returned by delta_decode()
+#define DELTA_ERR_FORMAT -1             //payload is cut short or the sample count is wrong
+#define DELTA_ERR_SYNC   -2             //a frame was lost, waiting for the next keyframe
+
+typedef struct {
+    uint8_t dt;                         //time since the previous sample, in ticks
+    int16_t x;
+    int16_t y;
+    int16_t z;
+} delta_sample;
+
+typedef struct {
+    int16_t ref[3];                     //last sample of the latest keyframe
+    uint8_t key_id;                     //id of the latest keyframe
+    uint8_t since_key;                  //frames since the last keyframe
+    uint8_t key_interval;               //a keyframe at least every this many frames
+    uint8_t need_key;
+} delta_enc;
+
+typedef struct {
+    int16_t ref[3];
+    uint8_t key_id;
+    uint8_t synced;                     //0 until a keyframe has been decoded
+    uint32_t keyframes;
+    uint32_t lost;                      //delta frames dropped because their keyframe was missed
+} delta_dec;
+
+void delta_enc_init(delta_enc *e, uint8_t key_interval);
+void delta_enc_reset(delta_enc *e);
+int delta_encode(delta_enc *e, const delta_sample *s, uint8_t n, uint8_t *out, int out_size);
+void delta_dec_init(delta_dec *d);
+int delta_decode(delta_dec *d, const uint8_t *in, int len, delta_sample *s, uint8_t max);
+
+#endif
@@ -0,0 +1,101 @@
+#include <stdint.h>
+#include "drdy.h"
+
+void drdy_init(drdy_stats *d, uint32_t nominal)
+{
+    d->nominal = nominal;
+    d->ref = nominal;
+    d->last = 0;
+    d->have_last = 0;
+    d->edges = 0;
+    d->intervals = 0;
+    d->missed = 0;
+    d->min = UINT32_MAX;
+    d->max = 0;
+    d->sum_dev = 0;
+    d->sum_sq = 0;
+}
+
+void drdy_edge(drdy_stats *d, uint32_t now)
+{
+    //called from the data-ready interrupt - a few adds and one multiply
+    uint32_t interval = now - d->last;
+    int32_t dev;
+
+    d->edges++;
+    if (!d->have_last)
+    {
+        d->have_last = 1;
+        d->last = now;
+        return;
+    }
+    d->last = now;
+    if (interval > d->nominal + d->nominal / 2)
+    {
+        d->missed += (interval + d->nominal / 2) / d->nominal - 1;
+        return;
+    }
+    if (d->intervals == 0)
+    {
+        d->ref = interval;              //the oscillator can be 1% off, nominal would leave a large offset in every term
+    }
+    dev = (int32_t)(interval - d->ref);
+    d->intervals++;
+    d->sum_dev += dev;
+    d->sum_sq += (uint64_t)((int64_t)dev * dev);
+    if (interval < d->min)
+    {
+        d->min = interval;
+    }
+    if (interval > d->max)
+    {
+        d->max = interval;
+    }
+}
+
+uint32_t drdy_mean(const drdy_stats *d)
+{
+    //mean interval, the nominal one until there is something to go on
+    if (d->intervals == 0)
+    {
+        return d->nominal;
+    }
+    return (uint32_t)((int64_t)d->ref + d->sum_dev / (int64_t)d->intervals);
+}
+
+uint32_t drdy_jitter(const drdy_stats *d)
+{
+    //RMS deviation of the intervals from their mean
+    uint64_t var, root = 0, bit = 1ull << 62;
+    int64_t mean_dev;
+
+    if (d->intervals < 2)
+    {
+        return 0;
+    }
+    mean_dev = d->sum_dev / (int64_t)d->intervals;
+    var = d->sum_sq / d->intervals;
+    if (var <= (uint64_t)(mean_dev * mean_dev))
+    {
+        return 0;
+    }
+    var -= (uint64_t)(mean_dev * mean_dev);
+    while (bit > var)                   //integer square root, bit by bit
+    {
+        bit >>= 2;
+    }
+    while (bit != 0)
+    {
+        if (var >= root + bit)
+        {
+            var -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+        {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)root;
+}
@@ -0,0 +1,35 @@
+#ifndef DRDY_H
+#define DRDY_H
+#include <stdint.h>
+
+// Timing of the accelerometer's data-ready edges
+// The BMI160 raises its data-ready interrupt once per reading, on its own oscillator. drdy_edge() is
+// called from that interrupt with the time of the edge, and the interval since the edge before it is
+// compared with the nominal one: min, max, mean and the RMS jitter around the mean show how evenly the
+// readings really came, and the mean is the true output data rate to stamp readings with. An interval
+// longer than 1.5 nominal ones means edges were missed (the interrupt was held off or the line is
+// noisy) - they are counted and the interval is left out of the statistics.
+//
+// Nothing in here touches hardware. Times are in any unit that does not wrap between two edges, the
+// firmware uses CPU cycles for the resolution.
+
+typedef struct {
+    uint32_t nominal;                   //expected interval
+    uint32_t ref;                       //first interval, the sums are kept around it so they stay small
+    uint32_t last;                      //time of the last edge
+    uint8_t have_last;
+    uint32_t edges;
+    uint32_t intervals;                 //in the statistics
+    uint32_t missed;                    //edges that should have come but did not
+    uint32_t min;
+    uint32_t max;
+    int64_t sum_dev;                    //sum of interval - ref
+    uint64_t sum_sq;                    //sum of (interval - ref)^2
+} drdy_stats;
+
+void drdy_init(drdy_stats *d, uint32_t nominal);
+void drdy_edge(drdy_stats *d, uint32_t now);
+uint32_t drdy_mean(const drdy_stats *d);
+uint32_t drdy_jitter(const drdy_stats *d);
+
+#endif
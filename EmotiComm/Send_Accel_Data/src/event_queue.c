@@ -0,0 +1,85 @@
+#include <stdint.h>
+#include "event_queue.h"
+
+void event_init(event_queue *q, const event_lock *lk)
+{
+    q->lk = lk;
+    q->head = 0;
+    q->tail = 0;
+    q->count = 0;
+    for (int i = 0; i < EVENT_TYPES; i++)
+    {
+        q->handler[i] = 0;
+        q->ctx[i] = 0;
+    }
+    q->posted = 0;
+    q->dispatched = 0;
+    q->dropped = 0;
+    q->high_water = 0;
+}
+
+void event_on(event_queue *q, uint8_t type, event_handler handler, void *ctx)
+{
+    //registers the handler for one event type - at start-up, before the interrupts that post it are enabled
+    if (type < EVENT_TYPES)
+    {
+        q->handler[type] = handler;
+        q->ctx[type] = ctx;
+    }
+}
+
+int event_post(event_queue *q, uint8_t type, uint8_t arg, uint32_t time)
+{
+    //adds an event, returns -1 if the queue is full or the type is unknown
+    //safe to call from interrupt handlers of any priority and from the main loop
+    uint32_t state;
+    event *e;
+
+    if (type >= EVENT_TYPES)
+    {
+        return -1;
+    }
+    state = q->lk->lock(q->lk->hw);
+    if (q->count == EVENT_QUEUE_LEN)
+    {
+        q->dropped++;
+        q->lk->unlock(q->lk->hw, state);
+        return -1;
+    }
+    e = &q->slot[q->head];
+    e->type = type;
+    e->arg = arg;
+    e->time = time;
+    q->head = (q->head + 1) % EVENT_QUEUE_LEN;
+    q->count++;
+    q->posted++;
+    if (q->count > q->high_water)
+    {
+        q->high_water = q->count;
+    }
+    q->lk->unlock(q->lk->hw, state);
+    return 0;
+}
+
+int event_dispatch(event_queue *q)
+{
+    //runs the handler of every event waiting, in the order they were posted - main loop only
+    //events posted by a handler or an interrupt meanwhile are left for the next call so it always returns
+    //returns the number of events handled
+    int n = q->count;
+
+    for (int i = 0; i < n; i++)
+    {
+        event e = q->slot[q->tail];
+        uint32_t state = q->lk->lock(q->lk->hw);
+        q->tail = (q->tail + 1) % EVENT_QUEUE_LEN;
+        q->count--;
+        q->lk->unlock(q->lk->hw, state);
+        q->dispatched++;
+        if (q->handler[e.type])
+        {
+            q->handler[e.type](q->ctx[e.type], &e);
+        }
+    }
+    return n;
+}
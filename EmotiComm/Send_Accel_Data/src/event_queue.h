@@ -0,0 +1,52 @@
+#ifndef EVENT_QUEUE_H
+#define EVENT_QUEUE_H
+#include <stdint.h>
+
+// Deferred work from interrupt handlers
+// An interrupt handler posts a small typed event and returns, the main loop calls event_dispatch() on
+// every pass and runs the handler registered for each event type there. Anything slow - printf on the
+// debug port, queueing frames, changing modes - belongs in the handler, not in the interrupt.
+//
+// The queue holds EVENT_QUEUE_LEN events. Posting is safe from any interrupt priority and from the main
+// loop, it only holds the lock while it copies one event in. An event that finds the queue full is
+// dropped and counted. Nothing in here touches hardware, the lock is passed in like the link_tx driver.
+
+#define EVENT_QUEUE_LEN 16          //events waiting at most
+#define EVENT_TYPES     8           //event types are numbered 0 to EVENT_TYPES - 1 by the firmware
+
+typedef struct {
+    uint8_t type;
+    uint8_t arg;                    //meaning depends on the type
+    uint32_t time;                  //micros() when it was posted
+} event;
+
+typedef void (*event_handler)(void *ctx, const event *e);
+
+typedef struct {
+    void *hw;                                                           //passed back to every call
+    uint32_t (*lock)(void *hw);                                         //mask interrupts, returns previous state
+    void (*unlock)(void *hw, uint32_t state);                           //restore interrupt state from lock()
+} event_lock;
+
+typedef struct {
+    const event_lock *lk;
+    event slot[EVENT_QUEUE_LEN];
+    volatile uint8_t head;                  //next free slot
+    volatile uint8_t tail;                  //next event to dispatch
+    volatile uint8_t count;
+    event_handler handler[EVENT_TYPES];
+    void *ctx[EVENT_TYPES];
+
+    //counters, posted/dropped/high_water are written with the queue locked, dispatched by the main loop
+    uint32_t posted;
+    uint32_t dispatched;
+    uint32_t dropped;                       //events lost because the queue was full
+    uint8_t high_water;                     //most events waiting at once
+} event_queue;
+
+void event_init(event_queue *q, const event_lock *lk);
+void event_on(event_queue *q, uint8_t type, event_handler handler, void *ctx);
+int event_post(event_queue *q, uint8_t type, uint8_t arg, uint32_t time);
+int event_dispatch(event_queue *q);
+
+#endif
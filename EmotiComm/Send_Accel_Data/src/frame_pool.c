@@ -0,0 +1,66 @@
+#include <stdint.h>
+#include "frame_pool.h"
+
+void frame_pool_init(frame_pool *p)
+{
+    //must run before the receive interrupt is enabled - both rings are written from here
+    frame_index_ring_init(&p->ready);
+    frame_index_ring_init(&p->free);
+    for (int i = 0; i < FRAME_POOL_SLOTS; i++)
+    {
+        p->slot[i].len = 0;
+        frame_index_ring_push(&p->free, i);
+    }
+    p->published = 0;
+    p->overflows = 0;
+    p->high_water = 0;
+}
+
+frame_slot *frame_pool_acquire(frame_pool *p)
+{
+    //interrupt side - returns a slot to fill, or 0 if every slot is queued or held by the main loop
+    //called once per frame, so each 0 returned is one frame lost
+    uint8_t index;
+    if (frame_index_ring_pop(&p->free, &index) != 0)
+    {
+        p->overflows++;
+        return 0;
+    }
+    uint8_t taken = FRAME_POOL_SLOTS - frame_index_ring_count(&p->free);
+    if (taken > p->high_water)
+    {
+        p->high_water = taken;
+    }
+    p->slot[index].len = 0;
+    return &p->slot[index];
+}
+
+void frame_pool_publish(frame_pool *p, frame_slot *s)
+{
+    //interrupt side - queues a complete frame for the main loop, data and len are visible before the index
+    frame_index_ring_push(&p->ready, s - p->slot);          //cannot fail, the ring holds every slot
+    p->published++;
+}
+
+frame_slot *frame_pool_borrow(frame_pool *p)
+{
+    //main loop side - returns the oldest complete frame, or 0 if there is none
+    uint8_t index;
+    if (frame_index_ring_pop(&p->ready, &index) != 0)
+    {
+        return 0;
+    }
+    return &p->slot[index];
+}
+
+void frame_pool_release(frame_pool *p, frame_slot *s)
+{
+    //main loop side - the slot can be filled again
+    frame_index_ring_push(&p->free, s - p->slot);
+}
+
+uint32_t frame_pool_waiting(const frame_pool *p)
+{
+    //complete frames the main loop has not taken yet
+    return frame_index_ring_count(&p->ready);
+}
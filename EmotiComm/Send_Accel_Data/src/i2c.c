@@ -1,12 +1,15 @@
 #include <stm32l432xx.h>
 #include "i2c.h"
 #include "eeng1030_lib.h"
+#include "i2c_async.h"
+#include "i2c_timing.h"
 void delay(volatile uint32_t dly) {
     while (dly--);
 }
 
 void initI2C(void)
 {
+    i2c_timing timing;
     pinMode(GPIOB,3,1); // make PB3 (internal LED) an output
     pinMode(GPIOB,6,2); // alternative functions for PB6 and PB7
     pinMode(GPIOB,7,2); 
@@ -15,10 +18,18 @@ void initI2C(void)
     RCC->APB1ENR1 |= (1 << 21); // enable I2C1
     I2C1->CR1 = 0;
     delay(100);
-	// 80MHz/(7+1)=10MHz.  10MHz/100kHz=100.  
-	// So need (49+1) clock ticks for high part of clock + (49+1) for low part
-	// Data setup delays are also added (Table 138 in the ref. manual was a bit of a help)
-    I2C1->TIMINGR = (7 << 28) + (4 << 20) + (2 << 16) + (49 << 8) + (49); 
+    if (I2C_BUS_HZ > 400000)
+    {
+        RCC->APB2ENR |= (1 << 0); // enable SYSCFG
+        SYSCFG->CFGR1 |= (1 << 20); // I2C1_FMP: fast mode plus drive on the I2C1 pins
+    }
+    // Counts for the rate, the analog filter delay and the rise and fall times (see i2c_timing.h).
+    // If the edges are too slow for the rate asked fall back to standard mode, which takes anything in spec.
+    if (i2c_timing_calc(I2C_CLOCK, I2C_BUS_HZ, I2C_RISE_NS, I2C_FALL_NS, &timing) != 0)
+    {
+        i2c_timing_calc(I2C_CLOCK, 100000, 1000, 300, &timing);
+    }
+    I2C1->TIMINGR = timing.timingr;
     I2C1->ICR |= 0xffff; // clear all pending interrupts
     I2C1->CR1 |= (1 << 0);
 }
@@ -89,4 +100,135 @@ uint8_t I2CRead()
 {
 	while((I2C1->ISR & (1 << 2))==0); // wait for receive complete
 	return I2C1->RXDR; 		// return rx data
-}
\ No newline at end of file
+}
+
+static int I2CWait(uint32_t flag)
+{
+	// waits for an ISR flag, -1 if the slave NACKs or nothing happens within I2C_TIMEOUT polls
+	for (unsigned timeout = 0; timeout < I2C_TIMEOUT; timeout++)
+	{
+		uint32_t isr = I2C1->ISR;
+		if (isr & flag)
+		{
+			return 0;
+		}
+		if (isr & (1 << 4)) // NACKF - AUTOEND sends the stop itself
+		{
+			while ((I2C1->ISR & (1 << 5)) == 0); // wait for STOPF
+			I2C1->ICR = (1 << 4) | (1 << 5);
+			return -1;
+		}
+	}
+	I2C1->CR2 |= (1 << 14); // give up, release the bus
+	return -1;
+}
+
+int I2CWriteRegisters(uint8_t address, uint8_t reg, const uint8_t *data, int nbytes)
+{
+	// writes nbytes to consecutive registers from reg in one transaction, 0 on success
+	I2C1->CR2 = ((address << 1) & 0x3ff) | ((nbytes + 1) << 16) | (1 << 25) | (1 << 13); // write, AUTOEND, START
+	if (I2CWait(1 << 1) != 0) // TXIS
+	{
+		return -1;
+	}
+	I2C1->TXDR = reg;
+	for (int i = 0; i < nbytes; i++)
+	{
+		if (I2CWait(1 << 1) != 0)
+		{
+			return -1;
+		}
+		I2C1->TXDR = data[i];
+	}
+	if (I2CWait(1 << 5) != 0) // STOPF
+	{
+		return -1;
+	}
+	I2C1->ICR = (1 << 5);
+	return 0;
+}
+
+int I2CReadRegisters(uint8_t address, uint8_t reg, uint8_t *data, int nbytes)
+{
+	// reads nbytes from consecutive registers from reg in one transaction:
+	// start, address + write, reg, restart, address + read, nbytes, stop
+	I2C1->CR2 = ((address << 1) & 0x3ff) | (1 << 16) | (1 << 13); // write 1 byte, no AUTOEND so the restart follows
+	if (I2CWait(1 << 1) != 0) // TXIS
+	{
+		return -1;
+	}
+	I2C1->TXDR = reg;
+	if (I2CWait(1 << 6) != 0) // TC - register pointer sent
+	{
+		return -1;
+	}
+	I2C1->CR2 = ((address << 1) & 0x3ff) | (1 << 10) | (nbytes << 16) | (1 << 25) | (1 << 13); // read, AUTOEND, START
+	for (int i = 0; i < nbytes; i++)
+	{
+		if (I2CWait(1 << 2) != 0) // RXNE
+		{
+			return -1;
+		}
+		data[i] = I2C1->RXDR;
+	}
+	if (I2CWait(1 << 5) != 0) // STOPF
+	{
+		return -1;
+	}
+	I2C1->ICR = (1 << 5);
+	return 0;
+}
+
+void I2CEnableInterrupts(void)
+{
+	// TXIE, RXIE, NACKIE, STOPIE, TCIE and ERRIE - every flag I2CEvent() reports
+	I2C1->CR1 |= (1 << 1) | (1 << 2) | (1 << 4) | (1 << 5) | (1 << 6) | (1 << 7);
+	NVIC->ISER[0] |= (1u << 31); // I2C1_EV (interrupt 31)
+	NVIC->ISER[1] |= (1 << 0);   // I2C1_ER (interrupt 32)
+}
+void I2CBegin(uint8_t address, int rw, int nbytes, int autoend)
+{
+	// start or restart without waiting, the flags that follow come through I2CEvent()
+	I2C1->CR2 = ((address << 1) & 0x3ff) | ((rw == READ) << 10) | (nbytes << 16) | ((autoend != 0) << 25) | (1 << 13);
+}
+void I2CAbort(void)
+{
+	// software reset - releases the bus and clears the flags, keeps the interrupt enables
+	I2C1->CR1 &= ~(1 << 0);
+	while(I2C1->CR1 & (1 << 0)); // forces a wait.
+	I2C1->CR1 |= (1 << 0);
+}
+int I2CEvent(void)
+{
+	// the most urgent pending flag as an I2C_EV_* event, NACK and STOP are cleared here, the others by
+	// writing TXDR, reading RXDR or starting again
+	uint32_t isr = I2C1->ISR;
+	if (isr & ((1 << 8) | (1 << 9) | (1 << 10))) // BERR, ARLO, OVR
+	{
+		I2C1->ICR = (1 << 8) | (1 << 9) | (1 << 10);
+		return I2C_EV_ERROR;
+	}
+	if (isr & (1 << 4)) // NACKF - before STOPF so the transaction fails
+	{
+		I2C1->ICR = (1 << 4);
+		return I2C_EV_NACK;
+	}
+	if (isr & (1 << 2)) // RXNE - before STOPF so the last byte is taken
+	{
+		return I2C_EV_RXNE;
+	}
+	if (isr & (1 << 5)) // STOPF
+	{
+		I2C1->ICR = (1 << 5);
+		return I2C_EV_STOP;
+	}
+	if (isr & (1 << 1)) // TXIS
+	{
+		return I2C_EV_TXIS;
+	}
+	if (isr & (1 << 6)) // TC
+	{
+		return I2C_EV_TC;
+	}
+	return I2C_EV_NONE;
+}
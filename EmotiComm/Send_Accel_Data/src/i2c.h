@@ -1,10 +1,42 @@
 #include <stm32l432xx.h>
 #define READ 1
 #define WRITE 0
+// The following timeout value was determined by
+// trial and error running the chip at 72MHz
+// There is a little bit of 'headroom' included
+#define I2C_TIMEOUT 20000
+// I2C1 runs from PCLK1 (RCC_CCIPR I2C1SEL = 00), TIMINGR is worked out from these by initI2C()
+// 100000, 400000 or 1000000 - fast mode plus (above 400 kHz) also turns on the PB6/PB7 20 mA drivers
+#define I2C_CLOCK 80000000
+#ifndef I2C_BUS_HZ
+#define I2C_BUS_HZ 400000
+#endif
+// Worst case SCL/SDA edges for the bus as wired, the I2C specification maximums for the mode unless
+// measured. Lower values give a rate nearer I2C_BUS_HZ.
+#ifndef I2C_RISE_NS
+#if I2C_BUS_HZ > 400000
+#define I2C_RISE_NS 120
+#define I2C_FALL_NS 120
+#elif I2C_BUS_HZ > 100000
+#define I2C_RISE_NS 300
+#define I2C_FALL_NS 300
+#else
+#define I2C_RISE_NS 1000
+#define I2C_FALL_NS 300
+#endif
+#endif
 void ResetI2C();
 void I2CStart(uint8_t address, int rw, int nbytes);
 void I2CReStart(uint8_t address, int rw, int nbytes);
 void I2CStop();
 void I2CWrite(uint8_t Data);
 void delay(volatile uint32_t dly);
-uint8_t I2CRead();
\ No newline at end of file
+uint8_t I2CRead();
+void initI2C(void);
+int I2CWriteRegisters(uint8_t address, uint8_t reg, const uint8_t *data, int nbytes);
+int I2CReadRegisters(uint8_t address, uint8_t reg, uint8_t *data, int nbytes);
+// interrupt driven access for i2c_async.h - once I2CEnableInterrupts() has run the blocking calls above must not be used
+void I2CEnableInterrupts(void);
+void I2CBegin(uint8_t address, int rw, int nbytes, int autoend);
+void I2CAbort(void);
+int I2CEvent(void);
@@ -0,0 +1,178 @@
+#include <stdint.h>
+#include "i2c_async.h"
+
+#define PHASE_WRITE 0                   //register address and any data
+#define PHASE_READ  1                   //after the restart
+
+void i2c_async_init(i2c_async *e, const i2c_async_driver *drv)
+{
+    e->drv = drv;
+    e->head = 0;
+    e->tail = 0;
+    e->count = 0;
+    e->phase = PHASE_WRITE;
+    e->index = 0;
+    e->nacked = 0;
+    e->started = 0;
+    e->watch_started = 0;
+    e->watch_time = 0;
+    e->done = 0;
+    e->failed = 0;
+    e->timeouts = 0;
+    e->full = 0;
+}
+
+//starts the oldest waiting transaction - called with interrupts masked or from the interrupt
+static void start_next(i2c_async *e)
+{
+    i2c_txn *t = e->queue[e->tail];
+
+    e->phase = PHASE_WRITE;
+    e->index = 0;
+    e->nacked = 0;
+    e->started++;
+    e->drv->start(e->drv->hw, t->addr, 0, 1 + t->wlen, t->rlen == 0);     //a read restarts after the register address
+}
+
+static void finish(i2c_async *e, int ok)
+{
+    //hands the transaction on the bus back and starts the next one
+    i2c_txn *t = e->queue[e->tail];
+
+    e->tail = (e->tail + 1) % I2C_QUEUE_LEN;
+    e->count--;
+    if (ok)
+    {
+        e->done++;
+    }
+    else
+    {
+        e->failed++;
+    }
+    t->status = ok ? I2C_TXN_DONE : I2C_TXN_FAILED;
+    if (t->done)
+    {
+        t->done(t->ctx, t);
+    }
+    if (e->count > 0)
+    {
+        start_next(e);
+    }
+}
+
+static void abort_txn(i2c_async *e)
+{
+    e->drv->reset(e->drv->hw);
+    if (e->count > 0)
+    {
+        finish(e, 0);
+    }
+}
+
+int i2c_async_queue(i2c_async *e, i2c_txn *t)
+{
+    //queues a transaction and starts it if the bus is free, returns -1 if the queue is full
+    //t must stay put until its status is final - safe to call from the main loop and from interrupts
+    uint32_t state = e->drv->lock(e->drv->hw);
+
+    if (e->count == I2C_QUEUE_LEN)
+    {
+        e->full++;
+        e->drv->unlock(e->drv->hw, state);
+        return -1;
+    }
+    t->status = I2C_TXN_BUSY;
+    e->queue[e->head] = t;
+    e->head = (e->head + 1) % I2C_QUEUE_LEN;
+    e->count++;
+    if (e->count == 1)
+    {
+        start_next(e);
+    }
+    e->drv->unlock(e->drv->hw, state);
+    return 0;
+}
+
+void i2c_async_event(i2c_async *e, uint8_t ev)
+{
+    //called from the I2C interrupt handlers for every flag they find
+    i2c_txn *t = e->queue[e->tail];
+
+    if (e->count == 0)
+    {
+        e->drv->reset(e->drv->hw);      //nothing should be happening, make sure the flag goes away
+        return;
+    }
+    switch (ev)
+    {
+    case I2C_EV_TXIS:
+        if (e->phase != PHASE_WRITE || e->index > t->wlen)
+        {
+            abort_txn(e);
+            break;
+        }
+        e->drv->put(e->drv->hw, e->index == 0 ? t->reg : t->wdata[e->index - 1]);
+        e->index++;
+        break;
+    case I2C_EV_TC:
+        if (e->phase != PHASE_WRITE || t->rlen == 0)
+        {
+            abort_txn(e);
+            break;
+        }
+        e->phase = PHASE_READ;
+        e->index = 0;
+        e->drv->start(e->drv->hw, t->addr, 1, t->rlen, 1);     //restart, stop after the last byte
+        break;
+    case I2C_EV_RXNE:
+        if (e->phase != PHASE_READ || e->index >= t->rlen)
+        {
+            abort_txn(e);
+            break;
+        }
+        t->rdata[e->index++] = e->drv->get(e->drv->hw);
+        break;
+    case I2C_EV_NACK:
+        e->nacked = 1;
+        break;
+    case I2C_EV_STOP:
+        finish(e, !e->nacked && (t->rlen == 0 ? e->phase == PHASE_WRITE && e->index == 1 + t->wlen
+                                               : e->phase == PHASE_READ && e->index == t->rlen));
+        break;
+    default:
+        abort_txn(e);
+        break;
+    }
+}
+
+void i2c_async_poll(i2c_async *e, uint32_t now)
+{
+    //gives up on a transaction that has been on the bus for I2C_ASYNC_TIMEOUT_US - main loop
+    uint32_t state;
+
+    if (e->count == 0 || e->started != e->watch_started)
+    {
+        e->watch_started = e->started;
+        e->watch_time = now;
+        return;
+    }
+    if (now - e->watch_time < I2C_ASYNC_TIMEOUT_US)
+    {
+        return;
+    }
+    state = e->drv->lock(e->drv->hw);
+    if (e->count > 0 && e->started == e->watch_started)
+    {
+        e->timeouts++;
+        abort_txn(e);
+    }
+    e->drv->unlock(e->drv->hw, state);
+    e->watch_started = e->started;
+    e->watch_time = now;
+}
+
+int i2c_async_busy(const i2c_async *e)
+{
+    //1 while a transaction is on the bus or waiting
+    return e->count > 0;
+}
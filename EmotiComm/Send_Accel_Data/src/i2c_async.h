@@ -0,0 +1,82 @@
+#ifndef I2C_ASYNC_H
+#define I2C_ASYNC_H
+#include <stdint.h>
+
+// Interrupt driven I2C transactions
+// A transaction writes a register address and then either writes data to it or reads len bytes back
+// after a restart - the usual register access of an I2C sensor. The caller fills in an i2c_txn, queues
+// it and carries on, the I2C interrupts move every byte, and when the stop has gone out the status
+// changes to I2C_TXN_DONE or I2C_TXN_FAILED and the optional callback runs (from the interrupt).
+// Transactions run one at a time in the order they were queued, up to I2C_QUEUE_LEN can wait.
+//
+// The interrupt handler turns the peripheral flags into I2C_EV_* events and passes them to
+// i2c_async_event(). A slave that does not acknowledge fails the transaction, one that holds the
+// bus is given up on by i2c_async_poll() after I2C_ASYNC_TIMEOUT_US and the peripheral is reset.
+// Nothing in here touches hardware, the peripheral is driven through i2c_async_driver.
+
+#define I2C_QUEUE_LEN         4         //transactions waiting at most, the one on the bus included
+#define I2C_ASYNC_TIMEOUT_US  5000      //longest a transaction may take, 8 bytes take about 1 ms at 100 kHz
+
+#define I2C_TXN_IDLE    0               //never queued
+#define I2C_TXN_BUSY    1               //queued or on the bus
+#define I2C_TXN_DONE    2
+#define I2C_TXN_FAILED  3               //not acknowledged, bus error or timeout
+
+//events from the interrupt handler
+#define I2C_EV_NONE     0
+#define I2C_EV_TXIS     1               //the next byte to send can be written
+#define I2C_EV_TC       2               //all bytes of this part sent, no stop - time for the restart
+#define I2C_EV_RXNE     3               //a byte has been received
+#define I2C_EV_NACK     4               //not acknowledged, the stop follows by itself
+#define I2C_EV_STOP     5               //stop condition sent, the transaction is over
+#define I2C_EV_ERROR    6               //bus error, arbitration lost or overrun
+
+typedef struct i2c_txn {
+    uint8_t addr;                       //7-bit slave address
+    uint8_t reg;                        //register address, always written first
+    const uint8_t *wdata;               //written after reg, wlen bytes
+    uint8_t wlen;
+    uint8_t *rdata;                     //read after a restart, rlen bytes - 0 for a write
+    uint8_t rlen;
+    void (*done)(void *ctx, struct i2c_txn *t);    //optional, runs in the interrupt once status is final
+    void *ctx;
+    volatile uint8_t status;
+} i2c_txn;
+
+typedef struct {
+    void *hw;                                                           //passed back to every call
+    void (*start)(void *hw, uint8_t addr, int read, uint8_t nbytes, int autoend);  //start or restart
+    void (*put)(void *hw, uint8_t data);                                //write the transmit register
+    uint8_t (*get)(void *hw);                                           //read the receive register
+    void (*reset)(void *hw);                                            //abandon whatever is on the bus
+    uint32_t (*lock)(void *hw);                                         //mask interrupts, returns previous state
+    void (*unlock)(void *hw, uint32_t state);                           //restore interrupt state from lock()
+} i2c_async_driver;
+
+typedef struct {
+    const i2c_async_driver *drv;
+    i2c_txn *queue[I2C_QUEUE_LEN];
+    uint8_t head;                       //next free slot
+    uint8_t tail;                       //transaction on the bus, or next to start
+    volatile uint8_t count;
+    uint8_t phase;                      //what the transaction on the bus is doing
+    uint8_t index;                      //bytes of this phase moved so far
+    uint8_t nacked;
+    volatile uint32_t started;          //transactions started, i2c_async_poll() watches it move
+    uint32_t watch_started;
+    uint32_t watch_time;
+
+    //counters
+    uint32_t done;
+    uint32_t failed;                    //not acknowledged or bus errors, timeouts included
+    uint32_t timeouts;
+    uint32_t full;                      //transactions refused because the queue was full
+} i2c_async;
+
+void i2c_async_init(i2c_async *e, const i2c_async_driver *drv);
+int i2c_async_queue(i2c_async *e, i2c_txn *t);
+void i2c_async_event(i2c_async *e, uint8_t ev);
+void i2c_async_poll(i2c_async *e, uint32_t now);
+int i2c_async_busy(const i2c_async *e);
+
+#endif
@@ -0,0 +1,131 @@
+#include <stdint.h>
+#include "i2c_timing.h"
+
+//I2C specification (UM10204) limits in ns, for each mode
+typedef struct {
+    uint32_t max_hz;
+    uint32_t low_min;                   //tLOW
+    uint32_t high_min;                  //tHIGH
+    uint32_t su_dat_min;                //tSU;DAT
+    uint32_t vd_dat_max;                //tVD;DAT, the longest the data may take to be valid after SCL falls
+    uint32_t rise_max;                  //tr
+    uint32_t fall_max;                  //tf
+} i2c_mode;
+
+static const i2c_mode modes[] = {
+    {  100000, 4700, 4000, 250, 3450, 1000, 300 },     //standard mode
+    {  400000, 1300,  600, 100,  900,  300, 300 },     //fast mode
+    { 1000000,  500,  260,  50,  450,  120, 120 },     //fast mode plus
+};
+
+//ceiling of a / b for femtosecond values, 0 if a is not positive
+static uint32_t counts_up(int64_t a, uint64_t b)
+{
+    return a <= 0 ? 0 : (uint32_t)((a + b - 1) / b);
+}
+
+int i2c_timing_calc(uint32_t clock, uint32_t bus_hz, uint32_t rise_ns, uint32_t fall_ns, i2c_timing *out)
+{
+    //returns 0 on success, -1 if the rate is above fast mode plus, the rise or fall time is too slow for
+    //its mode, or no prescaler gets within I2C_TIMING_MAX_SLOW_PPM while meeting the specification
+    //all the arithmetic is in femtoseconds, so kernel clock periods that are not whole nanoseconds stay exact enough
+    const i2c_mode *m = 0;
+    int found = 0;
+
+    for (unsigned i = 0; i < sizeof(modes) / sizeof(modes[0]); i++)
+    {
+        if (bus_hz <= modes[i].max_hz)
+        {
+            m = &modes[i];
+            break;
+        }
+    }
+    if (m == 0 || bus_hz == 0 || clock == 0 || rise_ns > m->rise_max || fall_ns > m->fall_max)
+    {
+        return -1;
+    }
+
+    int64_t tr = (int64_t)rise_ns * 1000000;
+    int64_t tf = (int64_t)fall_ns * 1000000;
+    int64_t af_min = I2C_AF_MIN_NS * 1000000ll;
+    int64_t af_max = I2C_AF_MAX_NS * 1000000ll;
+    int64_t tclk = 1000000000000000ll / clock;
+    int64_t sync = af_min + 2 * tclk;                                   //an edge seen through the filter, at the soonest
+    int64_t period = 1000000000000000ll / bus_hz;
+
+    for (uint32_t presc = 0; presc < 16; presc++)
+    {
+        int64_t tp = (int64_t)(presc + 1) * 1000000000000000ll / clock;
+
+        //setup: SCL must not rise before the data has risen and settled for tSU;DAT
+        uint32_t setup = counts_up(tr + (int64_t)m->su_dat_min * 1000000, tp);                       //SCLDEL + 1
+        //hold: the data may change once SCL has fallen (tHD;DAT min 0) and must be valid by tVD;DAT max
+        uint32_t hold_min = counts_up(tf - af_min - 3 * tclk, tp);
+        int64_t hold_room = (int64_t)m->vd_dat_max * 1000000 - tr - af_max - 4 * tclk;
+        if (setup == 0)
+        {
+            setup = 1;
+        }
+        if (setup > 16 || hold_min > 15 || hold_room < 0 || (int64_t)hold_min * tp > hold_room)
+        {
+            continue;
+        }
+
+        //each half period on its own must meet tLOW / tHIGH, and the low one must fit the hold and setup
+        uint32_t low_min = counts_up((int64_t)m->low_min * 1000000 - sync, tp);
+        uint32_t high_min = counts_up((int64_t)m->high_min * 1000000 - sync, tp);
+        if (low_min < hold_min + setup)
+        {
+            low_min = hold_min + setup;
+        }
+        if (low_min == 0)
+        {
+            low_min = 1;
+        }
+        if (high_min == 0)
+        {
+            high_min = 1;
+        }
+
+        //what is left of the period once the edges and synchronisation are taken out, rounded up so
+        //the bus never runs faster than asked, then shared in proportion to the two minimums
+        uint32_t total = counts_up(period - tr - tf - 2 * sync, tp);
+        if (total < low_min + high_min)
+        {
+            total = low_min + high_min;
+        }
+        uint32_t low = (uint32_t)(((uint64_t)total * m->low_min + (m->low_min + m->high_min) / 2) / (m->low_min + m->high_min));
+        if (low < low_min)
+        {
+            low = low_min;
+        }
+        if (total - low < high_min)
+        {
+            low = total - high_min;
+        }
+        uint32_t high = total - low;
+        if (low > 256 || high > 256)
+        {
+            continue;
+        }
+
+        int64_t actual_period = (int64_t)total * tp + tr + tf + 2 * sync;
+        uint32_t actual = (uint32_t)(1000000000000000ll / actual_period);
+        int32_t error_ppm = (int32_t)(((int64_t)actual - bus_hz) * 1000000 / bus_hz);
+        if (-error_ppm > I2C_TIMING_MAX_SLOW_PPM || (found && error_ppm <= out->error_ppm))
+        {
+            continue;                   //too slow, or no closer than a finer prescaler already got
+        }
+        found = 1;
+        out->presc = presc;
+        out->scldel = setup - 1;
+        out->sdadel = hold_min;
+        out->sclh = high - 1;
+        out->scll = low - 1;
+        out->timingr = ((uint32_t)presc << 28) | ((uint32_t)(setup - 1) << 20) | ((uint32_t)hold_min << 16) |
+                       ((uint32_t)(high - 1) << 8) | (low - 1);
+        out->actual = actual;
+        out->error_ppm = error_ppm;
+    }
+    return found ? 0 : -1;
+}
@@ -0,0 +1,30 @@
+#ifndef I2C_TIMING_H
+#define I2C_TIMING_H
+#include <stdint.h>
+
+// I2C TIMINGR calculation
+// TIMINGR holds five counts in units of the prescaled kernel clock, tPRESC = (PRESC + 1) / clock:
+//   SCLL + 1, SCLH + 1  SCL low and high periods
+//   SCLDEL + 1          data setup, from the data changing to SCL being released
+//   SDADEL              data hold, from SCL seen low to the data changing
+// The peripheral only starts counting once it sees an edge through the analog filter and two kernel
+// clocks of synchronisation, so each half period is also stretched by that and by the rise or fall time.
+// i2c_timing_calc() picks the prescaler and counts that run the bus as close to the asked rate as it
+// can without going faster, and keeps tLOW, tHIGH, tSU;DAT, tHD;DAT and tVD;DAT within the I2C
+// specification for the mode the rate falls in (standard 100 kHz, fast 400 kHz, fast plus 1 MHz).
+// Rise and fall times are those of the bus as built - they depend on the pull-ups and the wiring.
+
+#define I2C_TIMING_MAX_SLOW_PPM 100000  //reject settings more than 10% slower than asked
+#define I2C_AF_MIN_NS 50                //analog filter delay, from the STM32L432 datasheet
+#define I2C_AF_MAX_NS 80
+
+typedef struct {
+    uint32_t timingr;                   //value for I2Cx->TIMINGR
+    uint8_t presc, scldel, sdadel, sclh, scll;
+    uint32_t actual;                    //SCL rate with the shortest filter delay, never above the asked one
+    int32_t error_ppm;                  //(actual - asked) in parts per million
+} i2c_timing;
+
+int i2c_timing_calc(uint32_t clock, uint32_t bus_hz, uint32_t rise_ns, uint32_t fall_ns, i2c_timing *out);
+
+#endif
@@ -0,0 +1,82 @@
+#include <stdint.h>
+#include "link_rx.h"
+
+void link_rx_init(link_rx *rx, frame_pool *pool)
+{
+    rx->pool = pool;
+    rx->slot = 0;
+    rx->in_frame = 0;
+    rx->tail = 0;
+    rx->now = 0;
+    rx->bytes = 0;
+    rx->truncated = 0;
+    rx->too_long = 0;
+}
+
+void link_rx_byte(link_rx *rx, uint8_t c)
+{
+    //runs the delimiter state machine for one received byte
+    if (c == PKT_START)
+    {
+        if (rx->slot == 0)
+        {
+            rx->slot = frame_pool_acquire(rx->pool);
+        }
+        if (rx->slot == 0)
+        {
+            rx->in_frame = 0;                   //every slot is still in use, this frame is lost
+            return;
+        }
+        if (rx->in_frame)
+        {
+            rx->truncated++;
+        }
+        rx->in_frame = 1;                       //a new '[' always restarts the frame
+        rx->slot->len = 0;
+    }
+    else if (c == PKT_END)
+    {
+        if (rx->in_frame)
+        {
+            rx->in_frame = 0;
+            rx->slot->time = rx->now;
+            frame_pool_publish(rx->pool, rx->slot);
+            rx->slot = 0;
+        }
+    }
+    else if (rx->in_frame)
+    {
+        if (rx->slot->len < FRAME_SLOT_SIZE)
+        {
+            rx->slot->data[rx->slot->len++] = c;
+        }
+        else
+        {
+            rx->in_frame = 0;                   //too long to be one of ours, wait for the next '['
+            rx->too_long++;
+        }
+    }
+}
+
+void link_rx_feed(link_rx *rx, const uint8_t *ring, uint16_t ring_size, uint16_t head, uint32_t now)
+{
+    //consumes ring[tail .. head) wrapping at ring_size, head is the writer's next position
+    //now (microseconds) is recorded as the arrival time of every frame that ends in this call
+    uint16_t tail = rx->tail;
+
+    rx->now = now;
+    if (head >= ring_size)
+    {
+        head = 0;
+    }
+    while (tail != head)
+    {
+        rx->bytes++;
+        link_rx_byte(rx, ring[tail]);
+        if (++tail == ring_size)
+        {
+            tail = 0;
+        }
+    }
+    rx->tail = tail;
+}
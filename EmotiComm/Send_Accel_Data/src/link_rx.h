@@ -0,0 +1,30 @@
+#ifndef LINK_RX_H
+#define LINK_RX_H
+#include <stdint.h>
+#include "packet.h"
+#include "frame_pool.h"
+
+// Frame extraction for the RS-485 link
+// Bytes arrive in a ring (written by DMA or an interrupt) and link_rx_feed() walks everything
+// between its own read position and the writer's position in one pass. The bytes between '[' and
+// ']' are written straight into a frame_pool slot, which is published when the frame is complete.
+// A frame may be split across any number of feed calls and across the end of the ring.
+
+#define LINK_RX_MAX_BODY FRAME_SLOT_SIZE
+
+typedef struct {
+    frame_pool *pool;                   //completed frames go here
+    frame_slot *slot;                   //slot being filled, kept from one frame to the next until published
+    uint8_t in_frame;                   //1 between '[' and ']'
+    uint16_t tail;                      //next ring index to read
+    uint32_t now;                       //time of the current feed, given to each frame completed in it
+    uint32_t bytes;                     //bytes fed in
+    uint32_t truncated;                 //frames cut short by the next '[', their ']' never arrived
+    uint32_t too_long;                  //frames dropped because they did not fit a slot (overflows are counted by the pool)
+} link_rx;
+
+void link_rx_init(link_rx *rx, frame_pool *pool);
+void link_rx_byte(link_rx *rx, uint8_t c);
+void link_rx_feed(link_rx *rx, const uint8_t *ring, uint16_t ring_size, uint16_t head, uint32_t now);
+
+#endif
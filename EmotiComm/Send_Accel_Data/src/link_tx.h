@@ -0,0 +1,71 @@
+#ifndef LINK_TX_H
+#define LINK_TX_H
+#include <stdint.h>
+#include "packet.h"
+
+// Frame transmit queue for the RS-485 link
+// Whole frames are queued and handed to the driver one at a time. The driver reports the end of
+// each frame (last stop bit on the wire) by calling link_tx_done(), normally from the USART TC
+// interrupt. Nothing in here touches hardware directly, the driver can be backed by a mock.
+//
+// Frames wait in one of two classes. Control frames ([PONG]/[EXIT], ACKs, credit, rate negotiation) go
+// out at the next frame boundary ahead of any sensor data still waiting, sensor data frames go out in
+// the order they were queued. A frame is never cut short, a control frame queued while a data frame is
+// on the wire waits for its last stop bit.
+//
+// Before it takes an idle bus the queue asks the driver whether the pair is clear (see turnaround.h).
+// If it is not, the frames wait and the driver calls link_tx_poll() once the turnaround gap has passed.
+// Frames sent back to back keep the bus and are not held.
+
+#define LINK_TX_QUEUE_LEN   8       //number of whole data frames that can be waiting to go out - a full ARQ window
+#define LINK_TX_CONTROL_LEN 4       //number of control frames that can be waiting
+
+#define LINK_TX_CONTROL 0           //classes, lowest number goes first
+#define LINK_TX_DATA    1
+#define LINK_TX_CLASSES 2
+
+typedef struct {
+    void *hw;                                                           //passed back to every driver call
+    void (*set_driver)(void *hw, int transmit);                         //1 = drive the bus, 0 = release it and listen
+    void (*start)(void *hw, const uint8_t *data, uint16_t len);         //start sending len bytes in the background
+    uint32_t (*lock)(void *hw);                                         //mask interrupts, returns previous state
+    void (*unlock)(void *hw, uint32_t state);                           //restore interrupt state from lock()
+    int (*clear)(void *hw);             //optional - 1 if the bus may be taken now, 0 to wait for link_tx_poll()
+} link_tx_driver;
+
+typedef struct {
+    uint8_t (*frame)[PKT_MAX_WIRE];         //size slots, set by link_tx_init()
+    uint16_t *len;
+    uint8_t size;
+    volatile uint8_t head;                  //next free slot
+    volatile uint8_t tail;                  //oldest frame, the one on the wire if this class is sending
+    volatile uint8_t count;                 //frames queued including the one on the wire
+} link_tx_class;
+
+typedef struct {
+    const link_tx_driver *drv;
+    link_tx_class queue[LINK_TX_CLASSES];
+    uint8_t control_frame[LINK_TX_CONTROL_LEN][PKT_MAX_WIRE];
+    uint16_t control_len[LINK_TX_CONTROL_LEN];
+    uint8_t data_frame[LINK_TX_QUEUE_LEN][PKT_MAX_WIRE];
+    uint16_t data_len[LINK_TX_QUEUE_LEN];
+    volatile uint8_t sending;               //class of the frame on the wire
+    volatile uint8_t busy;                  //1 while the driver owns the bus
+
+    //counters, written by link_tx_done() or with the queue locked
+    uint32_t frames_sent;                   //frames whose last stop bit has left
+    uint32_t bytes_sent;
+    uint32_t preempted;                     //control frames sent while data frames were waiting ahead of them
+    uint32_t held;                          //times the bus was not clear yet when a frame was ready
+    uint32_t full;                          //frames refused because their class was full
+    uint8_t high_water;                     //most data frames queued at once, LINK_TX_QUEUE_LEN means it has been full
+} link_tx;
+
+void link_tx_init(link_tx *tx, const link_tx_driver *drv);
+int link_tx_queue(link_tx *tx, const uint8_t *frame, uint16_t len);
+int link_tx_queue_class(link_tx *tx, uint8_t cls, const uint8_t *frame, uint16_t len);
+void link_tx_done(link_tx *tx);
+void link_tx_poll(link_tx *tx);
+int link_tx_busy(const link_tx *tx);
+
+#endif
@@ -7,26 +7,57 @@ Last Updated : 30/04/2025
  communication setup. 
 - The board continuously reads X, Y, and Z accelerometer data using I2C and transmits this data 
   to a paired receiver board over UART (USART1).
-- Each data packet is formatted with square bracket delimiters ('[' and ']') for reliable parsing.
-- After sending a message, the board waits for an [Ack] response from the receiver to validate
-  correct switching of transceiver direction 
-- If no acknowledgement is received, the user can press a physical button to manually resend the message.
+- The BMI160 samples by itself at ACCEL_ODR into its FIFO (see bmi160.h) and pulses its INT1 pin (PA0,
+  EXTI0) for every new reading. Once ACCEL_WATERMARK bytes of readings have come in, the EXTI0 interrupt
+  reads the fill level and the I2C1 interrupts drain the FIFO in one burst (see i2c_async.h), and the main
+  loop hands the readings on one at a time while the next batch builds up. The main loop sleeps whenever it
+  has been round once, the next interrupt - at the latest the next reading - wakes it.
+- The interval between data-ready pulses is measured (see drdy.h), "odr" on the serial monitor prints the
+  real output data rate and its jitter, "odr <Hz>" changes the rate (25 to 1600 Hz).
+- Each data packet is a binary frame (see packet.h) with square bracket delimiters ('[' and ']'),
+  byte stuffing, a sequence number and a CRC for reliable parsing.
+- Samples are sent through a sliding window (see arq.h): up to ARQ_WINDOW frames can be waiting for an
+  acknowledgement, the last frame of each burst polls the receiver, and its ack slides the window on.
+- Frames that are not acknowledged are resent automatically, after a timeout if the ack itself is lost.
+  The timeout follows the measured round trip to the receiver and backs off while acks keep going missing,
+  a frame that is still not acked after ARQ_MAX_TRIES sends is given up on. "arq" on the serial monitor
+  shows the round trip, timeout and retransmission counts, "link" the link health counters (see link_Stats()).
+- Samples are batched: up to BATCH_MAX_SAMPLES readings, each with its time, share one frame (see batch.h).
+  A frame goes out once it holds the set number of samples or its oldest sample reaches the latency limit.
+  Both can be changed at run time by typing "batch <samples> <max latency ms>" on the serial monitor. Fewer
+  samples per frame than the link rate can carry at the current output data rate are refused.
+- Batches are compressed by default: a keyframe every DELTA_KEY_INTERVAL frames and small zig-zag/varint coded
+  changes in between (see delta_codec.h). "codec on" / "codec off" on the serial monitor switches this.
+- At start-up both boards talk at LINK_BAUD_SAFE and this board then negotiates the fastest link rate that
+  passes a test pattern in both directions (see link_speed.h), up to 1 Mbaud.
+- Neither board drives the pair until it has been quiet for the turnaround gap, so a reply cannot clip the
+  tail of the frame it answers. After the rate negotiation this board finds the shortest gap that still
+  gets test echoes back intact and sets it on both boards (see turnaround.h).
+- Several sensor boards can share the RS-485 pair (LINK_NODES > 1), each built with its own NODE_ADDRESS.
+  Every frame carries the address, the link runs at LINK_BAUD_BUS, and this board only sends when the
+  receiver polls it (see poll_sched.h). Pong Mode needs the pair to itself and is not available then.
 - The board supports a "Pong Mode," toggled by an interrupt-driven button. In Pong Mode : 
     - "PONG" message is sent to reciever board to tell it to stop sending acks
     - accelerometer values are sent in a loop to enable paddle control on the receiving board.
     - sender stops waiting for acknowledgements during Pong Mode to allow real-time motion input.
+    - instead the receiver grants credit for PONG_CREDITS frames at a time (see credit.h), and while there
+      is none left each new reading replaces the one waiting, so the paddle always gets the newest.
     - "EXIT" message is sent to reciver baord to exit pong mode when button is pressed
-- USART2 is used to output debug and validation messages to a serial monitor.
+- Interrupt handlers only move data or post an event (see event_queue.h), the main loop does the rest: the
+  button interrupt posts EVENT_BUTTON and the mode change, [EXIT] frame and printout happen in onButton().
+  Every handler times itself with the cycle counter, "isr" on the serial monitor prints the longest runs.
+- USART2 is used to output debug and validation messages to a serial monitor. "capture on" switches it to
+  CAPTURE_BAUD and streams every raw reading as a binary record by DMA instead (see telemetry.h).
 - LCD output provides visual feedback for Ack reciever verification and pong mode verification.
 
 Core components include:
 - I2C interface for reading accelerometer data
 - USART1 for board-to-board UART communication
 - USART2 for serial debugging
-- GPIO control of a bidirectional transceiver (RE/DE pins)
+- DMA transmission on USART1 with the transceiver driver enable (DE) switched by the USART itself
 - Interrupt-driven button handling for mode switching
 - LCD feedback display via SPI
-- Circular buffer and message parsing with acknowledgment logic
+- Received frames assembled in place in a small slot pool (see frame_pool.h), message parsing with acknowledgment logic
 */
 
 //include necessary header files
@@ -34,82 +65,200 @@ Core components include:
 #include <stdio.h>
 #include  <errno.h>
 #include  <sys/unistd.h> // STDOUT_FILENO, STDERR_FILENO
-#include "circular_buffer.h"
 #include "display.h"
 #include "biDirectional_Trans.h"
 #include <string.h>
 #include "i2c.h"         //For reading accelerometer data 
 #include "spi.h"        // For SPI communication with LCD
 #include "display.h"   // For LCD drawing functions like printText()
+#include "packet.h"   // Binary frame encoding for accelerometer samples
+#include "arq.h"     // Sliding window acknowledgements
+#include "timebase.h"
+#include "link_speed.h" // Start-up link rate negotiation
+#include "batch.h"      // Several samples per frame
+#include "delta_codec.h" // Delta compression of the batches
+#include "spsc_ring.h"   // Console receive ring
+#include "telemetry.h"   // Binary sample capture on USART2
+#include "credit.h"      // Pong mode flow control
+#include "event_queue.h" // Work deferred from interrupt handlers
+#include "turnaround.h"  // RS-485 turnaround gap calibration
+#include "bmi160.h"      // Accelerometer register access
+#include "i2c_async.h"   // Interrupt driven I2C transactions
+#include "drdy.h"        // Data-ready timing and jitter
 
 
                                                   //assembly instruction functions embedded with c to enable/disable interrupts
 #define enable_interrupts() asm(" cpsie i ")     //Change Processor State Interrupt Enable
 #define disable_interrupt() asm (" cpsid i")    //Change Processor State Interrupt Disable
-#define INPUT_BUFFER_SIZE CIRC_BUF_SIZE        //Input buffer size equal to circular buffer for consitency  
+#define INPUT_BUFFER_SIZE 64                   //longest console command line
 #define LINE_HEIGHT 10                        //LCD dimension definitions 
 #define SCREEN_HEIGHT 80
 #define SCREEN_WIDTH 160
 #define NUM_LINES 8
+#define NODE_ADDRESS PKT_ADDR_FIRST        //this board's address on the pair, every sensor board needs its own
+#define ARQ_WINDOW 8                        //frames allowed in flight before an ack is needed (1 = stop and wait)
+#define ARQ_TIMEOUT_US 50000               //ack timeout after the last byte of a burst, until a round trip has been measured
+#define DEBUG_BAUD 9600                  //USART2 serial monitor
+#define CAPTURE_BAUD 921600             //USART2 while binary capture is on
+#define SPEED_GIVE_UP_US 15000000       //stay at LINK_BAUD_SAFE if the receiver never answers
+#define TURN_GIVE_UP_US 10000000        //keep LINK_GAP_BITS if the gap calibration has not finished by then
+#define BATCH_SAMPLES 4                //default samples per frame
+#define BATCH_LATENCY_US 100000       //default limit on how long a sample may wait for its frame
+#define DELTA_KEY_INTERVAL 8         //frames between keyframes
+#define PONG_CREDITS 1              //pong mode frames the receiver can take before it has to grant more
+#define EVENT_BUTTON 0              //event types posted by the interrupt handlers, arg unused
+#define BUTTON_DEBOUNCE_US 200000  //presses closer together than this are contact bounce
+#define ACCEL_ODR BMI160_ODR_400HZ //BMI160 output data rate, above 800 Hz needs I2C_BUS_HZ of 400 kHz or more
+#define ACCEL_HEADERED 1           //headered FIFO frames, so readings lost while the FIFO was full are reported
+#define ACCEL_WATERMARK 140        //FIFO bytes that make a drain worth it, 20 headered frames (50 ms at 400 Hz)
+#define ACCEL_FRAME BMI160_FIFO_FRAME(ACCEL_HEADERED)
 
 //function prototypes 
 void setup(void);
 void delay_ms(volatile uint32_t dly);
-void initSerial(uint32_t baudrate);
+void initSerial(uint32_t link_baud, uint32_t debug_baud);
 void eputc(char c);
 void shiftdisp(int i,const char *message);
 void sendMessage();
-void clearMessage(char *buffer, int size);
 void printMessage(int i,const char *message);
 void shiftdisp(int type,const char *message);
 int buttonpressed(int buttonpin);
 void sendPongMessage(int pongmode);
-void measureAccel();
+int measureAccel();
+int accelWaiting();
+uint32_t readingTime(uint16_t i);
+void queueSample();
+void batchSample();
+int linkCarries(unsigned int samples);
+void pollConsole();
+void printLinkStats();
+int sendArqFrame(void *ctx, const uint8_t *frame, uint16_t len);
+int readFrame(packet *pkt, uint32_t *time);
+void negotiateSpeed();
+void sendSpeedFrame(void *ctx, const uint8_t *payload, uint8_t len);
+void setSpeed(void *ctx, uint32_t baud);
+void calibrateTurnaround();
+void sendTurnFrame(void *ctx, const uint8_t *payload, uint8_t len);
+void setGap(void *ctx, uint8_t gap_bits);
+void setDebugBaud(uint32_t baud);
+void startCapture(void *hw, const uint8_t *data, uint16_t len);
+void captureMode(int on);
+uint32_t irqLock(void *hw);
+void irqUnlock(void *hw, uint32_t state);
+void onButton(void *ctx, const event *e);
+void printIsrTimes();
+void printOdr();
+void setOdr(uint16_t hz);
+void idle();
+void initDataReady();
+int accelWrite(void *hw, uint8_t addr, uint8_t reg, const uint8_t *data, uint8_t len);
+int accelRead(void *hw, uint8_t addr, uint8_t reg, uint8_t *data, uint8_t len);
+void fifoLevelRead(void *ctx, i2c_txn *t);
+void fifoDrained(void *ctx, i2c_txn *t);
+void i2cStart(void *hw, uint8_t addr, int read, uint8_t nbytes, int autoend);
+void i2cPut(void *hw, uint8_t data);
+uint8_t i2cGet(void *hw);
+void i2cReset(void *hw);
 
 //variables declarations 
 int count;
 int currentLine = 0;
-circular_buffer rx_buf;                             //Circular buffer structure defined in circular buffer.h
-volatile uint32_t data_ready=0;                    //flag to indicate when meesage is finished being added to the buffer
 volatile char input_buffer[INPUT_BUFFER_SIZE];    //stores user-typed message from serial port
 volatile uint8_t input_index = 0;                //index variable to irerate through characters in input message
 volatile uint8_t input_ready = 0;               //flag to indicate when input message is ready to be sent 
-static volatile uint8_t message_started = 0;   //Flag to indicate when message has started being recieved 
+SPSC_RING(console_ring, char, 64)              //USART2_IRQHandler produces, pollConsole() consumes
+console_ring console_rx;
+volatile uint32_t console_overruns = 0;       //characters lost because the ring was full
 char messagesdisp[8][24];                     //stores ch line of messages to be printed to LCD
 int messagetype[8];                          //stores whether message is recieved message or sent message to detemine how it is displayed on LCD
-int ack_recieved = 0; 
 volatile int pongMode = 0;
-// The following timeout value was determined by
-// trial and error running the chip at 72MHz
-// There is a little bit of 'headroom' included
-#define I2C_TIMEOUT 20000
-uint16_t response;
+static const bmi160_bus accel_bus = { 0, accelWrite, accelRead };
+bmi160 accel;                               //BMI160 on I2C1
+static const i2c_async_driver i2c_driver = { 0, i2cStart, i2cPut, i2cGet, i2cReset, irqLock, irqUnlock };
+i2c_async i2c;                              //I2C1 transactions run by its interrupts once the sensor is set up
+uint8_t fifo_level_raw[2];                  //FIFO_LENGTH, filled by the I2C1 interrupts
+i2c_txn fifo_level_txn = { BMI160_ADDR, BMI160_REG_FIFO_LENGTH, 0, 0, fifo_level_raw, 2, fifoLevelRead, 0, I2C_TXN_IDLE };
+uint8_t fifo_raw[BMI160_FIFO_BURST];        //one drain of the FIFO
+i2c_txn fifo_txn = { BMI160_ADDR, BMI160_REG_FIFO_DATA, 0, 0, fifo_raw, 0, fifoDrained, 0, I2C_TXN_IDLE };
+volatile uint16_t fifo_new;                 //data-ready pulses since the last drain was started
+volatile uint8_t fifo_more;                 //the last drain was cut short by BMI160_FIFO_BURST
+volatile uint32_t fifo_drain_time;          //micros() at the data-ready pulse that started the drain on the bus
+bmi160_fifo accel_fifo;                     //frame parser state and counters
+bmi160_accel fifo_readings[BMI160_FIFO_MAX_READINGS];     //the last drain, decoded
+uint16_t fifo_count;
+uint16_t fifo_next;                         //next of fifo_readings for measureAccel() to hand out
+uint32_t fifo_period;                       //measured cycles between readings, when the last drain was decoded
+uint32_t fifo_base_time;                    //fifo_drain_time of the last drain decoded, its newest reading's time
+uint8_t accel_odr = ACCEL_ODR;
+uint8_t odr_conf;                           //ACC_CONF for a rate change
+i2c_txn odr_txn = { BMI160_ADDR, BMI160_REG_ACC_CONF, &odr_conf, 1, 0, 0, 0, 0, I2C_TXN_IDLE };
+drdy_stats drdy;                            //data-ready pulse timing, in CPU cycles
+uint32_t awake_since;                       //micros() when the sleep count was last reset
+uint32_t asleep_us;                         //spent in idle() since then
 int16_t x_accel;
 int16_t y_accel;
 int16_t z_accel;
+uint32_t accel_time;                        //micros() when the last reading was taken
 int32_t X_g;
 int32_t Y_g;
 int32_t Z_g;
+credit_tx credit;                           //pong mode credit and the newest reading waiting for it
+batch_tx pong_batch;                        //pong mode readings, sent one per frame as credit allows
+arq_tx arq;                                 //sliding window state for acknowledged samples
+static const uint32_t link_rates[LINK_NUM_RATES] = LINK_RATES;
+static const link_speed_ops speed_ops = { 0, sendSpeedFrame, setSpeed };
+link_speed speed;                           //start-up rate negotiation
+static const turn_ops turn_cal_ops = { 0, sendTurnFrame, setGap };
+turn_cal turn;                              //start-up turnaround gap calibration
+uint32_t link_us_per_byte = 10000000 / LINK_BAUD_SAFE;     //10 bits per byte on the link
+batch_tx batch;                             //samples waiting to be put in a frame
+delta_enc codec;                            //compression state for the sample stream
+static const telem_driver capture_driver = { 0, startCapture };
+telem capture;                              //binary records waiting for USART2
+volatile int capturing = 0;                 //1 while USART2 carries binary records instead of text
+static const event_lock irq_lock = { 0, irqLock, irqUnlock };
+event_queue events;                         //posted by the interrupt handlers, dispatched by the main loop
+isr_time isr_usart1 = { "USART1 (link)" };  //run times of the interrupt handlers in this file
+isr_time isr_usart2 = { "USART2 (console)" };
+isr_time isr_capture_dma = { "DMA1 ch7 (capture)" };
+isr_time isr_exti1 = { "EXTI1 (button)" };
+isr_time isr_exti0 = { "EXTI0 (data ready)" };
+isr_time isr_i2c1 = { "I2C1 (accelerometer)" };
 
 int main()
 {
 
-    char message_received[CIRC_BUF_SIZE];      //stores recieved message from circular buffer
-    int currentButton = 0;
-    int previousButton = 0;
+    packet rx_pkt;                             //decoded frame from the receiver
+    uint32_t rx_time;                          //when it arrived
     setup();  
     initI2C();         //setup i2c peripheral
     ResetI2C();      
-    // Take accelerometer out of power-down mode
-    I2CStart(0x69, WRITE, 2);
-    I2CWrite(0x7E);   
-    I2CWrite(0x11);         // Normal mode
-    I2CStop();
+    bmi160_init(&accel, &accel_bus, BMI160_ADDR);
+    bmi160_start(&accel);   // Take accelerometer out of power-down mode
+    delay_ms(100000);
+    bmi160_fifo_start(&accel, ACCEL_ODR, ACCEL_HEADERED, ACCEL_WATERMARK);
+    bmi160_drdy_int1(&accel);
+    bmi160_fifo_init(&accel_fifo, ACCEL_HEADERED);
+    drdy_init(&drdy, bmi160_odr_period_us(ACCEL_ODR) * 80);
+    i2c_async_init(&i2c, &i2c_driver);
+    I2CEnableInterrupts();  // readings are fetched in the background from here on
     delay_ms(1000000);     // Wait for startup                    
     init_display();
-    init_circ_buf(&rx_buf);
+    init_Timebase();
+    initDataReady();        // needs the cycle counter for the pulse timing
+    event_init(&events, &irq_lock);
+    event_on(&events, EVENT_BUTTON, onButton, 0);
+    batch_tx_init(&batch, BATCH_SAMPLES, BATCH_LATENCY_US);
+    delta_enc_init(&codec, DELTA_KEY_INTERVAL);
+    batch_tx_use_codec(&batch, &codec);
+    batch_tx_init(&pong_batch, 1, 0);
     NVIC->ISER[1] |= (1 << (37-32));        //ensures that the USART1_IRQHandler() gets triggered when data is received via UART2
+    NVIC->ISER[1] |= (1 << (38-32));        //USART2_IRQHandler() collects console characters
     enable_interrupts();
+    negotiateSpeed();                      //both boards are at LINK_BAUD_SAFE until this has run
+    calibrateTurnaround();                 //and at LINK_GAP_BITS until this has
+    arq_tx_init(&arq, NODE_ADDRESS, ARQ_WINDOW, ARQ_TIMEOUT_US, link_us_per_byte);
+    arq_tx_polled(&arq, LINK_NODES > 1);   //on a shared pair the receiver says when to send
     while(1)
     {
 
@@ -117,70 +266,68 @@ int main()
     if (pongMode == 1)
    {
         //pong mode set up
-        enable_Transmit(4,5);                                     //enable transmitter 
         printf("PONG MODE - PRESS BUTTON TO EXIT...\r\n");              
         printMessage(0,"PONG MODE = PRESS BUTTON TO EXIT");
         sendPongMessage(pongMode);                             //call pong message function - to alert other board that this board is in pong mode  
+        credit_tx_init(&credit, PONG_CREDITS);                 //the receiver starts with the same credit when it gets "PONG"
         delay(10000);
         
         while(pongMode)
         {
-            //pong mode involves measuring acceleration and sending the acceleration values in a continous loop 
-            measureAccel();
+            //pong mode measures continuously but only sends while the receiver has credit left for it,
+            //a reading that cannot go yet is replaced by the next one so the paddle always moves on the newest
+            if (measureAccel())
+            {
+                credit_tx_offer(&credit, x_accel, y_accel, z_accel, accel_time);
+            }
+            if (readFrame(&rx_pkt, 0) == 0)
+            {
+                credit_tx_grant(&credit, &rx_pkt);
+            }
             sendMessage();
-            delay(1000);  
+            pollConsole();
+            event_dispatch(&events);
+            i2c_async_poll(&i2c, micros());
+            if (!accelWaiting())
+            {
+                idle();                                        //until the next reading or frame
+            }
         }
         printf("EXITING PONG MODE..\r\n");
+        printf("pong: %lu readings sent, %lu replaced by newer ones\r\n", credit.sent, credit.overwritten);
         printMessage(0,"EXITING PONG MODE");
+        arq_tx_init(&arq, NODE_ADDRESS, ARQ_WINDOW, ARQ_TIMEOUT_US, link_us_per_byte);     //start a fresh window, the receiver is resynced by the first burst
+        delta_enc_reset(&codec);
         
     }
-        //Outside of pong mode, operation involves measuring accel data,sending accel data, waiting for ack, repeating when ack is recieved
-        measureAccel();
-        sendMessage();
-        enable_Recieve(4,5);
-        ack_recieved = 0;
-        printf("waiting for ack.....");
-
-    //loop used while waiting for ack to be recieved from other board
-        while(ack_recieved == 0)
-    {
- 
-        if (data_ready)                                     //data ready flag controller by usart1 interupt handler
+        //Outside of pong mode, samples go through the sliding window:
+        // - a new sample is taken whenever the window has room for it and one has been fetched
+        // - everything new or lost is sent in one burst, the last frame polls the receiver for an ack
+        // - the ack slides the window on, frames it does not cover are resent in the next burst
+        if (arq_tx_space(&arq) > 0 && measureAccel())
         {
-            
-            int i = 0;                                  
-            char c;                                       
-            while(get_circ_buf(&rx_buf, &c) == 0)         //get circ buffer fuction returns 0 when circular buffer is not empty    
+            batchSample();
+            if (batch_tx_ready(&batch, micros()))
             {
-                message_received[i++] = c;              //next character of buffer is retrieved and stored in message array each time get_circ_buf function is called
+                queueSample();
             }
-            message_received[i+1] = '\0';  
-           printf("Message received from USART1: %s\n", message_received);      //print to serial monitor (usart2) 
-          //  printf("\rReceived message: %s\r\n", message_received);
-
-
-          //if message recieved from recieving board is an Ack message
-            if (strcmp(message_received, "Ack") == 0)
-            {
-                printf("ACK RECIEVED\r\n");  
-                ack_recieved = 1;              //set ack_recieved flag to allow sensor data to be read and sent again
+        }
+        pollConsole();
+        event_dispatch(&events);
+        i2c_async_poll(&i2c, micros());        //gives up on a reading the sensor never finished
+        if (!transmit_Busy())
+        {
+            arq_tx_burst(&arq, micros(), sendArqFrame, 0);             //nothing is sent while a poll is outstanding, or until polled
+        }
 
-            delay_ms(5000000);                                                 
-            printMessage(1,message_received);                        //call printMessage funtion to print to LCD
-            clearMessage(message_received, CIRC_BUF_SIZE);          //After message has been recieved, call function to clear message recieved function
-            data_ready = 0;                                        //reset data_ready flag to zero
-            }
-                                         
+        //if message recieved from recieving board is an Ack frame
+        if (readFrame(&rx_pkt, &rx_time) == 0 && rx_pkt.type == PKT_TYPE_ACK)
+        {
+            arq_tx_ack(&arq, &rx_pkt, rx_time);       //arrival time from the receive interrupt, for the round trip
         }
-    //Check if button 1 is pressed - This button is responsable for manually sending messages after ack has not been recieved 
-        currentButton = buttonpressed(0);
-        if (previousButton == 0 && currentButton == 1)
+        else if (!accelWaiting() || arq_tx_space(&arq) == 0)
         {
-            //when button is pressed, the ack_recieved variable becomes one which allows the board to send on more data manually
-            printf("Ack not recieved, resending message...\r\n");
-            ack_recieved = 1; 
-            }
-            previousButton = currentButton;
+            idle();                                  //nothing to do, sleep until the next reading or frame
         }
         
     }
@@ -194,14 +341,15 @@ void setup()
 {
     initClocks();    
     RCC->AHB2ENR |= (1 << 0) + (1 << 1);     // enable GPIOA and GPIOB
+#if !LINK_HW_DE                             //with USART1 driver enable, DE/RE are on PA12 and set up by initSerial()
     pinMode(GPIOB,4,1);                     //Set pin B4 to 1 -ouput pin for RE
     pinMode(GPIOB,5,1);                    //Set pin pB5 to 1 - output pin for DE
+#endif
     pinMode(GPIOB,0,0);                   //Set pin PB0 to 0 - input for push button 
     pinMode(GPIOB,1,0);                  //Set pin PB1 to 0 - inpit for push button
     enablePullUp(GPIOB,1);              //enable internal pull-up resistors for PB1
     enablePullUp(GPIOB,0);             //enable internal pull-up resistors for PB0
-    initSerial(9600);
-    enable_Transmit(4,5);
+    initSerial(LINK_BAUD_SAFE, DEBUG_BAUD);
 
     //interupt setup for push button
     RCC->APB2ENR |= (1 << 0);               // Enable SYSCFG clock
@@ -214,7 +362,19 @@ void setup()
 
     
 }
-void initSerial(uint32_t baudrate)
+void initDataReady()
+{
+    //BMI160 INT1 on PA0 (A0), a rising edge for every new reading
+    pinMode(GPIOA,0,0);                    // input
+    SYSCFG->EXTICR[0] &= ~(0xF << 0);     // Map EXTI0 to PA0
+    EXTI->IMR1 |= (1 << 0);              // Unmask EXTI0
+    EXTI->RTSR1 |= (1 << 0);            // Rising edge trigger (INT1 is active high)
+    EXTI->FTSR1 &= ~(1 << 0);
+    EXTI->PR1 = (1 << 0);             // forget any pulse from before
+    awake_since = micros();
+    NVIC->ISER[0] |= (1 << 6);        // Enable EXTI0 IRQ (EXTI0_IRQn = interrupt 6)
+}
+void initSerial(uint32_t link_baud, uint32_t debug_baud)
 {
     RCC->AHB2ENR |= (1 << 0);                                // make sure GPIOA is turned on
     pinMode(GPIOA,2,2);                                     // alternate function mode for PA2
@@ -232,27 +392,43 @@ void initSerial(uint32_t baudrate)
 
 
 
-    const uint32_t CLOCK_SPEED=80000000;    
-    uint32_t BaudRateDivisor;
-    
-    BaudRateDivisor = CLOCK_SPEED/baudrate;      
+    baud_setting link_setting;
+    baud_setting debug_setting;
+
+    if (baud_calc(LINK_CLOCK, link_baud, 1, &link_setting) != 0)      //rounded divider, 8x oversampling only if 16x cannot reach the rate
+    {
+        baud_calc(LINK_CLOCK, LINK_BAUD_SAFE, 0, &link_setting);
+    }
+    if (baud_calc(LINK_CLOCK, debug_baud, 1, &debug_setting) != 0)
+    {
+        baud_calc(LINK_CLOCK, 9600, 0, &debug_setting);
+    }
     USART1->CR1 = 0;                                       //clear control reg 1
     USART1->CR2 = 0;                                      //clear control reg 2
-    USART1->CR3 = (1 << 12);                             //disable over-run errors
-    USART1->BRR = BaudRateDivisor;                      //set baud rate
-    USART1->CR1 =  (1 << 3);                           //enable the transmitter 
+    USART1->CR3 = 0;                                     //over-run detection stays on, errors are counted in link_Stats()
+    USART1->BRR = link_setting.brr;                     //set baud rate
+    USART1->CR1 =  (1 << 3) | (link_setting.over8 << 15);  //enable the transmitter, OVER8 if needed
     USART1->CR1 |=  (1 << 2);                         //enable the receiver
+    init_Transceiver(link_baud);                              //driver enable, transmit and receive DMA - must be set up before UE
     USART1->CR1 |= (1 << 0);                         //enable usart1 peripheral 
-    USART1->CR1 |= (1 << 5);                        //enable RXNE interrupt for USART1
     USART1->ICR = (1 << 1);                        //Clear any pending USART1 errors 
                                              
     USART2->CR1 = 0;                              //repeat for usart2
     USART2->CR2 = 0;
     USART2->CR3 = (1 << 12);             
-    USART2->BRR = BaudRateDivisor;
-    USART2->CR1 =  (1 << 3);   
+    USART2->BRR = debug_setting.brr;
+    USART2->CR1 =  (1 << 3) | (debug_setting.over8 << 15);
     USART2->CR1 |=  (1 << 2);  
+    console_ring_init(&console_rx);
+    USART2->CR1 |= (1 << 5);                       //RXNEIE - console characters are collected by USART2_IRQHandler()
     USART2->CR1 |= (1 << 0);
+    DMA1_CSELR->CSELR &= ~(0xF << 24);
+    DMA1_CSELR->CSELR |= (2 << 24);                // channel 7 request 2 = USART2_TX, for capture mode
+    DMA1_Channel7->CCR = (1 << 7) | (1 << 4) | (1 << 1);  // memory increment, memory to peripheral, transfer complete interrupt
+    DMA1_Channel7->CPAR = (uint32_t)&USART2->TDR;  // same (low) priority as the link channels, which win ties by their lower number
+    NVIC->ISER[0] |= (1 << 17);                    // Enable DMA1_Channel7 IRQ (interrupt 17)
+
+    printf("USART1 %lu baud (%ld ppm), USART2 %lu baud (%ld ppm)\r\n", link_setting.actual, link_setting.error_ppm, debug_setting.actual, debug_setting.error_ppm);
 }
 int _write(int file, char *data, int len)
 {
@@ -262,6 +438,10 @@ int _write(int file, char *data, int len)
         errno = EBADF;                 //error is returned when file is not standard output of standard error
         return -1;
     }
+    if (capturing)
+    {
+        return 0;                      //text would break up the binary records
+    }
     while(len--)
     {
         eputc(*data);                 //data string is iterated through and eputc function is called to send each character over USART
@@ -275,87 +455,352 @@ void eputc(char c)
     USART2->TDR=c;                          //load character in Transmission data register to send over USART2 - sends to serial monitor in this case 
 } 
 
+void setDebugBaud(uint32_t baud)
+{
+    //changes the USART2 rate once the last character has gone
+    baud_setting setting;
+    if (baud_calc(LINK_CLOCK, baud, 1, &setting) != 0)
+    {
+        return;
+    }
+    while ((USART2->ISR & (1 << 6)) == 0);     // TC - the last character has left
+    USART2->CR1 &= ~(1 << 0);                   // UE = 0 to change BRR and OVER8
+    USART2->BRR = setting.brr;
+    USART2->CR1 = (USART2->CR1 & ~(1 << 15)) | (setting.over8 << 15);
+    USART2->CR1 |= (1 << 0);
+}
+
+void startCapture(void *hw, const uint8_t *data, uint16_t len)
+{
+    //telem driver - sends a block of records by DMA, DMA1_Channel7_IRQHandler() reports the end
+    DMA1_Channel7->CCR &= ~(1 << 0);            // channel has to be disabled to reload it
+    DMA1_Channel7->CMAR = (uint32_t)data;
+    DMA1_Channel7->CNDTR = len;
+    DMA1_Channel7->CCR |= (1 << 0);
+}
+
+void captureMode(int on)
+{
+    //switches USART2 between text at DEBUG_BAUD and binary records at CAPTURE_BAUD (see telemetry.h)
+    if (on && !capturing)
+    {
+        printf("binary capture at %d baud, type \"capture off\" at that rate to stop\r\n", CAPTURE_BAUD);
+        telem_init(&capture, &capture_driver);
+        setDebugBaud(CAPTURE_BAUD);
+        USART2->CR3 |= (1 << 7);                // DMAT - TDR is fed by DMA1 channel 7
+        capturing = 1;
+    }
+    else if (!on && capturing)
+    {
+        while (capture.busy);
+        telem_flush(&capture);                  // the records still waiting
+        while (capture.busy);
+        capturing = 0;
+        USART2->CR3 &= ~(1 << 7);
+        setDebugBaud(DEBUG_BAUD);
+        printf("capture stopped: %lu records sent, %lu dropped\r\n", capture.records, capture.dropped);
+    }
+}
+
 
 
 void sendMessage()
 {
-    //function used to send accelerometer data to recieiving board via usart1
-  
-    char msg[48];
-    snprintf(msg, sizeof(msg), "X=%d,Y=%d,Z=%d", X_g, Y_g, Z_g);  // live accel values
-  //  printf("Sending: [%s]\r\n", msg);
-
-    // Send opening bracket
-    while (!(USART1->ISR & (1 << 6)));  // Wait until TXE = 1
-    USART1->TDR = '[';
-    //printf("Sent: [\r\n");
-    delay(1000);
-
-    // Send message contents
-    for (int i = 0; msg[i] != '\0'; i++) {
-        while (!(USART1->ISR & (1 << 6)));  // Wait until TXE = 1
-        USART1->TDR = msg[i];
-        delay(1000);
-        //  printf("Sent: %c\r\n", msg[i]);     // Debug: print each character
+    //function used to send the newest reading to recieiving board via usart1 in pong mode, if it has granted credit - no ack is expected
   
+    uint8_t frame[PKT_MAX_WIRE];
+    uint8_t payload[PKT_MAX_PAYLOAD];
+    uint8_t type;
+    credit_sample s;
+    int seq = credit_tx_take(&credit, &s);
+    int len, frame_len;
+
+    if (seq < 0)
+    {
+        return;                                 // no credit, or nothing newer than the last frame
     }
+    batch_tx_add(&pong_batch, s.x, s.y, s.z, s.time);
+    len = batch_tx_take(&pong_batch, &type, payload);       // a batch of one goes out as a stamped ACCEL frame
+    frame_len = packet_encode(type, NODE_ADDRESS, seq, payload, len, frame, sizeof(frame));
+
+    // Queue the whole frame - it is sent by DMA while the CPU carries on
+    if (send_Frame(frame, frame_len) != 0)
+    {
+        printf("transmit queue full, sample dropped\r\n");
+    }
+}
 
-    // Send closing bracket
-    while (!(USART1->ISR & (1 << 6)));
-    USART1->TDR = ']';
-  // printf("Sent: ]\r\n");
-  delay(1000);
 
-    while (!(USART1->ISR & (1 << 7)));      // Wait until TC = 1 (all sent)
-    printf("message sent\r\n");
+void batchSample()
+{
+    //adds the latest accelerometer reading to the batch, timed by when it was taken
+    batch_tx_add(&batch, x_accel, y_accel, z_accel, accel_time);
 }
 
+int linkCarries(unsigned int samples)
+{
+    //whether a frame of this many samples, and the turnaround gap after it, is on the wire before the next frame's readings are in
+    link_stats s;
+    uint32_t send_us, read_us = samples * bmi160_odr_period_us(accel_odr);
+    link_Stats(&s);
+    send_us = (batch_wire_bytes(samples) * 10 + s.gap_bits) * link_us_per_byte / 10;
+    return send_us < read_us;
+}
 
-void clearMessage(char *buffer, int size)
+void queueSample()
 {
-   //function used to clear recieved message after it has been recieved and displayed.
-    for (int i = 0; i < size; i++)
-    {
-        buffer[i] = '\0';
-    }
+    //moves the current batch into the sliding window as one frame
+    uint8_t payload[PKT_MAX_PAYLOAD];
+    uint8_t type;
+    int len = batch_tx_take(&batch, &type, payload);
+    arq_tx_queue(&arq, type, payload, len);
 }
 
-void USART1_IRQHandler(void)
+void pollConsole()
 {
-    //Interupt function handler - called when USART1 RX buffer is not empty
-    if (USART1->ISR & (1 << 5))               // Check if RXNE (Receive Not Empty) flag is set
+    //collects a line typed on the serial monitor (USART2) and handles "batch <samples> <max latency ms>", "codec on|off", "arq", "link",
+    //"isr", "odr [Hz]" and "capture on|off"
+    unsigned int samples, latency_ms, hz;
+    char c;
+    while (console_ring_pop(&console_rx, &c) == 0)
     {
-    
-        char c = USART1->RDR;               // Read the received character
-         // Debug print
-    //     printf("Char received: %c\r\n", c);
-        if (c == '[')                      // Message recieved from board 2 will be enclosed in sqaure brackets
+        if (c != '\r' && c != '\n' && input_index < INPUT_BUFFER_SIZE - 1)
         {
-            
-            init_circ_buf(&rx_buf);         // Reset/clear the circular buffer
-            message_started = 1;           // Set flag because message is being receiving
+            input_buffer[input_index++] = c;
+            continue;
         }
-        else if (c == ']')                //when final character of message is recieved
+        input_buffer[input_index] = '\0';
+        if (sscanf((const char *)input_buffer, "batch %u %u", &samples, &latency_ms) == 2)
         {
-            
-            if (message_started)                                 
+            if (samples >= 1 && samples < batch.target && !linkCarries(samples))
             {
-                data_ready = 1;                            //data ready if flag set if message was being recieved - indicated by flag above
-                message_started = 0;                      // Reset message recieving flag
-                printf("Full message received!\r\n");     
+                //smaller frames than the link can carry would only back up behind each other
+                printf("batch: %u samples per frame take longer to send than to read at this link rate, keeping %u\r\n",
+                       samples, batch.target);
             }
-  
-        }
-        else
-        {
-            if (message_started)
+            else
             {
-                put_circ_buf(&rx_buf, c);             // Store characters in circular buffer if recieving message flag is set and if end of message has not been reached
+                batch_tx_config(&batch, samples, latency_ms * 1000);
+                printf("batching %u samples per frame, %u ms max latency\r\n", batch.target, latency_ms);
             }
         }
+        else if (strcmp((const char *)input_buffer, "codec on") == 0)
+        {
+            batch_tx_use_codec(&batch, &codec);
+            printf("delta codec on\r\n");
+        }
+        else if (strcmp((const char *)input_buffer, "codec off") == 0)
+        {
+            batch_tx_use_codec(&batch, 0);
+            printf("delta codec off\r\n");
+        }
+        else if (strcmp((const char *)input_buffer, "arq") == 0)
+        {
+            printf("arq: srtt %lu us, rttvar %lu us, timeout %lu us\r\n", arq.srtt, arq.rttvar, arq_tx_timeout(&arq));
+            printf("arq: %lu frames sent, %lu resent, %lu timeouts, %lu given up\r\n", arq.frames_sent, arq.retransmits, arq.timeouts, arq.dropped);
+        }
+        else if (strcmp((const char *)input_buffer, "link") == 0)
+        {
+            printLinkStats();
+        }
+        else if (strcmp((const char *)input_buffer, "isr") == 0)
+        {
+            printIsrTimes();
+        }
+        else if (sscanf((const char *)input_buffer, "odr %u", &hz) == 1)
+        {
+            setOdr(hz);
+        }
+        else if (strcmp((const char *)input_buffer, "odr") == 0)
+        {
+            printOdr();
+        }
+        else if (strcmp((const char *)input_buffer, "capture on") == 0)
+        {
+            captureMode(1);
+        }
+        else if (strcmp((const char *)input_buffer, "capture off") == 0)
+        {
+            captureMode(0);
+        }
+        else if (input_index > 0)
+        {
+            printf("unknown command - batch <samples> <max latency ms> / codec on|off / arq / link / isr / odr [Hz] / capture on|off\r\n");
+        }
+        input_index = 0;
+    }
+}
+
+void printLinkStats()
+{
+    link_stats s;
+    link_Stats(&s);
+    s.retransmits = arq.retransmits;
+    s.timeouts = arq.timeouts;
+    s.dropped = arq.dropped;
+    printf("link in: %lu bytes, %lu frames, %lu framing, %lu noise, %lu overrun, %lu cut short, %lu too long, %lu queue full\r\n",
+           s.bytes_in, s.frames_in, s.framing_errors, s.noise_errors, s.overruns, s.truncated, s.too_long, s.overflows);
+    printf("link in: %lu bad checksum, %lu undecodable, %u waiting, deepest %u of %u\r\n",
+           s.crc_errors, s.bad_frames, s.waiting, s.high_water, FRAME_POOL_SLOTS);
+    printf("link out: %lu bytes, %lu frames, %lu queue full, deepest %u of %u, %lu control frames sent first\r\n",
+           s.bytes_out, s.frames_out, s.tx_full, s.tx_high_water, LINK_TX_QUEUE_LEN, s.tx_preempted);
+    printf("link out: turnaround gap %u bits, %lu frames held for it\r\n", s.gap_bits, s.tx_held);
+    printf("link arq: %lu resent, %lu timeouts, %lu given up\r\n", s.retransmits, s.timeouts, s.dropped);
+}
+
+int sendArqFrame(void *ctx, const uint8_t *frame, uint16_t len)
+{
+    //called by arq_tx_burst() for every frame in a burst
+    return send_Frame(frame, len);
+}
+
+int readFrame(packet *pkt, uint32_t *time)
+{
+    //decodes the oldest frame received from the other board, returns -1 if there was none, it is corrupt
+    //or it is for another sensor board on the pair
+    //time (if not 0) is set to when the frame arrived
+    frame_slot *frame = receive_Frame();         //filled in place by the USART1/DMA interrupts
+    int result;
+
+    if (frame == 0)
+    {
+        return -1;
+    }
+    if (time)
+    {
+        *time = frame->time;
+    }
+    result = decode_Frame(frame, pkt);
+    release_Frame(frame);                      //slot can take the next frame
+    if (result == 0 && pkt->addr != NODE_ADDRESS && pkt->addr != PKT_ADDR_ALL)
+    {
+        return -1;
+    }
+    return result == 0 ? 0 : -1;
+}
+
+void negotiateSpeed()
+{
+    //steps the link up through link_rates[] until a rate fails, both boards then settle on the last one that worked
+    packet rx_pkt;
+    uint32_t start = micros();
+
+    if (LINK_NODES > 1)
+    {
+        setSpeed(0, LINK_BAUD_BUS);                 //shared pair, every board is built for the same fixed rate
+        link_us_per_byte = (10000000 + LINK_BAUD_BUS - 1) / LINK_BAUD_BUS;
+        return;
+    }
+    link_speed_master_init(&speed, link_rates, LINK_NUM_RATES, LINK_CLOCK, &speed_ops, start);
+    while (!link_speed_done(&speed))
+    {
+        if (readFrame(&rx_pkt, 0) == 0)
+        {
+            link_speed_input(&speed, &rx_pkt, micros());
+        }
+        link_speed_poll(&speed, micros());
+        if (micros() - start > SPEED_GIVE_UP_US)
+        {
+            set_Link_Baud(LINK_BAUD_SAFE, 0);         //no receiver - its own idle timer also brings it back here
+            printf("no answer to speed negotiation\r\n");
+            break;
+        }
+    }
+    uint32_t rate = link_speed_done(&speed) ? link_speed_rate(&speed) : LINK_BAUD_SAFE;
+    link_us_per_byte = (10000000 + rate - 1) / rate;
+    printf("link running at %lu baud\r\n", rate);
+}
+
+void sendSpeedFrame(void *ctx, const uint8_t *payload, uint8_t len)
+{
+    uint8_t frame[PKT_MAX_WIRE];
+    int frame_len = packet_encode(PKT_TYPE_SPEED, NODE_ADDRESS, 0, payload, len, frame, sizeof(frame));
+    send_Control(frame, frame_len);
+}
+
+void setSpeed(void *ctx, uint32_t baud)
+{
+    int32_t error_ppm;
+    if (set_Link_Baud(baud, &error_ppm) == 0)
+    {
+        printf("USART1 now %lu baud (%ld ppm)\r\n", baud, error_ppm);
     }
 }
 
+void calibrateTurnaround()
+{
+    //narrows the turnaround gap down to the shortest one test echoes still come back through, plus a margin
+    packet rx_pkt;
+    uint32_t start = micros();
+
+    if (LINK_NODES > 1)
+    {
+        return;                                     //every board on a shared pair keeps LINK_GAP_BITS
+    }
+    turn_cal_master_init(&turn, &turn_cal_ops, start);
+    while (!turn_cal_done(&turn))
+    {
+        if (readFrame(&rx_pkt, 0) == 0)
+        {
+            turn_cal_input(&turn, &rx_pkt, micros());
+        }
+        turn_cal_poll(&turn, micros());
+        if (micros() - start > TURN_GIVE_UP_US)
+        {
+            setGap(0, LINK_GAP_BITS);
+            printf("no answer to turnaround calibration\r\n");
+            return;
+        }
+    }
+    printf("turnaround gap %u bits after %lu probes, %lu lost\r\n", turn.configured, turn.probes, turn.lost);
+}
+
+void sendTurnFrame(void *ctx, const uint8_t *payload, uint8_t len)
+{
+    uint8_t frame[PKT_MAX_WIRE];
+    int frame_len = packet_encode(PKT_TYPE_TURN, NODE_ADDRESS, 0, payload, len, frame, sizeof(frame));
+    send_Control(frame, frame_len);
+}
+
+void setGap(void *ctx, uint8_t gap_bits)
+{
+    set_Link_Gap(gap_bits);
+}
+
+void USART1_IRQHandler(void)
+{
+    //Interupt function handler - called on idle line after received bytes or when a transmitted frame has completed
+    uint32_t start = cycles();
+    transceiver_USART1_IRQ();                 // runs the frame extractor over the receive ring / releases the bus at transmission complete
+    isr_Time(&isr_usart1, start);
+}
+
+void DMA1_Channel7_IRQHandler(void)
+{
+    uint32_t start = cycles();
+    if (DMA1->ISR & (1 << 25))                  // TCIF7 - a block of capture records has been written to TDR
+    {
+        DMA1->IFCR = (1 << 24);                 // clear all channel 7 flags
+        DMA1_Channel7->CCR &= ~(1 << 0);
+        telem_done(&capture);
+    }
+    isr_Time(&isr_capture_dma, start);
+}
+
+void USART2_IRQHandler(void)
+{
+    //moves each console character into console_rx, the main loop picks them up in pollConsole()
+    uint32_t start = cycles();
+    while (USART2->ISR & (1 << 5))              // RXNE - reading RDR clears it
+    {
+        if (console_ring_push(&console_rx, USART2->RDR) != 0)
+        {
+            console_overruns++;
+        }
+    }
+    isr_Time(&isr_usart2, start);
+}
+
 void printMessage(int i,const char *message)
 {
     //function used to display message on the LCD 
@@ -466,78 +911,277 @@ int buttonpressed(int buttonpin)
 }
 
 
-//function used to retrieve accelerometer values - void function used as x,y,z are global functions
-void measureAccel() {
-         //X VALUE
-         printf("Reading X axis...\n");
-         GPIOB->ODR |= (1 << 3);	                   // set port bit for logic analyser debug
-         I2CStart(0x69,WRITE,1);                      // Write the address of the 
-         I2CWrite(0x12);                           	// register we want to talk to
-         I2CReStart(0x69,READ,2);                  // Switch to read mode and request 2 bytes
-         response=I2CRead();		              // read low byte
-         x_accel=response;  	    
-         response=I2CRead();		            // read high byte
-         x_accel=x_accel+(response << 8);      // combine bytes
- 
-         //Y VALUE
-         printf("Reading Y axis...\n");
-         I2CStart(0x69,WRITE,1);                // Write the address of the 
-         I2CWrite(0x14);      	               // register we want to talk to
-         I2CReStart(0x69,READ,2);             // Switch to read mode and request 2 bytes
-         response=I2CRead();		         // read low byte
-         y_accel=response;  	
-         response=I2CRead();		       // read high byte
-         y_accel=y_accel+(response << 8); // combine bytes
- 
-         //Z VALUE
-         printf("Reading Z axis...\n");
-         I2CStart(0x69,WRITE,1);              // Write the address of the 
-         I2CWrite(0x16);      	             // register we want to talk to
-         I2CReStart(0x69,READ,2);           // Switch to read mode and request 2 bytes
-         response=I2CRead();		       // read low byte
-         z_accel=response;  	
-         response=I2CRead();		      // read high byte
-         z_accel=z_accel+(response << 8); // combine bytes
- 
-        
-         
- 
- 
-         // end the tranmission and convert values, then print all 3
-         I2CStop();	                               // end I2C transaction
-         GPIOB->ODR &= ~(1 << 3);                 // clear port bit for logic analyser debug
+//function used to retrieve accelerometer values - x,y,z are global, returns 1 when they hold a new reading
+//readings come from the last drain of the BMI160 FIFO, one per call. The drains are started by the
+//data-ready interrupt, EXTI0_IRQHandler()
+int measureAccel() {
+         if (fifo_next == fifo_count && fifo_txn.status == I2C_TXN_DONE)
+         {
+             // a drain has come in: decode it all, the newest reading is the one whose pulse started the drain
+             // and the ones before it are spaced by the measured data-ready interval
+             uint32_t state = irqLock(0);
+             fifo_period = drdy_mean(&drdy);
+             fifo_base_time = fifo_drain_time;     // the next drain may start while these are still being handed out
+             irqUnlock(0, state);
+             fifo_count = bmi160_fifo_parse(&accel_fifo, fifo_raw, fifo_txn.rlen, fifo_readings, BMI160_FIFO_MAX_READINGS);
+             fifo_next = 0;
+             fifo_txn.status = I2C_TXN_IDLE;        // taken, the next drain can start
+             if (capturing)
+             {
+                 for (uint16_t i = 0; i < fifo_count; i++)
+                 {
+                     telem_push(&capture, readingTime(i), fifo_readings[i].x, fifo_readings[i].y, fifo_readings[i].z);
+                 }
+                 telem_flush(&capture);          // goes straight out if DMA is idle, else with the next drain
+             }
+         }
+         if (fifo_next == fifo_count)
+         {
+             return 0;
+         }
+         x_accel = fifo_readings[fifo_next].x;
+         y_accel = fifo_readings[fifo_next].y;
+         z_accel = fifo_readings[fifo_next].z;
+         accel_time = readingTime(fifo_next);     // capture time sent with the sample for latency measurement
+         fifo_next++;
          X_g = x_accel;	                         // promote to 32 bits and preserve sign
          X_g=(X_g*981)/16384;                   // assuming +1g ->16384 (+/-2g range)
          Y_g = y_accel;	                       // promote to 32 bits and preserve sign
          Y_g=(Y_g*981)/16384;                 // assuming +1g ->16384 (+/-2g range)
          Z_g = z_accel;	                     // promote to 32 bits and preserve sign
          Z_g=(Z_g*981)/16384;               // assuming +1g ->16384 (+/-2g range)
-         
-    
-     enable_Transmit(4,5);   
-     delay_ms(10000);
-     delay_ms(100000);  // Debounce delay
+         return 1;
+}
+
+uint32_t readingTime(uint16_t i)
+{
+    //micros() when fifo_readings[i] was taken
+    return fifo_base_time - (uint32_t)((uint64_t)fifo_period * (fifo_count - 1 - i) / 80);
+}
+
+int accelWaiting()
+{
+    //1 if measureAccel() has a reading to hand out
+    return fifo_next < fifo_count || fifo_txn.status == I2C_TXN_DONE;
+}
+
+void EXTI0_IRQHandler(void)
+{
+    //BMI160 INT1, a new reading is in the FIFO - times it and starts a drain once enough have come in
+    //pong mode drains every reading straight away, the paddle needs the newest more than fewer transactions
+    uint32_t start = cycles();
+    if (EXTI->PR1 & (1 << 0))
+    {
+        EXTI->PR1 = (1 << 0);
+        drdy_edge(&drdy, start);
+        fifo_new++;
+        if ((fifo_new >= (pongMode ? 1 : ACCEL_WATERMARK / ACCEL_FRAME) || fifo_more) &&
+            fifo_level_txn.status != I2C_TXN_BUSY && fifo_txn.status != I2C_TXN_BUSY && fifo_txn.status != I2C_TXN_DONE)
+        {
+            fifo_new = 0;
+            fifo_more = 0;
+            fifo_drain_time = micros();
+            GPIOB->ODR |= (1 << 3);	                // set port bit for logic analyser debug, cleared when the drain ends
+            if (i2c_async_queue(&i2c, &fifo_level_txn) != 0)
+            {
+                fifo_more = 1;                      // try again with the next pulse
+                GPIOB->ODR &= ~(1 << 3);
+            }
+        }
+    }
+    isr_Time(&isr_exti0, start);
+}
+
+void fifoLevelRead(void *ctx, i2c_txn *t)
+{
+    //runs in the I2C1 interrupt once the fill level is in, drains everything that is there
+    uint16_t level = bmi160_fifo_length(fifo_level_raw);
+    if (t->status != I2C_TXN_DONE || level == 0)
+    {
+        fifo_more = t->status != I2C_TXN_DONE;  // a failed read is tried again with the next pulse
+        GPIOB->ODR &= ~(1 << 3);             // clear port bit for logic analyser debug
+        return;
+    }
+    fifo_txn.rlen = level < BMI160_FIFO_BURST ? level : BMI160_FIFO_BURST;
+    if (i2c_async_queue(&i2c, &fifo_txn) != 0)
+    {
+        fifo_more = 1;
+        GPIOB->ODR &= ~(1 << 3);
+    }
+}
+
+void fifoDrained(void *ctx, i2c_txn *t)
+{
+    //runs in the I2C1 interrupt once the drain is over, measureAccel() decodes it
+    //a burst cut short by BMI160_FIFO_BURST, or one that failed, is followed up at the next pulse
+    fifo_more = t->status != I2C_TXN_DONE || t->rlen == BMI160_FIFO_BURST;
+    GPIOB->ODR &= ~(1 << 3);                 // clear port bit for logic analyser debug
+}
+
+void idle()
+{
+    //sleeps until the next interrupt - with data-ready pulses coming in, never longer than one reading
+    uint32_t start = micros();
+    __WFI();
+    asleep_us += micros() - start;
+}
+
+void setOdr(uint16_t hz)
+{
+    //"odr <Hz>" - changes the output data rate, the timing statistics start again
+    uint8_t code = bmi160_odr_code(hz);
+    uint32_t state;
+    if (code == 0)
+    {
+        printf("odr: 25, 50, 100, 200, 400, 800 or 1600 Hz\r\n");
+        return;
+    }
+    odr_conf = 0x20 | code;                  // normal filter, as bmi160_fifo_start()
+    if (odr_txn.status == I2C_TXN_BUSY || i2c_async_queue(&i2c, &odr_txn) != 0)
+    {
+        printf("odr: I2C busy, try again\r\n");
+        return;
+    }
+    accel_odr = code;
+    state = irqLock(0);
+    drdy_init(&drdy, bmi160_odr_period_us(code) * 80);
+    irqUnlock(0, state);
+    asleep_us = 0;
+    awake_since = micros();
+    printf("odr: %u Hz, a reading every %lu us%s\r\n", hz, bmi160_odr_period_us(code),
+           code > BMI160_ODR_800HZ && I2C_BUS_HZ < 400000 ? " - more than a 100 kHz bus can drain" : "");
+}
+
+void printOdr()
+{
+    //"odr" - data-ready timing since start-up or the last rate change, and how much of it the CPU slept
+    drdy_stats d;
+    uint32_t state = irqLock(0);
+    d = drdy;
+    irqUnlock(0, state);
+    uint32_t mean = drdy_mean(&d);
+    uint32_t centi_hz = (uint32_t)(8000000000ull / mean);     // 80 cycles a microsecond
+    uint32_t elapsed = micros() - awake_since;
+    printf("odr: set %lu Hz, measured %lu.%02lu Hz over %lu readings, %lu missed\r\n",
+           1000000 / bmi160_odr_period_us(accel_odr), centi_hz / 100, centi_hz % 100, d.intervals, d.missed);
+    printf("odr: interval mean %lu.%02lu us, min %lu.%02lu, max %lu.%02lu, jitter %lu.%02lu us rms\r\n",
+           mean / 80, mean % 80 * 100 / 80, d.intervals ? d.min / 80 : 0, d.intervals ? d.min % 80 * 100 / 80 : 0,
+           d.max / 80, d.max % 80 * 100 / 80, drdy_jitter(&d) / 80, drdy_jitter(&d) % 80 * 100 / 80);
+    printf("odr: CPU asleep %lu%% of the time\r\n", elapsed ? (uint32_t)((uint64_t)asleep_us * 100 / elapsed) : 0);
+}
+
+void i2cStart(void *hw, uint8_t addr, int read, uint8_t nbytes, int autoend)
+{
+    I2CBegin(addr, read ? READ : WRITE, nbytes, autoend);
+}
+
+void i2cPut(void *hw, uint8_t data)
+{
+    I2C1->TXDR = data;
+}
+
+uint8_t i2cGet(void *hw)
+{
+    return I2C1->RXDR;
+}
+
+void i2cReset(void *hw)
+{
+    I2CAbort();
+}
+
+void I2C1_EV_IRQHandler(void)
+{
+    //every flag that is up is handled before returning, a NACK and its STOP often come together
+    uint32_t start = cycles();
+    int ev;
+    while ((ev = I2CEvent()) != I2C_EV_NONE)
+    {
+        i2c_async_event(&i2c, ev);
+    }
+    isr_Time(&isr_i2c1, start);
+}
+
+void I2C1_ER_IRQHandler(void)
+{
+    I2C1_EV_IRQHandler();                   // bus errors are events like the others
+}
+int accelWrite(void *hw, uint8_t addr, uint8_t reg, const uint8_t *data, uint8_t len)
+{
+    return I2CWriteRegisters(addr, reg, data, len);
+}
+
+int accelRead(void *hw, uint8_t addr, uint8_t reg, uint8_t *data, uint8_t len)
+{
+    return I2CReadRegisters(addr, reg, data, len);
 }
+
 void EXTI1_IRQHandler(void) //interrupt function for button
 {
+    //only records the press, onButton() acts on it from the main loop
+    uint32_t start = cycles();
     if (EXTI->PR1 & (1 << 1))  // Check if EXTI line 1 triggered
     {
         EXTI->PR1 = (1 << 1);  // Clear the interrupt pending flag for EXTI1
+        event_post(&events, EVENT_BUTTON, 0, micros());
+    }
+    isr_Time(&isr_exti1, start);
+}
 
-        ack_recieved = 1;
-        if (pongMode == 1)
-        {
-            pongMode = 0;                   //disable pong mode
-            enable_Transmit(4,5);          //set transceiver to transmit mode
-            sendPongMessage(pongMode);    //Notify recieving board to resume sending response ACKs
-        }
-        else if(pongMode == 0)
-        {
-        pongMode = 1;          // Enable Pong mode
-        }
-        printf("Button Interrupt...\r\n");
+void onButton(void *ctx, const event *e)
+{
+    //EXTI1 press, run by event_dispatch() - toggles pong mode
+    static uint32_t last_press;
+    static int pressed = 0;
+
+    if (pressed && e->time - last_press < BUTTON_DEBOUNCE_US)
+    {
+        return;                         //contact bounce of the last press
     }
-    
+    pressed = 1;
+    last_press = e->time;
+    if (pongMode == 1)
+    {
+        pongMode = 0;                   //disable pong mode
+        sendPongMessage(pongMode);    //Notify recieving board to resume sending response ACKs
+    }
+    else if(pongMode == 0 && LINK_NODES == 1)
+    {
+    pongMode = 1;          // Enable Pong mode - not on a shared pair, it would talk over the other sensor boards
+    }
+    printf("Button Interrupt... (%lu us after the press)\r\n", micros() - e->time);
+}
+
+uint32_t irqLock(void *hw)
+{
+    //event queue lock - masks interrupts, returns the previous state
+    uint32_t state = __get_PRIMASK();
+    __disable_irq();
+    return state;
+}
+
+void irqUnlock(void *hw, uint32_t state)
+{
+    __set_PRIMASK(state);
+}
+
+void printIsrTimes()
+{
+    //longest and mean run of every interrupt handler since reset, and how the event queue has coped
+    const isr_time *isr[] = { &isr_usart1, &isr_link_tx_dma, &isr_link_rx_dma, &isr_alarm, &isr_usart2, &isr_capture_dma, &isr_exti1, &isr_exti0, &isr_i2c1 };
+    for (unsigned i = 0; i < sizeof(isr) / sizeof(isr[0]); i++)
+    {
+        const isr_time *t = isr[i];
+        uint32_t mean = t->calls ? t->total_cycles / t->calls : 0;
+        printf("isr %s: %lu calls, longest %lu cycles (%lu us), mean %lu cycles\r\n",
+               t->name, t->calls, t->max_cycles, t->max_cycles / 80, mean);
+    }
+    printf("events: %lu posted, %lu handled, %lu dropped, deepest %u of %u\r\n",
+           events.posted, events.dispatched, events.dropped, events.high_water, EVENT_QUEUE_LEN);
+    printf("i2c: %lu transactions, %lu failed (%lu timed out), %lu refused\r\n",
+           i2c.done, i2c.failed, i2c.timeouts, i2c.full);
+    printf("fifo: %lu readings, %lu lost while full, %lu frames split between drains, %lu bad drains\r\n",
+           accel_fifo.frames, accel_fifo.skipped, accel_fifo.partial, accel_fifo.bad);
 }
 
 //function used to send message to other board that pong mode has been triggered or exited
@@ -548,21 +1192,16 @@ void sendPongMessage(int pongmode)
     //determine the message sent to the other board based on the pongmode value
     // 1 = in pong mode which means that this board needs to tell the other board to stop sending acks and keep receiving data 
     // 2 = exiting pong mode which measns that this board needs to tell the other board to start sending acks again
+ //no leading guard spaces needed - the USART holds DE for exactly the length of the frame
     if (pongmode == 1){
-    msg = "  [PONG]";
+    msg = "[PONG]";
     }
  
     else
     {
-    msg = "  [EXIT]";
+    msg = "[EXIT]";
     }
 
-    for (int i = 0; msg[i] != '\0'; i++) {
-        while (!(USART1->ISR & (1 << 6)));  // Wait until TXE = 1
-        USART1->TDR = msg[i];
-       printf("Sent: %c\n", msg[i]);       // Debug: print each character
-        delay(100000);
-    }
-    while (!(USART1->ISR & (1 << 7)));      // Wait until TC = 1 (all sent)
-    
+    send_Control((const uint8_t *)msg, strlen(msg));    //goes out after the frame on the wire, ahead of waiting sensor data - safe to call from the button interrupt
+
 }
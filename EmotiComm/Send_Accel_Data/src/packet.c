@@ -0,0 +1,163 @@
+#include <stdint.h>
+#include "packet.h"
+
+//CRC-16/CCITT nibble table - 16 entries is a good trade between flash use and speed
+static const uint16_t crc16_table[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+static uint16_t crc16_update(uint16_t crc, uint8_t b)
+{
+    crc = (crc << 4) ^ crc16_table[(crc >> 12) ^ (b >> 4)];        //high nibble
+    crc = (crc << 4) ^ crc16_table[(crc >> 12) ^ (b & 0x0F)];      //low nibble
+    return crc;
+}
+
+uint16_t packet_crc16(const uint8_t *data, int len)
+{
+    uint16_t crc = 0xFFFF;
+    while (len--)
+    {
+        crc = crc16_update(crc, *data++);
+    }
+    return crc;
+}
+
+static int needs_escape(uint8_t b)
+{
+    return (b == PKT_START) || (b == PKT_END) || (b == PKT_ESC);
+}
+
+//writes one body byte to out[] with byte stuffing, returns new index or -1 if out[] is full
+static int put_stuffed(uint8_t *out, int index, int out_size, uint8_t b)
+{
+    if (needs_escape(b))
+    {
+        if (index + 2 > out_size)
+        {
+            return -1;
+        }
+        out[index++] = PKT_ESC;
+        out[index++] = b ^ PKT_ESC_XOR;
+    }
+    else
+    {
+        if (index + 1 > out_size)
+        {
+            return -1;
+        }
+        out[index++] = b;
+    }
+    return index;
+}
+
+int packet_encode(uint8_t type, uint8_t addr, uint8_t seq, const uint8_t *payload, uint8_t len, uint8_t *out, int out_size)
+{
+    //builds a complete frame including '[' and ']' in out[], type may have PKT_FLAG_POLL or'd in
+    //returns the number of bytes written, or -1 if the payload is too long or out[] is too small
+    uint8_t header[PKT_HEADER_SIZE];
+    uint16_t crc = 0xFFFF;
+    int index = 0;
+
+    if (len > PKT_MAX_PAYLOAD || out_size < 2)
+    {
+        return -1;
+    }
+    header[0] = PKT_SYNC | (type & (PKT_TYPE_MASK | PKT_FLAG_POLL));
+    header[1] = len;
+    header[2] = seq;
+    header[3] = addr;
+
+    out[index++] = PKT_START;
+    for (int i = 0; i < PKT_HEADER_SIZE && index >= 0; i++)
+    {
+        crc = crc16_update(crc, header[i]);
+        index = put_stuffed(out, index, out_size, header[i]);
+    }
+    for (int i = 0; i < len && index >= 0; i++)
+    {
+        crc = crc16_update(crc, payload[i]);
+        index = put_stuffed(out, index, out_size, payload[i]);
+    }
+    if (index >= 0)
+    {
+        index = put_stuffed(out, index, out_size, crc & 0xFF);
+    }
+    if (index >= 0)
+    {
+        index = put_stuffed(out, index, out_size, crc >> 8);
+    }
+    if (index < 0 || index >= out_size)
+    {
+        return -1;
+    }
+    out[index++] = PKT_END;
+    return index;
+}
+
+int packet_decode(const uint8_t *body, int body_len, packet *pkt)
+{
+    //body[] holds the (still stuffed) bytes received between '[' and ']'
+    //the frame is unstuffed into pkt and checked, returns 0 on success or a PKT_ERR_xxx code
+    uint8_t raw[PKT_MAX_BODY];
+    int n = 0;
+
+    for (int i = 0; i < body_len; i++)
+    {
+        uint8_t b = body[i];
+        if (b == PKT_ESC)
+        {
+            if (++i >= body_len)
+            {
+                return PKT_ERR_ESC;
+            }
+            b = body[i] ^ PKT_ESC_XOR;
+        }
+        if (n >= PKT_MAX_BODY)
+        {
+            return PKT_ERR_LEN;
+        }
+        raw[n++] = b;
+    }
+
+    if (n < PKT_HEADER_SIZE + PKT_CRC_SIZE)
+    {
+        return PKT_ERR_LEN;
+    }
+    if ((raw[0] & PKT_SYNC_MASK) != PKT_SYNC)
+    {
+        return PKT_ERR_SYNC;
+    }
+    if (raw[1] > PKT_MAX_PAYLOAD || n != PKT_HEADER_SIZE + raw[1] + PKT_CRC_SIZE)
+    {
+        return PKT_ERR_LEN;
+    }
+    uint16_t crc = raw[n - 2] | (raw[n - 1] << 8);
+    if (packet_crc16(raw, n - PKT_CRC_SIZE) != crc)
+    {
+        return PKT_ERR_CRC;
+    }
+
+    pkt->type = raw[0] & PKT_TYPE_MASK;
+    pkt->flags = raw[0] & PKT_FLAG_POLL;
+    pkt->len = raw[1];
+    pkt->seq = raw[2];
+    pkt->addr = raw[3];
+    for (int i = 0; i < pkt->len; i++)
+    {
+        pkt->payload[i] = raw[PKT_HEADER_SIZE + i];
+    }
+    return 0;
+}
+
+void packet_put_accel(uint8_t *payload, int16_t x, int16_t y, int16_t z)
+{
+    //raw accelerometer counts are sent LSB first, the same order the BMI160 registers are read in
+    payload[0] = x & 0xFF;
+    payload[1] = (x >> 8) & 0xFF;
+    payload[2] = y & 0xFF;
+    payload[3] = (y >> 8) & 0xFF;
+    payload[4] = z & 0xFF;
+    payload[5] = (z >> 8) & 0xFF;
+}
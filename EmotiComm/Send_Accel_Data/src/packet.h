@@ -0,0 +1,77 @@
+#ifndef PACKET_H
+#define PACKET_H
+#include <stdint.h>
+
+// Binary frame used on the RS-485 link (replaces the "X=%d,Y=%d,Z=%d" text messages)
+//
+// On the wire:   '[' <stuffed body> ']'
+// Body:          type | len | seq | addr | payload[len] | crc16 lo | crc16 hi
+//
+// - type : upper 3 bits are a fixed sync pattern (101), bit 4 is the poll flag, lower 4 bits give the frame type
+// - len  : number of payload bytes
+// - seq  : 8-bit sequence number, wraps at 255
+// - addr : sensor board the frame is from or for (PKT_ADDR_xxx), the receiver board is the other end of every frame
+// - crc16: CRC-16/CCITT (poly 0x1021, init 0xFFFF) over type, len, seq, addr and payload
+//
+// Any '[', ']' or PKT_ESC byte inside the body is sent as PKT_ESC followed by (byte ^ PKT_ESC_XOR),
+// so the delimiters can only ever appear at the start and end of a frame.
+//
+// A sample sent on its own, with its stamp (see batch.h), is 4 + 4 + 6 + 2 = 16 body bytes, 18 on the wire
+// (at most 34 if every byte needs escaping), compared to up to 26 bytes for the old "[X=-1962,Y=-1962,Z=-1962]"
+// text message. A full batch of BATCH_MAX_SAMPLES is 4 + 47 + 2 = 53 body bytes, about 9 on the wire per sample.
+
+#define PKT_START       '['
+#define PKT_END         ']'
+#define PKT_ESC         0x5C    //'\\' - chosen so that '[', ']' and PKT_ESC all stay clear of the delimiters once xor'd
+#define PKT_ESC_XOR     0x20
+
+#define PKT_SYNC        0xA0    //sync pattern in the top 3 bits of the type byte
+#define PKT_SYNC_MASK   0xE0
+#define PKT_TYPE_MASK   0x0F
+#define PKT_FLAG_POLL   0x10    //hands the bus over - from a sensor board the receiver must answer with an ack,
+                                //on an ack from the receiver the addressed sensor board may send (see arq.h)
+
+#define PKT_TYPE_ACCEL  0x01    //payload: stamp (see batch.h), int16 x, int16 y, int16 z raw accelerometer counts (little endian)
+#define PKT_TYPE_ACK    0x02    //payload: next expected seq, bitmap of frames received after it (bit 0 = next+1)
+#define PKT_TYPE_SYNC   0x03    //no payload, seq is the sender's first unacknowledged sequence number
+#define PKT_TYPE_ACCEL_BATCH 0x05   //payload: several timed accelerometer samples, see batch.h
+                                    //0x04 is PKT_TYPE_SPEED, see link_speed.h
+#define PKT_TYPE_ACCEL_DELTA 0x06   //payload: timed samples compressed by delta_codec.h
+#define PKT_TYPE_IDLE   0x07    //no payload, a polled sensor board has nothing to send and hands the bus back
+                                    //0x08 is PKT_TYPE_CREDIT, see credit.h
+                                    //0x09 is PKT_TYPE_TURN, see turnaround.h
+
+#define PKT_HEADER_SIZE 4
+#define PKT_CRC_SIZE    2
+#define PKT_MAX_PAYLOAD 48      //room for the stamp and a full batch of BATCH_MAX_SAMPLES timed samples
+#define PKT_MAX_BODY    (PKT_HEADER_SIZE + PKT_MAX_PAYLOAD + PKT_CRC_SIZE)
+#define PKT_MAX_WIRE    (2 + 2 * PKT_MAX_BODY)      //worst case: delimiters plus every body byte escaped
+
+#define PKT_ACCEL_PAYLOAD 6
+
+//addresses on the RS-485 pair, every sensor board is built with its own
+#define PKT_ADDR_FIRST  1       //first sensor board
+#define PKT_ADDR_LAST   8       //last sensor board
+#define PKT_ADDR_ALL    0xFF    //every sensor board
+
+//error codes returned by packet_decode()
+#define PKT_ERR_LEN     -1      //body too short/long or length field does not match
+#define PKT_ERR_SYNC    -2      //type byte does not carry the sync pattern
+#define PKT_ERR_ESC     -3      //escape byte at the end of the body
+#define PKT_ERR_CRC     -4      //checksum mismatch
+
+typedef struct {
+    uint8_t type;                       //frame type (PKT_TYPE_xxx)
+    uint8_t flags;                      //PKT_FLAG_xxx bits from the type byte
+    uint8_t seq;                        //sequence number
+    uint8_t addr;                       //sensor board the frame is from or for
+    uint8_t len;                        //payload length
+    uint8_t payload[PKT_MAX_PAYLOAD];
+} packet;
+
+uint16_t packet_crc16(const uint8_t *data, int len);
+int packet_encode(uint8_t type, uint8_t addr, uint8_t seq, const uint8_t *payload, uint8_t len, uint8_t *out, int out_size);
+int packet_decode(const uint8_t *body, int body_len, packet *pkt);
+void packet_put_accel(uint8_t *payload, int16_t x, int16_t y, int16_t z);
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef POLL_SCHED_H
+#define POLL_SCHED_H
+#include <stdint.h>
+
+// Receiver-driven polling of several sensor boards on one RS-485 pair
+//
+// Only the receiver starts a conversation. It hands the bus to one sensor board at a time with an ack
+// carrying PKT_FLAG_POLL (see arq.h), and the board's turn ends when a frame from it carries
+// PKT_FLAG_POLL back, or when no frame from it has arrived within reply_us. Frames only count once they
+// have arrived whole, so reply_us covers the poll, the board's turnaround and its longest frame, and it
+// starts again from every frame heard. Each board has its own poll period, and the bus goes to the
+// board whose poll is most overdue (earliest deadline first).
+//
+// A poll period is a floor on that board's update rate, so a board is only taken on if the bus has
+// time for it: every poll books turn_us of bus time (the ack, one full answer and both turnarounds) and
+// the sum of turn_us / period over all boards has to stay within POLL_MAX_LOAD. Adding boards then
+// never pushes any of them below its own rate - the one that does not fit is refused instead.
+//
+// Time is passed in (microseconds from micros()) so the scheduler runs the same on a host.
+
+#define POLL_MAX_NODES  8
+#define POLL_MAX_LOAD   900             //per mille of bus time that may be booked, the rest covers resends
+#define POLL_NONE       -1
+
+typedef struct {
+    uint8_t addr;                       //PKT_ADDR_xxx of the sensor board
+    uint32_t period;                    //poll at least this often (us)
+    uint32_t load;                      //per mille of bus time booked for it
+    uint32_t due;                       //time of the next poll
+    uint32_t polls;
+    uint32_t answered;                  //turns ended by the board handing the bus back
+    uint32_t missed;                    //turns that ran out of time
+    uint32_t late_max;                  //longest a poll has been behind its due time (us)
+} poll_node;
+
+typedef struct {
+    poll_node node[POLL_MAX_NODES];
+    uint8_t count;
+    int8_t current;                     //node holding the bus, POLL_NONE while the receiver has it
+    uint32_t deadline;                  //the current turn ends by then unless the board is heard
+    uint32_t turn_us;                   //bus time booked per poll
+    uint32_t reply_us;                  //time allowed for the next frame of a turn to arrive
+    uint32_t load;                      //per mille of bus time booked in all
+} poll_sched;
+
+void poll_sched_init(poll_sched *s, uint32_t turn_us, uint32_t reply_us);
+int poll_sched_add(poll_sched *s, uint8_t addr, uint32_t period, uint32_t now);
+int poll_sched_set_period(poll_sched *s, int index, uint32_t period);
+int poll_sched_find(const poll_sched *s, uint8_t addr);
+int poll_sched_next(poll_sched *s, uint32_t now);
+void poll_sched_heard(poll_sched *s, uint8_t addr, int hands_back, uint32_t now);
+int poll_sched_poll(poll_sched *s, uint32_t now);
+
+#endif
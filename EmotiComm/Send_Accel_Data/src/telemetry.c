@@ -0,0 +1,96 @@
+#include <stdint.h>
+#include "telemetry.h"
+#include "packet.h"
+
+void telem_init(telem *t, const telem_driver *drv)
+{
+    t->drv = drv;
+    t->fill = 0;
+    t->filling = 0;
+    t->busy = 0;
+    t->seq = 0;
+    t->records = 0;
+    t->dropped = 0;
+}
+
+void telem_encode(const telem_record *r, uint8_t *out)
+{
+    //writes one TELEM_RECORD_SIZE byte record
+    uint16_t crc;
+
+    out[0] = TELEM_SYNC0;
+    out[1] = TELEM_SYNC1;
+    out[2] = r->seq & 0xFF;
+    out[3] = r->seq >> 8;
+    for (int i = 0; i < 4; i++)
+    {
+        out[4 + i] = (r->time >> (8 * i)) & 0xFF;
+    }
+    out[8] = (uint16_t)r->x & 0xFF;
+    out[9] = (uint16_t)r->x >> 8;
+    out[10] = (uint16_t)r->y & 0xFF;
+    out[11] = (uint16_t)r->y >> 8;
+    out[12] = (uint16_t)r->z & 0xFF;
+    out[13] = (uint16_t)r->z >> 8;
+    crc = packet_crc16(&out[2], 12);
+    out[14] = crc & 0xFF;
+    out[15] = crc >> 8;
+}
+
+int telem_decode(const uint8_t *in, telem_record *r)
+{
+    //reads the record starting at in, returns 0 if the sync bytes and CRC are right, -1 if not
+    if (in[0] != TELEM_SYNC0 || in[1] != TELEM_SYNC1 ||
+        packet_crc16(&in[2], 12) != (uint16_t)(in[14] | (in[15] << 8)))
+    {
+        return -1;
+    }
+    r->seq = in[2] | (in[3] << 8);
+    r->time = in[4] | (in[5] << 8) | ((uint32_t)in[6] << 16) | ((uint32_t)in[7] << 24);
+    r->x = (int16_t)(in[8] | (in[9] << 8));
+    r->y = (int16_t)(in[10] | (in[11] << 8));
+    r->z = (int16_t)(in[12] | (in[13] << 8));
+    return 0;
+}
+
+void telem_flush(telem *t)
+{
+    //hands the records collected so far to the driver if it is free - call on every pass of the main loop
+    uint8_t *block = t->block[t->filling];
+    uint16_t len = t->fill;
+
+    if (t->busy || len == 0)
+    {
+        return;
+    }
+    t->busy = 1;
+    t->records += len / TELEM_RECORD_SIZE;
+    t->filling ^= 1;
+    t->fill = 0;
+    t->drv->start(t->drv->hw, block, len);
+}
+
+int telem_push(telem *t, uint32_t time, int16_t x, int16_t y, int16_t z)
+{
+    //adds one sample, returns -1 if it had to be dropped - main loop only
+    telem_record r = { t->seq++, time, x, y, z };
+
+    if (t->fill + TELEM_RECORD_SIZE > (int)sizeof(t->block[0]))
+    {
+        telem_flush(t);
+        if (t->fill + TELEM_RECORD_SIZE > (int)sizeof(t->block[0]))
+        {
+            t->dropped++;                   //both blocks taken, the PC sees the gap in seq
+            return -1;
+        }
+    }
+    telem_encode(&r, &t->block[t->filling][t->fill]);
+    t->fill += TELEM_RECORD_SIZE;
+    return 0;
+}
+
+void telem_done(telem *t)
+{
+    //called by the driver once the block it was given has gone out
+    t->busy = 0;
+}
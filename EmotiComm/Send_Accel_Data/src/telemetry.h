@@ -0,0 +1,57 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+#include <stdint.h>
+
+// Binary capture of raw samples on USART2
+// In capture mode every accelerometer reading is written to the serial monitor port as a fixed size
+// record instead of text. Records are collected in one of two blocks while DMA sends the other, so the
+// main loop never waits for USART2 and the RS-485 link keeps its timing. A record that finds both blocks
+// taken is dropped and counted, its sequence number is still used up so the PC sees the gap.
+//
+// Record, TELEM_RECORD_SIZE bytes, multi-byte fields little endian:
+//   0xA5 | 0x5A | seq u16 | time u32 | x i16 | y i16 | z i16 | crc16 lo | crc16 hi
+// - seq:   counts every sample offered to telem_push(), wraps at 65535
+// - time:  micros() when the sample was taken
+// - x/y/z: raw accelerometer counts
+// - crc16: packet_crc16() (CRC-16/CCITT) over seq to z
+// A reader finds the start of a record by the two sync bytes and only trusts it if the CRC matches.
+// Host_Tools/telem_decode.c turns a capture into CSV.
+//
+// Nothing in here touches hardware, the driver starts a background transfer and calls telem_done()
+// when it has finished, normally from the DMA transfer complete interrupt.
+
+#define TELEM_SYNC0          0xA5
+#define TELEM_SYNC1          0x5A
+#define TELEM_RECORD_SIZE    16
+#define TELEM_BLOCK_RECORDS  16             //records per DMA transfer at most
+
+typedef struct {
+    uint16_t seq;
+    uint32_t time;
+    int16_t x, y, z;
+} telem_record;
+
+typedef struct {
+    void *hw;                                                           //passed back to every driver call
+    void (*start)(void *hw, const uint8_t *data, uint16_t len);         //start sending len bytes in the background
+} telem_driver;
+
+typedef struct {
+    const telem_driver *drv;
+    uint8_t block[2][TELEM_BLOCK_RECORDS * TELEM_RECORD_SIZE];
+    uint16_t fill;                          //bytes in the block being filled
+    uint8_t filling;                        //block being filled, the other one may be on its way out
+    volatile uint8_t busy;                  //1 while the driver sends the other block
+    uint16_t seq;                           //sequence number of the next record
+    uint32_t records;                       //records handed to the driver
+    uint32_t dropped;                       //records lost because both blocks were taken
+} telem;
+
+void telem_init(telem *t, const telem_driver *drv);
+void telem_encode(const telem_record *r, uint8_t *out);
+int telem_decode(const uint8_t *in, telem_record *r);
+int telem_push(telem *t, uint32_t time, int16_t x, int16_t y, int16_t z);
+void telem_flush(telem *t);
+void telem_done(telem *t);
+
+#endif
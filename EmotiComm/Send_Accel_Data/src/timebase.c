@@ -0,0 +1,73 @@
+#include <stm32l432xx.h>
+#include "timebase.h"
+
+isr_time isr_alarm = { "TIM2 (alarm)" };
+static void (*volatile alarm_fn)(void);     //run by the next compare match, 0 if no alarm is set
+
+void init_Timebase(void)
+{
+    RCC->APB1ENR1 |= (1 << 0);          // turn on TIM2
+    TIM2->CR1 = 0;
+    TIM2->PSC = 80 - 1;                 // 80MHz/80 = 1MHz, one count per microsecond
+    TIM2->ARR = 0xFFFFFFFF;             // count through all 32 bits
+    TIM2->EGR = (1 << 0);               // UG - load the prescaler straight away
+    TIM2->CR1 |= (1 << 0);              // start counting
+    NVIC->ISER[0] |= (1 << 28);         // Enable TIM2 IRQ (interrupt 28), CC1IE is only set while an alarm waits
+
+    CoreDebug->DEMCR |= (1 << 24);      // TRCENA - turn on the DWT unit
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= (1 << 0);              // CYCCNTENA - count every CPU cycle
+}
+
+uint32_t micros(void)
+{
+    return TIM2->CNT;
+}
+
+void alarm_At(uint32_t time, void (*fn)(void))
+{
+    //call with interrupts masked or from an interrupt handler - the compare is changed with the alarm interrupt off
+    TIM2->DIER &= ~(1 << 1);            // CC1IE = 0 while the alarm is changed
+    alarm_fn = fn;
+    TIM2->CCR1 = time;
+    TIM2->SR = ~(1 << 1);               // clear CC1IF from any earlier match
+    TIM2->DIER |= (1 << 1);             // CC1IE = 1
+    if ((int32_t)(TIM2->CNT - time) >= 0)
+    {
+        TIM2->EGR = (1 << 1);           // CC1G - the time has already passed, fire now
+    }
+}
+
+void TIM2_IRQHandler(void)
+{
+    uint32_t start = cycles();
+    void (*fn)(void) = alarm_fn;
+    if (TIM2->SR & (1 << 1))            // CC1IF - the alarm time has come
+    {
+        TIM2->SR = ~(1 << 1);
+        TIM2->DIER &= ~(1 << 1);        // one shot
+        alarm_fn = 0;
+        if (fn)
+        {
+            fn();
+        }
+    }
+    isr_Time(&isr_alarm, start);
+}
+
+uint32_t cycles(void)
+{
+    return DWT->CYCCNT;
+}
+
+void isr_Time(isr_time *t, uint32_t start)
+{
+    //records one run of an interrupt handler that started at cycles() = start - call last thing in the handler
+    uint32_t spent = DWT->CYCCNT - start;
+    t->calls++;
+    t->total_cycles += spent;
+    if (spent > t->max_cycles)
+    {
+        t->max_cycles = spent;
+    }
+}
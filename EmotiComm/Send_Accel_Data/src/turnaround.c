@@ -0,0 +1,233 @@
+#include <stdint.h>
+#include "turnaround.h"
+
+#define TURN_M_PROBE 0
+#define TURN_M_SET   1
+#define TURN_M_DONE  2
+#define TURN_S_IDLE  3
+#define TURN_S_PROBE 4
+
+//sent in every ECHO - alternating bits and the delimiter first so a clipped start shows up
+static const uint8_t turn_pattern[TURN_PATTERN_LEN] = { '[', 0x55, 0xAA, 0x00, 0xFF, 0x0F, 0xF0, ']' };
+
+void turn_guard_init(turn_guard *g, uint8_t gap_bits, uint8_t lead_16ths, uint8_t tail_16ths, uint32_t baud)
+{
+    g->lead_16ths = lead_16ths;
+    g->tail_16ths = tail_16ths;
+    turn_guard_set_gap(g, gap_bits, baud);
+}
+
+void turn_guard_set_gap(turn_guard *g, uint8_t gap_bits, uint32_t baud)
+{
+    //also called with the old gap whenever the rate changes
+    g->gap_bits = gap_bits;
+    g->gap_us = ((uint32_t)gap_bits * 1000000 + baud - 1) / baud + 1;
+}
+
+uint32_t turn_guard_wait(const turn_guard *g, uint32_t last_heard, uint32_t now)
+{
+    //returns 0 if the pair has been quiet for the gap, otherwise the microseconds still to wait
+    uint32_t quiet = now - last_heard;
+    return quiet >= g->gap_us ? 0 : g->gap_us - quiet;
+}
+
+void turn_guard_de_times(const turn_guard *g, int over8, uint8_t *deat, uint8_t *dedt)
+{
+    //DEAT/DEDT values for USART1 CR1 - in sample times, 16 per bit or 8 with OVER8, 31 at most
+    uint32_t lead = over8 ? (g->lead_16ths + 1) / 2 : g->lead_16ths;
+    uint32_t tail = over8 ? (g->tail_16ths + 1) / 2 : g->tail_16ths;
+    *deat = lead > 31 ? 31 : lead;
+    *dedt = tail > 31 ? 31 : tail;
+}
+
+static void send_op(turn_cal *c, uint8_t op, uint8_t gap)
+{
+    uint8_t payload[2 + TURN_PATTERN_LEN];
+    uint8_t len = 2;
+
+    payload[0] = op;
+    payload[1] = gap;
+    if (op == TURN_OP_ECHO)
+    {
+        for (int i = 0; i < TURN_PATTERN_LEN; i++)
+        {
+            payload[len++] = turn_pattern[i];
+        }
+    }
+    c->ops->send(c->ops->ctx, payload, len);
+}
+
+static int pattern_ok(const packet *pkt)
+{
+    if (pkt->len != 2 + TURN_PATTERN_LEN)
+    {
+        return 0;
+    }
+    for (int i = 0; i < TURN_PATTERN_LEN; i++)
+    {
+        if (pkt->payload[2 + i] != turn_pattern[i])
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void probe(turn_cal *c, uint32_t now)
+{
+    c->probes++;
+    send_op(c, TURN_OP_PROBE, c->gap);
+    c->deadline = now + TURN_REPLY_US;
+}
+
+static void settle(turn_cal *c, uint32_t now)
+{
+    uint32_t gap = c->high + TURN_MARGIN_BITS;
+
+    c->configured = gap > 255 ? 255 : gap;
+    c->retries = 0;
+    c->state = TURN_M_SET;
+    send_op(c, TURN_OP_SET, c->configured);
+    c->deadline = now + TURN_REPLY_US;
+}
+
+static void gap_result(turn_cal *c, int passed, uint32_t now)
+{
+    //one gap has been probed - halve the range that is left, or settle once it is down to one gap
+    if (passed)
+    {
+        c->high = c->gap;
+    }
+    else if (c->gap == TURN_MAX_BITS)
+    {
+        c->high = TURN_MAX_BITS;        //not even the longest gap works, use it anyway
+        c->low = TURN_MAX_BITS;
+    }
+    else
+    {
+        c->low = c->gap + 1;
+    }
+    if (c->low >= c->high)
+    {
+        settle(c, now);
+        return;
+    }
+    c->gap = (c->low + c->high) / 2;
+    c->echoes = 0;
+    probe(c, now);
+}
+
+void turn_cal_master_init(turn_cal *c, const turn_ops *ops, uint32_t now)
+{
+    //sender board - starts probing at the longest gap straight away
+    c->ops = ops;
+    c->configured = TURN_MAX_BITS;
+    c->finished = 0;
+    c->probes = 0;
+    c->lost = 0;
+    c->low = 0;
+    c->high = TURN_MAX_BITS;
+    c->gap = TURN_MAX_BITS;
+    c->echoes = 0;
+    c->state = TURN_M_PROBE;
+    ops->set_gap(ops->ctx, TURN_MAX_BITS);     //the master keeps the safe gap until the end
+    probe(c, now);
+}
+
+void turn_cal_slave_init(turn_cal *c, const turn_ops *ops)
+{
+    //receiver board - only ever answers the master
+    c->ops = ops;
+    c->configured = TURN_MAX_BITS;
+    c->finished = 0;
+    c->gap = TURN_MAX_BITS;
+    c->state = TURN_S_IDLE;
+    ops->set_gap(ops->ctx, TURN_MAX_BITS);
+}
+
+void turn_cal_input(turn_cal *c, const packet *pkt, uint32_t now)
+{
+    //takes every decoded frame from the other board, only PKT_TYPE_TURN ones are used
+    uint8_t op, gap;
+
+    if (pkt->type != PKT_TYPE_TURN || pkt->len < 2)
+    {
+        return;
+    }
+    op = pkt->payload[0];
+    gap = pkt->payload[1];
+    if (c->state == TURN_M_PROBE && op == TURN_OP_ECHO && gap == c->gap && pattern_ok(pkt))
+    {
+        if (++c->echoes == TURN_PROBES)
+        {
+            gap_result(c, 1, now);
+        }
+        else
+        {
+            probe(c, now);
+        }
+    }
+    else if (c->state == TURN_M_SET && op == TURN_OP_SET_ACK && gap == c->configured)
+    {
+        c->ops->set_gap(c->ops->ctx, c->configured);
+        c->state = TURN_M_DONE;
+        c->finished = 1;
+    }
+    else if (c->state >= TURN_S_IDLE && op == TURN_OP_PROBE)
+    {
+        c->ops->set_gap(c->ops->ctx, gap);      //before the echo is queued, it waits for exactly this gap
+        c->gap = gap;
+        c->state = TURN_S_PROBE;
+        c->deadline = now + TURN_SLAVE_US;
+        send_op(c, TURN_OP_ECHO, gap);
+    }
+    else if (c->state >= TURN_S_IDLE && op == TURN_OP_SET)
+    {
+        c->configured = gap;
+        c->ops->set_gap(c->ops->ctx, gap);
+        c->state = TURN_S_IDLE;
+        c->finished = 1;
+        send_op(c, TURN_OP_SET_ACK, gap);      //answered every time in case the ack is lost
+    }
+}
+
+void turn_cal_poll(turn_cal *c, uint32_t now)
+{
+    //runs the timeouts, call it regularly from the main loop
+    int expired = (int32_t)(now - c->deadline) >= 0;
+
+    if (!expired)
+    {
+        return;
+    }
+    switch (c->state)
+    {
+    case TURN_M_PROBE:
+        c->lost++;                      //echo missing or garbled - this gap is too short
+        gap_result(c, 0, now);
+        break;
+    case TURN_M_SET:
+        if (++c->retries < TURN_SET_RETRIES)
+        {
+            send_op(c, TURN_OP_SET, c->configured);
+            c->deadline = now + TURN_REPLY_US;
+        }
+        else
+        {
+            c->configured = TURN_MAX_BITS;     //slave not answering, stay on the safe gap
+            c->ops->set_gap(c->ops->ctx, c->configured);
+            c->state = TURN_M_DONE;
+            c->finished = 1;
+        }
+        break;
+    case TURN_S_PROBE:
+        c->ops->set_gap(c->ops->ctx, c->configured);     //probing stopped half way
+        c->state = TURN_S_IDLE;
+        break;
+    }
+}
+
+int turn_cal_done(const turn_cal *c)
+{
+    return c->finished;
+}
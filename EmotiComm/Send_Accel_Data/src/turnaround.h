@@ -0,0 +1,84 @@
+#ifndef TURNAROUND_H
+#define TURNAROUND_H
+#include <stdint.h>
+#include "packet.h"
+
+// RS-485 turnaround timing
+// Three guard times, all in bit periods at the current rate so they scale with the link:
+//   - gap:  silence after the last byte heard from the other board before this board drives the pair.
+//           The other board's driver is still on for its own tail, and the transceiver takes a while
+//           to let go after that. A frame queued sooner waits in the transmit queue (link_tx).
+//   - lead: DE is raised this long before the first start bit (USART1 DEAT)
+//   - tail: DE is held this long after the last stop bit (USART1 DEDT)
+// Lead and tail are in 1/16 bit, USART1 counts them in sample times and can do at most 31 of those.
+//
+// The gap can be calibrated at start-up. The sender (master) asks the receiver to answer probes after
+// shorter and shorter gaps:
+//   master  PROBE(g)        -> slave           slave answers after g bit periods of silence
+//   slave   ECHO(g)         -> master          payload carries a fixed test pattern
+// A gap passes when TURN_PROBES echoes in a row come back intact, the search halves the range between
+// the smallest gap that passed and the largest that failed. TURN_MARGIN_BITS is added to the smallest
+// gap that passed and the master settles it with the slave:
+//   master  SET(g)          -> slave           until the slave answers SET_ACK(g)
+// A board answers no faster than its main loop gets to the frame, so a probe can only show a gap is
+// unsafe while the reply is quicker than that - the result is the guard that has to be enforced on
+// top of the software's own reply time.
+//
+// All frames are PKT_TYPE_TURN with payload: op | gap | test pattern (ECHO only). Time is passed in
+// (microseconds) and the link is driven through turn_ops, so this runs the same on a host.
+
+#define PKT_TYPE_TURN 0x09
+
+#define TURN_OP_PROBE   1
+#define TURN_OP_ECHO    2
+#define TURN_OP_SET     3
+#define TURN_OP_SET_ACK 4
+
+#define TURN_MAX_BITS     32            //top of the search, and the gap both boards use until calibrated
+#define TURN_PROBES       8             //echoes that all have to come back for a gap to pass
+#define TURN_MARGIN_BITS  2             //added to the smallest gap that passed
+#define TURN_PATTERN_LEN  8
+#define TURN_REPLY_US     100000        //master: time allowed for each echo
+#define TURN_SLAVE_US     1000000       //slave: back to its configured gap if the probes stop
+#define TURN_SET_RETRIES  5
+
+typedef struct {
+    uint8_t gap_bits;
+    uint8_t lead_16ths;
+    uint8_t tail_16ths;
+    uint32_t gap_us;                    //gap_bits at the current rate, rounded up, plus one tick of micros()
+} turn_guard;
+
+typedef struct {
+    void *ctx;
+    void (*send)(void *ctx, const uint8_t *payload, uint8_t len);      //send one PKT_TYPE_TURN frame
+    void (*set_gap)(void *ctx, uint8_t gap_bits);                       //gap for every frame this board sends from now on
+} turn_ops;
+
+typedef struct {
+    const turn_ops *ops;
+    uint8_t state;
+    uint8_t gap;                        //master: gap being probed, slave: gap the last probe asked for
+    uint8_t low;                        //master: gaps below this have failed
+    uint8_t high;                       //master: smallest gap that has passed
+    uint8_t echoes;                     //master: intact echoes at the gap being probed
+    uint8_t retries;                    //master: SET frames sent without an answer
+    uint8_t configured;                 //gap in use outside probing - the result once finished
+    uint8_t finished;
+    uint32_t deadline;
+    uint32_t probes;                    //master: probes sent
+    uint32_t lost;                      //master: probes whose echo did not come back intact
+} turn_cal;
+
+void turn_guard_init(turn_guard *g, uint8_t gap_bits, uint8_t lead_16ths, uint8_t tail_16ths, uint32_t baud);
+void turn_guard_set_gap(turn_guard *g, uint8_t gap_bits, uint32_t baud);
+uint32_t turn_guard_wait(const turn_guard *g, uint32_t last_heard, uint32_t now);
+void turn_guard_de_times(const turn_guard *g, int over8, uint8_t *deat, uint8_t *dedt);
+
+void turn_cal_master_init(turn_cal *c, const turn_ops *ops, uint32_t now);
+void turn_cal_slave_init(turn_cal *c, const turn_ops *ops);
+void turn_cal_input(turn_cal *c, const packet *pkt, uint32_t now);
+void turn_cal_poll(turn_cal *c, uint32_t now);
+int turn_cal_done(const turn_cal *c);
+
+#endif